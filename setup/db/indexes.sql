@@ -12,5 +12,10 @@ CREATE INDEX ways_poly_timestamp_idx ON public.ways_poly(timestamp DESC);
 CREATE INDEX ways_line_timestamp_idx ON public.ways_line(timestamp DESC);
 
 CREATE INDEX idx_changesets_hashtags ON public.changesets USING gin(hashtags);
-CREATE INDEX idx_osm_id_status ON public.validation (osm_id)
+CREATE INDEX idx_osm_id_status ON public.validation (osm_id);
 
+-- Fill the reverse index of the imported ways
+INSERT INTO public.way_refs (way_id, node_id)
+    SELECT DISTINCT w.osm_id, n.node_id
+    FROM (SELECT osm_id, refs FROM public.ways_poly UNION ALL SELECT osm_id, refs FROM public.ways_line) w,
+    unnest(w.refs) AS n(node_id);
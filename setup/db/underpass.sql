@@ -59,6 +59,17 @@ CREATE TABLE IF NOT EXISTS public.validation (
 ALTER TABLE ONLY public.validation
     ADD CONSTRAINT validation_pkey PRIMARY KEY (osm_id, status, source);
 
+CREATE TABLE IF NOT EXISTS public.checkpoints (
+    stream text NOT NULL,
+    frequency text NOT NULL,
+    sequence int8,
+    path text,
+    timestamp timestamp with time zone,
+    updated_at timestamp with time zone
+);
+ALTER TABLE ONLY public.checkpoints
+    ADD CONSTRAINT checkpoints_pkey PRIMARY KEY (stream, frequency);
+
 CREATE TABLE IF NOT EXISTS public.ways_poly (
     osm_id int8,
     changeset int8,
@@ -109,6 +120,20 @@ CREATE TABLE IF NOT EXISTS public.relations (
 ALTER TABLE ONLY public.relations
     ADD CONSTRAINT relations_pkey PRIMARY KEY (osm_id);
 
+-- The ways that use each node, for updating their geometry when a
+-- node moves
+CREATE TABLE IF NOT EXISTS public.way_refs (
+    way_id int8 NOT NULL,
+    node_id int8 NOT NULL
+);
+
+-- The relations that use each way, for updating their geometry when a
+-- way changes
+CREATE TABLE IF NOT EXISTS public.rel_refs (
+    rel_id int8 NOT NULL,
+    way_id int8 NOT NULL
+);
+
 CREATE UNIQUE INDEX nodes_id_idx ON public.nodes (osm_id DESC);
 CREATE UNIQUE INDEX ways_poly_id_idx ON public.ways_poly (osm_id DESC);
 CREATE UNIQUE INDEX ways_line_id_idx ON public.ways_line(osm_id DESC);
@@ -122,6 +147,11 @@ CREATE INDEX nodes_timestamp_idx ON public.nodes(timestamp DESC);
 CREATE INDEX ways_poly_timestamp_idx ON public.ways_poly(timestamp DESC);
 CREATE INDEX ways_line_timestamp_idx ON public.ways_line(timestamp DESC);
 
+CREATE INDEX IF NOT EXISTS way_refs_node_idx ON public.way_refs (node_id);
+CREATE INDEX IF NOT EXISTS way_refs_way_idx ON public.way_refs (way_id);
+CREATE INDEX IF NOT EXISTS rel_refs_way_idx ON public.rel_refs (way_id);
+CREATE INDEX IF NOT EXISTS rel_refs_rel_idx ON public.rel_refs (rel_id);
+
 CREATE INDEX idx_changesets_hashtags ON public.changesets USING gin(hashtags);
 CREATE INDEX idx_osm_id_status ON public.validation (osm_id)
 
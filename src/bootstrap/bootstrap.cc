@@ -59,10 +59,48 @@ Bootstrap::allTasksQueries(std::shared_ptr<std::vector<BootstrapTask>> tasks) {
         for (auto itt = it->osmquery.begin(); itt != it->osmquery.end(); ++itt) {
             queries.osm.push_back(*itt);
         }
+        queries.relrefs.insert(queries.relrefs.end(), it->relrefs.begin(), it->relrefs.end());
+        queries.validated.insert(queries.validated.end(), it->validated.begin(), it->validated.end());
     }
     return queries;
 }
 
+void
+Bootstrap::submit(const BootstrapQueries &queries) {
+    // The next page is validated while this one is written, but only
+    // one page is written at a time
+    wait();
+    std::size_t chunks = dbpool->size();
+    std::size_t chunk = (queries.underpass.size() + chunks - 1) / chunks;
+    for (std::size_t start = 0; start < queries.underpass.size(); start += chunk) {
+        auto end = std::begin(queries.underpass) + std::min(start + chunk, queries.underpass.size());
+        pending.push_back(dbpool->submit(std::vector<std::string>(std::begin(queries.underpass) + start, end)));
+    }
+    written = queries.validated;
+    for (auto it = queries.osm.begin(); it != queries.osm.end(); ++it) {
+        osmdb->query(*it);
+    }
+    if (!rawcopy->write(queries.relrefs)) {
+        log_error("Couldn't write the way members of some relations!");
+    }
+}
+
+void
+Bootstrap::wait(void) {
+    bool complete = true;
+    for (auto it = pending.begin(); it != pending.end(); ++it) {
+        if (!it->get()) {
+            log_error("Couldn't write some of the validation results!");
+            complete = false;
+        }
+    }
+    pending.clear();
+    if (validator->cache) {
+        validator->cache->commit(written, complete);
+    }
+    written.clear();
+}
+
 void
 Bootstrap::start(const underpassconfig::UnderpassConfig &config) {
     std::cout << "Connecting to OSM database ... " << std::endl;
@@ -78,6 +116,12 @@ Bootstrap::start(const underpassconfig::UnderpassConfig &config) {
         log_error("Could not connect to Underpass DB, aborting bootstrapping thread!");
         return;
     }
+    // A connection for each worker writing the validation results
+    dbpool = std::make_shared<PqPool>();
+    if (!dbpool->connect(config.underpass_db_url, config.getDbConnections())) {
+        log_error("Could not connect to Underpass DB, aborting bootstrapping thread!");
+        return;
+    }
 
     std::cout << "Loading plugins ... " << std::endl;
     std::string plugins;
@@ -97,8 +141,25 @@ Bootstrap::start(const underpassconfig::UnderpassConfig &config) {
     }
 
     validator = creator();
+    // The results saved by the last run let it skip what didn't change
+    if (config.validation_cache_budget > 0) {
+        validator->cache = std::make_shared<ValidationCache>(
+            static_cast<std::size_t>(config.validation_cache_budget) * 1024 * 1024);
+        if (!config.validation_cache_file.empty()) {
+            validator->cache->open(config.validation_cache_file);
+        }
+    }
     queryvalidate = std::make_shared<QueryValidate>(db);
     queryraw = std::make_shared<QueryRaw>(osmdb);
+    rawcopy = std::make_shared<RawCopy>(osmdb);
+    // Seed the node locations with all the nodes in the database,
+    // so the replicator doesn't have to query them
+    if (!config.node_locations.empty()) {
+        auto locations = std::make_shared<NodeLocations>();
+        if (locations->open(config.node_locations)) {
+            queryraw->locations = locations;
+        }
+    }
     page_size = config.bootstrap_page_size;
     concurrency = config.concurrency;
     norefs = config.norefs;
@@ -106,6 +167,11 @@ Bootstrap::start(const underpassconfig::UnderpassConfig &config) {
     processWays();
     processNodes();
     processRelations();
+    dbpool->dump();
+    if (validator->cache) {
+        validator->cache->dump();
+        validator->cache->save();
+    }
 
 }
 
@@ -156,14 +222,7 @@ Bootstrap::processWays() {
 
             pool.join();
 
-            auto queries = allTasksQueries(tasks);
-
-            for (auto it = queries.underpass.begin(); it != queries.underpass.end(); ++it) {
-                db->query(*it);
-            }
-            for (auto it = queries.osm.begin(); it != queries.osm.end(); ++it) {
-                osmdb->query(*it);
-            }
+            submit(allTasksQueries(tasks));
 
             lastid = ways->back().id;
             for (auto it = tasks->begin(); it != tasks->end(); ++it) {
@@ -173,6 +232,7 @@ Bootstrap::processWays() {
         percentage = (count * 100) / total;
         std::cout << "\r" << "Processing " << *table_it << ": " << count << "/" << total << " (" << percentage << "%)";
     }
+    wait();
     std::cout << std::endl;
 
 }
@@ -197,6 +257,13 @@ Bootstrap::processNodes() {
 
         auto nodes = std::make_shared<std::vector<OsmNode>>();
         nodes = queryraw->getNodesFromDB(lastid, concurrency * page_size);
+        // Nothing else writes to the database during a bootstrap, so
+        // these replace the stored locations
+        if (queryraw->locations) {
+            for (auto it = nodes->begin(); it != nodes->end(); ++it) {
+                queryraw->locations->set(it->id, it->point, true);
+            }
+        }
 
         auto tasks = std::make_shared<std::vector<BootstrapTask>>(concurrentTasks);
         boost::asio::thread_pool pool(concurrentTasks);
@@ -213,13 +280,7 @@ Bootstrap::processNodes() {
 
         pool.join();
 
-        auto queries = allTasksQueries(tasks);
-        for (auto it = queries.underpass.begin(); it != queries.underpass.end(); ++it) {
-            db->query(*it);
-        }
-        for (auto it = queries.osm.begin(); it != queries.osm.end(); ++it) {
-            osmdb->query(*it);
-        }
+        submit(allTasksQueries(tasks));
         lastid = nodes->back().id;
         for (auto it = tasks->begin(); it != tasks->end(); ++it) {
             count += it->processed;
@@ -227,7 +288,11 @@ Bootstrap::processNodes() {
     }
     percentage = (count * 100) / total;
     std::cout << "\r" << "Processing nodes: " << count << "/" << total << " (" << percentage << "%)";
+    wait();
     std::cout << std::endl;
+    if (queryraw->locations) {
+        queryraw->locations->sync();
+    }
 
 }
 
@@ -267,13 +332,7 @@ Bootstrap::processRelations() {
 
         pool.join();
 
-        auto queries = allTasksQueries(tasks);
-        for (auto it = queries.underpass.begin(); it != queries.underpass.end(); ++it) {
-            db->query(*it);
-        }
-        for (auto it = queries.osm.begin(); it != queries.osm.end(); ++it) {
-            osmdb->query(*it);
-        }
+        submit(allTasksQueries(tasks));
         lastid = relations->back().id;
         for (auto it = tasks->begin(); it != tasks->end(); ++it) {
             count += it->processed;
@@ -281,7 +340,7 @@ Bootstrap::processRelations() {
     }
     percentage = (count * 100) / total;
     std::cout << "\r" << "Processing relations: " << count << "/" << total << " (" << percentage << "%)";
-
+    wait();
     std::cout << std::endl;
 
 }
@@ -302,14 +361,18 @@ Bootstrap::threadBootstrapWayTask(WayTask wayTask)
 
     auto wayval = std::make_shared<std::vector<std::shared_ptr<ValidateStatus>>>();
 
-    // Proccesing ways
+    // Proccesing ways, the page is validated in one batch
+    std::vector<const OsmWay *> page;
     for (size_t i = taskIndex * page_size; i < (taskIndex + 1) * page_size; ++i) {
         if (i < ways->size()) {
-            auto way = ways->at(i);
-            wayval->push_back(validator->checkWay(way, "building"));
+            page.push_back(&ways->at(i));
             ++processed;
         }
     }
+    validator->checkWays(page, "building", *wayval);
+    if (validator->cache) {
+        task.validated = *wayval;
+    }
 
     auto result = queryvalidate->ways(wayval);
     for (auto it = result->begin(); it != result->end(); ++it) {
@@ -338,19 +401,29 @@ Bootstrap::threadBootstrapNodeTask(NodeTask nodeTask)
 
     auto nodeval = std::make_shared<std::vector<std::shared_ptr<ValidateStatus>>>();
 
-    // Proccesing nodes
-    std::vector<std::string> node_tests = {"building", "natural", "place", "waterway"};
+    // Proccesing nodes, in a batch for each of the keys
+    std::vector<const osmobjects::TagKey *> node_tests = {&osmobjects::keys::building, &osmobjects::keys::natural,
+                                                          &osmobjects::keys::place, &osmobjects::keys::waterway};
+    std::vector<std::vector<const OsmNode *>> batches(node_tests.size());
     for (size_t i = taskIndex * page_size; i < (taskIndex + 1) * page_size; ++i) {
         if (i < nodes->size()) {
-            auto node = nodes->at(i);
-            for (auto test_it = std::begin(node_tests); test_it != std::end(node_tests); ++test_it) {
-                if (node.containsKey(*test_it)) {
-                    nodeval->push_back(validator->checkNode(node, *test_it));
+            const OsmNode &node = nodes->at(i);
+            for (std::size_t test = 0; test < node_tests.size(); test++) {
+                if (node.containsKey(*node_tests[test])) {
+                    batches[test].push_back(&node);
                 }
             }
             ++processed;
         }
     }
+    std::vector<std::shared_ptr<ValidateStatus>> results;
+    for (std::size_t test = 0; test < node_tests.size(); test++) {
+        validator->checkNodes(batches[test], node_tests[test]->name, results);
+        nodeval->insert(nodeval->end(), results.begin(), results.end());
+    }
+    if (validator->cache) {
+        task.validated = *nodeval;
+    }
 
     auto result = queryvalidate->nodes(nodeval);
     for (auto it = result->begin(); it != result->end(); ++it) {
@@ -386,7 +459,9 @@ Bootstrap::threadBootstrapRelationTask(RelationTask relationTask)
             // relationval->push_back(validator->checkRelation(way, "building"));
             // Fill the rel_refs table
             for (auto mit = relation.members.begin(); mit != relation.members.end(); ++mit) {
-                task.osmquery.push_back("INSERT INTO rel_refs (rel_id, way_id) VALUES (" + std::to_string(relation.id) + "," + std::to_string(mit->ref) + "); ");
+                if (mit->type == osmobjects::way) {
+                    task.relrefs.push_back(std::make_pair(relation.id, mit->ref));
+                }
             }
             ++processed;
         }
@@ -19,8 +19,11 @@
 
 #include "validate/queryvalidate.hh"
 #include "raw/queryraw.hh"
+#include "raw/rawcopy.hh"
 #include "underpassconfig.hh"
 #include "validate/validate.hh"
+#include "data/pqpool.hh"
+#include <future>
 #include <mutex>
 
 using namespace queryvalidate;
@@ -35,6 +38,8 @@ namespace bootstrap {
 struct BootstrapTask {
     std::vector<std::string> query;
     std::vector<std::string> osmquery;
+    std::vector<std::pair<long, long>> relrefs; ///< Relations and their way members
+    std::vector<std::shared_ptr<ValidateStatus>> validated; ///< The validation results, for the cache
     int processed = 0;
 };
 
@@ -43,6 +48,8 @@ struct BootstrapTask {
 struct BootstrapQueries {
     std::vector<std::string> underpass;
     std::vector<std::string> osm;
+    std::vector<std::pair<long, long>> relrefs; ///< Rows for rel_refs, written with COPY
+    std::vector<std::shared_ptr<ValidateStatus>> validated; ///< The validation results, for the cache
 };
 
 struct WayTask {
@@ -81,12 +88,22 @@ class Bootstrap {
     void threadBootstrapNodeTask(NodeTask nodeTask);
     void threadBootstrapRelationTask(RelationTask relationTask);
     BootstrapQueries allTasksQueries(std::shared_ptr<std::vector<BootstrapTask>> tasks);
+    /// Write the queries for a page in the background, split between
+    /// the pooled connections, once the previous page is written
+    void submit(const BootstrapQueries &queries);
+    /// Wait for the page being written, then store it's validation
+    /// results in the cache
+    void wait(void);
     
     std::shared_ptr<Validate> validator;
     std::shared_ptr<QueryValidate> queryvalidate;
     std::shared_ptr<QueryRaw> queryraw;
     std::shared_ptr<Pq> db;
     std::shared_ptr<Pq> osmdb;
+    std::shared_ptr<RawCopy> rawcopy;
+    std::shared_ptr<PqPool> dbpool;
+    std::vector<std::future<bool>> pending; ///< The writes of the last page
+    std::vector<std::shared_ptr<ValidateStatus>> written; ///< The validation results of the last page
     bool norefs;
     unsigned int concurrency;
     unsigned int page_size;
@@ -0,0 +1,175 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "data/coalescer.hh"
+
+namespace pq {
+
+Coalescer::Entry &
+Coalescer::find(osmobjects::osmtype_t type, long id, long version, bool &found)
+{
+    auto &ids = index[type];
+    auto it = ids.find(id);
+    found = it != ids.end();
+    if (found) {
+        return entries[it->second];
+    }
+    ids[id] = entries.size();
+    entries.push_back({type, id, version, {}, {}, {}});
+    return entries.back();
+}
+
+void
+Coalescer::add(osmobjects::osmtype_t type, long id, long version, std::vector<Statement> &&writes)
+{
+    if (writes.empty()) {
+        return;
+    }
+    added += writes.size();
+    bool found;
+    Entry &entry = find(type, id, version, found);
+    if (found && version < entry.version) {
+        return;
+    }
+    entry.version = version;
+    entry.writes = std::move(writes);
+    entry.updates.clear();
+    entry.removals.clear();
+}
+
+void
+Coalescer::update(osmobjects::osmtype_t type, long id, long version, std::vector<Statement> &&writes)
+{
+    if (writes.empty()) {
+        return;
+    }
+    added += writes.size();
+    bool found;
+    Entry &entry = find(type, id, version, found);
+    if (found && version < entry.version) {
+        return;
+    }
+    // A newer version means the full write is stale
+    if (version > entry.version) {
+        entry.writes.clear();
+        entry.removals.clear();
+    }
+    entry.version = version;
+    entry.updates = std::move(writes);
+}
+
+void
+Coalescer::remove(osmobjects::osmtype_t type, long id, long version, const std::string &statement)
+{
+    added++;
+    bool found;
+    Entry &entry = find(type, id, version, found);
+    if (found && version < entry.version) {
+        return;
+    }
+    if (version > entry.version) {
+        entry.removals.clear();
+    }
+    entry.version = version;
+    entry.writes.clear();
+    entry.updates.clear();
+    if (std::find(entry.removals.begin(), entry.removals.end(), statement) == entry.removals.end()) {
+        entry.removals.push_back(statement);
+    }
+}
+
+void
+Coalescer::add(Coalescer &&later)
+{
+    std::size_t total = added + later.added;
+    for (auto it = std::begin(later.entries); it != std::end(later.entries); ++it) {
+        if (!it->writes.empty()) {
+            add(it->type, it->id, it->version, std::move(it->writes));
+        }
+        if (!it->updates.empty()) {
+            update(it->type, it->id, it->version, std::move(it->updates));
+        }
+        for (auto rit = std::begin(it->removals); rit != std::end(it->removals); ++rit) {
+            remove(it->type, it->id, it->version, *rit);
+        }
+    }
+    added = total;
+    later.entries.clear();
+    later.index.clear();
+}
+
+std::vector<Statement>
+Coalescer::statements(void) const
+{
+    return statements(1).front();
+}
+
+std::vector<std::vector<Statement>>
+Coalescer::statements(std::size_t parts) const
+{
+    parts = std::max<std::size_t>(parts, 1);
+    std::vector<std::vector<Statement>> calls(parts);
+    std::vector<std::vector<std::string>> names(parts);
+    std::vector<std::map<std::string, std::vector<long>>> removals(parts);
+    for (auto it = std::begin(entries); it != std::end(entries); ++it) {
+        std::size_t part = static_cast<std::size_t>(it->id) % parts;
+        calls[part].insert(calls[part].end(), it->writes.begin(), it->writes.end());
+        calls[part].insert(calls[part].end(), it->updates.begin(), it->updates.end());
+        for (auto rit = std::begin(it->removals); rit != std::end(it->removals); ++rit) {
+            auto &ids = removals[part][*rit];
+            if (ids.empty()) {
+                names[part].push_back(*rit);
+            }
+            ids.push_back(it->id);
+        }
+    }
+    // The removals are done last, like the per file queries did
+    for (std::size_t part = 0; part < parts; part++) {
+        for (auto it = std::begin(names[part]); it != std::end(names[part]); ++it) {
+            calls[part].push_back(Statement(*it).bind(removals[part][*it]));
+        }
+    }
+    return calls;
+}
+
+std::size_t
+Coalescer::size(void) const
+{
+    std::size_t writes = 0;
+    for (auto it = std::begin(entries); it != std::end(entries); ++it) {
+        writes += it->writes.size() + it->updates.size() + it->removals.size();
+    }
+    return writes;
+}
+
+} // namespace pq
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,103 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __COALESCER_HH__
+#define __COALESCER_HH__
+
+/// \file coalescer.hh
+/// \brief Only write the last change of each object in a batch of files
+///
+/// When several change files are committed together, the same object is
+/// often changed in more than one of them. Writing every version rewrites
+/// the same row and it's indexes, so only the writes for the latest
+/// version of each object are kept.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "data/pq.hh"
+#include "osm/osmobjects.hh"
+
+/// \namespace pq
+namespace pq {
+
+/// \class Coalescer
+/// \brief The prepared statement calls for a batch, by object
+///
+/// The writes for an object replace the ones added before for it, unless
+/// they are for an older version. A geometry update for the same version
+/// is kept after the full write instead, since it was made from newer
+/// node locations. Removals are collected and done with one statement
+/// that takes an array of IDs.
+class Coalescer {
+  public:
+    /// Add the writes that set the whole object
+    void add(osmobjects::osmtype_t type, long id, long version, std::vector<Statement> &&writes);
+    /// Add writes that only change the geometry of the object
+    void update(osmobjects::osmtype_t type, long id, long version, std::vector<Statement> &&writes);
+    /// Add the removal of the object by a statement that takes an array
+    /// of IDs. An object can be removed by more than one statement.
+    void remove(osmobjects::osmtype_t type, long id, long version, const std::string &statement);
+    /// Add the writes from a later file
+    void add(Coalescer &&later);
+
+    /// The statement calls left, in order
+    std::vector<Statement> statements(void) const;
+    /// The statement calls left, split into \a parts by object. All the
+    /// writes of an object are in the same part, so the parts can be
+    /// run at the same time on different connections.
+    std::vector<std::vector<Statement>> statements(std::size_t parts) const;
+    /// The number of writes left
+    std::size_t size(void) const;
+    bool empty(void) const { return entries.empty(); };
+
+    std::size_t added = 0; ///< The number of writes added, before coalescing
+
+  private:
+    /// The writes left for one object
+    struct Entry {
+        osmobjects::osmtype_t type;
+        long id;
+        long version;
+        std::vector<Statement> writes;
+        std::vector<Statement> updates;
+        std::vector<std::string> removals;
+    };
+    /// Find the entry for an object, or make a new one
+    Entry &find(osmobjects::osmtype_t type, long id, long version, bool &found);
+
+    std::vector<Entry> entries;
+    std::map<osmobjects::osmtype_t, std::unordered_map<long, std::size_t>> index;
+};
+
+} // namespace pq
+
+#endif // EOF __COALESCER_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
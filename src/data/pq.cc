@@ -26,6 +26,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -136,6 +137,9 @@ Pq::connect(const std::string &dburl)
         sdb = std::make_unique<pqxx::connection>(args);
         if (sdb->is_open()) {
             log_debug("Opened database connection to %1%", args);
+            // Prepared statements only exist on the connection they
+            // were prepared on
+            prepared.clear();
             return true;
         } else {
             return false;
@@ -164,6 +168,143 @@ Pq::query(const std::string &query)
     return result;
 }
 
+bool
+Pq::prepare(const std::string &name, const std::string &sql)
+{
+    std::scoped_lock write_lock{pqxx_mutex};
+    auto found = statements.find(name);
+    if (found != statements.end() && found->second == sql) {
+        return true;
+    }
+    statements[name] = sql;
+    prepared.erase(name);
+    return true;
+}
+
+void
+Pq::ready(const std::string &name)
+{
+    if (prepared.count(name)) {
+        return;
+    }
+    auto found = statements.find(name);
+    if (found == statements.end()) {
+        throw std::runtime_error("no statement " + name);
+    }
+    sdb->prepare(name, found->second);
+    prepared.insert(name);
+}
+
+pqxx::result
+Pq::execute(const Statement &statement)
+{
+    std::scoped_lock write_lock{pqxx_mutex};
+    pqxx::result result;
+    try {
+        ready(statement.name);
+        pqxx::work worker(*sdb);
+        result = worker.exec_prepared(statement.name, pqxx::prepare::make_dynamic_params(statement.params));
+        worker.commit();
+    } catch (std::exception &e) {
+        log_error("ERROR executing statement %1%: %2%", statement.name, e.what());
+        // Return an empty result so higher level code can handle the error
+        return pqxx::result();
+    }
+    return result;
+}
+
+bool
+Pq::execute(const std::vector<Statement> &calls)
+{
+    return execute(std::string(), calls);
+}
+
+bool
+Pq::execute(const std::string &query, const std::vector<Statement> &calls)
+{
+    if (query.empty() && calls.empty()) {
+        return true;
+    }
+    std::scoped_lock write_lock{pqxx_mutex};
+    try {
+        for (auto it = std::begin(calls); it != std::end(calls); ++it) {
+            ready(it->name);
+        }
+        pqxx::work worker(*sdb);
+        if (!query.empty()) {
+            worker.exec(query);
+        }
+        for (auto it = std::begin(calls); it != std::end(calls); ++it) {
+            worker.exec_prepared(it->name, pqxx::prepare::make_dynamic_params(it->params));
+        }
+        worker.commit();
+    } catch (std::exception &e) {
+        log_error("ERROR executing %1% statements: %2%", calls.size(), e.what());
+        return false;
+    }
+    return true;
+}
+
+bool
+Pq::pipeline(const std::vector<std::string> &queries)
+{
+    if (queries.empty()) {
+        return true;
+    }
+    std::scoped_lock write_lock{pqxx_mutex};
+    try {
+        pqxx::work worker(*sdb);
+        pqxx::pipeline pipe(worker);
+        // Queries are sent in batches, without waiting for the results
+        // of the ones before them
+        pipe.retain(pipeline_depth);
+        for (auto it = std::begin(queries); it != std::end(queries); ++it) {
+            pipe.insert(*it);
+        }
+        pipe.complete();
+        worker.commit();
+    } catch (std::exception &e) {
+        log_error("ERROR executing %1% pipelined queries: %2%", queries.size(), e.what());
+        return false;
+    }
+    return true;
+}
+
+Statement &
+Statement::bind(const std::vector<long> &values)
+{
+    std::string array = "{";
+    for (auto it = std::begin(values); it != std::end(values); ++it) {
+        array += std::to_string(*it) + ",";
+    }
+    if (array.size() > 1) {
+        array.pop_back();
+    }
+    params.push_back(array + "}");
+    return *this;
+}
+
+Statement &
+Statement::bind(const std::vector<std::string> &values)
+{
+    std::string array = "{";
+    for (auto it = std::begin(values); it != std::end(values); ++it) {
+        array += '"';
+        for (auto c = it->cbegin(); c != it->cend(); ++c) {
+            if (*c == '"' || *c == '\\') {
+                array += '\\';
+            }
+            array += *c;
+        }
+        array += "\",";
+    }
+    if (array.size() > 1) {
+        array.pop_back();
+    }
+    params.push_back(array + "}");
+    return *this;
+}
+
 std::string
 Pq::escapedString(const std::string &s)
 {
@@ -33,14 +33,43 @@
 #endif
 
 #include <iostream>
+#include <map>
+#include <optional>
 #include <pqxx/pqxx>
+#include <set>
 #include <string>
+#include <type_traits>
 #include <vector>
 #include <mutex>
 
 /// \namespace pq
 namespace pq {
 
+/// \struct Statement
+/// \brief A call of a prepared statement, with it's parameters
+///
+/// The parameters are sent separately from the SQL as text, so they
+/// don't need to be escaped, and the server parses and plans the
+/// statement only once per connection. A parameter without a value
+/// is a NULL.
+struct Statement {
+    explicit Statement(const std::string &statement) : name(statement) {};
+
+    Statement &bind(const std::string &value) { params.push_back(value); return *this; };
+    Statement &bind(const char *value) { params.push_back(std::string(value)); return *this; };
+    Statement &bind(const std::optional<std::string> &value) { params.push_back(value); return *this; };
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value, Statement &>::type
+    bind(T value) { params.push_back(std::to_string(value)); return *this; };
+    /// Bind an array, used as a $1::bigint[] parameter
+    Statement &bind(const std::vector<long> &values);
+    /// Bind an array, used as a $1::text[] parameter
+    Statement &bind(const std::vector<std::string> &values);
+
+    std::string name;  ///< The name the statement was prepared with
+    std::vector<std::optional<std::string>> params;
+};
+
 /// \class Pq
 /// \brief This is a higher level class wrapped around libpqxx
 class Pq {
@@ -57,6 +86,18 @@ class Pq {
 
     /// Run query into the database
     pqxx::result query(const std::string &query);
+    /// Add a prepared statement. It's prepared on the connection the
+    /// first time it's executed, and again after connecting.
+    bool prepare(const std::string &name, const std::string &sql);
+    /// Run a prepared statement in it's own transaction
+    pqxx::result execute(const Statement &statement);
+    /// Run prepared statements in order, all in one transaction
+    bool execute(const std::vector<Statement> &calls);
+    /// Run a query and then prepared statements, all in one transaction
+    bool execute(const std::string &query, const std::vector<Statement> &calls);
+    /// Run queries in order, all in one transaction, without waiting
+    /// for the result of each query before sending the next one
+    bool pipeline(const std::vector<std::string> &queries);
     /// Parse the URL for the database connection
     bool parseURL(const std::string &query);
 
@@ -80,6 +121,13 @@ class Pq {
     std::string passwd;  ///< The database password
     std::string dbname;  ///< The database name
     std::mutex pqxx_mutex;
+    std::map<std::string, std::string> statements; ///< The prepared statements, by name
+    std::set<std::string> prepared; ///< The statements prepared on this connection
+    int pipeline_depth = 64; ///< How many queries pipeline() sends at once
+
+  private:
+    /// Prepare a statement on the connection, if it isn't yet
+    void ready(const std::string &name);
 
 };
 
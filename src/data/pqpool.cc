@@ -0,0 +1,144 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+
+#include "data/pqpool.hh"
+
+#include "utils/log.hh"
+using namespace logger;
+
+namespace pq {
+
+PqPool::~PqPool(void)
+{
+    // Finish the submitted work while the connections still exist
+    if (workers) {
+        workers->join();
+    }
+}
+
+bool
+PqPool::connect(const std::string &dburl, std::size_t size)
+{
+    size = std::max<std::size_t>(size, 1);
+    for (std::size_t i = 0; i < size; i++) {
+        auto conn = std::make_unique<Pq>();
+        if (!conn->connect(dburl)) {
+            log_error("Couldn't open database connection %1% of %2%", i + 1, size);
+            return false;
+        }
+        std::scoped_lock lock{pool_mutex};
+        idle.push_back(conn.get());
+        connections.push_back(std::move(conn));
+    }
+    workers = std::make_unique<boost::asio::thread_pool>(size);
+    log_debug("Opened %1% database connections", size);
+    return true;
+}
+
+void
+PqPool::prepare(const std::string &name, const std::string &sql)
+{
+    for (auto it = std::begin(connections); it != std::end(connections); ++it) {
+        (*it)->prepare(name, sql);
+    }
+}
+
+std::shared_ptr<Pq>
+PqPool::acquire(void)
+{
+    std::unique_lock<std::mutex> lock(pool_mutex);
+    if (idle.empty()) {
+        waited++;
+    }
+    available.wait(lock, [this] { return !idle.empty(); });
+    Pq *conn = idle.back();
+    idle.pop_back();
+    acquired++;
+    return std::shared_ptr<Pq>(conn, [this](Pq *conn) { release(conn); });
+}
+
+void
+PqPool::release(Pq *conn)
+{
+    std::scoped_lock lock{pool_mutex};
+    idle.push_back(conn);
+    available.notify_one();
+}
+
+std::future<bool>
+PqPool::submit(std::vector<std::string> queries)
+{
+    auto promise = std::make_shared<std::promise<bool>>();
+    auto result = promise->get_future();
+    submitted++;
+    boost::asio::post(*workers, [this, promise, queries = std::move(queries)] {
+        bool ok = acquire()->pipeline(queries);
+        if (!ok) {
+            failed++;
+        }
+        promise->set_value(ok);
+    });
+    return result;
+}
+
+std::future<bool>
+PqPool::submit(std::vector<Statement> calls)
+{
+    auto promise = std::make_shared<std::promise<bool>>();
+    auto result = promise->get_future();
+    submitted++;
+    boost::asio::post(*workers, [this, promise, calls = std::move(calls)] {
+        bool ok = acquire()->execute(calls);
+        if (!ok) {
+            failed++;
+        }
+        promise->set_value(ok);
+    });
+    return result;
+}
+
+void
+PqPool::dump(void)
+{
+    std::size_t free = 0;
+    {
+        std::scoped_lock lock{pool_mutex};
+        free = idle.size();
+    }
+    log_debug("Database pool: %1% connections, %2% idle, %3% checkouts, %4% waited, %5% submitted, %6% failed",
+              connections.size(), free, acquired.load(), waited.load(), submitted.load(), failed.load());
+}
+
+} // namespace pq
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,105 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __PQPOOL_HH__
+#define __PQPOOL_HH__
+
+/// \file pqpool.hh
+/// \brief A pool of database connections for the worker threads
+///
+/// A Pq has a single connection, and a mutex so only one thread at a
+/// time uses it. When all the workers share one, the database access
+/// is serialized however many workers there are. A pool has a
+/// connection for each worker, so they can all use the database at
+/// the same time.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio/thread_pool.hpp>
+
+#include "data/pq.hh"
+
+/// \namespace pq
+namespace pq {
+
+/// \class PqPool
+/// \brief A fixed size pool of connections to one database
+///
+/// A worker checks out a connection with acquire(), and it's returned
+/// to the pool when the worker drops it. Work can also be submitted to
+/// run in the background on the next free connection. The pool has to
+/// outlive the connections checked out from it.
+class PqPool {
+  public:
+    PqPool(void) {};
+    ~PqPool(void);
+
+    /// Open the connections to a database
+    bool connect(const std::string &dburl, std::size_t size);
+    /// Add a prepared statement to every connection
+    void prepare(const std::string &name, const std::string &sql);
+
+    /// Check out a connection, waiting for one to be free
+    std::shared_ptr<Pq> acquire(void);
+    /// Run queries in one transaction on the next free connection, in
+    /// the background. The result is false if a query failed.
+    std::future<bool> submit(std::vector<std::string> queries);
+    /// Run prepared statements in one transaction on the next free
+    /// connection, in the background
+    std::future<bool> submit(std::vector<Statement> calls);
+
+    /// The number of connections
+    std::size_t size(void) const { return connections.size(); };
+    /// Dump the pool counters to the log
+    void dump(void);
+
+  private:
+    /// Return a connection to the pool
+    void release(Pq *conn);
+
+    std::vector<std::unique_ptr<Pq>> connections;
+    std::vector<Pq *> idle;             ///< The connections not checked out
+    std::mutex pool_mutex;
+    std::condition_variable available;
+    std::unique_ptr<boost::asio::thread_pool> workers; ///< Runs the submitted work
+    std::atomic<long> acquired{0};      ///< Connections checked out
+    std::atomic<long> waited{0};        ///< Check outs that had to wait for a connection
+    std::atomic<long> submitted{0};     ///< Background transactions
+    std::atomic<long> failed{0};        ///< Background transactions that failed
+};
+
+} // namespace pq
+
+#endif // EOF __PQPOOL_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
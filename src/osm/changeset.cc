@@ -87,11 +87,21 @@ using namespace logger;
 /// \namespace changesets
 namespace changesets {
 
+// Read a downloaded file from memory, decompressing it while parsing
 bool
 ChangeSetFile::readChanges(const std::vector<unsigned char> &buffer)
 {
-
-    // parse_memory((const Glib::ustring &)buffer);
+    boost::iostreams::filtering_streambuf<boost::iostreams::input> inbuf;
+    // Check the magic number of the file
+    if (buffer.size() > 2 && buffer[0] == 0x1f && buffer[1] == 0x8b) {
+        inbuf.push(boost::iostreams::gzip_decompressor());
+    }
+    inbuf.push(boost::iostreams::array_source{reinterpret_cast<const char *>(buffer.data()), buffer.size()});
+    std::istream instream(&inbuf);
+    // Let decompression errors through to the caller, otherwise the
+    // parser just sees a truncated file.
+    instream.exceptions(std::ios_base::badbit);
+    return readXML(instream);
 }
 
 // Read a changeset file from disk or memory into internal storage
@@ -131,6 +141,12 @@ ChangeSetFile::readChanges(const std::string &file)
 
 void
 ChangeSetFile::areaFilter(const multipolygon_t &poly)
+{
+    areaFilter(geoutil::BoundaryIndex(poly));
+}
+
+void
+ChangeSetFile::areaFilter(const geoutil::BoundaryIndex &boundary)
 {
 #ifdef TIMING_DEBUG_X
     boost::timer::auto_cpu_timer timer("ChangeSetFile::areaFilter: took %w seconds\n");
@@ -138,7 +154,7 @@ ChangeSetFile::areaFilter(const multipolygon_t &poly)
     // log_debug("Pre filtering changeset size is %1%", changes.size());
     for (auto it = std::begin(changes); it != std::end(changes); it++) {
         ChangeSet *change = it->get();
-        if (poly.empty()) {
+        if (boundary.empty()) {
             // log_debug("Accepting changeset %1% as in priority area because area information is missing",
             // change->id);
             change->priority = true;
@@ -151,7 +167,7 @@ ChangeSetFile::areaFilter(const multipolygon_t &poly)
         boost::geometry::append(change->bbox, point_t(change->max_lon, change->max_lat));
         // point_t pt;
         // boost::geometry::centroid(change->bbox, pt);
-        if (!boost::geometry::intersects(change->bbox, poly)) {
+        if (!boundary.intersects(change->bbox)) {
             // log_debug("Validating changeset %1% is not in a priority area", change->id);
 
             change->priority = false;
@@ -54,6 +54,7 @@ using namespace boost::gregorian;
 
 #include "osm/osmobjects.hh"
 #include "stats/querystats.hh"
+#include "utils/boundaryindex.hh"
 
 
 // Forward declaration
@@ -146,6 +147,8 @@ class ChangeSetFile
 
     /// Delete features not in the boundary
     void areaFilter(const multipolygon_t &poly);
+    /// Delete features not in the prepared boundary
+    void areaFilter(const geoutil::BoundaryIndex &boundary);
 
     /// Read a changeset file from disk or memory into internal storage
     bool readChanges(const std::string &file);
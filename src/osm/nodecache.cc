@@ -0,0 +1,102 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file nodecache.cc
+/// \brief The node locations used by a change file
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <algorithm>
+
+#include "osm/nodecache.hh"
+
+namespace osmchange {
+
+/// The smallest table, most change files have more nodes than this
+static const std::size_t minimum = 1024;
+
+void
+NodeCache::resize(std::size_t size)
+{
+    std::vector<Slot> old(size, Slot{empty_id, 0, 0});
+    old.swap(slots);
+    shift = 64;
+    for (std::size_t bits = size; bits > 1; bits >>= 1) {
+        shift--;
+    }
+    std::size_t mask = slots.size() - 1;
+    for (auto it = std::begin(old); it != std::end(old); ++it) {
+        if (it->id == empty_id) {
+            continue;
+        }
+        std::size_t i = hash(it->id);
+        while (slots[i].id != empty_id) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = *it;
+    }
+}
+
+void
+NodeCache::reserve(std::size_t nodes)
+{
+    std::size_t size = std::max(slots.size(), minimum);
+    while (size < nodes * 2) {
+        size *= 2;
+    }
+    if (size != slots.size()) {
+        resize(size);
+    }
+}
+
+void
+NodeCache::insert(long id, const point_t &point)
+{
+    if ((count + 1) * 2 > slots.size()) {
+        reserve(count + 1);
+    }
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = hash(id);
+    while (slots[i].id != id && slots[i].id != empty_id) {
+        i = (i + 1) & mask;
+    }
+    if (slots[i].id == empty_id) {
+        slots[i].id = id;
+        count++;
+    }
+    slots[i].x = static_cast<std::int32_t>(std::lround(point.get<0>() * precision));
+    slots[i].y = static_cast<std::int32_t>(std::lround(point.get<1>() * precision));
+}
+
+void
+NodeCache::clear(void)
+{
+    std::fill(slots.begin(), slots.end(), Slot{empty_id, 0, 0});
+    count = 0;
+}
+
+} // namespace osmchange
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
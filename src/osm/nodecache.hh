@@ -0,0 +1,126 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __NODECACHE_HH__
+#define __NODECACHE_HH__
+
+/// \file nodecache.hh
+/// \brief The node locations used by a change file
+///
+/// Every way in a change file looks up the location of each of it's
+/// nodes, often more than once, so this is a flat hash table instead
+/// of a tree.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+#include "osm/osmobjects.hh"
+
+/// \namespace osmchange
+namespace osmchange {
+
+/// \class NodeCache
+/// \brief A hash table of node locations by node ID
+///
+/// The table uses open addressing with linear probing, so a lookup is
+/// one hash and usually one cache line. The locations are stored as 32
+/// bit fixed point numbers, which is the precision of the OSM data, so
+/// each node is 16 bytes. The table doubles when it's half full.
+class NodeCache {
+  public:
+    NodeCache(void) {};
+
+    /// Make room for \a count nodes, so adding them doesn't grow the table
+    void reserve(std::size_t count);
+    /// Add or replace the location of a node
+    void insert(long id, const point_t &point);
+    /// Get the location of a node, returns false if it isn't there
+    bool find(long id, point_t &point) const
+    {
+        const Slot *slot = lookup(id);
+        if (slot == nullptr) {
+            return false;
+        }
+        point = point_t(slot->x / precision, slot->y / precision);
+        return true;
+    };
+    /// Is the location of a node there
+    bool contains(long id) const { return lookup(id) != nullptr; };
+
+    std::size_t size(void) const { return count; };
+    bool empty(void) const { return count == 0; };
+    /// Remove all the nodes, keeping the memory
+    void clear(void);
+
+    /// The fixed point scale, which is about 1cm at the equator
+    static constexpr double precision = 10000000.0;
+
+  private:
+    /// A node, the ID is empty when the slot isn't used
+    struct Slot {
+        std::int64_t id;
+        std::int32_t x;
+        std::int32_t y;
+    };
+    static constexpr std::int64_t empty_id = std::numeric_limits<std::int64_t>::min();
+
+    /// Fibonacci hashing spreads the sequential IDs of a change file
+    std::size_t hash(long id) const
+    {
+        return (static_cast<std::uint64_t>(id) * 0x9E3779B97F4A7C15ULL) >> shift;
+    };
+    const Slot *lookup(long id) const
+    {
+        if (count == 0) {
+            return nullptr;
+        }
+        std::size_t mask = slots.size() - 1;
+        for (std::size_t i = hash(id);; i = (i + 1) & mask) {
+            const Slot &slot = slots[i];
+            if (slot.id == id) {
+                return &slot;
+            }
+            if (slot.id == empty_id) {
+                return nullptr;
+            }
+        }
+    };
+    /// Rehash into a table of \a size slots, which is a power of 2
+    void resize(std::size_t size);
+
+    std::vector<Slot> slots;
+    std::size_t count = 0;
+    unsigned int shift = 64; ///< 64 minus the log2 of the table size
+};
+
+} // namespace osmchange
+
+#endif // EOF __NODECACHE_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,143 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __OBJECTARENA_HH__
+#define __OBJECTARENA_HH__
+
+/// \file objectarena.hh
+/// \brief Arena storage for the OSM objects in a change file
+///
+/// A change file contains many thousands of small objects, which all
+/// get created while parsing and are all thrown away together once the
+/// file has been processed. Rather than allocating each one from the
+/// heap, they are carved out of large blocks owned by an arena, and
+/// the blocks are released all at once when the last object is gone.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+/// \namespace osmobjects
+namespace osmobjects {
+
+template <typename T> class ArenaAllocator;
+
+/// \class ObjectArena
+/// \brief A block allocator shared by all the objects in a change file
+///
+/// Objects are created with make(), which returns a normal shared_ptr,
+/// so they can be used anywhere a heap allocated object can be. The
+/// object and it's reference count are stored in the arena, and each
+/// object keeps the arena alive, so an object that outlives the change
+/// file is still valid. Freeing an object only runs it's destructor,
+/// the memory is reused when the whole arena goes away.
+///
+/// That means one object kept after the file keeps all the blocks of
+/// the file too, so anything that keeps objects longer, like the
+/// ObjectCache, has to copy them to the heap first.
+///
+/// This is not thread safe, each change file is only ever worked on
+/// by one thread at a time.
+class ObjectArena : public std::enable_shared_from_this<ObjectArena> {
+  public:
+    /// Arenas have to be shared, since the objects keep a reference
+    static std::shared_ptr<ObjectArena> create(std::size_t block = 64 * 1024)
+    {
+        return std::shared_ptr<ObjectArena>(new ObjectArena(block));
+    };
+
+    /// Create an object in the arena
+    template <typename T, typename... Args>
+    std::shared_ptr<T> make(Args &&...args)
+    {
+        objects++;
+        return std::allocate_shared<T>(ArenaAllocator<T>(shared_from_this()),
+                                       std::forward<Args>(args)...);
+    };
+
+    /// Get memory from the current block, or start a new one
+    void *allocate(std::size_t bytes, std::size_t alignment)
+    {
+        used += bytes;
+        return resource.allocate(bytes, alignment);
+    };
+
+    /// The number of objects created in this arena
+    std::size_t getObjects(void) const { return objects; };
+    /// The number of bytes handed out by this arena
+    std::size_t getBytes(void) const { return used; };
+
+  private:
+    ObjectArena(std::size_t block) : resource(block) {};
+
+    std::pmr::monotonic_buffer_resource resource;
+    std::size_t objects = 0;  ///< Objects created
+    std::size_t used = 0;     ///< Bytes allocated
+};
+
+/// \class ArenaAllocator
+/// \brief Allocates from an ObjectArena, used by std::allocate_shared()
+template <typename T>
+class ArenaAllocator {
+  public:
+    using value_type = T;
+
+    explicit ArenaAllocator(std::shared_ptr<ObjectArena> owner)
+        : arena(std::move(owner)) {};
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {};
+
+    T *allocate(std::size_t n)
+    {
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    };
+    /// Memory is only released when the arena is destroyed
+    void deallocate(T *, std::size_t) {};
+
+    std::shared_ptr<ObjectArena> arena;
+};
+
+template <typename T, typename U>
+bool
+operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+    return a.arena == b.arena;
+}
+
+template <typename T, typename U>
+bool
+operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b)
+{
+    return a.arena != b.arena;
+}
+
+} // namespace osmobjects
+
+#endif // EOF __OBJECTARENA_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -46,6 +46,7 @@ using namespace boost::gregorian;
 #include <boost/filesystem.hpp>
 #include <ogrsf_frmts.h>
 #include <boost/units/systems/si/length.hpp>
+#include <boost/iostreams/device/array.hpp>
 #include <boost/iostreams/filtering_streambuf.hpp>
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/timer/timer.hpp>
@@ -54,6 +55,7 @@ using namespace boost::gregorian;
 #include "validate/validate.hh"
 #include "osm/osmobjects.hh"
 #include "osm/osmchange.hh"
+#include "osm/osmchangereader.hh"
 #include <ogr_geometry.h>
 
 #include "stats/statsconfig.hh"
@@ -124,6 +126,23 @@ OsmChangeFile::readChanges(const std::string &file)
     return true;
 }
 
+// Read a downloaded file from memory, decompressing it while parsing
+bool
+OsmChangeFile::readChanges(const std::vector<unsigned char> &buffer)
+{
+    boost::iostreams::filtering_streambuf<boost::iostreams::input> inbuf;
+    // Check the magic number of the file
+    if (buffer.size() > 2 && buffer[0] == 0x1f && buffer[1] == 0x8b) {
+        inbuf.push(boost::iostreams::gzip_decompressor());
+    }
+    inbuf.push(boost::iostreams::array_source{reinterpret_cast<const char *>(buffer.data()), buffer.size()});
+    std::istream instream(&inbuf);
+    // Let decompression errors through to the caller, otherwise the
+    // parser just sees a truncated file.
+    instream.exceptions(std::ios_base::badbit);
+    return readXML(instream);
+}
+
 // Used for testing
 void
 OsmChangeFile::buildGeometriesFromNodeCache() {
@@ -132,7 +151,10 @@ OsmChangeFile::buildGeometriesFromNodeCache() {
         for (auto wit = std::begin(change->ways); wit != std::end(change->ways); ++wit) {
             osmobjects::OsmWay *way = wit->get();
             for (auto lit = std::begin(way->refs); lit != std::end(way->refs); ++lit) {
-                bg::append(way->linestring, nodecache[*lit]);
+                point_t point;
+                if (nodecache.find(*lit, point)) {
+                    bg::append(way->linestring, point);
+                }
             }
             if (way->isClosed()) {
                 way->polygon = { {std::begin(way->linestring), std::end(way->linestring)} };
@@ -143,7 +165,7 @@ OsmChangeFile::buildGeometriesFromNodeCache() {
             } else {
                 ss << std::setprecision(12) << bg::wkt(way->linestring);
             }
-            waycache.insert(std::pair(way->id, std::make_shared<osmobjects::OsmWay>(*way)));
+            waycache.insert(std::pair(way->id, *wit));
         }
     }
 }
@@ -181,9 +203,7 @@ OsmChangeFile::buildRelationGeometry(osmobjects::OsmRelation &relation) {
             return;
         }
         
-        auto way = std::make_shared<osmobjects::OsmWay>();
-
-        way = waycache.at(mit->ref);
+        auto way = waycache.at(mit->ref);
 
         if (bg::num_points(way->linestring) > 0 &&
             bg::num_points(way->polygon) == 0)
@@ -191,11 +211,14 @@ OsmChangeFile::buildRelationGeometry(osmobjects::OsmRelation &relation) {
 
             // Linestrings
 
+            // The cached way is the same object as the one in the change,
+            // so the direction is changed on a copy
+            linestring_t linestring = way->linestring;
+
             if (!way->isClosed()) {
 
                 // Reverse the line direction if it's necessary
                 if (first && (std::next(mit) != members.end())) {
-                    auto nextWay = std::make_shared<osmobjects::OsmWay>();
                     auto nextWayId = std::next(mit)->ref;
                     if (!waycache.count(nextWayId)) {
                         // Way is not available in cache,
@@ -203,25 +226,25 @@ OsmChangeFile::buildRelationGeometry(osmobjects::OsmRelation &relation) {
                         // or the way was deleted
                         return;
                     }
-                    nextWay = waycache.at(nextWayId);
+                    auto nextWay = waycache.at(nextWayId);
 
                     if ( bg::num_points(nextWay->linestring) > 0 && 
-                        bg::num_points(way->linestring) > 0 && (
-                        bg::equals(way->linestring.front(), nextWay->linestring.front()) ||
-                        bg::equals(way->linestring.front(), nextWay->linestring.back())
+                        bg::num_points(linestring) > 0 && (
+                        bg::equals(linestring.front(), nextWay->linestring.front()) ||
+                        bg::equals(linestring.front(), nextWay->linestring.back())
                     )) {
-                        bg::reverse(way->linestring);
+                        bg::reverse(linestring);
                     }
                 } else {
-                    if ( bg::num_points(way->linestring) > 0 &&
+                    if ( bg::num_points(linestring) > 0 &&
                          bg::num_points(lastLinestring) > 0 ) {
-                        if (bg::equals(way->linestring.back(), lastLinestring.back())) {
-                            bg::reverse(way->linestring);
+                        if (bg::equals(linestring.back(), lastLinestring.back())) {
+                            bg::reverse(linestring);
                         }
                     }
                 }
 
-                bg::append(part, way->linestring);
+                bg::append(part, linestring);
 
                 // Check if object is closed
                 if (relation.isMultiPolygon() && bg::equals(part.back(), part.front())) {
@@ -245,7 +268,6 @@ OsmChangeFile::buildRelationGeometry(osmobjects::OsmRelation &relation) {
                     lastLinestring.clear();
                 } else if (std::next(mit) != members.end()) {
                     // Check if object is disconnected
-                    auto nextWay = std::make_shared<osmobjects::OsmWay>();
                     auto nextWayId = std::next(mit)->ref;
                     if (!waycache.count(nextWayId)) {
                         // Way is not available in cache,
@@ -253,10 +275,10 @@ OsmChangeFile::buildRelationGeometry(osmobjects::OsmRelation &relation) {
                         // or the way was deleted
                         return;
                     }
-                    nextWay = waycache.at(nextWayId);
-                    if ( (bg::num_points(way->linestring) > 0 && bg::num_points(nextWay->linestring) > 0 &&
-                        !bg::equals(way->linestring.back(), nextWay->linestring.front()) &&
-                        !bg::equals(way->linestring.back(), nextWay->linestring.back())) ||
+                    auto nextWay = waycache.at(nextWayId);
+                    if ( (bg::num_points(linestring) > 0 && bg::num_points(nextWay->linestring) > 0 &&
+                        !bg::equals(linestring.back(), nextWay->linestring.front()) &&
+                        !bg::equals(linestring.back(), nextWay->linestring.back())) ||
                         (bg::num_points(nextWay->linestring) == 0)
                     ) {
                         parts_outer.push_back({
@@ -286,7 +308,7 @@ OsmChangeFile::buildRelationGeometry(osmobjects::OsmRelation &relation) {
                 }
             }
 
-            lastLinestring = way->linestring;
+            lastLinestring = linestring;
 
         } else {
 
@@ -297,15 +319,16 @@ OsmChangeFile::buildRelationGeometry(osmobjects::OsmRelation &relation) {
                 bg::num_points(way->polygon) > 0
             ) {
                 // Convert way's Polygon to LineString
-                bg::assign_points(way->linestring, way->polygon.outer());
+                linestring_t linestring;
+                bg::assign_points(linestring, way->polygon.outer());
                 if (mit->role == "inner") {
                         parts_inner.push_back({
-                            { way->linestring },
+                            { linestring },
                             polygon_t()
                         });
                 } else {
                         parts_outer.push_back({
-                            { way->linestring },
+                            { linestring },
                             polygon_t()
                         });
                 }
@@ -430,7 +453,11 @@ OsmChangeFile::readXML(std::istream &xml)
     setlocale(LC_NUMERIC, "C");
     // log_debug("OsmChangeFile::readXML(): " << xml.rdbuf());
     std::ofstream myfile;
-#ifdef LIBXML
+#if defined(PULLPARSER)
+    // The pull parser scans the data in place, and is much faster
+    // than libxml++ since OsmChange files only use a subset of XML.
+    return readPull(xml);
+#elif defined(LIBXML)
     // libxml calls on_element_start for each node, using a SAX parser,
     // and works well for large files.
     try {
@@ -526,6 +553,182 @@ OsmChangeFile::readXML(std::istream &xml)
     return false;
 }
 
+// Parse the XML using the pull parser. This does the same thing as
+// on_start_element(), but the element names are an enum, and the
+// attributes point into the buffer, so nothing gets copied until it's
+// stored.
+bool
+OsmChangeFile::readPull(std::istream &xml)
+{
+#ifdef TIMING_DEBUG_X
+    boost::timer::auto_cpu_timer timer("OsmChangeFile::readPull: took %w seconds\n");
+#endif
+    OsmChangeReader reader(xml);
+    Element element;
+    std::shared_ptr<OsmChange> change;
+    std::string keybuf;
+    std::string valbuf;
+    while (reader.next(element)) {
+        switch (element.type) {
+            // There are 3 change states to handle, each one contains possibly
+            // multiple nodes and ways.
+            case element_t::create:
+                change = std::make_shared<OsmChange>(osmobjects::create, arena);
+                changes.push_back(change);
+                continue;
+            case element_t::modify:
+                change = std::make_shared<OsmChange>(osmobjects::modify, arena);
+                changes.push_back(change);
+                continue;
+            case element_t::remove:
+                change = std::make_shared<OsmChange>(osmobjects::remove, arena);
+                changes.push_back(change);
+                continue;
+            case element_t::node:
+                if (!change) {
+                    continue;
+                }
+                change->obj = change->newNode();
+                change->obj->action = change->action;
+                break;
+            case element_t::way:
+                if (!change) {
+                    continue;
+                }
+                change->obj = change->newWay();
+                change->obj->action = change->action;
+                break;
+            case element_t::relation:
+                if (!change) {
+                    continue;
+                }
+                change->obj = change->newRelation();
+                change->obj->action = change->action;
+                break;
+            case element_t::tag: {
+                if (!change || !change->obj) {
+                    continue;
+                }
+                std::string_view key;
+                std::string_view value;
+                for (int i = 0; i < element.count; i++) {
+                    auto &attr = element.attributes[i];
+                    if (attr.name == "k") {
+                        key = OsmChangeReader::unescape(attr, keybuf);
+                    } else if (attr.name == "v") {
+                        value = OsmChangeReader::unescape(attr, valbuf);
+                    }
+                }
+                change->obj->addTag(key, value);
+                continue;
+            }
+            case element_t::nd:
+                if (!change) {
+                    continue;
+                }
+                for (int i = 0; i < element.count; i++) {
+                    if (element.attributes[i].name == "ref") {
+                        change->addRef(OsmChangeReader::toLong(element.attributes[i].value));
+                    }
+                }
+                continue;
+            case element_t::member: {
+                if (!change) {
+                    continue;
+                }
+                long ref = -1;
+                osmobjects::osmtype_t type = osmobjects::osmtype_t::empty;
+                std::string_view role;
+                for (int i = 0; i < element.count; i++) {
+                    auto &attr = element.attributes[i];
+                    if (attr.name == "type") {
+                        if (attr.value == "way") {
+                            type = osmobjects::osmtype_t::way;
+                        } else if (attr.value == "node") {
+                            type = osmobjects::osmtype_t::node;
+                        } else if (attr.value == "relation") {
+                            type = osmobjects::osmtype_t::relation;
+                        } else {
+                            log_debug("Invalid relation type '%1%'!", attr.value);
+                        }
+                    } else if (attr.name == "ref") {
+                        ref = OsmChangeReader::toLong(attr.value);
+                    } else if (attr.name == "role") {
+                        role = OsmChangeReader::unescape(attr, valbuf);
+                    }
+                }
+                if (ref != -1 && type != osmobjects::osmtype_t::empty) {
+                    change->addMember(ref, type, std::string(role));
+                } else {
+                    log_debug("Invalid relation (ref: %1%, type: %2%, role: %3%",
+                              ref, type, role);
+                }
+                continue;
+            }
+            default:
+                continue;
+        }
+
+        // Process the attributes of a node, way, or relation
+        auto obj = change->obj.get();
+        bool lat = false;
+        bool lon = false;
+        for (int i = 0; i < element.count; i++) {
+            auto &attr = element.attributes[i];
+            auto &name = attr.name;
+            if (name.empty()) {
+                continue;
+            }
+            switch (name[0]) {
+                case 'i':
+                    if (name == "id") {
+                        obj->id = OsmChangeReader::toLong(attr.value);
+                    }
+                    break;
+                case 'u':
+                    if (name == "uid") {
+                        obj->uid = OsmChangeReader::toLong(attr.value);
+                    } else if (name == "user") {
+                        obj->user = OsmChangeReader::unescape(attr, valbuf);
+                    }
+                    break;
+                case 'v':
+                    if (name == "version") {
+                        obj->version = OsmChangeReader::toLong(attr.value);
+                    }
+                    break;
+                case 'c':
+                    if (name == "changeset") {
+                        obj->changeset = OsmChangeReader::toLong(attr.value);
+                    }
+                    break;
+                case 't':
+                    if (name == "timestamp") {
+                        obj->timestamp = OsmChangeReader::toTimestamp(attr.value);
+                        change->final_entry = obj->timestamp;
+                    }
+                    break;
+                case 'l':
+                    if (name == "lat") {
+                        static_cast<OsmNode *>(obj)->setLatitude(OsmChangeReader::toDouble(attr.value));
+                        lat = true;
+                    } else if (name == "lon") {
+                        static_cast<OsmNode *>(obj)->setLongitude(OsmChangeReader::toDouble(attr.value));
+                        lon = true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+        // A deleted node may not have a location
+        if (element.type == element_t::node && lat && lon) {
+            nodecache.insert(obj->id, static_cast<OsmNode *>(obj)->point);
+        }
+    }
+    return true;
+}
+
 #ifdef LIBXML
 // Called by libxml++ for each element of the XML file
 void
@@ -543,15 +746,15 @@ OsmChangeFile::on_start_element(const Glib::ustring &name,
     // There are 3 change states to handle, each one contains possibly multiple
     // nodes and ways.
     if (name == "create") {
-        change = std::make_shared<OsmChange>(osmobjects::create);
+        change = std::make_shared<OsmChange>(osmobjects::create, arena);
         changes.push_back(change);
         return;
     } else if (name == "modify") {
-        change = std::make_shared<OsmChange>(osmobjects::modify);
+        change = std::make_shared<OsmChange>(osmobjects::modify, arena);
         changes.push_back(change);
         return;
     } else if (name == "delete") {
-        change = std::make_shared<OsmChange>(osmobjects::remove);
+        change = std::make_shared<OsmChange>(osmobjects::remove, arena);
         changes.push_back(change);
         return;
     } else {
@@ -566,7 +769,7 @@ OsmChangeFile::on_start_element(const Glib::ustring &name,
     } else if (name == "tag") {
         // A tag element has only has 1 attribute, and numbers are stored as
         // strings
-        change->obj->tags[attributes[0].value] = attributes[1].value;
+        change->obj->addTag(attributes[0].value.raw(), attributes[1].value.raw());
         return;
     } else if (name == "way") {
         change->obj.reset();
@@ -651,11 +854,11 @@ OsmChangeFile::on_start_element(const Glib::ustring &name,
         } else if (attr_pair.name == "lat") {
             auto lat = reinterpret_cast<OsmNode *>(change->obj.get());
             lat->setLatitude(std::stod(attr_pair.value));
-            nodecache[lat->id] = lat->point;
+            nodecache.insert(lat->id, lat->point);
         } else if (attr_pair.name == "lon") {
             auto lon = reinterpret_cast<OsmNode *>(change->obj.get());
             lon->setLongitude(std::stod(attr_pair.value));
-            nodecache[lon->id] = lon->point;
+            nodecache.insert(lon->id, lon->point);
         }
     }
 }
@@ -717,16 +920,19 @@ OsmChangeFile::dump(void)
         }
     }
 #if 0
-    std::cerr << "\tDumping nodecache:" << std::endl;
-    for (auto it = std::begin(nodecache); it != std::end(nodecache); ++it) {
-        std::cerr << "\t\t: " << it->first << ": " << bg::wkt(it->second) << std::endl;
-    }
+    std::cerr << "\tNodes in nodecache: " << nodecache.size() << std::endl;
 #endif
 }
 
 
 void
 OsmChangeFile::areaFilter(const multipolygon_t &poly)
+{
+    areaFilter(geoutil::BoundaryIndex(poly));
+}
+
+void
+OsmChangeFile::areaFilter(const geoutil::BoundaryIndex &boundary)
 {
 #ifdef TIMING_DEBUG_X
     boost::timer::auto_cpu_timer timer("OsmChangeFile::areaFilter: took %w seconds\n");
@@ -740,10 +946,10 @@ OsmChangeFile::areaFilter(const multipolygon_t &poly)
         // Filter nodes
         for (auto nit = std::begin(change->nodes); nit != std::end(change->nodes); ++nit) {
             OsmNode *node = nit->get();
-            if (poly.empty() || bg::within(node->point, poly)) {
+            if (boundary.empty() || boundary.within(node->point)) {
                 node->priority = true;
-                nodecache[node->id] = node->point;
-            } else if (!bg::within(node->point, poly)) {
+                nodecache.insert(node->id, node->point);
+            } else {
                 node->priority = false;
             }
         }
@@ -751,12 +957,13 @@ OsmChangeFile::areaFilter(const multipolygon_t &poly)
         // Filter ways
         for (auto wit = std::begin(change->ways); wit != std::end(change->ways); ++wit) {
             OsmWay *way = wit->get();
-            if (poly.empty()) {
+            if (boundary.empty()) {
                 way->priority = true;
             } else {
                 way->priority = false;
                 for (auto rit = std::begin(way->refs); rit != std::end(way->refs); ++rit) {
-                    if (nodecache.count(*rit) && bg::within(nodecache[*rit], poly)) {
+                    point_t point;
+                    if (nodecache.find(*rit, point) && boundary.within(point)) {
                         way->priority = true;
                         break;
                     }
@@ -771,7 +978,7 @@ OsmChangeFile::areaFilter(const multipolygon_t &poly)
         // Filter relations
         for (auto rit = std::begin(change->relations); rit != std::end(change->relations); ++rit) {
             OsmRelation *relation = rit->get();
-            if (poly.empty()) {
+            if (boundary.empty()) {
                 relation->priority = true;
             } else {
                 relation->priority = false;
@@ -797,6 +1004,9 @@ OsmChangeFile::collectStats(const multipolygon_t &poly)
     auto mstats =
         std::make_shared<std::map<long, std::shared_ptr<ChangeStats>>>();
         std::shared_ptr<ChangeStats> ostats;
+    // The categories are compiled once, and the hits reuse their memory
+    auto classifier = statsconfig::StatsConfig::getClassifier();
+    std::vector<std::string> hits;
 
     for (auto it = std::begin(changes); it != std::end(changes); ++it) {
         OsmChange *change = it->get();
@@ -809,7 +1019,7 @@ OsmChangeFile::collectStats(const multipolygon_t &poly)
             // Some older nodes in a way wound up with this one tag, which nobody noticed,
             // so ignore it.
             if (node->tags.size() == 1 &&
-                node->tags.find("created_at") != node->tags.end()) {
+                node->tags.count(keys::created_at)) {
                 continue;
             }
             ostats = (*mstats)[node->changeset];
@@ -821,8 +1031,8 @@ OsmChangeFile::collectStats(const multipolygon_t &poly)
                 ostats->closed_at = node->timestamp;
                 (*mstats)[node->changeset] = ostats;
             }
-            auto hits = scanTags(node->tags, osmchange::node);
-            for (auto hit = std::begin(*hits); hit != std::end(*hits); ++hit) {
+            scanTags(node->tags, osmchange::node, *classifier, hits);
+            for (auto hit = std::begin(hits); hit != std::end(hits); ++hit) {
                 if (node->action == osmobjects::create) {
                     ostats->added[*hit]++;
                 } else if (node->action == osmobjects::modify) {
@@ -847,7 +1057,7 @@ OsmChangeFile::collectStats(const multipolygon_t &poly)
 
             // Some older ways in a way wound up with this one tag, which nobody noticed,
             // so ignore it.
-            if (way->tags.size() == 1 && way->tags.find("created_at") != way->tags.end()) {
+            if (way->tags.size() == 1 && way->tags.count(keys::created_at)) {
                 continue;
             }
             ostats = (*mstats)[way->changeset];
@@ -860,8 +1070,8 @@ OsmChangeFile::collectStats(const multipolygon_t &poly)
                 (*mstats)[way->changeset] = ostats;
             }
 
-            auto hits = scanTags(way->tags, osmchange::way);
-            for (auto hit = std::begin(*hits); hit != std::end(*hits); ++hit) {
+            scanTags(way->tags, osmchange::way, *classifier, hits);
+            for (auto hit = std::begin(hits); hit != std::end(hits); ++hit) {
 
                 if (way->action == osmobjects::create) {
                     ostats->added[*hit]++;
@@ -874,11 +1084,15 @@ OsmChangeFile::collectStats(const multipolygon_t &poly)
                     // Get the geometry behind each reference
                     bg::model::linestring<sphere_t> globe;
                     for (auto lit = std::begin(way->refs); lit != std::end(way->refs); ++lit) {
-                        double x = nodecache[*lit].get<0>();
-                        double y = nodecache[*lit].get<1>();
+                        point_t point;
+                        if (!nodecache.find(*lit, point)) {
+                            continue;
+                        }
+                        double x = point.get<0>();
+                        double y = point.get<1>();
                         if (x != 0 && y != 0) {
                             globe.push_back(sphere_t(x,y));
-                            bg::append(way->linestring, nodecache[*lit]);
+                            bg::append(way->linestring, point);
                         }
                     }
                     std::string tag;
@@ -915,8 +1129,8 @@ OsmChangeFile::collectStats(const multipolygon_t &poly)
                 ostats->closed_at = relation->timestamp;
                 (*mstats)[relation->changeset] = ostats;
             }
-            auto hits = scanTags(relation->tags, osmchange::relation);
-            for (auto hit = std::begin(*hits); hit != std::end(*hits); ++hit) {
+            scanTags(relation->tags, osmchange::relation, *classifier, hits);
+            for (auto hit = std::begin(hits); hit != std::end(hits); ++hit) {
                 if (relation->action == osmobjects::create) {
                     ostats->added[*hit]++;
                 } else if (relation->action == osmobjects::modify) {
@@ -928,28 +1142,12 @@ OsmChangeFile::collectStats(const multipolygon_t &poly)
     return mstats;
 }
 
-std::shared_ptr<std::vector<std::string>>
-OsmChangeFile::scanTags(std::map<std::string, std::string> tags, osmchange::osmtype_t type)
+void
+OsmChangeFile::scanTags(const osmobjects::TagList &tags, osmchange::osmtype_t type,
+                        const statsconfig::StatsClassifier &classifier, std::vector<std::string> &hits)
 {
-    auto statsconfig = statsconfig::StatsConfig();
-    auto hits = std::make_shared<std::vector<std::string>>();
-    for (auto it = std::begin(tags); it != std::end(tags); ++it) {
-        if (!it->second.empty()) {
-            std::string hit = "";
-            if (type == node) {
-                hit = statsconfig.search(it->first, it->second, node);
-            } else if (type == way) {
-                hit = statsconfig.search(it->first, it->second, way);
-            } else if (type == relation) {
-                hit = statsconfig.search(it->first, it->second, relation);
-            }
-            if (!hit.empty()) {
-                hits->push_back(hit);
-            }
-        }
-    }
-
-    return hits;
+    hits.clear();
+    classifier.scan(tags, type, hits);
 }
 
 /// Dump internal data to the terminal, only for debugging
@@ -974,13 +1172,19 @@ ChangeStats::dump(void)
 };
 
 std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>>
-OsmChangeFile::validateNodes(const multipolygon_t &poly, std::shared_ptr<Validate> &plugin)
+OsmChangeFile::validateNodes(const multipolygon_t &poly, std::shared_ptr<Validate> &plugin,
+                             boost::asio::thread_pool *pool)
 {
 #ifdef TIMING_DEBUG_X
     boost::timer::auto_cpu_timer timer("OsmChangeFile::validateNodes: took %w seconds\n");
 #endif
-    auto totals =
-        std::make_shared<std::vector<std::shared_ptr<ValidateStatus>>>();
+    // A node is checked for each of these keys it has, so the nodes are
+    // validated in a batch for each key, and the results put back in the
+    // order of the nodes
+    std::vector<const TagKey *> node_tests = {&keys::building, &keys::natural, &keys::place, &keys::waterway};
+    std::vector<std::vector<const OsmNode *>> batches(node_tests.size());
+    std::vector<std::vector<std::size_t>> slots(node_tests.size());
+    std::size_t total = 0;
     for (auto it = std::begin(changes); it != std::end(changes); ++it) {
         OsmChange *change = it->get();
         for (auto nit = std::begin(change->nodes);
@@ -989,25 +1193,37 @@ OsmChangeFile::validateNodes(const multipolygon_t &poly, std::shared_ptr<Validat
             if (!node->priority || node->tags.empty() || node->action == osmobjects::remove) {
                 continue;
             }
-            std::vector<std::string> node_tests = {"building", "natural", "place", "waterway"};
-            for (auto test_it = std::begin(node_tests); test_it != std::end(node_tests); ++test_it) {
-                if (node->containsKey(*test_it)) {
-                    auto status = plugin->checkNode(*node, *test_it);
-                    totals->push_back(status);
+            for (std::size_t i = 0; i < node_tests.size(); i++) {
+                if (node->containsKey(*node_tests[i])) {
+                    batches[i].push_back(node);
+                    slots[i].push_back(total++);
                 }
             }
         }
     }
+    auto totals =
+        std::make_shared<std::vector<std::shared_ptr<ValidateStatus>>>(total);
+    std::vector<std::shared_ptr<ValidateStatus>> results;
+    for (std::size_t i = 0; i < node_tests.size(); i++) {
+        if (batches[i].empty()) {
+            continue;
+        }
+        plugin->checkNodes(batches[i], node_tests[i]->name, results, pool);
+        for (std::size_t j = 0; j < results.size(); j++) {
+            (*totals)[slots[i][j]] = std::move(results[j]);
+        }
+    }
     return totals;
 }
 
 std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>>
-OsmChangeFile::validateWays(const multipolygon_t &poly, std::shared_ptr<Validate> &plugin)
+OsmChangeFile::validateWays(const multipolygon_t &poly, std::shared_ptr<Validate> &plugin,
+                            boost::asio::thread_pool *pool)
 {
 #ifdef TIMING_DEBUG_X
     boost::timer::auto_cpu_timer timer("OsmChangeFile::validateWays: took %w seconds\n");
 #endif
-    auto totals = std::make_shared<std::vector<std::shared_ptr<ValidateStatus>>>();
+    std::vector<const OsmWay *> ways;
     for (auto it = std::begin(changes); it != std::end(changes); ++it) {
         OsmChange *change = it->get();
         for (auto nit = std::begin(change->ways); nit != std::end(change->ways); ++nit) {
@@ -1015,10 +1231,11 @@ OsmChangeFile::validateWays(const multipolygon_t &poly, std::shared_ptr<Validate
             if (!way->priority) {
                 continue;
             }
-            auto status = plugin->checkWay(*way, "building");
-            totals->push_back(status);
+            ways.push_back(way);
         }
     }
+    auto totals = std::make_shared<std::vector<std::shared_ptr<ValidateStatus>>>();
+    plugin->checkWays(ways, "building", *totals, pool);
     return totals;
 }
 
@@ -50,10 +50,17 @@ using namespace boost::gregorian;
 #define BOOST_BIND_GLOBAL_PLACEHOLDERS 1
 
 #include "validate/validate.hh"
+#include "osm/objectarena.hh"
+#include "osm/nodecache.hh"
 #include "osm/osmobjects.hh"
 #include "osm/osmchange.hh"
+#include "utils/boundaryindex.hh"
 #include <ogr_geometry.h>
 
+namespace statsconfig {
+class StatsClassifier;
+} // namespace statsconfig
+
 /// \namespace osmchange
 namespace osmchange {
 
@@ -88,6 +95,9 @@ class ChangeStats {
 class OsmChange {
   public:
     OsmChange(osmobjects::action_t act) { action = act; };
+    /// Objects created by this change are stored in \a store
+    OsmChange(osmobjects::action_t act, std::shared_ptr<osmobjects::ObjectArena> store)
+        : action(act), arena(std::move(store)) {};
 
     ///< dump internal data, for debugging only
     void dump(void);
@@ -187,7 +197,7 @@ class OsmChange {
     /// Instantiate a new node
     std::shared_ptr<osmobjects::OsmNode> newNode(void)
     {
-        auto tmp = std::make_shared<osmobjects::OsmNode>();
+        auto tmp = newObject<osmobjects::OsmNode>();
         type = node;
         nodes.push_back(tmp);
         return tmp;
@@ -195,8 +205,7 @@ class OsmChange {
     /// Instantiate a new way
     std::shared_ptr<osmobjects::OsmWay> newWay(void)
     {
-        std::shared_ptr<osmobjects::OsmWay> tmp =
-            std::make_shared<osmobjects::OsmWay>();
+        auto tmp = newObject<osmobjects::OsmWay>();
         type = way;
         ways.push_back(tmp);
         return tmp;
@@ -204,20 +213,29 @@ class OsmChange {
     /// Instantiate a new relation
     std::shared_ptr<osmobjects::OsmRelation> newRelation(void)
     {
-        std::shared_ptr<osmobjects::OsmRelation> tmp =
-            std::make_shared<osmobjects::OsmRelation>();
+        auto tmp = newObject<osmobjects::OsmRelation>();
         type = relation;
         relations.push_back(tmp);
         return tmp;
     };
+    /// Create an object in the arena, if this change has one
+    template <typename T>
+    std::shared_ptr<T> newObject(void)
+    {
+        if (arena) {
+            return arena->make<T>();
+        }
+        return std::make_shared<T>();
+    };
 
     ptime final_entry;    ///< The timestamp of the last change in the file
     osmobjects::action_t action = osmobjects::none; ///< The change action
     osmtype_t type;                                 ///< The OSM object type
-    std::list<std::shared_ptr<osmobjects::OsmNode>> nodes; ///< The nodes in this change
-    std::list<std::shared_ptr<osmobjects::OsmWay>> ways; ///< The ways in this change
-    std::list<std::shared_ptr<osmobjects::OsmRelation>> relations; ///< The relations in this change
+    std::vector<std::shared_ptr<osmobjects::OsmNode>> nodes; ///< The nodes in this change
+    std::vector<std::shared_ptr<osmobjects::OsmWay>> ways; ///< The ways in this change
+    std::vector<std::shared_ptr<osmobjects::OsmRelation>> relations; ///< The relations in this change
     std::shared_ptr<osmobjects::OsmObject> obj;
+    std::shared_ptr<osmobjects::ObjectArena> arena; ///< Where new objects are stored
 };
 
 /// \class OsmChangeFile
@@ -242,8 +260,15 @@ class OsmChangeFile
     /// Read a changeset file from disk or memory into internal storage
     bool readChanges(const std::string &osc);
 
+    /// Read a downloaded file from memory. If it's compressed, it's
+    /// decompressed as it's parsed, so the uncompressed XML is never
+    /// in memory all at once.
+    bool readChanges(const std::vector<unsigned char> &buffer);
+
     /// Delete any data not in the boundary polygon
     void areaFilter(const multipolygon_t &poly);
+    /// Delete any data not in the prepared boundary
+    void areaFilter(const geoutil::BoundaryIndex &boundary);
 
     void buildGeometriesFromNodeCache();
     void buildRelationGeometry(osmobjects::OsmRelation &relation);
@@ -257,29 +282,40 @@ class OsmChangeFile
     /// Read an istream of the data and parse the XML
     bool readXML(std::istream &xml);
 
+    /// Parse the XML with the built-in pull parser, which is used by
+    /// readXML() when built with --enable-parser=pull
+    bool readPull(std::istream &xml);
+
     std::map<long, std::shared_ptr<ChangeStats>> userstats; ///< User statistics for this file
 
     std::list<std::shared_ptr<OsmChange>> changes;      ///< All the changes in this file
 
-    std::map<double, point_t> nodecache;                ///< Cache nodes across multiple changesets
+    NodeCache nodecache;                                ///< Cache nodes across multiple changesets
     
     std::map<long, std::shared_ptr<osmobjects::OsmWay>> waycache; ///< Cache ways across multiple changesets
 
+    /// All the objects parsed from this file are stored here, and the
+    /// memory is released in one go when the file is done with.
+    std::shared_ptr<osmobjects::ObjectArena> arena = osmobjects::ObjectArena::create();
+
     /// Collect statistics for each user
     std::shared_ptr<std::map<long, std::shared_ptr<ChangeStats>>>
     collectStats(const multipolygon_t &poly);
 
-    /// Validate multiple nodes
+    /// Validate multiple nodes, in parallel on the \a pool if there is one
     std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>>
-    validateNodes(const multipolygon_t &poly, std::shared_ptr<Validate> &plugin);
+    validateNodes(const multipolygon_t &poly, std::shared_ptr<Validate> &plugin,
+                  boost::asio::thread_pool *pool = nullptr);
 
-    /// Validate multi ways
+    /// Validate multi ways, in parallel on the \a pool if there is one
     std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>>
-    validateWays(const multipolygon_t &poly, std::shared_ptr<Validate> &plugin);
+    validateWays(const multipolygon_t &poly, std::shared_ptr<Validate> &plugin,
+                 boost::asio::thread_pool *pool = nullptr);
 
-    /// Scan tags for the proper values
-    std::shared_ptr<std::vector<std::string>>
-    scanTags(std::map<std::string, std::string> tags, osmchange::osmtype_t type);
+    /// Scan tags for the proper values, replacing the contents of \a hits
+    void
+    scanTags(const osmobjects::TagList &tags, osmchange::osmtype_t type,
+             const statsconfig::StatsClassifier &classifier, std::vector<std::string> &hits);
 
 //    std::map<long, bool> priority;
     /// dump internal data, for debugging only
@@ -0,0 +1,376 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file osmchangereader.cc
+/// \brief A minimal pull parser for OsmChange files
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "osm/osmchangereader.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+
+namespace osmchange {
+
+OsmChangeReader::OsmChangeReader(std::istream &in, std::size_t chunk)
+    : input(in)
+{
+    buffer.resize(chunk);
+}
+
+// Move the unprocessed data to the front of the buffer, and read more
+bool
+OsmChangeReader::fill(std::size_t keep)
+{
+    if (eof) {
+        return false;
+    }
+    std::size_t remaining = len - keep;
+    if (keep > 0 && remaining > 0) {
+        std::memmove(buffer.data(), buffer.data() + keep, remaining);
+    }
+    len = remaining;
+    pos = 0;
+    // A single element is bigger than the buffer
+    if (len == buffer.size()) {
+        buffer.resize(buffer.size() * 2);
+    }
+    input.read(buffer.data() + len, buffer.size() - len);
+    auto got = input.gcount();
+    if (got <= 0) {
+        eof = true;
+        return false;
+    }
+    len += got;
+    return true;
+}
+
+bool
+OsmChangeReader::next(Element &element)
+{
+    while (true) {
+        const char *data = buffer.data();
+        const char *end = data + len;
+        const char *lt = static_cast<const char *>(std::memchr(data + pos, '<', len - pos));
+        if (lt == nullptr) {
+            // Only text left in the buffer, which is ignored
+            pos = len;
+            if (!fill(len)) {
+                return false;
+            }
+            continue;
+        }
+
+        // Find the end of the element. Comments are the only thing
+        // that may contain a '>' outside of quotes.
+        const char *gt = nullptr;
+        bool incomplete = false;
+        if (lt + 1 < end && lt[1] == '!') {
+            if (end - lt < 4) {
+                incomplete = true;
+            } else if (std::memcmp(lt, "<!--", 4) == 0) {
+                std::string_view rest(lt + 4, end - lt - 4);
+                auto found = rest.find("-->");
+                if (found == std::string_view::npos) {
+                    incomplete = true;
+                } else {
+                    gt = lt + 4 + found + 2;
+                }
+            }
+        }
+        if (!incomplete && gt == nullptr) {
+            char quote = 0;
+            for (const char *p = lt + 1; p < end; p++) {
+                if (quote) {
+                    if (*p == quote) {
+                        quote = 0;
+                    }
+                } else if (*p == '"' || *p == '\'') {
+                    quote = *p;
+                } else if (*p == '>') {
+                    gt = p;
+                    break;
+                }
+            }
+            incomplete = (gt == nullptr);
+        }
+        if (incomplete) {
+            if (!fill(lt - data)) {
+                return false;
+            }
+            continue;
+        }
+
+        pos = gt + 1 - data;
+        // Skip end tags, comments, and the XML declaration
+        char c = lt[1];
+        if (c == '/' || c == '?' || c == '!') {
+            continue;
+        }
+        parse(lt + 1, gt, element);
+        return true;
+    }
+}
+
+// Parse the name and attributes of an element, start is just after
+// the '<', and end is the '>'.
+void
+OsmChangeReader::parse(const char *start, const char *end, Element &element)
+{
+    if (end > start && end[-1] == '/') {
+        end--;
+    }
+
+    const char *p = start;
+    while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+        p++;
+    }
+    element.name = std::string_view(start, p - start);
+
+    // Dispatch on the length first, so most names need only one compare
+    auto &name = element.name;
+    element.type = element_t::unknown;
+    switch (name.size()) {
+        case 2:
+            if (name == "nd") {
+                element.type = element_t::nd;
+            }
+            break;
+        case 3:
+            if (name == "tag") {
+                element.type = element_t::tag;
+            } else if (name == "way") {
+                element.type = element_t::way;
+            }
+            break;
+        case 4:
+            if (name == "node") {
+                element.type = element_t::node;
+            }
+            break;
+        case 6:
+            switch (name[0]) {
+                case 'c':
+                    if (name == "create") {
+                        element.type = element_t::create;
+                    }
+                    break;
+                case 'd':
+                    if (name == "delete") {
+                        element.type = element_t::remove;
+                    }
+                    break;
+                case 'm':
+                    if (name == "modify") {
+                        element.type = element_t::modify;
+                    } else if (name == "member") {
+                        element.type = element_t::member;
+                    }
+                    break;
+                default:
+                    break;
+            }
+            break;
+        case 8:
+            if (name == "relation") {
+                element.type = element_t::relation;
+            }
+            break;
+        case 9:
+            if (name == "osmChange") {
+                element.type = element_t::osmchange;
+            }
+            break;
+        default:
+            break;
+    }
+
+    // Attributes are name="value" pairs separated by whitespace
+    element.count = 0;
+    while (p < end && element.count < static_cast<int>(element.attributes.size())) {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+            p++;
+        }
+        if (p >= end) {
+            break;
+        }
+        const char *aname = p;
+        while (p < end && *p != '=' && *p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+            p++;
+        }
+        std::string_view attrname(aname, p - aname);
+        while (p < end && *p != '"' && *p != '\'') {
+            p++;
+        }
+        if (p >= end) {
+            break;
+        }
+        char quote = *p++;
+        const char *value = p;
+        const char *close = static_cast<const char *>(std::memchr(p, quote, end - p));
+        if (close == nullptr) {
+            break;
+        }
+        auto &attr = element.attributes[element.count++];
+        attr.name = attrname;
+        attr.value = std::string_view(value, close - value);
+        attr.escaped = false;
+        for (const char *c = value; c < close && !attr.escaped; c++) {
+            attr.escaped = *c == '&' || *c == '\n' || *c == '\r' || *c == '\t';
+        }
+        p = close + 1;
+    }
+    // The elements of an OsmChange file have at most 9 attributes, so
+    // the rest of a longer one is only logged
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) {
+        p++;
+    }
+    if (p < end && element.count == static_cast<int>(element.attributes.size())) {
+        log_error("Too many attributes in <%1%>, only the first %2% were read", element.name, element.count);
+    }
+}
+
+std::string_view
+OsmChangeReader::unescape(const Attribute &attr, std::string &buf)
+{
+    if (!attr.escaped) {
+        return attr.value;
+    }
+    buf.clear();
+    auto &value = attr.value;
+    for (std::size_t i = 0; i < value.size(); i++) {
+        // Like any XML parser, a line break or tab in a value is a space,
+        // unless it's written as a character reference
+        if (value[i] == '\r') {
+            buf += ' ';
+            if (i + 1 < value.size() && value[i + 1] == '\n') {
+                i++;
+            }
+            continue;
+        }
+        if (value[i] == '\n' || value[i] == '\t') {
+            buf += ' ';
+            continue;
+        }
+        if (value[i] != '&') {
+            buf += value[i];
+            continue;
+        }
+        auto semi = value.find(';', i);
+        if (semi == std::string_view::npos) {
+            buf += value[i];
+            continue;
+        }
+        auto entity = value.substr(i + 1, semi - i - 1);
+        if (entity == "amp") {
+            buf += '&';
+        } else if (entity == "lt") {
+            buf += '<';
+        } else if (entity == "gt") {
+            buf += '>';
+        } else if (entity == "quot") {
+            buf += '"';
+        } else if (entity == "apos") {
+            buf += '\'';
+        } else if (entity.size() > 1 && entity[0] == '#') {
+            // A numeric character reference, written out as UTF-8
+            unsigned long code = 0;
+            if (entity[1] == 'x' || entity[1] == 'X') {
+                std::from_chars(entity.data() + 2, entity.data() + entity.size(), code, 16);
+            } else {
+                std::from_chars(entity.data() + 1, entity.data() + entity.size(), code, 10);
+            }
+            if (code < 0x80) {
+                buf += static_cast<char>(code);
+            } else if (code < 0x800) {
+                buf += static_cast<char>(0xc0 | (code >> 6));
+                buf += static_cast<char>(0x80 | (code & 0x3f));
+            } else if (code < 0x10000) {
+                buf += static_cast<char>(0xe0 | (code >> 12));
+                buf += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                buf += static_cast<char>(0x80 | (code & 0x3f));
+            } else {
+                buf += static_cast<char>(0xf0 | (code >> 18));
+                buf += static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+                buf += static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+                buf += static_cast<char>(0x80 | (code & 0x3f));
+            }
+        } else {
+            // Not an entity we know, so leave it alone
+            buf.append(value.data() + i, semi - i + 1);
+        }
+        i = semi;
+    }
+    return buf;
+}
+
+long
+OsmChangeReader::toLong(std::string_view value)
+{
+    long result = 0;
+    std::from_chars(value.data(), value.data() + value.size(), result);
+    return result;
+}
+
+double
+OsmChangeReader::toDouble(std::string_view value)
+{
+    // The value is always followed by the closing quote in the buffer,
+    // so strtod stops there without needing a terminated copy.
+    return std::strtod(value.data(), nullptr);
+}
+
+ptime
+OsmChangeReader::toTimestamp(std::string_view value)
+{
+    // 2020-10-30T20:15:24Z
+    if (value.size() < 19) {
+        return not_a_date_time;
+    }
+    auto num = [&value](int offset, int digits) {
+        int result = 0;
+        for (int i = offset; i < offset + digits; i++) {
+            result = result * 10 + (value[i] - '0');
+        }
+        return result;
+    };
+    try {
+        return ptime(date(num(0, 4), num(5, 2), num(8, 2)),
+                     hours(num(11, 2)) + minutes(num(14, 2)) + seconds(num(17, 2)));
+    } catch (std::exception &e) {
+        return not_a_date_time;
+    }
+}
+
+} // namespace osmchange
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,129 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __OSMCHANGEREADER_HH__
+#define __OSMCHANGEREADER_HH__
+
+/// \file osmchangereader.hh
+/// \brief A minimal pull parser for OsmChange files
+///
+/// OsmChange files only use a small subset of XML, so instead of a
+/// general purpose parser this scans the data in place. Element names
+/// are turned into an enum, and attribute names and values are handed
+/// out as string_views into the buffer, so nothing is copied until
+/// the data is stored in an OSM object.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <array>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "boost/date_time/posix_time/posix_time.hpp"
+using namespace boost::posix_time;
+using namespace boost::gregorian;
+
+/// \namespace osmchange
+namespace osmchange {
+
+/// \enum element_t
+/// The elements used in an OsmChange file. This is scoped, since the
+/// names overlap with osmtype_t.
+enum class element_t {
+    unknown,
+    osmchange,
+    create,
+    modify,
+    remove,
+    node,
+    way,
+    relation,
+    tag,
+    nd,
+    member
+};
+
+/// \struct Attribute
+/// \brief An attribute of an element, which points into the reader's buffer
+struct Attribute {
+    std::string_view name;
+    std::string_view value;
+    bool escaped = false;     ///< The value contains XML entities, or whitespace that becomes a space
+};
+
+/// \struct Element
+/// \brief The start of an element, only valid until the next one is read
+struct Element {
+    element_t type = element_t::unknown;
+    std::string_view name;
+    std::array<Attribute, 16> attributes;
+    int count = 0;            ///< The number of attributes
+};
+
+/// \class OsmChangeReader
+/// \brief Read the start elements of an OsmChange file
+///
+/// The input is read in chunks, and only the start of each element is
+/// returned, since that's where all the data is in an OsmChange
+/// file. End tags, comments, and text are skipped.
+class OsmChangeReader {
+  public:
+    OsmChangeReader(std::istream &in, std::size_t chunk = 64 * 1024);
+
+    /// Read the next start element, returns false at the end of the data
+    bool next(Element &element);
+
+    /// Decode the XML entities in an attribute value, and turn line
+    /// breaks and tabs into spaces. If there are none, the view is
+    /// returned, otherwise the decoded value is put in \a buf.
+    static std::string_view unescape(const Attribute &attr, std::string &buf);
+
+    /// Convert a number in an attribute to a long
+    static long toLong(std::string_view value);
+    /// Convert a number in an attribute to a double
+    static double toDouble(std::string_view value);
+    /// Convert an OSM timestamp, like 2020-10-30T20:15:24Z
+    static ptime toTimestamp(std::string_view value);
+
+  private:
+    /// Read more data into the buffer, keeping anything after \a keep
+    bool fill(std::size_t keep);
+    /// Parse the element starting at start, ending at end
+    void parse(const char *start, const char *end, Element &element);
+
+    std::istream &input;
+    std::vector<char> buffer;
+    std::size_t pos = 0;      ///< The current position in the buffer
+    std::size_t len = 0;      ///< The amount of data in the buffer
+    bool eof = false;
+};
+
+} // namespace osmchange
+
+#endif // EOF __OSMCHANGEREADER_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -35,6 +35,7 @@ using namespace boost::posix_time;
 using namespace boost::gregorian;
 #define BOOST_BIND_GLOBAL_PLACEHOLDERS 1
 
+#include "osm/osmtags.hh"
 #include "utils/log.hh"
 using namespace logger;
 
@@ -70,8 +71,8 @@ typedef enum { empty, node, way, relation, member } osmtype_t;
 class OsmObject {
   public:
     /// Add a metadata tag to an OSM object
-    void addTag(const std::string &key, const std::string &value) {
-        tags[key] = value;
+    void addTag(std::string_view key, std::string_view value) {
+        tags.set(key, value);
     };
 
     void setAction(action_t act) { action = act; };
@@ -86,17 +87,20 @@ class OsmObject {
     long uid = 0;                            ///< The User ID of the mapper of this object
     std::string user;                        ///< The User name  of the mapper of this object
     long changeset = 0;                      ///< The changeset ID this object is contained in
-    std::map<std::string, std::string> tags; ///< OSM metadata tags
+    TagList tags;                            ///< OSM metadata tags
 
     bool priority = false; ///< Whether it's in the priority area
     /// Dump internal data to the terminal, only for debugging
     void dump(void) const;
-    std::string getTagValue(const std::string &key) { return tags[key] ; };
-    bool containsKey(const std::string &key) { return tags.count(key); };
-    bool containsValue(const std::string &key, const std::string &value)
+    std::string getTagValue(const std::string &key) const { return tags.get(key); };
+    bool containsKey(const std::string &key) const { return tags.count(key); };
+    /// The same for the keys used often, which only compares pointers
+    const std::string &getTagValue(const TagKey &key) const { return tags.get(key); };
+    bool containsKey(const TagKey &key) const { return tags.count(key); };
+    bool containsValue(const std::string &key, const std::string &value) const
     {
         std::string lower = boost::algorithm::to_lower_copy(value);
-        if (tags[key].size() == 0) {
+        if (tags.get(key).size() == 0) {
             return true;
         }
         for (auto it = tags.begin(); it != tags.end(); ++it) {
@@ -0,0 +1,272 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file osmtags.cc
+/// \brief Compact storage for the tags of an OSM object
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
+
+#include "osm/osmtags.hh"
+
+namespace osmobjects {
+
+namespace keys {
+const TagKey building("building");
+const TagKey highway("highway");
+const TagKey waterway("waterway");
+const TagKey natural("natural");
+const TagKey place("place");
+const TagKey created_at("created_at");
+} // namespace keys
+
+StringTable &
+StringTable::instance(void)
+{
+    static StringTable table;
+    return table;
+}
+
+const std::string *
+StringTable::intern(std::string_view str)
+{
+    if (str.size() > max_length) {
+        return nullptr;
+    }
+    {
+        std::shared_lock lock{mutex};
+        auto found = index.find(str);
+        if (found != index.end()) {
+            return found->second;
+        }
+    }
+    std::unique_lock lock{mutex};
+    // Another thread may have added it while unlocked
+    auto found = index.find(str);
+    if (found != index.end()) {
+        return found->second;
+    }
+    if (strings.size() >= max_strings) {
+        return nullptr;
+    }
+    const std::string &stored = strings.emplace_back(str);
+    index.emplace(std::string_view(stored), &stored);
+    bytes += sizeof(std::string) + stored.capacity() + sizeof(std::string_view) * 2 + 16;
+    return &stored;
+}
+
+const std::string *
+StringTable::find(std::string_view str) const
+{
+    std::shared_lock lock{mutex};
+    auto found = index.find(str);
+    if (found != index.end()) {
+        return found->second;
+    }
+    return nullptr;
+}
+
+std::size_t
+StringTable::size(void) const
+{
+    std::shared_lock lock{mutex};
+    return strings.size();
+}
+
+std::size_t
+StringTable::getBytes(void) const
+{
+    std::shared_lock lock{mutex};
+    return bytes;
+}
+
+TagList::TagList(const TagList &other)
+{
+    *this = other;
+}
+
+TagList &
+TagList::operator=(const TagList &other)
+{
+    if (this == &other) {
+        return *this;
+    }
+    clear();
+    entries.reserve(other.entries.size());
+    // The entries are already sorted, but any owned strings need a copy
+    for (auto it = std::begin(other.entries); it != std::end(other.entries); ++it) {
+        set(*it->key, *it->value);
+    }
+    return *this;
+}
+
+const std::string *
+TagList::own(std::string_view str)
+{
+    if (!owned) {
+        owned = std::make_unique<std::forward_list<std::string>>();
+    }
+    return &owned->emplace_front(str);
+}
+
+void
+TagList::release(const std::string *str)
+{
+    // Interned strings aren't in the list, so they're never removed
+    if (owned) {
+        owned->remove_if([str](const std::string &item) { return &item == str; });
+    }
+}
+
+void
+TagList::set(std::string_view key, std::string_view value)
+{
+    auto pos = std::lower_bound(std::begin(entries), std::end(entries), key,
+                                [](const Tag &tag, std::string_view k) {
+                                    return std::string_view(*tag.key) < k;
+                                });
+    auto &table = StringTable::instance();
+    const std::string *ival = nullptr;
+    if (value.size() <= max_value) {
+        ival = table.intern(value);
+    }
+    if (ival == nullptr) {
+        ival = own(value);
+    }
+    if (pos != std::end(entries) && *pos->key == key) {
+        // The old value would stay in the list until it's cleared
+        const std::string *old = pos->value;
+        pos->value = ival;
+        release(old);
+        return;
+    }
+    const std::string *ikey = table.intern(key);
+    if (ikey == nullptr) {
+        ikey = own(key);
+    }
+    entries.insert(pos, {ikey, ival});
+}
+
+std::size_t
+TagList::erase(std::string_view key)
+{
+    for (auto it = std::begin(entries); it != std::end(entries); ++it) {
+        if (*it->key == key) {
+            const std::string *oldkey = it->key;
+            const std::string *oldvalue = it->value;
+            entries.erase(it);
+            release(oldkey);
+            release(oldvalue);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+TagList::const_iterator
+TagList::find(std::string_view key) const
+{
+    // Objects rarely have more than a handful of tags, so a scan that
+    // checks the length first is faster than a binary search.
+    for (auto it = std::begin(entries); it != std::end(entries); ++it) {
+        if (it->key->size() == key.size() && *it->key == key) {
+            return it;
+        }
+    }
+    return end();
+}
+
+TagList::const_iterator
+TagList::find(const std::string *key) const
+{
+    for (auto it = std::begin(entries); it != std::end(entries); ++it) {
+        if (it->key == key) {
+            return it;
+        }
+    }
+    return end();
+}
+
+const std::string &
+TagList::get(std::string_view key) const
+{
+    static const std::string missing;
+    auto found = find(key);
+    if (found == end()) {
+        return missing;
+    }
+    return found->second;
+}
+
+const std::string &
+TagList::get(const TagKey &key) const
+{
+    static const std::string missing;
+    auto found = find(key);
+    if (found == end()) {
+        return missing;
+    }
+    return found->second;
+}
+
+const std::string &
+TagList::at(std::string_view key) const
+{
+    auto found = find(key);
+    if (found == end()) {
+        throw std::out_of_range("No tag " + std::string(key));
+    }
+    return found->second;
+}
+
+void
+TagList::clear(void)
+{
+    entries.clear();
+    owned.reset();
+}
+
+std::size_t
+TagList::getBytes(void) const
+{
+    std::size_t total = sizeof(TagList) + entries.capacity() * sizeof(Tag);
+    if (owned) {
+        total += sizeof(std::forward_list<std::string>);
+        for (auto it = std::begin(*owned); it != std::end(*owned); ++it) {
+            total += sizeof(void *) + sizeof(std::string);
+            if (it->capacity() > 15) {
+                total += it->capacity() + 1;
+            }
+        }
+    }
+    return total;
+}
+
+} // namespace osmobjects
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
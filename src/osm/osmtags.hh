@@ -0,0 +1,214 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __OSMTAGS_HH__
+#define __OSMTAGS_HH__
+
+/// \file osmtags.hh
+/// \brief Compact storage for the tags of an OSM object
+///
+/// The same few hundred keys, and many of the values, are used over
+/// and over by every object in a change file. Each distinct string is
+/// only stored once in a process wide table, and the tags of an object
+/// are a small sorted array of pointers into it. Comparing two
+/// interned strings is then just comparing the pointers.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <cstddef>
+#include <deque>
+#include <forward_list>
+#include <iterator>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+/// \namespace osmobjects
+namespace osmobjects {
+
+/// \class StringTable
+/// \brief A process wide table of interned strings
+///
+/// Strings are never removed, so the table has a limit on the number of
+/// strings, and the length of the values, so rare values like names and
+/// notes don't grow it forever in a long running replicator.
+class StringTable {
+  public:
+    /// There is only one table, shared by all threads
+    static StringTable &instance(void);
+
+    /// Get the single copy of a string, adding it if needed. Returns
+    /// nullptr if it's too long, or the table is full.
+    const std::string *intern(std::string_view str);
+    /// Get the single copy of a string, without adding it
+    const std::string *find(std::string_view str) const;
+
+    /// The number of strings in the table
+    std::size_t size(void) const;
+    /// The memory used by the strings and the index
+    std::size_t getBytes(void) const;
+
+    static const std::size_t max_strings = 1024 * 1024; ///< Limit on table size
+    static const std::size_t max_length = 255;          ///< Limit on string length
+
+  private:
+    StringTable(void) {};
+
+    mutable std::shared_mutex mutex;
+    std::deque<std::string> strings; ///< A deque never moves what's in it
+    std::unordered_map<std::string_view, const std::string *> index;
+    std::size_t bytes = 0;
+};
+
+/// \class TagKey
+/// \brief A key that's looked up in the tags of many objects
+///
+/// The key is interned once, so finding it in a TagList only compares
+/// the pointers. If it couldn't be interned, the strings are compared.
+class TagKey {
+  public:
+    explicit TagKey(std::string_view key)
+        : name(key), interned(StringTable::instance().intern(key)) {};
+
+    std::string name;           ///< The key
+    const std::string *interned; ///< The interned key, nullptr if it isn't
+};
+
+/// The keys looked up for every object by the statistics and the
+/// validation
+namespace keys {
+extern const TagKey building;
+extern const TagKey highway;
+extern const TagKey waterway;
+extern const TagKey natural;
+extern const TagKey place;
+extern const TagKey created_at;
+} // namespace keys
+
+/// \class TagList
+/// \brief The tags of an OSM object, sorted by key
+///
+/// This has the parts of the std::map API that are used on tags, but no
+/// operator[], so looking up a missing key never adds it. Keys are
+/// always interned, and values are if they are short, since those are
+/// the ones that repeat, like building=yes or highway=residential.
+/// Anything that can't be interned is owned by the list.
+class TagList {
+  public:
+    /// An entry in the list, both point to an interned or owned string
+    struct Tag {
+        const std::string *key;
+        const std::string *value;
+    };
+
+    /// Iterates over key and value pairs like a std::map
+    class const_iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<const std::string &, const std::string &>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        /// So it->first and it->second work
+        struct arrow {
+            value_type pair;
+            const value_type *operator->() const { return &pair; };
+        };
+
+        const_iterator(std::vector<Tag>::const_iterator pos) : it(pos) {};
+        reference operator*() const { return {*it->key, *it->value}; };
+        arrow operator->() const { return {**this}; };
+        const_iterator &operator++() { ++it; return *this; };
+        const_iterator operator++(int) { auto tmp = *this; ++it; return tmp; };
+        bool operator==(const const_iterator &other) const { return it == other.it; };
+        bool operator!=(const const_iterator &other) const { return it != other.it; };
+
+      private:
+        std::vector<Tag>::const_iterator it;
+    };
+    using iterator = const_iterator;
+
+    TagList(void) {};
+    TagList(const TagList &other);
+    TagList(TagList &&other) = default;
+    TagList &operator=(const TagList &other);
+    TagList &operator=(TagList &&other) = default;
+
+    /// Add a tag, or replace the value if the key is already set
+    void set(std::string_view key, std::string_view value);
+    /// Remove a tag, returns the number removed like std::map
+    std::size_t erase(std::string_view key);
+
+    /// Get the value of a tag, which is empty if the key isn't set
+    const std::string &get(std::string_view key) const;
+    /// Get the value of a tag, throwing std::out_of_range if it isn't set
+    const std::string &at(std::string_view key) const;
+    /// Returns 1 if the key is set, like std::map
+    std::size_t count(std::string_view key) const { return find(key) != end(); };
+    const_iterator find(std::string_view key) const;
+
+    /// Look up an interned key, which only compares the pointers
+    const_iterator find(const std::string *key) const;
+    std::size_t count(const std::string *key) const { return find(key) != end(); };
+    /// Look up a key that was interned once, for the keys used often
+    const_iterator find(const TagKey &key) const
+    {
+        return key.interned ? find(key.interned) : find(std::string_view(key.name));
+    };
+    std::size_t count(const TagKey &key) const { return find(key) != end(); };
+    /// Get the value of a tag, which is empty if the key isn't set
+    const std::string &get(const TagKey &key) const;
+
+    std::size_t size(void) const { return entries.size(); };
+    bool empty(void) const { return entries.empty(); };
+    void clear(void);
+    const_iterator begin(void) const { return entries.begin(); };
+    const_iterator end(void) const { return entries.end(); };
+
+    /// The memory used by this object, not counting the interned strings
+    std::size_t getBytes(void) const;
+
+    static const std::size_t max_value = 32; ///< Longer values are not interned
+
+  private:
+    /// Store a string that couldn't be interned
+    const std::string *own(std::string_view str);
+    /// Free a string that isn't used anymore, if it's owned by the list
+    void release(const std::string *str);
+
+    std::vector<Tag> entries;
+    std::unique_ptr<std::forward_list<std::string>> owned; ///< Usually not needed
+};
+
+} // namespace osmobjects
+
+#endif // EOF __OSMTAGS_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,293 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file nodelocations.cc
+/// \brief A memory mapped file of node locations
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "raw/nodelocations.hh"
+#include "osm/osmchange.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+
+namespace queryraw {
+
+/// The file grows in steps of this many slots, which is 128Mb
+static const std::size_t growth = 16 * 1024 * 1024;
+
+/// A deleted node, so a location read from the database before it was
+/// deleted can't be stored. It decodes to a longitude over 214 degrees.
+static const std::uint64_t removed = ~0ULL;
+
+NodeLocations::~NodeLocations(void)
+{
+    close();
+}
+
+bool
+NodeLocations::open(const std::string &file)
+{
+    std::unique_lock lock{mutex};
+    filespec = file;
+    fd = ::open(filespec.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        log_error("Couldn't open node locations %1%: %2%", filespec, std::strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        log_error("Couldn't stat node locations %1%: %2%", filespec, std::strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    std::size_t size = st.st_size / sizeof(std::uint64_t);
+    if (size < growth) {
+        size = growth;
+    }
+    // Extending the file doesn't write anything, so it stays sparse
+    if (ftruncate(fd, size * sizeof(std::uint64_t)) < 0) {
+        log_error("Couldn't size node locations %1%: %2%", filespec, std::strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    void *addr = mmap(nullptr, size * sizeof(std::uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        log_error("Couldn't map node locations %1%: %2%", filespec, std::strerror(errno));
+        ::close(fd);
+        fd = -1;
+        return false;
+    }
+    slots = static_cast<std::uint64_t *>(addr);
+    capacity = size;
+    log_debug("Opened node locations %1%, room for %2% nodes", filespec, capacity);
+    return true;
+}
+
+void
+NodeLocations::close(void)
+{
+    std::unique_lock lock{mutex};
+    if (slots != nullptr) {
+        munmap(slots, capacity * sizeof(std::uint64_t));
+        slots = nullptr;
+        capacity = 0;
+    }
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+bool
+NodeLocations::grow(long id)
+{
+    std::size_t size = capacity * 2;
+    if (size <= static_cast<std::size_t>(id)) {
+        size = (id / growth + 1) * growth;
+    }
+    if (ftruncate(fd, size * sizeof(std::uint64_t)) < 0) {
+        log_error("Couldn't grow node locations %1%: %2%", filespec, std::strerror(errno));
+        return false;
+    }
+    void *addr = mremap(slots, capacity * sizeof(std::uint64_t),
+                        size * sizeof(std::uint64_t), MREMAP_MAYMOVE);
+    if (addr == MAP_FAILED) {
+        log_error("Couldn't remap node locations %1%: %2%", filespec, std::strerror(errno));
+        return false;
+    }
+    slots = static_cast<std::uint64_t *>(addr);
+    capacity = size;
+    return true;
+}
+
+std::uint64_t
+NodeLocations::encode(const point_t &point)
+{
+    // Flipping the sign bit makes 0 decode to -214 degrees, so an
+    // unused slot can't be mistaken for a real location.
+    auto lon = static_cast<std::uint32_t>(static_cast<std::int32_t>(std::lround(point.get<0>() * precision))) ^ 0x80000000U;
+    auto lat = static_cast<std::uint32_t>(static_cast<std::int32_t>(std::lround(point.get<1>() * precision))) ^ 0x80000000U;
+    return (static_cast<std::uint64_t>(lon) << 32) | lat;
+}
+
+point_t
+NodeLocations::decode(std::uint64_t value)
+{
+    auto lon = static_cast<std::int32_t>(static_cast<std::uint32_t>(value >> 32) ^ 0x80000000U);
+    auto lat = static_cast<std::int32_t>(static_cast<std::uint32_t>(value) ^ 0x80000000U);
+    return point_t(lon / precision, lat / precision);
+}
+
+bool
+NodeLocations::get(long id, point_t &point)
+{
+    std::shared_lock lock{mutex};
+    if (id <= 0 || static_cast<std::size_t>(id) >= capacity) {
+        misses++;
+        return false;
+    }
+    std::uint64_t value = __atomic_load_n(&slots[id], __ATOMIC_RELAXED);
+    if (value == 0 || value == removed) {
+        misses++;
+        return false;
+    }
+    point = decode(value);
+    hits++;
+    return true;
+}
+
+/// Store a location in a slot. A location that isn't from a committed
+/// file only fills an empty slot, since the database may have been read
+/// before a newer location was committed, which would then be lost.
+static void
+store(std::uint64_t &slot, std::uint64_t value, bool committed)
+{
+    if (committed) {
+        __atomic_store_n(&slot, value, __ATOMIC_RELAXED);
+    } else {
+        std::uint64_t empty = 0;
+        __atomic_compare_exchange_n(&slot, &empty, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+}
+
+void
+NodeLocations::set(long id, const point_t &point, bool committed)
+{
+    if (id <= 0) {
+        return;
+    }
+    {
+        std::shared_lock lock{mutex};
+        if (slots == nullptr) {
+            return;
+        }
+        if (static_cast<std::size_t>(id) < capacity) {
+            store(slots[id], encode(point), committed);
+            updates++;
+            return;
+        }
+    }
+    std::unique_lock lock{mutex};
+    if (static_cast<std::size_t>(id) >= capacity && !grow(id)) {
+        return;
+    }
+    store(slots[id], encode(point), committed);
+    updates++;
+}
+
+void
+NodeLocations::remove(long id)
+{
+    std::shared_lock lock{mutex};
+    if (id > 0 && static_cast<std::size_t>(id) < capacity) {
+        __atomic_store_n(&slots[id], removed, __ATOMIC_RELAXED);
+        updates++;
+    }
+}
+
+void
+NodeLocations::resolve(const std::vector<long> &ids,
+                       osmchange::NodeCache &nodecache,
+                       std::vector<long> &missing)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::uint64_t found = 0;
+    {
+        std::shared_lock lock{mutex};
+        for (auto it = std::begin(ids); it != std::end(ids); ++it) {
+            long id = *it;
+            std::uint64_t value = 0;
+            if (id > 0 && static_cast<std::size_t>(id) < capacity) {
+                value = __atomic_load_n(&slots[id], __ATOMIC_RELAXED);
+            }
+            if (value == 0 || value == removed) {
+                missing.push_back(id);
+            } else {
+                nodecache.insert(id, decode(value));
+                found++;
+            }
+        }
+    }
+    hits += found;
+    misses += ids.size() - found;
+    lookup_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+}
+
+void
+NodeLocations::update(const osmchange::OsmChangeFile &osmchanges)
+{
+    for (auto it = std::begin(osmchanges.changes); it != std::end(osmchanges.changes); ++it) {
+        osmchange::OsmChange *change = it->get();
+        for (auto nit = std::begin(change->nodes); nit != std::end(change->nodes); ++nit) {
+            osmobjects::OsmNode *node = nit->get();
+            if (node->action == osmobjects::remove) {
+                remove(node->id);
+            } else {
+                set(node->id, node->point, true);
+            }
+        }
+    }
+}
+
+void
+NodeLocations::sync(void)
+{
+    std::shared_lock lock{mutex};
+    if (slots != nullptr) {
+        msync(slots, capacity * sizeof(std::uint64_t), MS_ASYNC);
+    }
+}
+
+void
+NodeLocations::dump(void) const
+{
+    std::uint64_t lookups = hits + misses;
+    double rate = 0;
+    double latency = 0;
+    if (lookups > 0) {
+        rate = hits * 100.0 / lookups;
+        latency = static_cast<double>(lookup_ns) / lookups;
+    }
+    log_debug("Node locations: %1% lookups, %2%%% hit rate, %3%ns per lookup, %4% updates",
+              lookups, rate, latency, updates.load());
+}
+
+} // namespace queryraw
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
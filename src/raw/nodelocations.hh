@@ -0,0 +1,136 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __NODELOCATIONS_HH__
+#define __NODELOCATIONS_HH__
+
+/// \file nodelocations.hh
+/// \brief A memory mapped file of node locations
+///
+/// Building the geometry of a way needs the location of every node it
+/// references, and most of those aren't in the change file. Instead of
+/// asking the database for them, the locations are kept in a file that
+/// is indexed by the node ID, like the flat nodes file of osm2pgsql.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "osm/nodecache.hh"
+#include "osm/osmobjects.hh"
+
+namespace osmchange {
+class OsmChangeFile;
+}
+
+/// \namespace queryraw
+namespace queryraw {
+
+/// \class NodeLocations
+/// \brief Node locations stored in a sparse, memory mapped file
+///
+/// Each node has a slot at it's ID, holding the longitude and latitude
+/// as 32 bit fixed point numbers, so the file is 8 bytes times the
+/// highest node ID. It's created as a sparse file, so only the pages
+/// with nodes in them use any disk space. An empty slot is all zeros,
+/// and a deleted node is all ones, neither of which decode to a valid
+/// location.
+///
+/// Lookups and updates can be done from multiple threads, the file is
+/// only locked exclusively when it has to grow.
+class NodeLocations {
+  public:
+    NodeLocations(void) {};
+    ~NodeLocations(void);
+
+    /// Open or create the file of node locations
+    bool open(const std::string &filespec);
+    /// Unmap and close the file
+    void close(void);
+    bool isOpen(void) const { return slots != nullptr; };
+
+    /// Get the location of a node, returns false if it isn't known
+    bool get(long id, point_t &point);
+    /// Store the location of a node. The locations read from the
+    /// database may be older than a file that was committed since, so
+    /// they only go in an empty slot. The ones from the committed files
+    /// replace what's there.
+    void set(long id, const point_t &point, bool committed = false);
+    /// Forget the location of a deleted node. The slot is marked, so a
+    /// location read from the database before the deletion isn't stored.
+    void remove(long id);
+
+    /// Look up all the \a ids, adding the ones found to \a nodecache,
+    /// and the others to \a missing, so they can be queried from the
+    /// database.
+    void resolve(const std::vector<long> &ids,
+                 osmchange::NodeCache &nodecache,
+                 std::vector<long> &missing);
+    /// Store the locations of the nodes in a change file, and forget
+    /// the deleted ones
+    void update(const osmchange::OsmChangeFile &osmchanges);
+
+    /// Write the changes to disk
+    void sync(void);
+
+    /// The number of lookups that found a location
+    std::uint64_t getHits(void) const { return hits; };
+    /// The number of lookups that didn't
+    std::uint64_t getMisses(void) const { return misses; };
+    /// Log the hit rate and the lookup time
+    void dump(void) const;
+
+    /// The fixed point scale, which is about 1cm at the equator
+    static constexpr double precision = 10000000.0;
+
+  private:
+    /// Make the file big enough for \a id. The unique lock must be held.
+    bool grow(long id);
+    /// Encode a location so an empty slot is 0
+    static std::uint64_t encode(const point_t &point);
+    static point_t decode(std::uint64_t value);
+
+    int fd = -1;
+    std::uint64_t *slots = nullptr; ///< The mapped file
+    std::size_t capacity = 0;       ///< The number of slots mapped
+    std::string filespec;
+    mutable std::shared_mutex mutex;
+
+    std::atomic<std::uint64_t> hits = 0;
+    std::atomic<std::uint64_t> misses = 0;
+    std::atomic<std::uint64_t> updates = 0;
+    std::atomic<std::uint64_t> lookup_ns = 0; ///< Time spent in resolve()
+};
+
+} // namespace queryraw
+
+#endif // EOF __NODELOCATIONS_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,243 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file objectcache.cc
+/// \brief The recently used nodes and ways, shared by all the workers
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <boost/geometry.hpp>
+
+#include "raw/objectcache.hh"
+#include "osm/osmchange.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+
+namespace queryraw {
+
+/// The memory used by the list and index for each object, on top of
+/// the entry itself
+static const std::size_t overhead = 64;
+
+ObjectCache::ObjectCache(std::size_t bytes, std::size_t count)
+{
+    if (count == 0) {
+        count = 1;
+    }
+    for (std::size_t i = 0; i < count; i++) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    budget = bytes / count;
+}
+
+const ObjectCache::Entry *
+ObjectCache::find(Shard &shard, long key)
+{
+    auto it = shard.index.find(key);
+    if (it == shard.index.end() || it->second->removed) {
+        misses++;
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    hits++;
+    return &*it->second;
+}
+
+void
+ObjectCache::put(Entry &&entry, bool committed)
+{
+    Shard &shard = this->shard(entry.key);
+    std::scoped_lock lock{shard.mutex};
+    auto it = shard.index.find(entry.key);
+    if (it != shard.index.end()) {
+        long version = it->second->version;
+        if (entry.version < version || (entry.version == version && !committed)) {
+            return;
+        }
+        shard.bytes -= it->second->bytes;
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+    shard.bytes += entry.bytes;
+    shard.lru.push_front(std::move(entry));
+    shard.index[shard.lru.front().key] = shard.lru.begin();
+    while (shard.bytes > budget && shard.lru.size() > 1) {
+        shard.bytes -= shard.lru.back().bytes;
+        shard.index.erase(shard.lru.back().key);
+        shard.lru.pop_back();
+        evictions++;
+    }
+}
+
+bool
+ObjectCache::get(long id, point_t &point)
+{
+    long node = key(osmobjects::node, id);
+    Shard &shard = this->shard(node);
+    std::scoped_lock lock{shard.mutex};
+    const Entry *entry = find(shard, node);
+    if (entry == nullptr) {
+        return false;
+    }
+    point = entry->point;
+    return true;
+}
+
+std::shared_ptr<const osmobjects::OsmWay>
+ObjectCache::getWay(long id)
+{
+    long way = key(osmobjects::way, id);
+    Shard &shard = this->shard(way);
+    std::scoped_lock lock{shard.mutex};
+    const Entry *entry = find(shard, way);
+    if (entry == nullptr) {
+        return nullptr;
+    }
+    return entry->way;
+}
+
+void
+ObjectCache::set(long id, const point_t &point, long version, bool committed)
+{
+    put({key(osmobjects::node, id), version, point, nullptr, false, sizeof(Entry) + overhead}, committed);
+}
+
+void
+ObjectCache::set(const osmobjects::OsmWay &way, bool committed)
+{
+    // Only what's needed to build the geometry of a relation is kept,
+    // the tags can be large and aren't used. The copy is on the heap,
+    // since a way from the arena of the file would keep the whole arena.
+    auto slim = std::make_shared<osmobjects::OsmWay>();
+    slim->id = way.id;
+    slim->version = way.version;
+    slim->refs = way.refs;
+    slim->linestring = way.linestring;
+    slim->polygon = way.polygon;
+    std::size_t bytes = sizeof(Entry) + overhead + sizeof(osmobjects::OsmWay) +
+                        slim->refs.size() * sizeof(long) +
+                        boost::geometry::num_points(slim->linestring) * sizeof(point_t) +
+                        boost::geometry::num_points(slim->polygon) * sizeof(point_t);
+    put({key(osmobjects::way, way.id), way.version, point_t(), slim, false, bytes}, committed);
+}
+
+void
+ObjectCache::remove(osmobjects::osmtype_t type, long id, long version)
+{
+    put({key(type, id), version, point_t(), nullptr, true, sizeof(Entry) + overhead}, true);
+}
+
+void
+ObjectCache::drop(osmobjects::osmtype_t type, long id)
+{
+    long key = this->key(type, id);
+    Shard &shard = this->shard(key);
+    std::scoped_lock lock{shard.mutex};
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.bytes -= it->second->bytes;
+        shard.lru.erase(it->second);
+        shard.index.erase(it);
+    }
+}
+
+void
+ObjectCache::resolve(const std::vector<long> &ids,
+                     osmchange::NodeCache &nodecache,
+                     std::vector<long> &missing)
+{
+    for (auto it = std::begin(ids); it != std::end(ids); ++it) {
+        point_t point;
+        if (get(*it, point)) {
+            nodecache.insert(*it, point);
+        } else {
+            missing.push_back(*it);
+        }
+    }
+}
+
+void
+ObjectCache::update(const osmchange::OsmChangeFile &osmchanges)
+{
+    for (auto it = std::begin(osmchanges.changes); it != std::end(osmchanges.changes); ++it) {
+        osmchange::OsmChange *change = it->get();
+        for (auto nit = std::begin(change->nodes); nit != std::end(change->nodes); ++nit) {
+            osmobjects::OsmNode *node = nit->get();
+            if (!node->priority) {
+                drop(osmobjects::node, node->id);
+            } else if (node->action == osmobjects::remove) {
+                remove(osmobjects::node, node->id, node->version);
+            } else {
+                set(node->id, node->point, node->version, true);
+            }
+        }
+        for (auto wit = std::begin(change->ways); wit != std::end(change->ways); ++wit) {
+            osmobjects::OsmWay *way = wit->get();
+            if (way->action == osmobjects::remove) {
+                remove(osmobjects::way, way->id, way->version);
+                continue;
+            }
+            if (!way->priority) {
+                drop(osmobjects::way, way->id);
+                continue;
+            }
+            // A way that is missing some of it's nodes would be wrong
+            // for the next files, so it's left for the database
+            std::size_t points = boost::geometry::num_points(way->linestring) +
+                                 boost::geometry::num_points(way->polygon);
+            if (!way->refs.empty() && points == way->refs.size()) {
+                set(*way, true);
+            }
+        }
+    }
+}
+
+std::size_t
+ObjectCache::getBytes(void)
+{
+    std::size_t bytes = 0;
+    for (auto it = std::begin(shards); it != std::end(shards); ++it) {
+        std::scoped_lock lock{(*it)->mutex};
+        bytes += (*it)->bytes;
+    }
+    return bytes;
+}
+
+void
+ObjectCache::dump(void)
+{
+    std::uint64_t lookups = hits + misses;
+    double rate = 0;
+    if (lookups > 0) {
+        rate = hits * 100.0 / lookups;
+    }
+    log_debug("Object cache: %1% lookups, %2%%% hit rate, %3% evictions, %4%Mb used",
+              lookups, rate, evictions.load(), getBytes() / (1024 * 1024));
+}
+
+} // namespace queryraw
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,149 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __OBJECTCACHE_HH__
+#define __OBJECTCACHE_HH__
+
+/// \file objectcache.hh
+/// \brief The recently used nodes and ways, shared by all the workers
+///
+/// The same nodes and ways are often edited in change files a few
+/// minutes apart, and each file used to query them from the database
+/// again. This keeps the most recently used ones in memory, up to a
+/// budget, for all the files.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "osm/nodecache.hh"
+#include "osm/osmobjects.hh"
+
+namespace osmchange {
+class OsmChangeFile;
+}
+
+/// \namespace queryraw
+namespace queryraw {
+
+/// \class ObjectCache
+/// \brief A sharded LRU cache of node locations and way geometries
+///
+/// The objects are spread over shards by ID, each with it's own lock,
+/// so the workers don't wait for each other. Each shard gets an equal
+/// part of the memory budget, and drops the least recently used objects
+/// when it's over.
+///
+/// Every object has the version it came from. The objects read from the
+/// database may be older than a file that was committed since, so they
+/// don't replace an object of the same version. The objects from the
+/// committed files do.
+class ObjectCache {
+  public:
+    /// A cache using up to \a budget bytes
+    ObjectCache(std::size_t budget, std::size_t shards = 16);
+
+    /// Get the location of a node, returns false if it isn't cached
+    bool get(long id, point_t &point);
+    /// Get a way with it's geometry, or nullptr if it isn't cached
+    std::shared_ptr<const osmobjects::OsmWay> getWay(long id);
+    /// Store the location of a node
+    void set(long id, const point_t &point, long version, bool committed = false);
+    /// Store the geometry of a way
+    void set(const osmobjects::OsmWay &way, bool committed = false);
+    /// Forget a deleted object. The deletion is remembered, so an older
+    /// version read from the database doesn't bring it back.
+    void remove(osmobjects::osmtype_t type, long id, long version);
+
+    /// Look up all the \a ids, adding the ones found to \a nodecache,
+    /// and the others to \a missing
+    void resolve(const std::vector<long> &ids,
+                 osmchange::NodeCache &nodecache,
+                 std::vector<long> &missing);
+    /// Store the nodes and ways of a committed change file, and forget
+    /// the deleted ones. The objects outside the priority area aren't
+    /// written to the database, so they're dropped from the cache too.
+    void update(const osmchange::OsmChangeFile &osmchanges);
+
+    /// The number of lookups that found an object
+    std::uint64_t getHits(void) const { return hits; };
+    /// The number of lookups that didn't
+    std::uint64_t getMisses(void) const { return misses; };
+    /// The number of objects dropped to stay in the budget
+    std::uint64_t getEvictions(void) const { return evictions; };
+    /// The memory used by the cached objects
+    std::size_t getBytes(void);
+    /// Log the hit rate, the evictions and the memory used
+    void dump(void);
+
+  private:
+    /// A cached node or way
+    struct Entry {
+        long key;
+        long version;
+        point_t point;
+        std::shared_ptr<const osmobjects::OsmWay> way;
+        bool removed;
+        std::size_t bytes;
+    };
+    /// The objects for part of the IDs, most recently used first
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;
+        std::unordered_map<long, std::list<Entry>::iterator> index;
+        std::size_t bytes = 0;
+    };
+    /// Nodes and ways are stored together, so the type is in the key
+    static long key(osmobjects::osmtype_t type, long id) { return id * 2 + (type == osmobjects::way ? 1 : 0); };
+    Shard &shard(long key) { return *shards[static_cast<std::uint64_t>(key) % shards.size()]; };
+    /// Add or replace an object, then drop the oldest ones if the shard
+    /// is over budget
+    void put(Entry &&entry, bool committed);
+    /// Find an object, and make it the most recently used. The shard
+    /// must be locked.
+    const Entry *find(Shard &shard, long key);
+    /// Drop an object without remembering it, so the next lookup goes
+    /// to the database
+    void drop(osmobjects::osmtype_t type, long id);
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::size_t budget; ///< The bytes for each shard
+
+    std::atomic<std::uint64_t> hits = 0;
+    std::atomic<std::uint64_t> misses = 0;
+    std::atomic<std::uint64_t> evictions = 0;
+};
+
+} // namespace queryraw
+
+#endif // EOF __OBJECTCACHE_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -43,6 +43,7 @@
 #include "raw/queryraw.hh"
 #include "osm/osmobjects.hh"
 #include "osm/osmchange.hh"
+#include "raw/rawcopy.hh"
 
 #include <boost/timer/timer.hpp>
 
@@ -56,14 +57,91 @@ namespace queryraw {
 
 QueryRaw::QueryRaw(void) {}
 
+/// The prepared statements for the raw tables. The version checks are
+/// the same as the ones in the SQL built by applyChange(). The refs of
+/// an object are only replaced when it's upsert was applied, so an older
+/// version can't replace the refs of a newer one.
+static const std::map<std::string, std::string> rawStatements = {
+    {"raw_node_upsert", "INSERT INTO nodes AS r (osm_id, geom, tags, timestamp, version, \"user\", uid, changeset) \
+VALUES ($1, $2::geometry, $3::jsonb, $4, $5, $6, $7, $8) ON CONFLICT (osm_id) DO UPDATE SET geom = EXCLUDED.geom, \
+tags = EXCLUDED.tags, timestamp = EXCLUDED.timestamp, version = EXCLUDED.version, \"user\" = EXCLUDED.\"user\", \
+uid = EXCLUDED.uid, changeset = EXCLUDED.changeset WHERE r.version < EXCLUDED.version"},
+    {"raw_node_delete", "DELETE FROM nodes WHERE osm_id = ANY($1::bigint[])"},
+    {"raw_nodes_by_id", "SELECT osm_id, st_x(geom) as lat, st_y(geom) as lon, version FROM nodes \
+WHERE osm_id = ANY($1::bigint[]) AND st_x(geom) IS NOT NULL AND st_y(geom) IS NOT NULL"},
+    {"raw_relation_upsert", "INSERT INTO relations AS r (osm_id, tags, refs, geom, timestamp, version, \"user\", uid, changeset) \
+VALUES ($1, $2::jsonb, $3::jsonb, $4::geometry, $5, $6, $7, $8, $9) ON CONFLICT (osm_id) DO UPDATE SET tags = EXCLUDED.tags, \
+refs = EXCLUDED.refs, geom = EXCLUDED.geom, timestamp = EXCLUDED.timestamp, version = EXCLUDED.version, \
+\"user\" = EXCLUDED.\"user\", uid = EXCLUDED.uid, changeset = EXCLUDED.changeset WHERE r.version <= EXCLUDED.version"},
+    {"raw_relation_geometry", "UPDATE relations SET geom = $2::geometry, timestamp = $3 WHERE osm_id = $1"},
+    {"raw_relation_delete", "DELETE FROM relations WHERE osm_id = ANY($1::bigint[])"},
+    {"raw_way_refs_replace", "WITH applied AS (SELECT 1 FROM ways_poly WHERE osm_id = $1 AND version = $3 \
+UNION ALL SELECT 1 FROM ways_line WHERE osm_id = $1 AND version = $3), \
+old AS (DELETE FROM way_refs WHERE way_id = $1 AND EXISTS (SELECT 1 FROM applied)) \
+INSERT INTO way_refs (way_id, node_id) SELECT DISTINCT $1::bigint, unnest($2::bigint[]) \
+WHERE EXISTS (SELECT 1 FROM applied)"},
+    {"raw_way_refs_delete", "DELETE FROM way_refs WHERE way_id = ANY($1::bigint[])"},
+    {"raw_ways_by_node_refs", "SELECT osm_id, refs, version, tags, uid, changeset FROM ways_poly \
+WHERE osm_id IN (SELECT way_id FROM way_refs WHERE node_id = ANY($1::bigint[])) \
+UNION ALL SELECT osm_id, refs, version, tags, uid, changeset FROM ways_line \
+WHERE osm_id IN (SELECT way_id FROM way_refs WHERE node_id = ANY($1::bigint[]))"},
+    {"raw_rel_refs_replace", "WITH applied AS (SELECT 1 FROM relations WHERE osm_id = $1 AND version = $3), \
+old AS (DELETE FROM rel_refs WHERE rel_id = $1 AND EXISTS (SELECT 1 FROM applied)) \
+INSERT INTO rel_refs (rel_id, way_id) SELECT DISTINCT $1::bigint, unnest($2::bigint[]) \
+WHERE EXISTS (SELECT 1 FROM applied)"},
+    {"raw_rel_refs_delete", "DELETE FROM rel_refs WHERE rel_id = ANY($1::bigint[])"},
+    {"raw_relations_by_way_refs", "SELECT osm_id, refs, version, tags, uid, changeset FROM relations \
+WHERE osm_id IN (SELECT rel_id FROM rel_refs WHERE way_id = ANY($1::bigint[]))"}
+};
+
+/// The Ways that are members of a Relation, for the rel_refs table
+static std::vector<long>
+wayMembers(const OsmRelation &relation)
+{
+    std::vector<long> ways;
+    for (auto mit = std::begin(relation.members); mit != std::end(relation.members); ++mit) {
+        if (mit->type == osmobjects::way) {
+            ways.push_back(mit->ref);
+        }
+    }
+    return ways;
+}
+
+/// The statements for ways, one set for each table
+static const std::string wayUpsert = "INSERT INTO %1% AS r (osm_id, tags, refs, geom, timestamp, version, \"user\", uid, changeset) \
+VALUES ($1, $2::jsonb, $3::bigint[], $4::geometry, $5, $6, $7, $8, $9) ON CONFLICT (osm_id) DO UPDATE SET tags = EXCLUDED.tags, \
+refs = EXCLUDED.refs, geom = EXCLUDED.geom, timestamp = EXCLUDED.timestamp, version = EXCLUDED.version, \
+\"user\" = EXCLUDED.\"user\", uid = EXCLUDED.uid, changeset = EXCLUDED.changeset WHERE r.version <= EXCLUDED.version";
+static const std::string wayGeometry = "UPDATE %1% SET geom = $2::geometry, timestamp = $3 WHERE osm_id = $1";
+static const std::string wayDelete = "DELETE FROM %1% WHERE osm_id = ANY($1::bigint[])";
+
 QueryRaw::QueryRaw(std::shared_ptr<Pq> db) {
     dbconn = db;
+    if (!dbconn) {
+        return;
+    }
+    auto statements = getStatements();
+    for (auto it = std::begin(statements); it != std::end(statements); ++it) {
+        dbconn->prepare(it->first, it->second);
+    }
+}
+
+std::map<std::string, std::string>
+QueryRaw::getStatements(void)
+{
+    std::map<std::string, std::string> statements = rawStatements;
+    for (const std::string *table : {&QueryRaw::polyTable, &QueryRaw::lineTable}) {
+        statements["raw_" + *table + "_upsert"] = (boost::format(wayUpsert) % *table).str();
+        statements["raw_" + *table + "_geometry"] = (boost::format(wayGeometry) % *table).str();
+        statements["raw_" + *table + "_delete"] = (boost::format(wayDelete) % *table).str();
+    }
+    return statements;
 }
 
 // Receives a dictionary of tags (key: value) and returns
 // a JSONB string for doing an insert operation into the database.
 std::string
-QueryRaw::buildTagsQuery(std::map<std::string, std::string> tags) const {
+QueryRaw::buildTagsQuery(const osmobjects::TagList &tags) const {
     if (tags.size() > 0) {
         std::string tagsStr = "jsonb_build_object(";
         int count = 0;
@@ -320,6 +398,14 @@ QueryRaw::applyChange(const OsmWay &way) const
                 query += fmt.str();
                 queries->push_back(query);
 
+                // Replace the Way's entries in the reverse index of Nodes,
+                // if this version was written
+                std::string applied = " AND EXISTS (SELECT 1 FROM " + *tableName + " WHERE osm_id = " +
+                                      std::to_string(way.id) + " AND version = " + std::to_string(way.version) + ")";
+                queries->push_back("DELETE FROM way_refs WHERE way_id = " + std::to_string(way.id) + applied +
+                                   "; INSERT INTO way_refs (way_id, node_id) SELECT DISTINCT " +
+                                   std::to_string(way.id) + ", unnest(" + refs + ") WHERE TRUE" + applied + ";");
+
             } else {
 
                 // Update only the Way's geometry. This is the case when a Way was indirectly 
@@ -367,6 +453,7 @@ QueryRaw::applyChange(const OsmWay &way) const
         } else {
             queries->push_back("DELETE FROM " + QueryRaw::lineTable + " where osm_id = " + std::to_string(way.id) + ";");
         }
+        queries->push_back("DELETE FROM way_refs WHERE way_id = " + std::to_string(way.id) + ";");
     }
 
     return queries;
@@ -447,6 +534,23 @@ QueryRaw::applyChange(const OsmRelation &relation) const
                 query.append(fmt.str());
                 queries->push_back(query);
 
+                // Replace the Relation's entries in the reverse index of Ways,
+                // if this version was written
+                std::string ways;
+                for (long way : wayMembers(relation)) {
+                    ways += std::to_string(way) + ",";
+                }
+                if (!ways.empty()) {
+                    ways.erase(ways.size() - 1);
+                }
+                std::string applied = " AND EXISTS (SELECT 1 FROM relations WHERE osm_id = " +
+                                      std::to_string(relation.id) + " AND version = " +
+                                      std::to_string(relation.version) + ")";
+                queries->push_back("DELETE FROM rel_refs WHERE rel_id = " + std::to_string(relation.id) + applied +
+                                   "; INSERT INTO rel_refs (rel_id, way_id) SELECT DISTINCT " +
+                                   std::to_string(relation.id) + ", unnest(ARRAY[" + ways + "]::bigint[])" +
+                                   " WHERE TRUE" + applied + ";");
+
             } else {
 
                 // Update only the Relation's geometry. This is the case when a Relation was indirectly 
@@ -476,11 +580,106 @@ QueryRaw::applyChange(const OsmRelation &relation) const
     } else if (relation.action == osmobjects::remove) {
         // Delete a Relation geometry and its references.
         queries->push_back("DELETE FROM relations where osm_id = " + std::to_string(relation.id) + ";");
+        queries->push_back("DELETE FROM rel_refs WHERE rel_id = " + std::to_string(relation.id) + ";");
     }
 
     return queries;
 }
 
+// Apply the change for a Node, as calls of the prepared statements
+void
+QueryRaw::applyChange(const OsmNode &node, Coalescer &writes) const
+{
+    if (node.action == osmobjects::create || node.action == osmobjects::modify) {
+        Statement upsert("raw_node_upsert");
+        upsert.bind(node.id).bind(RawCopy::ewkb(node.point)).bind(RawCopy::json(node.tags));
+        upsert.bind(to_simple_string(boost::posix_time::microsec_clock::universal_time()));
+        upsert.bind(node.version).bind(node.user).bind(node.uid).bind(node.changeset);
+        writes.add(osmobjects::node, node.id, node.version, {upsert});
+    } else if (node.action == osmobjects::remove) {
+        writes.remove(osmobjects::node, node.id, node.version, "raw_node_delete");
+    }
+}
+
+// Apply the change for a Way, as calls of the prepared statements
+void
+QueryRaw::applyChange(const OsmWay &way, Coalescer &writes) const
+{
+    bool closed = way.refs.size() > 3 && way.refs.front() == way.refs.back();
+    const std::string &table = closed ? QueryRaw::polyTable : QueryRaw::lineTable;
+    const std::string &other = closed ? QueryRaw::lineTable : QueryRaw::polyTable;
+
+    if (way.refs.size() > 0
+        && (way.action == osmobjects::create || way.action == osmobjects::modify || way.action == osmobjects::modify_geom)) {
+        // Only complete geometries are written
+        if (!((way.refs.front() != way.refs.back() && way.refs.size() == bg::num_points(way.linestring)) ||
+              (way.refs.front() == way.refs.back() && way.refs.size() == bg::num_points(way.polygon)))) {
+            return;
+        }
+        std::string geometry = closed ? RawCopy::ewkb(way.polygon) : RawCopy::ewkb(way.linestring);
+        std::string timestamp = to_simple_string(boost::posix_time::microsec_clock::universal_time());
+        // A Way that was closed or opened moves to the other table
+        Statement moved = Statement("raw_" + other + "_delete").bind(std::vector<long>{way.id});
+        if (way.action != osmobjects::modify_geom) {
+            Statement upsert("raw_" + table + "_upsert");
+            upsert.bind(way.id).bind(RawCopy::json(way.tags));
+            upsert.bind(std::vector<long>(std::begin(way.refs), std::end(way.refs)));
+            upsert.bind(geometry).bind(timestamp).bind(way.version);
+            upsert.bind(way.user).bind(way.uid).bind(way.changeset);
+            Statement refs("raw_way_refs_replace");
+            refs.bind(way.id).bind(std::vector<long>(std::begin(way.refs), std::end(way.refs))).bind(way.version);
+            writes.add(osmobjects::way, way.id, way.version, {upsert, moved, refs});
+        } else {
+            Statement update("raw_" + table + "_geometry");
+            update.bind(way.id).bind(geometry).bind(timestamp);
+            writes.update(osmobjects::way, way.id, way.version, {update, moved});
+        }
+    } else if (way.action == osmobjects::remove) {
+        // A deleted Way has no refs, so it's removed from both tables
+        writes.remove(osmobjects::way, way.id, way.version, "raw_" + QueryRaw::polyTable + "_delete");
+        writes.remove(osmobjects::way, way.id, way.version, "raw_" + QueryRaw::lineTable + "_delete");
+        writes.remove(osmobjects::way, way.id, way.version, "raw_way_refs_delete");
+    }
+}
+
+// Apply the change for a Relation, as calls of the prepared statements
+void
+QueryRaw::applyChange(const OsmRelation &relation, Coalescer &writes) const
+{
+    if (relation.action == osmobjects::create || relation.action == osmobjects::modify || relation.action == osmobjects::modify_geom) {
+        // Ignore empty geometries
+        std::string geometry;
+        if (relation.isMultiPolygon()) {
+            if (bg::num_points(relation.multipolygon) == 0) {
+                return;
+            }
+            geometry = RawCopy::ewkb(relation.multipolygon);
+        } else {
+            if (bg::num_points(relation.multilinestring) == 0) {
+                return;
+            }
+            geometry = RawCopy::ewkb(relation.multilinestring);
+        }
+        std::string timestamp = to_simple_string(boost::posix_time::microsec_clock::universal_time());
+        if (relation.action != osmobjects::modify_geom) {
+            Statement upsert("raw_relation_upsert");
+            upsert.bind(relation.id).bind(RawCopy::json(relation.tags)).bind(RawCopy::json(relation.members));
+            upsert.bind(geometry).bind(timestamp).bind(relation.version);
+            upsert.bind(relation.user).bind(relation.uid).bind(relation.changeset);
+            Statement refs("raw_rel_refs_replace");
+            refs.bind(relation.id).bind(wayMembers(relation)).bind(relation.version);
+            writes.add(osmobjects::relation, relation.id, relation.version, {upsert, refs});
+        } else {
+            Statement update("raw_relation_geometry");
+            update.bind(relation.id).bind(geometry).bind(timestamp);
+            writes.update(osmobjects::relation, relation.id, relation.version, {update});
+        }
+    } else if (relation.action == osmobjects::remove) {
+        writes.remove(osmobjects::relation, relation.id, relation.version, "raw_relation_delete");
+        writes.remove(osmobjects::relation, relation.id, relation.version, "raw_rel_refs_delete");
+    }
+}
+
 // Receives a string of comma separated values and
 // returns a vector. This function is useful for
 // getting a vector of references from a query result
@@ -497,12 +696,11 @@ std::vector<long> arrayStrToVector(std::string refs_str) {
 }
 
 // Get all Relations that have at least 1 reference to any Way
-// of a list. This function receives a string of comma separated
-// ids ("213213,328947,287313") and returns a list of Relation
-// objects. This is useful for getting Relations that were
-// indirectly modified by a change on a Way.
+// of a list, and returns a list of Relation objects. This is
+// useful for getting Relations that were indirectly modified
+// by a change on a Way.
 std::list<std::shared_ptr<OsmRelation>>
-QueryRaw::getRelationsByWaysRefs(std::string &wayIds) const
+QueryRaw::getRelationsByWaysRefs(const std::vector<long> &wayIds) const
 {
 #ifdef TIMING_DEBUG
     boost::timer::auto_cpu_timer timer("getRelationsByWaysRefs(wayIds): took %w seconds\n");
@@ -510,9 +708,9 @@ QueryRaw::getRelationsByWaysRefs(std::string &wayIds) const
     // Object to return
     std::list<std::shared_ptr<osmobjects::OsmRelation>> rels;
 
-    // Query for getting Relations
-    std::string relsQuery = "SELECT distinct(osm_id), refs, version, tags, uid, changeset FROM relations WHERE EXISTS (SELECT 1 FROM jsonb_array_elements(refs) AS ref WHERE (ref->>'ref')::bigint IN (" + wayIds + "));";
-    auto rels_result = dbconn->query(relsQuery);
+    // Get the Relations that have any of the Ways as a member, with one
+    // lookup in the rel_refs index
+    auto rels_result = dbconn->execute(Statement("raw_relations_by_way_refs").bind(wayIds));
 
     // Fill vector with OsmRelation objects
     for (auto rel_it = rels_result.begin(); rel_it != rels_result.end(); ++rel_it) {
@@ -523,9 +721,9 @@ QueryRaw::getRelationsByWaysRefs(std::string &wayIds) const
 
         for (auto mit = members.begin(); mit != members.end(); ++mit) {
             auto memberType = osmobjects::osmtype_t::way;
-            if (mit->at("type") == "n") {
+            if (mit->at("type") == "n" || mit->at("type") == "node") {
                 memberType = osmobjects::osmtype_t::node;
-            } else if (mit->at("type") == "r") {
+            } else if (mit->at("type") == "r" || mit->at("type") == "relation") {
                 memberType = osmobjects::osmtype_t::relation;
             }
             rel->addMember(std::stol(mit->at("ref")), memberType, mit->at("role"));
@@ -561,8 +759,8 @@ QueryRaw::getWaysByIds(std::string &waysIds, std::map<long, std::shared_ptr<osmo
     boost::timer::auto_cpu_timer timer("getWaysByIds(waysIds, waycache): took %w seconds\n");
 #endif
     // Get Ways and it's geometries (Polygon and LineString)
-    std::string waysQuery = "SELECT distinct(osm_id), ST_AsText(geom, 4326), 'polygon' as type from ways_poly wp where osm_id = any(ARRAY[" + waysIds + "]) ";
-    waysQuery += "UNION SELECT distinct(osm_id), ST_AsText(geom, 4326), 'linestring' as type from ways_line wp where osm_id = any(ARRAY[" + waysIds + "])";
+    std::string waysQuery = "SELECT distinct(osm_id), ST_AsText(geom, 4326), 'polygon' as type, version from ways_poly wp where osm_id = any(ARRAY[" + waysIds + "]) ";
+    waysQuery += "UNION SELECT distinct(osm_id), ST_AsText(geom, 4326), 'linestring' as type, version from ways_line wp where osm_id = any(ARRAY[" + waysIds + "])";
     auto ways_result = dbconn->query(waysQuery);
     if (ways_result.size() == 0) {
         log_debug("No results returned!");
@@ -581,7 +779,11 @@ QueryRaw::getWaysByIds(std::string &waysIds, std::map<long, std::shared_ptr<osmo
         } else {
             bg::read_wkt((*way_it)[1].as<std::string>(), way->linestring);
         }
-        waycache.insert(std::pair(way->id, std::make_shared<osmobjects::OsmWay>(*way)));
+        way->version = (*way_it)[3].as<long>();
+        waycache.insert(std::pair(way->id, way));
+        if (cache) {
+            cache->set(*way);
+        }
     }
 }
 
@@ -601,13 +803,18 @@ QueryRaw::getWaysByIds(std::string &waysIds, std::map<long, std::shared_ptr<osmo
 // TODO: divide this function into multiple ones
 //
 void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const multipolygon_t &poly)
+{
+    buildGeometries(osmchanges, geoutil::BoundaryIndex(poly));
+}
+
+void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const geoutil::BoundaryIndex &boundary)
 {
 #ifdef TIMING_DEBUG
-    boost::timer::auto_cpu_timer timer("buildGeometries(osmchanges, poly): took %w seconds\n");
+    boost::timer::auto_cpu_timer timer("buildGeometries(osmchanges, boundary): took %w seconds\n");
 #endif
-    std::string referencedNodeIds;
-    std::string modifiedNodesIds;
-    std::string modifiedWaysIds;
+    std::vector<long> referencedNodes;
+    std::vector<long> modifiedNodesIds;
+    std::vector<long> modifiedWaysIds;
     std::vector<long> removedWays;
     std::vector<long> removedRelations;
 
@@ -620,13 +827,13 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
                 // Save referenced Nodes ids for later use. The geometries of these
                 // Nodes will be needed later when building geometries for Ways
                 for (auto rit = std::begin(way->refs); rit != std::end(way->refs); ++rit) {
-                    if (!osmchanges->nodecache.count(*rit)) {
-                        referencedNodeIds += std::to_string(*rit) + ",";
+                    if (!osmchanges->nodecache.contains(*rit)) {
+                        referencedNodes.push_back(*rit);
                     }
                 }
                 // Save Ways in waycache, pre-filter by priority area
-                if (poly.empty() || bg::within(way->linestring, poly)) {
-                    osmchanges->waycache.insert(std::make_pair(way->id, std::make_shared<osmobjects::OsmWay>(*way)));
+                if (boundary.empty() || boundary.within(way->linestring)) {
+                    osmchanges->waycache.insert(std::make_pair(way->id, *wit));
                 }
             } else {
                 // Save removed Ways for later use. This list will be used to known
@@ -641,8 +848,8 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
             OsmNode *node = nit->get();
             if (node->action == osmobjects::modify) {
                 // Get only modified nodes ids inside the priority area
-                if (poly.empty() || bg::within(node->point, poly)) {
-                    modifiedNodesIds += std::to_string(node->id) + ",";
+                if (boundary.empty() || boundary.within(node->point)) {
+                    modifiedNodesIds.push_back(node->id);
                 }
             }
         }
@@ -657,8 +864,7 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
 
     // Add indirectly modified ways to osmchanges. An indirectly modified Way is a Way
     // whose geoemtry was modified because one of it's referenced Nodes was modified
-    if (modifiedNodesIds.size() > 1) {
-        modifiedNodesIds.erase(modifiedNodesIds.size() - 1);
+    if (modifiedNodesIds.size() > 0) {
 
         // Get all Ways that have at least one reference to one of the modified Nodes
         auto modifiedWays = getWaysByNodesRefs(modifiedNodesIds);
@@ -666,15 +872,15 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
         // Add a new change for the indirectly modified Way
         auto change = std::make_shared<OsmChange>(none);
         for (auto wit = modifiedWays.begin(); wit != modifiedWays.end(); ++wit) {
-           auto way = std::make_shared<OsmWay>(*wit->get());
+           auto way = *wit;
            // If the Way is not removed
            if (std::find(removedWays.begin(), removedWays.end(), way->id) == removedWays.end()) {
 
                 // Save referenced Nodes. This list will be used for getting the geometries of
                 // these Nodes, used when building the Way geometry
                 for (auto rit = std::begin(way->refs); rit != std::end(way->refs); ++rit) {
-                    if (!osmchanges->nodecache.count(*rit)) {
-                        referencedNodeIds += std::to_string(*rit) + ",";
+                    if (!osmchanges->nodecache.contains(*rit)) {
+                        referencedNodes.push_back(*rit);
                     }
                 }
 
@@ -687,7 +893,7 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
 
                 // Save the id of the indirectly modified Way for later use. This will be used
                 // for identifying which Relations were indirectly modified by this change.
-                modifiedWaysIds += std::to_string(way->id) + ",";
+                modifiedWaysIds.push_back(way->id);
            }
         }
         osmchanges->changes.push_back(change);
@@ -695,17 +901,16 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
 
     // Add indirectly modified Relations to osmchanges. This is the case when a Way referenced
     // in a Relation was modified (or indirectly modified by a change on one of its Nodes)
-    if (modifiedWaysIds.size() > 1) {
+    if (modifiedWaysIds.size() > 0) {
 
         // Get indirectly modified Relations from the DB, using the list of Ways
         // that were modified
-        modifiedWaysIds.erase(modifiedWaysIds.size() - 1);
         auto modifiedRelations = getRelationsByWaysRefs(modifiedWaysIds);
 
         // Create a new change for the indirecty modified Relation
         auto change = std::make_shared<OsmChange>(none);
         for (auto rel_it = modifiedRelations.begin(); rel_it != modifiedRelations.end(); ++rel_it) {
-           auto relation = std::make_shared<OsmRelation>(*rel_it->get());
+           auto relation = *rel_it;
            // If the Relation is not removed
            if (std::find(removedRelations.begin(), removedRelations.end(), relation->id) == removedRelations.end()) {
                 // Flag it as modified geometry. This means that only the geometry was modified,
@@ -720,12 +925,23 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
     }
 
     // Fill nodecache with referenced Nodes. This will be used later when building the
-    // geometries of Ways
-    if (referencedNodeIds.size() > 1) {
-        referencedNodeIds.erase(referencedNodeIds.size() - 1);
+    // geometries of Ways. The cached and local node locations are used first, so only
+    // the Nodes that aren't there have to be queried from the DB
+    std::vector<long> missingNodes;
+    osmchanges->nodecache.reserve(osmchanges->nodecache.size() + referencedNodes.size());
+    if (cache) {
+        cache->resolve(referencedNodes, osmchanges->nodecache, missingNodes);
+        missingNodes.swap(referencedNodes);
+        missingNodes.clear();
+    }
+    if (locations) {
+        locations->resolve(referencedNodes, osmchanges->nodecache, missingNodes);
+    } else {
+        missingNodes.swap(referencedNodes);
+    }
+    if (missingNodes.size() > 0) {
         // Get Nodes geoemtries from DB
-        std::string nodesQuery = "SELECT osm_id, st_x(geom) as lat, st_y(geom) as lon FROM nodes where osm_id in (" + referencedNodeIds + ");";
-        auto result = dbconn->query(nodesQuery);
+        auto result = dbconn->execute(Statement("raw_nodes_by_id").bind(missingNodes));
         if (result.size() == 0) {
             log_debug("No results returned!");
             return;
@@ -736,7 +952,13 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
             auto node_lat = (*node_it)[2].as<double>();
             auto node_lon = (*node_it)[1].as<double>();
             OsmNode node(node_lat, node_lon);
-            osmchanges->nodecache[node_id] = node.point;
+            osmchanges->nodecache.insert(node_id, node.point);
+            if (locations) {
+                locations->set(node_id, node.point);
+            }
+            if (cache) {
+                cache->set(node_id, node.point, (*node_it)[3].as<long>());
+            }
         }
     }
 
@@ -750,8 +972,9 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
             if (bg::num_points(way->linestring) != way->refs.size()) {
                 way->linestring.clear();
                 for (auto rit = way->refs.begin(); rit != way->refs.end(); ++rit) {
-                    if (osmchanges->nodecache.count(*rit)) {
-                        bg::append(way->linestring, osmchanges->nodecache.at(*rit));
+                    point_t point;
+                    if (osmchanges->nodecache.find(*rit, point)) {
+                        bg::append(way->linestring, point);
                     }
                 }
                 if (way->isClosed()) {
@@ -761,15 +984,20 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
             }
 
             // Save Way pointer for later use. This will be used when building Relations geometries.
-            if (poly.empty() || bg::within(way->linestring, poly)) {
-                if (osmchanges->waycache.count(way->id)) {
-                    if (way->isClosed()) {
-                        osmchanges->waycache.at(way->id)->polygon = way->polygon;
-                    } else {
-                        osmchanges->waycache.at(way->id)->linestring = way->linestring;
+            if (boundary.empty() || boundary.within(way->linestring)) {
+                auto cached = osmchanges->waycache.find(way->id);
+                if (cached != osmchanges->waycache.end()) {
+                    // Ways from this file are shared with the cache, so
+                    // only ways from the database need to be updated
+                    if (cached->second.get() != way) {
+                        if (way->isClosed()) {
+                            cached->second->polygon = way->polygon;
+                        } else {
+                            cached->second->linestring = way->linestring;
+                        }
                     }
                 } else {
-                    osmchanges->waycache.insert(std::make_pair(way->id, std::make_shared<osmobjects::OsmWay>(*way)));
+                    osmchanges->waycache.insert(std::make_pair(way->id, *wit));
                 }
             }
 
@@ -778,6 +1006,8 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
 
     // Build list of Relations that have missing geometries. This list will be used for
     // querying the database and get the geometries of the referenced Ways .
+    // Ways in the shared cache are copied instead, since their geometry can
+    // be updated here.
     std::string relsForWayCacheIds;
     for (auto it = std::begin(osmchanges->changes); it != std::end(osmchanges->changes); it++) {
         OsmChange *change = it->get();
@@ -785,7 +1015,13 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
             OsmRelation *relation = rel_it->get();
             if (relation->action != osmobjects::remove) {
                 for (auto mit = relation->members.begin(); mit != relation->members.end(); ++mit) {
-                    if (mit->type == osmobjects::way && !osmchanges->waycache.count(mit->ref)) {
+                    if (mit->type != osmobjects::way || osmchanges->waycache.count(mit->ref)) {
+                        continue;
+                    }
+                    auto cached = cache ? cache->getWay(mit->ref) : nullptr;
+                    if (cached) {
+                        osmchanges->waycache.insert(std::make_pair(mit->ref, std::make_shared<OsmWay>(*cached)));
+                    } else {
                         relsForWayCacheIds += std::to_string(mit->ref) + ",";
                     }
                 }
@@ -813,26 +1049,28 @@ void QueryRaw::buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const
 
 // Fill Node cache with Nodes referenced from Ways
 void
-QueryRaw::getNodeCacheFromWays(std::shared_ptr<std::vector<OsmWay>> ways, std::map<double, point_t> &nodecache) const
+QueryRaw::getNodeCacheFromWays(std::shared_ptr<std::vector<OsmWay>> ways, NodeCache &nodecache) const
 {
 #ifdef TIMING_DEBUG
     boost::timer::auto_cpu_timer timer("getNodeCacheFromWays(ways, nodecache): took %w seconds\n");
 #endif
 
-    // Build a string list of all Nodes ids referenced from Ways
-    std::string nodeIds;
+    // Build a string list of all Nodes ids referenced from Ways, that
+    // aren't in the local node locations
+    std::vector<long> refs;
     for (auto wit = ways->begin(); wit != ways->end(); ++wit) {
-        for (auto rit = std::begin(wit->refs); rit != std::end(wit->refs); ++rit) {
-            nodeIds += std::to_string(*rit) + ",";
-        }
+        refs.insert(refs.end(), std::begin(wit->refs), std::end(wit->refs));
     }
-
-    if (nodeIds.size() > 1) {
-        nodeIds.erase(nodeIds.size() - 1);
-
+    std::vector<long> missing;
+    nodecache.reserve(nodecache.size() + refs.size());
+    if (locations) {
+        locations->resolve(refs, nodecache, missing);
+    } else {
+        missing.swap(refs);
+    }
+    if (missing.size() > 0) {
         // Get Nodes geometries from the DB
-        std::string nodesQuery = "SELECT osm_id, st_x(geom) as lat, st_y(geom) as lon FROM nodes where osm_id in (" + nodeIds + ") and st_x(geom) is not null and st_y(geom) is not null;";
-        auto result = dbconn->query(nodesQuery);
+        auto result = dbconn->execute(Statement("raw_nodes_by_id").bind(missing));
         if (result.size() == 0) {
             log_debug("No results returned!");
             return;
@@ -844,63 +1082,56 @@ QueryRaw::getNodeCacheFromWays(std::shared_ptr<std::vector<OsmWay>> ways, std::m
             auto node_lat = (*node_it)[1].as<double>();
             auto node_lon = (*node_it)[2].as<double>();
             auto point = point_t(node_lat, node_lon);
-            nodecache.insert(std::make_pair(node_id, point));
+            nodecache.insert(node_id, point);
+            if (locations) {
+                locations->set(node_id, point);
+            }
         }
     }
 }
 
-// Recieve a string of comma separated values of Nodes ids
-// and return a vector of Ways
+// Recieve a list of Nodes ids and return the Ways that use any of them
 std::list<std::shared_ptr<OsmWay>>
-QueryRaw::getWaysByNodesRefs(std::string &nodeIds) const
+QueryRaw::getWaysByNodesRefs(const std::vector<long> &nodeIds) const
 {
 #ifdef TIMING_DEBUG
     boost::timer::auto_cpu_timer timer("getWaysByNodesRefs(nodeIds): took %w seconds\n");
 #endif
     std::list<std::shared_ptr<osmobjects::OsmWay>> ways;
-    std::vector<std::string> queries;
-
-    // Get all Ways that have references to Nodes from the DB, including Polygons and LineString geometries
-    // std::string waysQuery = "SELECT distinct(osm_id), refs, version, tags, uid, changeset from way_refs join ways_poly wp on wp.osm_id = way_id where node_id = any(ARRAY[" + nodeIds + "])";
-    queries.push_back("SELECT distinct(osm_id), refs, version, tags, uid, changeset from ways_poly where refs @> '{" + nodeIds + "}'");
-
-    queries.push_back("SELECT distinct(osm_id), refs, version, tags, uid, changeset from ways_line where refs @> '{" + nodeIds + "}'");
-    // waysQuery += " UNION SELECT distinct(osm_id), refs, version, tags, uid, changeset from way_refs join ways_line wl on wl.osm_id = way_id where node_id = any(ARRAY[" + nodeIds + "]);";
 
-    for (auto it = queries.begin(); it != queries.end(); ++it) {
+    // Get all Ways that have references to any of the Nodes from the DB, including Polygons
+    // and LineString geometries, with one lookup in the way_refs index
+    auto ways_result = dbconn->execute(Statement("raw_ways_by_node_refs").bind(nodeIds));
+    if (ways_result.size() == 0) {
+        log_debug("No results returned!");
+        return ways;
+    }
 
-        auto ways_result = dbconn->query(*it);
-        if (ways_result.size() == 0) {
-            log_debug("No results returned!");
-            return ways;
+    // Create Ways objects and fill the vector
+    for (auto way_it = ways_result.begin(); way_it != ways_result.end(); ++way_it) {
+        auto way = std::make_shared<OsmWay>();
+        way->id = (*way_it)[0].as<long>();
+        std::string refs_str = (*way_it)[1].as<std::string>();
+        if (refs_str.size() > 1) {
+            way->refs = arrayStrToVector(refs_str);
         }
-
-        // Create Ways objects and fill the vector
-        for (auto way_it = ways_result.begin(); way_it != ways_result.end(); ++way_it) {
-            auto way = std::make_shared<OsmWay>();
-            way->id = (*way_it)[0].as<long>();
-            std::string refs_str = (*way_it)[1].as<std::string>();
-            if (refs_str.size() > 1) {
-                way->refs = arrayStrToVector(refs_str);
-            }
-            way->version = (*way_it)[2].as<long>();
-            auto tags = (*way_it)[3];
-            if (!tags.is_null()) {
-                auto tags = parseJSONObjectStr((*way_it)[3].as<std::string>());
-                for (auto const& [key, val] : tags) {
-                    way->addTag(key, val);
-                }
-            }
-            auto uid = (*way_it)[4];
-            if (!uid.is_null()) {
-                way->uid = (*way_it)[4].as<long>();
-            }
-            auto changeset = (*way_it)[5];
-            if (!changeset.is_null()) {
-                way->changeset = (*way_it)[5].as<long>();
+        way->version = (*way_it)[2].as<long>();
+        auto tags = (*way_it)[3];
+        if (!tags.is_null()) {
+            auto tags = parseJSONObjectStr((*way_it)[3].as<std::string>());
+            for (auto const& [key, val] : tags) {
+                way->addTag(key, val);
             }
-            ways.push_back(way);
         }
+        auto uid = (*way_it)[4];
+        if (!uid.is_null()) {
+            way->uid = (*way_it)[4].as<long>();
+        }
+        auto changeset = (*way_it)[5];
+        if (!changeset.is_null()) {
+            way->changeset = (*way_it)[5].as<long>();
+        }
+        ways.push_back(way);
     }
     return ways;
 }
@@ -939,7 +1170,7 @@ QueryRaw::getNodesFromDB(long lastid, int pageSize) {
         point_t point;
         std::string point_str = (*node_it)[1].as<std::string>();
         bg::read_wkt(point_str, point);
-        node.setPoint(bg::get<0>(point), bg::get<1>(point));
+        node.point = point;
         node.version = (*node_it)[2].as<long>();
         auto tags = (*node_it)[3];
         if (!tags.is_null()) {
@@ -1089,9 +1320,9 @@ QueryRaw::getRelationsFromDB(long lastid, int pageSize) {
             auto refs = parseJSONArrayStr((*rel_it)[1].as<std::string>());
             for (auto ref_it = refs.begin(); ref_it != refs.end(); ++ref_it) {
                 auto relType = osmobjects::osmtype_t::way;
-                if (ref_it->at("type") == "n") {
+                if (ref_it->at("type") == "n" || ref_it->at("type") == "node") {
                     relType = osmobjects::osmtype_t::node;
-                } else if (ref_it->at("type") == "r") {
+                } else if (ref_it->at("type") == "r" || ref_it->at("type") == "relation") {
                     relType = osmobjects::osmtype_t::relation;
                 }
                 relation.addMember(
@@ -35,8 +35,11 @@
 #include <iostream>
 #include <map>
 #include "data/pq.hh"
+#include "data/coalescer.hh"
 #include "osm/osmobjects.hh"
 #include "osm/osmchange.hh"
+#include "raw/nodelocations.hh"
+#include "raw/objectcache.hh"
 
 using namespace pq;
 using namespace osmobjects;
@@ -57,6 +60,10 @@ class QueryRaw {
     ~QueryRaw(void){};
     QueryRaw(std::shared_ptr<Pq> db);
 
+    /// The prepared statements for the raw tables, by name, so they
+    /// can be added to other connections to the same database
+    static std::map<std::string, std::string> getStatements(void);
+
     // Name of the table for storing polygons
     static const std::string polyTable;
     // Name of the table for storing linestrings
@@ -68,22 +75,34 @@ class QueryRaw {
     std::shared_ptr<std::vector<std::string>> applyChange(const OsmWay &way) const;
     /// Build query for processed Relation
     std::shared_ptr<std::vector<std::string>> applyChange(const OsmRelation &relation) const;
+    /// Add the prepared statement calls for a processed Node
+    void applyChange(const OsmNode &node, Coalescer &writes) const;
+    /// Add the prepared statement calls for a processed Way
+    void applyChange(const OsmWay &way, Coalescer &writes) const;
+    /// Add the prepared statement calls for a processed Relation
+    void applyChange(const OsmRelation &relation, Coalescer &writes) const;
     /// Build all geometries for a OsmChange file
     void buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const multipolygon_t &poly);
+    /// Build all geometries for a OsmChange file, using a prepared boundary
+    void buildGeometries(std::shared_ptr<OsmChangeFile> osmchanges, const geoutil::BoundaryIndex &boundary);
     /// Get nodes for filling Node cache from refs on ways 
-    void getNodeCacheFromWays(std::shared_ptr<std::vector<OsmWay>> ways, std::map<double, point_t> &nodecache) const;
+    void getNodeCacheFromWays(std::shared_ptr<std::vector<OsmWay>> ways, NodeCache &nodecache) const;
     // Get ways by node refs (used for ways geometries)
-    std::list<std::shared_ptr<OsmWay>> getWaysByNodesRefs(std::string &nodeIds) const;
+    std::list<std::shared_ptr<OsmWay>> getWaysByNodesRefs(const std::vector<long> &nodeIds) const;
     // Get ways by ids (used for relations geometries)
     void getWaysByIds(std::string &relsForWayCacheIds, std::map<long, std::shared_ptr<osmobjects::OsmWay>> &waycache);
     // Get relations by referenced ways (used for relations geometries)
-    std::list<std::shared_ptr<OsmRelation>> getRelationsByWaysRefs(std::string &wayIds) const;
+    std::list<std::shared_ptr<OsmRelation>> getRelationsByWaysRefs(const std::vector<long> &wayIds) const;
     // OSM DB connection
     std::shared_ptr<Pq> dbconn;
+    // Local node locations, used before querying the DB for nodes
+    std::shared_ptr<NodeLocations> locations;
+    // Recently used nodes and ways, shared by all the files
+    std::shared_ptr<ObjectCache> cache;
     // Get object (nodes, ways or relations) count from the database
     int getCount(const std::string &tableName);
     // Build tags query for insert tags into the databse
-    std::string buildTagsQuery(std::map<std::string, std::string> tags) const;
+    std::string buildTagsQuery(const osmobjects::TagList &tags) const;
     // Get ways by page
     std::shared_ptr<std::vector<OsmWay>> getWaysFromDB(long lastid, int pageSize, const std::string &tableName);
     // Get ways by page, without refs (useful for non OSM databases)
@@ -0,0 +1,561 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file rawcopy.cc
+/// \brief Bulk writes of the raw OSM tables using COPY
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <tuple>
+#include <boost/format.hpp>
+
+#include "raw/rawcopy.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace osmobjects;
+
+namespace bg = boost::geometry;
+
+namespace queryraw {
+
+/// The staging tables. ON COMMIT DELETE ROWS empties them after each
+/// batch, so they never need to be truncated.
+static const std::string stageTables = "\
+CREATE TEMP TABLE IF NOT EXISTS nodes_stage (osm_id int8, changeset int8, geom geometry, tags jsonb, \
+version int, username text, uid int8, op char(1)) ON COMMIT DELETE ROWS; \
+CREATE TEMP TABLE IF NOT EXISTS ways_poly_stage (osm_id int8, changeset int8, geom geometry, tags jsonb, \
+refs int8[], version int, username text, uid int8, op char(1)) ON COMMIT DELETE ROWS; \
+CREATE TEMP TABLE IF NOT EXISTS ways_line_stage (osm_id int8, changeset int8, geom geometry, tags jsonb, \
+refs int8[], version int, username text, uid int8, op char(1)) ON COMMIT DELETE ROWS; \
+CREATE TEMP TABLE IF NOT EXISTS relations_stage (osm_id int8, changeset int8, geom geometry, tags jsonb, \
+refs jsonb, version int, username text, uid int8, op char(1)) ON COMMIT DELETE ROWS;";
+
+/// Merge the staging tables into the raw tables. There is only one row
+/// per object in a batch, so each step can be a single statement. The
+/// version checks are the same as the ones in QueryRaw::applyChange().
+static const std::string mergeNodes = "\
+DELETE FROM nodes n USING nodes_stage s WHERE s.op = 'd' AND n.osm_id = s.osm_id; \
+INSERT INTO nodes AS r (osm_id, geom, tags, timestamp, version, \"user\", uid, changeset) \
+SELECT osm_id, geom, tags, now(), version, username, uid, changeset FROM nodes_stage WHERE op = 'u' \
+ON CONFLICT (osm_id) DO UPDATE SET geom = EXCLUDED.geom, tags = EXCLUDED.tags, \
+timestamp = EXCLUDED.timestamp, version = EXCLUDED.version, \"user\" = EXCLUDED.\"user\", \
+uid = EXCLUDED.uid, changeset = EXCLUDED.changeset WHERE r.version < EXCLUDED.version;";
+
+/// A deleted way doesn't have a geometry, so it's removed from both tables
+static const std::string mergeWays = "\
+DELETE FROM %1% w USING (SELECT osm_id FROM ways_poly_stage WHERE op = 'd' \
+UNION ALL SELECT osm_id FROM ways_line_stage WHERE op = 'd') s WHERE w.osm_id = s.osm_id; \
+INSERT INTO %1% AS r (osm_id, tags, refs, geom, timestamp, version, \"user\", uid, changeset) \
+SELECT osm_id, tags, refs, geom, now(), version, username, uid, changeset FROM %1%_stage WHERE op = 'u' \
+ON CONFLICT (osm_id) DO UPDATE SET tags = EXCLUDED.tags, refs = EXCLUDED.refs, geom = EXCLUDED.geom, \
+timestamp = EXCLUDED.timestamp, version = EXCLUDED.version, \"user\" = EXCLUDED.\"user\", \
+uid = EXCLUDED.uid, changeset = EXCLUDED.changeset WHERE r.version <= EXCLUDED.version; \
+UPDATE %1% w SET geom = s.geom, timestamp = now() FROM %1%_stage s WHERE s.op = 'g' AND w.osm_id = s.osm_id; \
+DELETE FROM %2% w USING %1%_stage s WHERE s.op IN ('u', 'g') AND w.osm_id = s.osm_id;";
+
+/// Replace the entries of the written or deleted Ways in the reverse
+/// index of Nodes. A staged Way was only written if the table has it's
+/// version now, otherwise a newer version is there with it's own refs.
+static const std::string mergeWayRefs = "\
+DELETE FROM way_refs r USING (SELECT osm_id FROM ways_poly_stage WHERE op = 'd' \
+UNION ALL SELECT osm_id FROM ways_line_stage WHERE op = 'd' \
+UNION ALL SELECT s.osm_id FROM ways_poly_stage s JOIN ways_poly w USING (osm_id, version) WHERE s.op = 'u' \
+UNION ALL SELECT s.osm_id FROM ways_line_stage s JOIN ways_line w USING (osm_id, version) WHERE s.op = 'u') s \
+WHERE r.way_id = s.osm_id; \
+INSERT INTO way_refs (way_id, node_id) SELECT DISTINCT s.osm_id, n.node_id \
+FROM (SELECT s.osm_id, s.refs FROM ways_poly_stage s JOIN ways_poly w USING (osm_id, version) WHERE s.op = 'u' \
+UNION ALL SELECT s.osm_id, s.refs FROM ways_line_stage s JOIN ways_line w USING (osm_id, version) WHERE s.op = 'u') s, \
+unnest(s.refs) AS n(node_id);";
+
+static const std::string mergeRelations = "\
+DELETE FROM relations r USING relations_stage s WHERE s.op = 'd' AND r.osm_id = s.osm_id; \
+INSERT INTO relations AS r (osm_id, tags, refs, geom, timestamp, version, \"user\", uid, changeset) \
+SELECT osm_id, tags, refs, geom, now(), version, username, uid, changeset FROM relations_stage WHERE op = 'u' \
+ON CONFLICT (osm_id) DO UPDATE SET tags = EXCLUDED.tags, refs = EXCLUDED.refs, geom = EXCLUDED.geom, \
+timestamp = EXCLUDED.timestamp, version = EXCLUDED.version, \"user\" = EXCLUDED.\"user\", \
+uid = EXCLUDED.uid, changeset = EXCLUDED.changeset WHERE r.version <= EXCLUDED.version; \
+UPDATE relations r SET geom = s.geom, timestamp = now() FROM relations_stage s \
+WHERE s.op = 'g' AND r.osm_id = s.osm_id;";
+
+/// Replace the entries of the written or deleted Relations in the
+/// reverse index of Ways, like the Ways. The members from osm2pgsql use
+/// the short type.
+static const std::string mergeRelRefs = "\
+DELETE FROM rel_refs r USING (SELECT osm_id FROM relations_stage WHERE op = 'd' \
+UNION ALL SELECT s.osm_id FROM relations_stage s JOIN relations w USING (osm_id, version) WHERE s.op = 'u') s \
+WHERE r.rel_id = s.osm_id; \
+INSERT INTO rel_refs (rel_id, way_id) SELECT DISTINCT s.osm_id, (m->>'ref')::bigint \
+FROM relations_stage s JOIN relations w USING (osm_id, version), jsonb_array_elements(s.refs) m \
+WHERE s.op = 'u' AND m->>'type' IN ('way', 'w');";
+
+/// Which row wins when an object is in a batch twice with the same version
+static int
+rank(RawRow::op_t op)
+{
+    switch (op) {
+        case RawRow::geometry: return 1;
+        case RawRow::upsert: return 2;
+        case RawRow::remove: return 3;
+        default: return 0;
+    }
+}
+
+void
+RawBatch::add(std::unordered_map<long, Slot> &index, std::vector<RawRow> RawBatch::*table, RawRow &&row,
+              bool later)
+{
+    auto found = index.find(row.osm_id);
+    if (found != index.end()) {
+        RawRow &old = (this->*found->second.table)[found->second.index];
+        if (row.version < old.version) {
+            return;
+        }
+        if (row.version == old.version) {
+            // A geometry from a later file was built from newer node
+            // locations, so it replaces the one in the full row
+            if (later && row.op == RawRow::geometry && old.op == RawRow::upsert) {
+                old.geom = std::move(row.geom);
+                return;
+            }
+            if (!later && rank(row.op) < rank(old.op)) {
+                return;
+            }
+        }
+        old.op = RawRow::skip;
+        rows--;
+    }
+    (this->*table).push_back(std::move(row));
+    index[(this->*table).back().osm_id] = {table, (this->*table).size() - 1};
+    rows++;
+}
+
+void
+RawBatch::add(RawBatch &&other)
+{
+    for (auto it = std::begin(other.nodes); it != std::end(other.nodes); ++it) {
+        if (it->op != RawRow::skip) {
+            add(nodeindex, &RawBatch::nodes, std::move(*it), true);
+        }
+    }
+    for (auto table : {&RawBatch::ways_poly, &RawBatch::ways_line}) {
+        for (auto it = std::begin(other.*table); it != std::end(other.*table); ++it) {
+            if (it->op != RawRow::skip) {
+                add(wayindex, table, std::move(*it), true);
+            }
+        }
+    }
+    for (auto it = std::begin(other.relations); it != std::end(other.relations); ++it) {
+        if (it->op != RawRow::skip) {
+            add(relindex, &RawBatch::relations, std::move(*it), true);
+        }
+    }
+    other = RawBatch();
+}
+
+void
+RawBatch::add(const OsmNode &node)
+{
+    RawRow row;
+    row.osm_id = node.id;
+    row.version = node.version;
+    if (node.action == osmobjects::create || node.action == osmobjects::modify) {
+        row.op = RawRow::upsert;
+        row.changeset = node.changeset;
+        row.geom = RawCopy::ewkb(node.point);
+        row.tags = RawCopy::json(node.tags);
+        row.user = node.user;
+        row.uid = node.uid;
+    } else if (node.action == osmobjects::remove) {
+        row.op = RawRow::remove;
+    } else {
+        return;
+    }
+    add(nodeindex, &RawBatch::nodes, std::move(row));
+}
+
+void
+RawBatch::add(const OsmWay &way)
+{
+    RawRow row;
+    row.osm_id = way.id;
+    row.version = way.version;
+    bool closed = way.refs.size() > 3 && way.refs.front() == way.refs.back();
+    auto table = closed ? &RawBatch::ways_poly : &RawBatch::ways_line;
+
+    if (way.refs.size() > 0 && (way.action == osmobjects::create || way.action == osmobjects::modify ||
+                                way.action == osmobjects::modify_geom)) {
+        // Only complete geometries are written
+        if (!((way.refs.front() != way.refs.back() && way.refs.size() == bg::num_points(way.linestring)) ||
+              (way.refs.front() == way.refs.back() && way.refs.size() == bg::num_points(way.polygon)))) {
+            return;
+        }
+        if (closed) {
+            row.geom = RawCopy::ewkb(way.polygon);
+        } else {
+            row.geom = RawCopy::ewkb(way.linestring);
+        }
+        if (way.action == osmobjects::modify_geom) {
+            row.op = RawRow::geometry;
+        } else {
+            row.op = RawRow::upsert;
+            row.changeset = way.changeset;
+            row.tags = RawCopy::json(way.tags);
+            std::string refs = "{";
+            for (auto it = std::begin(way.refs); it != std::end(way.refs); ++it) {
+                refs += std::to_string(*it) + ",";
+            }
+            refs.back() = '}';
+            row.refs = refs;
+            row.user = way.user;
+            row.uid = way.uid;
+        }
+    } else if (way.action == osmobjects::remove) {
+        row.op = RawRow::remove;
+    } else {
+        return;
+    }
+    add(wayindex, table, std::move(row));
+}
+
+void
+RawBatch::add(const OsmRelation &relation)
+{
+    RawRow row;
+    row.osm_id = relation.id;
+    row.version = relation.version;
+    if (relation.action == osmobjects::create || relation.action == osmobjects::modify ||
+        relation.action == osmobjects::modify_geom) {
+        // Ignore empty geometries
+        if (relation.isMultiPolygon()) {
+            if (bg::num_points(relation.multipolygon) == 0) {
+                return;
+            }
+            row.geom = RawCopy::ewkb(relation.multipolygon);
+        } else {
+            if (bg::num_points(relation.multilinestring) == 0) {
+                return;
+            }
+            row.geom = RawCopy::ewkb(relation.multilinestring);
+        }
+        if (relation.action == osmobjects::modify_geom) {
+            row.op = RawRow::geometry;
+        } else {
+            row.op = RawRow::upsert;
+            row.changeset = relation.changeset;
+            row.tags = RawCopy::json(relation.tags);
+            row.refs = RawCopy::json(relation.members);
+            row.user = relation.user;
+            row.uid = relation.uid;
+        }
+    } else if (relation.action == osmobjects::remove) {
+        row.op = RawRow::remove;
+    } else {
+        return;
+    }
+    add(relindex, &RawBatch::relations, std::move(row));
+}
+
+/// \class WkbWriter
+/// \brief Writes little endian WKB as hex, which is what PostGIS
+/// accepts as the text form of a geometry
+class WkbWriter {
+  public:
+    void byte(std::uint8_t value) {
+        static const char digits[] = "0123456789ABCDEF";
+        hex += digits[value >> 4];
+        hex += digits[value & 0x0f];
+    };
+    void uint32(std::uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            byte(value >> (i * 8));
+        }
+    };
+    void real(double value) {
+        std::uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        for (int i = 0; i < 8; i++) {
+            byte(bits >> (i * 8));
+        }
+    };
+    /// Only the outermost geometry has the SRID
+    void header(std::uint32_t type, bool srid) {
+        byte(1);
+        if (srid) {
+            uint32(type | 0x20000000);
+            uint32(4326);
+        } else {
+            uint32(type);
+        }
+    };
+    template <typename T> void points(const T &range) {
+        uint32(range.size());
+        for (auto it = std::begin(range); it != std::end(range); ++it) {
+            real(it->x());
+            real(it->y());
+        }
+    };
+    void linestring(const linestring_t &line, bool srid) {
+        header(2, srid);
+        points(line);
+    };
+    void polygon(const polygon_t &poly, bool srid) {
+        header(3, srid);
+        if (poly.outer().empty()) {
+            uint32(0);
+            return;
+        }
+        uint32(poly.inners().size() + 1);
+        points(poly.outer());
+        for (auto it = std::begin(poly.inners()); it != std::end(poly.inners()); ++it) {
+            points(*it);
+        }
+    };
+
+    std::string hex;
+};
+
+std::string
+RawCopy::ewkb(const point_t &point)
+{
+    WkbWriter wkb;
+    wkb.header(1, true);
+    wkb.real(point.x());
+    wkb.real(point.y());
+    return wkb.hex;
+}
+
+std::string
+RawCopy::ewkb(const linestring_t &line)
+{
+    WkbWriter wkb;
+    wkb.linestring(line, true);
+    return wkb.hex;
+}
+
+std::string
+RawCopy::ewkb(const polygon_t &poly)
+{
+    WkbWriter wkb;
+    wkb.polygon(poly, true);
+    return wkb.hex;
+}
+
+std::string
+RawCopy::ewkb(const multilinestring_t &lines)
+{
+    WkbWriter wkb;
+    wkb.header(5, true);
+    wkb.uint32(lines.size());
+    for (auto it = std::begin(lines); it != std::end(lines); ++it) {
+        wkb.linestring(*it, false);
+    }
+    return wkb.hex;
+}
+
+/// Quote a string for JSON. PostgreSQL doesn't allow \u0000 in JSONB,
+/// so any NUL characters are dropped.
+static void
+quote(std::string &out, const std::string &str)
+{
+    static const char digits[] = "0123456789abcdef";
+    out += '"';
+    for (auto it = std::begin(str); it != std::end(str); ++it) {
+        unsigned char c = *it;
+        switch (c) {
+            case '\0': break;
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    out += "\\u00";
+                    out += digits[c >> 4];
+                    out += digits[c & 0x0f];
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+std::optional<std::string>
+RawCopy::json(const TagList &tags)
+{
+    if (tags.empty()) {
+        return std::nullopt;
+    }
+    std::string out = "{";
+    for (auto it = std::begin(tags); it != std::end(tags); ++it) {
+        quote(out, it->first);
+        out += ':';
+        quote(out, it->second);
+        out += ',';
+    }
+    out.back() = '}';
+    return out;
+}
+
+std::optional<std::string>
+RawCopy::json(const std::list<OsmRelationMember> &members)
+{
+    if (members.empty()) {
+        return std::nullopt;
+    }
+    std::string out = "[";
+    for (auto it = std::begin(members); it != std::end(members); ++it) {
+        out += "{\"role\":";
+        quote(out, it->role);
+        switch (it->type) {
+            case osmobjects::osmtype_t::node: out += ",\"type\":\"node\""; break;
+            case osmobjects::osmtype_t::way: out += ",\"type\":\"way\""; break;
+            case osmobjects::osmtype_t::relation: out += ",\"type\":\"relation\""; break;
+            default: out += ",\"type\":\"\"";
+        }
+        out += ",\"ref\":" + std::to_string(it->ref) + "},";
+    }
+    out.back() = ']';
+    return out;
+}
+
+void
+RawCopy::copy(pqxx::work &worker, const std::string &stage, const std::vector<RawRow> &rows, bool refs)
+{
+    static const char *ops[] = {"", "u", "g", "d"};
+    if (refs) {
+        pqxx::stream_to stream{worker, stage, std::vector<std::string>{
+            "osm_id", "changeset", "geom", "tags", "refs", "version", "username", "uid", "op"}};
+        for (auto it = std::begin(rows); it != std::end(rows); ++it) {
+            if (it->op != RawRow::skip) {
+                stream << std::make_tuple(it->osm_id, it->changeset, it->geom, it->tags, it->refs,
+                                          it->version, it->user, it->uid, ops[it->op]);
+            }
+        }
+        stream.complete();
+    } else {
+        pqxx::stream_to stream{worker, stage, std::vector<std::string>{
+            "osm_id", "changeset", "geom", "tags", "version", "username", "uid", "op"}};
+        for (auto it = std::begin(rows); it != std::end(rows); ++it) {
+            if (it->op != RawRow::skip) {
+                stream << std::make_tuple(it->osm_id, it->changeset, it->geom, it->tags,
+                                          it->version, it->user, it->uid, ops[it->op]);
+            }
+        }
+        stream.complete();
+    }
+}
+
+bool
+RawCopy::write(const RawBatch &batch)
+{
+    if (batch.empty()) {
+        return true;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::scoped_lock write_lock{dbconn->pqxx_mutex};
+    try {
+        pqxx::work worker(*dbconn->sdb);
+        if (!staged) {
+            worker.exec(stageTables);
+        }
+        copy(worker, "nodes_stage", batch.nodes, false);
+        copy(worker, "ways_poly_stage", batch.ways_poly, true);
+        copy(worker, "ways_line_stage", batch.ways_line, true);
+        copy(worker, "relations_stage", batch.relations, true);
+        worker.exec(mergeNodes);
+        worker.exec(str(boost::format(mergeWays) % "ways_poly" % "ways_line"));
+        worker.exec(str(boost::format(mergeWays) % "ways_line" % "ways_poly"));
+        worker.exec(mergeWayRefs);
+        worker.exec(mergeRelations);
+        worker.exec(mergeRelRefs);
+        worker.commit();
+    } catch (std::exception &e) {
+        log_error("ERROR copying raw data %1%", e.what());
+        // The staging tables are gone if they were created in this transaction
+        staged = false;
+        return false;
+    }
+    staged = true;
+    rows += batch.size();
+    batches++;
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+bool
+RawCopy::write(const std::vector<std::pair<long, long>> &refs)
+{
+    if (refs.empty()) {
+        return true;
+    }
+    auto start = std::chrono::steady_clock::now();
+    std::string rels;
+    long last = 0;
+    for (auto it = std::begin(refs); it != std::end(refs); ++it) {
+        if (it == std::begin(refs) || it->first != last) {
+            rels += std::to_string(it->first) + ",";
+            last = it->first;
+        }
+    }
+    rels.back() = '}';
+    std::scoped_lock write_lock{dbconn->pqxx_mutex};
+    try {
+        pqxx::work worker(*dbconn->sdb);
+        worker.exec("DELETE FROM rel_refs WHERE rel_id = ANY('{" + rels + "'::bigint[])");
+        pqxx::stream_to stream{worker, "rel_refs", std::vector<std::string>{"rel_id", "way_id"}};
+        for (auto it = std::begin(refs); it != std::end(refs); ++it) {
+            stream << std::make_tuple(it->first, it->second);
+        }
+        stream.complete();
+        worker.commit();
+    } catch (std::exception &e) {
+        log_error("ERROR copying rel_refs %1%", e.what());
+        return false;
+    }
+    rows += refs.size();
+    batches++;
+    seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+void
+RawCopy::dump(void) const
+{
+    double rate = 0;
+    if (seconds > 0) {
+        rate = rows / seconds;
+    }
+    log_debug("Raw COPY: %1% rows in %2% batches, %3% rows/s", rows, batches, rate);
+}
+
+} // namespace queryraw
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
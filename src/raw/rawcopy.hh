@@ -0,0 +1,163 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __RAWCOPY_HH__
+#define __RAWCOPY_HH__
+
+/// \file rawcopy.hh
+/// \brief Bulk writes of the raw OSM tables using COPY
+///
+/// Instead of an INSERT statement per object, that has to be parsed and
+/// planned, and has it's geometry parsed from WKT, the rows of a change
+/// file are streamed into temporary staging tables with COPY, with the
+/// geometry already encoded as EWKB. A few set based statements then
+/// merge the staging tables into the raw tables.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "data/pq.hh"
+#include "osm/osmobjects.hh"
+
+/// \namespace queryraw
+namespace queryraw {
+
+/// \struct RawRow
+/// \brief A row for one of the raw tables
+struct RawRow {
+    /// What to do with the row when it's merged
+    typedef enum { skip, upsert, geometry, remove } op_t;
+
+    op_t op = skip;
+    long osm_id = 0;
+    long changeset = 0;
+    std::optional<std::string> geom; ///< Hex encoded EWKB
+    std::optional<std::string> tags; ///< JSON object
+    std::optional<std::string> refs; ///< Array of node IDs, or JSON relation members
+    int version = 0;
+    std::string user;
+    long uid = 0;
+};
+
+/// \class RawBatch
+/// \brief The rows from one or more change files, ready to be copied
+///
+/// This makes the same decisions about each object as
+/// QueryRaw::applyChange(), but keeps the data as rows instead of SQL.
+/// An object can be changed more than once in a file, and only the
+/// latest version is kept, since the merge has to be done as a single
+/// statement per table. The batches of several files can be added
+/// together, so the objects they share are only written once.
+class RawBatch {
+  public:
+    /// Add a node, if it should be written
+    void add(const osmobjects::OsmNode &node);
+    /// Add a way, if it should be written
+    void add(const osmobjects::OsmWay &way);
+    /// Add a relation, if it should be written
+    void add(const osmobjects::OsmRelation &relation);
+    /// Add the rows from a later file
+    void add(RawBatch &&other);
+
+    /// The number of rows that will be written
+    std::size_t size(void) const { return rows; };
+    bool empty(void) const { return rows == 0; };
+
+    std::vector<RawRow> nodes;
+    std::vector<RawRow> ways_poly;
+    std::vector<RawRow> ways_line;
+    std::vector<RawRow> relations;
+
+  private:
+    /// Where the latest row for an object is
+    struct Slot {
+        std::vector<RawRow> RawBatch::*table;
+        std::size_t index;
+    };
+    /// Add a row, replacing an older row for the same object
+    void add(std::unordered_map<long, Slot> &index, std::vector<RawRow> RawBatch::*table, RawRow &&row,
+             bool later = false);
+
+    std::unordered_map<long, Slot> nodeindex;
+    std::unordered_map<long, Slot> wayindex;
+    std::unordered_map<long, Slot> relindex;
+    std::size_t rows = 0;
+};
+
+/// \class RawCopy
+/// \brief Write batches of rows to the raw tables
+///
+/// The staging tables are temporary tables, so they are never written
+/// to the WAL, and each connection has it's own.
+class RawCopy {
+  public:
+    RawCopy(std::shared_ptr<pq::Pq> db) : dbconn(db) {};
+
+    /// Copy a batch to the staging tables, and merge it into the raw
+    /// tables, all in one transaction
+    bool write(const RawBatch &batch);
+    /// Replace the rows in rel_refs for the relations in \a refs, which
+    /// are pairs of a relation and one of it's way members
+    bool write(const std::vector<std::pair<long, long>> &refs);
+
+    /// Encode a geometry as hex EWKB with SRID 4326
+    static std::string ewkb(const point_t &point);
+    static std::string ewkb(const linestring_t &line);
+    static std::string ewkb(const polygon_t &poly);
+    static std::string ewkb(const multilinestring_t &lines);
+    /// Encode tags as a JSON object, or nothing if there are none
+    static std::optional<std::string> json(const osmobjects::TagList &tags);
+    /// Encode relation members as a JSON array
+    static std::optional<std::string> json(const std::list<osmobjects::OsmRelationMember> &members);
+
+    /// The number of rows written
+    std::uint64_t getRows(void) const { return rows; };
+    /// Log the number of rows, and the rows per second
+    void dump(void) const;
+
+  private:
+    /// Stream the rows of one table into it's staging table
+    void copy(pqxx::work &worker, const std::string &stage, const std::vector<RawRow> &rows, bool refs);
+
+    std::shared_ptr<pq::Pq> dbconn;
+    bool staged = false;         ///< Whether the staging tables exist on this connection
+    std::uint64_t rows = 0;
+    std::uint64_t batches = 0;
+    double seconds = 0;          ///< Time spent in write()
+};
+
+} // namespace queryraw
+
+#endif // EOF __RAWCOPY_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,151 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include "replicator/catchup.hh"
+
+#include "utils/log.hh"
+using namespace logger;
+
+namespace replication {
+
+/// The length of the period in a file
+static time_duration
+period(frequency_t frequency)
+{
+    return frequency == daily ? hours(24) : hours(1);
+}
+
+/// The first end of a period after \a timestamp
+static ptime
+nextPeriod(frequency_t frequency, ptime timestamp)
+{
+    static const ptime epoch(boost::gregorian::date(1970, 1, 1));
+    long length = period(frequency).total_seconds();
+    long elapsed = (timestamp - epoch).total_seconds();
+    return epoch + seconds((elapsed / length + 1) * length);
+}
+
+void
+CatchUp::plan(ptime start, const StateFile &latestday, const StateFile &latesthour)
+{
+    legs.clear();
+    leg = 0;
+    sequence = -1;
+    end = start;
+    if (start == not_a_date_time || latesthour.timestamp == not_a_date_time ||
+        latesthour.timestamp - start < min_gap) {
+        return;
+    }
+
+    ptime from = start;
+    ptime day = nextPeriod(daily, start);
+    if (latestday.timestamp != not_a_date_time && latestday.timestamp >= day) {
+        // Most of the day with the start was done already
+        if (day - start < hours(12)) {
+            add(hourly, latesthour, from, day);
+            from = day;
+        }
+        if (latestday.timestamp > from) {
+            add(daily, latestday, from, latestday.timestamp);
+            from = latestday.timestamp;
+        }
+    }
+    if (latesthour.timestamp > from) {
+        add(hourly, latesthour, from, latesthour.timestamp);
+    }
+    if (!legs.empty()) {
+        sequence = legs.front().first;
+        log_debug("Catching up from %1% to %2% with %3% files", start, end, size());
+    }
+}
+
+void
+CatchUp::add(frequency_t frequency, const StateFile &latest, ptime from, ptime to)
+{
+    ptime first = nextPeriod(frequency, from);
+    if (first > to) {
+        return;
+    }
+    long firstseq = toSequence(latest, frequency, first);
+    long lastseq = toSequence(latest, frequency, to);
+    if (!legs.empty() && legs.back().frequency == frequency && legs.back().last + 1 == firstseq) {
+        legs.back().last = lastseq;
+        legs.back().end = to;
+    } else {
+        legs.push_back({frequency, firstseq, lastseq, to});
+    }
+    end = to;
+}
+
+bool
+CatchUp::next(frequency_t &frequency, long &seq)
+{
+    if (done()) {
+        return false;
+    }
+    frequency = legs[leg].frequency;
+    seq = sequence;
+    if (sequence < legs[leg].last) {
+        sequence++;
+    } else if (++leg < legs.size()) {
+        sequence = legs[leg].first;
+    }
+    return true;
+}
+
+long
+CatchUp::size(void) const
+{
+    long files = 0;
+    for (auto it = std::begin(legs); it != std::end(legs); ++it) {
+        files += it->last - it->first + 1;
+    }
+    return files;
+}
+
+std::string
+CatchUp::getURL(const RemoteURL &remote, frequency_t frequency, long seq)
+{
+    return "https://" + remote.domain + "/" + remote.datadir + "/" + StateFile::freq_to_string(frequency) + "/" +
+           (boost::format("%03d/%03d/%03d") % (seq / 1000000) % (seq / 1000 % 1000) % (seq % 1000)).str() +
+           ".osc.gz";
+}
+
+long
+CatchUp::toSequence(const StateFile &latest, frequency_t frequency, ptime timestamp)
+{
+    return latest.sequence - (latest.timestamp - timestamp).total_seconds() / period(frequency).total_seconds();
+}
+
+} // namespace replication
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __CATCHUP_HH__
+#define __CATCHUP_HH__
+
+/// \file catchup.hh
+/// \brief Catch up with daily and hourly files instead of minutely ones
+///
+/// When the replicator is days behind, downloading and applying every
+/// minutely file is 1440 files a day. The daily and hourly files have
+/// the same changes, with only the last version of each object in the
+/// period, so catching up with them is much less work.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+using namespace boost::posix_time;
+
+#include "replicator/replication.hh"
+
+/// \namespace replication
+namespace replication {
+
+/// \struct Leg
+/// \brief A run of files of the same frequency
+struct Leg {
+    frequency_t frequency;  ///< The frequency of the files
+    long first;             ///< The sequence of the first file
+    long last;              ///< The sequence of the last file
+    ptime end;              ///< The timestamp of the last file
+};
+
+/// \class CatchUp
+/// \brief The daily and hourly files to get from a point in time to now
+///
+/// The timestamp in the state.txt of a file is the end of the period it
+/// has the changes for. The daily and hourly files end on the day and
+/// the hour, so their sequence can be found from the latest one.
+///
+/// Applying a change again is harmless, since the older versions are
+/// ignored, so the first file may start before the starting point. The
+/// daily file that has the start is only used when most of it is new,
+/// otherwise hourly files are used to the end of that day. After the
+/// last daily file, hourly files are used up to the latest one, and the
+/// minutely files carry on from there.
+class CatchUp {
+  public:
+    /// Plan the files after \a start, from the latest \a daily and
+    /// \a hourly state files. Nothing is planned if \a start is less
+    /// than min_gap before the latest hourly file.
+    void plan(ptime start, const StateFile &daily, const StateFile &hourly);
+
+    /// Get the next file to download, returns false when there are none left
+    bool next(frequency_t &frequency, long &sequence);
+    /// Whether all the planned files were returned
+    bool done(void) const { return leg >= legs.size(); };
+    /// The frequency of the next file, minutely when the plan is done
+    frequency_t current(void) const { return done() ? minutely : legs[leg].frequency; };
+    /// The number of files planned
+    long size(void) const;
+
+    /// The URL of a file like \a remote, with another frequency and sequence
+    static std::string getURL(const RemoteURL &remote, frequency_t frequency, long sequence);
+    /// The sequence of the file ending at \a timestamp, from the \a latest
+    /// state file of a daily or hourly frequency
+    static long toSequence(const StateFile &latest, frequency_t frequency, ptime timestamp);
+
+    std::vector<Leg> legs;             ///< The planned files
+    ptime end = not_a_date_time;       ///< The timestamp of the last planned file
+    long handover = -1;                ///< The minutely file that ends at or before \a end
+    time_duration min_gap = hours(2);  ///< How far behind before using the plan
+
+  private:
+    /// Add the files of a \a frequency ending after \a from, up to \a to
+    void add(frequency_t frequency, const StateFile &latest, ptime from, ptime to);
+
+    std::size_t leg = 0;    ///< The leg of the next file
+    long sequence = -1;     ///< The next file in the leg
+};
+
+} // namespace replication
+
+#endif // EOF __CATCHUP_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
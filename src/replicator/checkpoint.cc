@@ -0,0 +1,130 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+
+#include "replicator/checkpoint.hh"
+
+#include "utils/log.hh"
+using namespace logger;
+
+namespace replication {
+
+Checkpoint::Checkpoint(std::shared_ptr<pq::Pq> db, const std::string &name, frequency_t freq)
+    : stream(name), frequency(freq), dbconn(db)
+{
+    dbconn->prepare("checkpoint_load", "SELECT sequence, path, \
+to_char(timestamp AT TIME ZONE 'UTC', 'YYYY-MM-DD HH24:MI:SS') FROM checkpoints WHERE stream = $1 AND frequency = $2");
+    dbconn->prepare("checkpoint_update", "INSERT INTO checkpoints AS c (stream, frequency, sequence, path, timestamp, updated_at) \
+VALUES ($1, $2, $3, $4, $5, now()) ON CONFLICT (stream, frequency) DO UPDATE SET sequence = EXCLUDED.sequence, \
+path = EXCLUDED.path, timestamp = COALESCE(EXCLUDED.timestamp, c.timestamp), updated_at = EXCLUDED.updated_at");
+}
+
+bool
+Checkpoint::load(void)
+{
+    auto result = dbconn->execute(pq::Statement("checkpoint_load").bind(stream).bind(StateFile::freq_to_string(frequency)));
+    if (result.size() == 0) {
+        return false;
+    }
+    sequence = result[0][0].as<long>();
+    path = result[0][1].as<std::string>();
+    if (!result[0][2].is_null()) {
+        timestamp = time_from_string(result[0][2].as<std::string>());
+    }
+    blocked = false;
+    log_debug("Checkpoint for %1% %2%: %3% at %4%", stream, StateFile::freq_to_string(frequency), path, timestamp);
+    return true;
+}
+
+void
+Checkpoint::start(long seq)
+{
+    sequence = seq;
+    path = (boost::format("%03d/%03d/%03d") % (seq / 1000000) % (seq / 1000 % 1000) % (seq % 1000)).str();
+    blocked = false;
+}
+
+bool
+Checkpoint::advance(const std::string &filepath, const ptime &filetime, bool complete,
+                    std::vector<pq::Statement> &statements)
+{
+    long seq = toSequence(filepath);
+    // Already committed before, when a file is processed again
+    if (seq < 0 || (sequence >= 0 && seq <= sequence)) {
+        return false;
+    }
+    if (!complete || (sequence >= 0 && seq != sequence + 1)) {
+        blocked = true;
+        log_error("Replication file %1% is missing, the %2% checkpoint stays at %3%", filepath, stream, path);
+        return false;
+    }
+    // The gap is filled once the file after the checkpoint is done
+    blocked = false;
+    sequence = seq;
+    path = filepath;
+    pq::Statement update("checkpoint_update");
+    update.bind(stream).bind(StateFile::freq_to_string(frequency)).bind(sequence).bind(path);
+    if (filetime != not_a_date_time) {
+        timestamp = filetime;
+        update.bind(to_iso_extended_string(timestamp) + "Z");
+    } else {
+        update.bind(std::optional<std::string>());
+    }
+    statements.push_back(update);
+    return true;
+}
+
+std::string
+Checkpoint::getURL(const std::string &server) const
+{
+    return "https://" + server + "/replication/" + StateFile::freq_to_string(frequency) + "/" + path +
+           (frequency == changeset ? ".osm.gz" : ".osc.gz");
+}
+
+long
+Checkpoint::toSequence(const std::string &filepath)
+{
+    std::vector<std::string> parts;
+    boost::split(parts, filepath, boost::is_any_of("/"));
+    if (parts.size() != 3) {
+        return -1;
+    }
+    try {
+        return std::stol(parts[0]) * 1000000 + std::stol(parts[1]) * 1000 + std::stol(parts[2]);
+    } catch (const std::exception &e) {
+        return -1;
+    }
+}
+
+} // namespace replication
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,96 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __CHECKPOINT_HH__
+#define __CHECKPOINT_HH__
+
+/// \file checkpoint.hh
+/// \brief The position of the replicator, stored in the database
+///
+/// The checkpoint is the last file of a stream of replication files
+/// that was committed, with all the files before it. It's written in
+/// the same transaction as the data of that file, so after a restart
+/// the replicator can carry on from the file after it, without
+/// skipping or redoing any file that was committed.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include "data/pq.hh"
+#include "replicator/replication.hh"
+
+using namespace boost::posix_time;
+
+/// \namespace replication
+namespace replication {
+
+/// \class Checkpoint
+/// \brief The last contiguous file committed for a stream and frequency
+///
+/// Files have to be added in sequence order. If a file couldn't be
+/// processed, the checkpoint stays before it until that file is added
+/// again, so it isn't skipped, and the files after it don't move the
+/// checkpoint past the gap.
+class Checkpoint {
+  public:
+    Checkpoint(std::shared_ptr<pq::Pq> db, const std::string &stream, frequency_t frequency);
+
+    /// Read the checkpoint from the database. Returns false if there
+    /// isn't one.
+    bool load(void);
+    /// Set the file before the first one that will be added
+    void start(long sequence);
+    /// Add the next file. If the checkpoint moved, the statement that
+    /// writes it is added to the list, to be run in the same
+    /// transaction as the data of the file.
+    bool advance(const std::string &path, const ptime &timestamp, bool complete,
+                 std::vector<pq::Statement> &statements);
+    /// The URL of the checkpoint file on a planet server
+    std::string getURL(const std::string &server) const;
+
+    /// Get the sequence number of a path like 000/075/000
+    static long toSequence(const std::string &path);
+
+    std::string stream;           ///< The kind of files, osmchange or changeset
+    frequency_t frequency;        ///< The frequency of the files
+    long sequence = -1;           ///< The sequence of the last file, -1 if there is none
+    std::string path;             ///< The path of the last file, like 000/075/000
+    ptime timestamp = not_a_date_time; ///< The timestamp of the last file
+    bool blocked = false;         ///< The file after the checkpoint is missing, so it can't move
+
+  private:
+    std::shared_ptr<pq::Pq> dbconn;
+};
+
+} // namespace replication
+
+#endif // EOF __CHECKPOINT_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
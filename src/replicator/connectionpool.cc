@@ -0,0 +1,219 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <iostream>
+#include <string>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/error.hpp>
+#include <boost/asio/ssl/stream.hpp>
+
+#include "replicator/connectionpool.hh"
+
+#include "utils/log.hh"
+using namespace logger;
+
+namespace replication {
+
+Connection::Connection(net::io_context &ioc, ssl::context &ctx, const std::string &dom)
+    : domain(dom), stream(ioc, ctx)
+{
+    last_used = std::chrono::steady_clock::now();
+}
+
+Connection::~Connection(void)
+{
+    close();
+}
+
+bool
+Connection::isHealthy(void)
+{
+    auto &sock = stream.next_layer();
+    if (!sock.is_open()) {
+        return false;
+    }
+    // An idle keep-alive connection should have nothing to read. If the
+    // server has closed it, a peek returns EOF, or the close_notify
+    // alert is waiting in the socket buffer.
+    boost::system::error_code ec;
+    sock.non_blocking(true, ec);
+    if (ec) {
+        return false;
+    }
+    char byte;
+    sock.receive(net::buffer(&byte, 1), tcp::socket::message_peek, ec);
+    bool healthy = (ec == net::error::would_block || ec == net::error::try_again);
+    sock.non_blocking(false, ec);
+    return healthy && !ec;
+}
+
+void
+Connection::close(void)
+{
+    auto &sock = stream.next_layer();
+    if (!sock.is_open()) {
+        return;
+    }
+    boost::system::error_code ec;
+    // The server may already be gone, so don't wait on it
+    // to answer the close_notify.
+    sock.shutdown(tcp::socket::shutdown_both, ec);
+    sock.close(ec);
+}
+
+ConnectionPool::ConnectionPool(void)
+{
+    // Verify the remote server's certificate
+    ctx.set_verify_mode(ssl::verify_none);
+}
+
+ConnectionPool &
+ConnectionPool::instance(void)
+{
+    static ConnectionPool pool;
+    return pool;
+}
+
+tcp::resolver::results_type
+ConnectionPool::resolve(const std::string &domain, int port)
+{
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::scoped_lock lock{pool_mutex};
+        auto it = dns.find(domain);
+        if (it != dns.end() && now - it->second.resolved < dns_ttl) {
+            dns_hits++;
+            return it->second.results;
+        }
+    }
+
+    // Don't hold the lock during the lookup, it may be slow
+    dns_misses++;
+    tcp::resolver resolver{ioc};
+    auto results = resolver.resolve(domain, std::to_string(port));
+
+    std::scoped_lock lock{pool_mutex};
+    dns[domain] = Endpoints{results, now};
+    return results;
+}
+
+std::shared_ptr<Connection>
+ConnectionPool::acquire(const std::string &domain, int port)
+{
+    auto now = std::chrono::steady_clock::now();
+    {
+        std::scoped_lock lock{pool_mutex};
+        auto &conns = idle[domain];
+        // The most recently used connections are at the front
+        while (!conns.empty()) {
+            auto conn = conns.front();
+            conns.pop_front();
+            if (now - conn->last_used < idle_timeout && conn->isHealthy()) {
+                hits++;
+                conn->reused = true;
+                return conn;
+            }
+            // Stale or closed by the server, the destructor closes it
+        }
+    }
+
+    misses++;
+    auto conn = std::make_shared<Connection>(ioc, ctx, domain);
+    auto results = resolve(domain, port);
+    try {
+        // Make the connection on the IP address we get from a lookup
+        net::connect(conn->stream.next_layer(), results.begin(), results.end());
+        // Perform the SSL handshake
+        conn->stream.handshake(ssl::stream_base::client);
+    } catch (boost::system::system_error &ex) {
+        // The cached address may be stale, so look it up again next time
+        invalidate(domain);
+        throw;
+    }
+    return conn;
+}
+
+void
+ConnectionPool::release(std::shared_ptr<Connection> conn, bool reusable)
+{
+    if (!conn) {
+        return;
+    }
+    conn->requests++;
+    if (!reusable) {
+        conn->close();
+        return;
+    }
+    conn->reused = false;
+    conn->last_used = std::chrono::steady_clock::now();
+    std::scoped_lock lock{pool_mutex};
+    auto &conns = idle[conn->domain];
+    conns.push_front(conn);
+    while (conns.size() > max_idle) {
+        conns.pop_back();
+    }
+}
+
+void
+ConnectionPool::invalidate(const std::string &domain)
+{
+    std::scoped_lock lock{pool_mutex};
+    dns.erase(domain);
+    idle.erase(domain);
+}
+
+PoolStats
+ConnectionPool::getStats(void)
+{
+    PoolStats stats;
+    stats.hits = hits;
+    stats.misses = misses;
+    stats.reconnects = reconnects;
+    stats.dns_hits = dns_hits;
+    stats.dns_misses = dns_misses;
+    std::scoped_lock lock{pool_mutex};
+    for (auto it = std::begin(idle); it != std::end(idle); ++it) {
+        stats.idle += it->second.size();
+    }
+    return stats;
+}
+
+void
+ConnectionPool::dump(void)
+{
+    auto stats = getStats();
+    log_debug("Connection pool: %1% hits, %2% misses, %3% reconnects, %4% idle",
+              stats.hits, stats.misses, stats.reconnects, stats.idle);
+    log_debug("Connection pool DNS cache: %1% hits, %2% misses",
+              stats.dns_hits, stats.dns_misses);
+}
+
+} // namespace replication
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
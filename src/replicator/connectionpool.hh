@@ -0,0 +1,149 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __CONNECTIONPOOL_HH__
+#define __CONNECTIONPOOL_HH__
+
+/// \file connectionpool.hh
+/// \brief A pool of persistent HTTPS connections to the planet servers
+///
+/// Downloading replication files used to open a new TCP connection and
+/// do a full TLS handshake for every file. When catching up that is
+/// thousands of handshakes for small files, so instead the connections
+/// are kept alive and shared between all the threads downloading files.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <boost/asio/connect.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/ssl/error.hpp>
+#include <boost/asio/ssl/stream.hpp>
+
+namespace net = boost::asio;      // from <boost/asio.hpp>
+namespace ssl = boost::asio::ssl; // from <boost/asio/ssl.hpp>
+using tcp = net::ip::tcp;         // from <boost/asio/ip/tcp.hpp>
+
+/// \namespace replication
+namespace replication {
+
+/// \class Connection
+/// \brief A single keep-alive SSL connection to a server
+class Connection {
+  public:
+    Connection(net::io_context &ioc, ssl::context &ctx, const std::string &domain);
+    ~Connection(void);
+
+    /// Check whether an idle connection can still be used. The server
+    /// may have closed it, in which case the socket is readable.
+    bool isHealthy(void);
+    /// Shutdown the SSL stream and close the socket
+    void close(void);
+
+    std::string domain;     ///< The domain this connection is open to
+    ssl::stream<tcp::socket> stream; ///< The SSL stream
+    std::chrono::steady_clock::time_point last_used; ///< When this was last returned to the pool
+    long requests = 0;      ///< How many requests have been sent on this connection
+    bool reused = false;    ///< Whether this connection came from the idle list
+};
+
+/// \struct PoolStats
+/// \brief Counters for the connection pool
+struct PoolStats {
+    long hits = 0;          ///< Requests that reused an idle connection
+    long misses = 0;        ///< Requests that needed a new connection
+    long reconnects = 0;    ///< Reused connections the server had closed
+    long dns_hits = 0;      ///< Lookups answered from the DNS cache
+    long dns_misses = 0;    ///< Lookups that went to the resolver
+    long idle = 0;          ///< Connections currently idle in the pool
+};
+
+/// \class ConnectionPool
+/// \brief A per domain pool of persistent HTTPS connections
+///
+/// There is one pool for the whole process, which is shared by all the
+/// threads downloading files. Connections are checked out for a single
+/// request, and returned to the pool afterwards if the server allowed
+/// keep-alive.
+class ConnectionPool {
+  public:
+    /// The pool shared by all the threads
+    static ConnectionPool &instance(void);
+
+    /// Get a connection to a domain, either an idle one or a new one
+    std::shared_ptr<Connection> acquire(const std::string &domain, int port);
+    /// Return a connection to the pool. If it can't be reused, it's closed.
+    void release(std::shared_ptr<Connection> conn, bool reusable);
+    /// Drop the cached DNS results and idle connections for a domain,
+    /// used when a connection can't be made.
+    void invalidate(const std::string &domain);
+    /// Count a reused connection that turned out to be closed by the server
+    void reconnected(void) { reconnects++; };
+
+    /// Get a snapshot of the pool counters
+    PoolStats getStats(void);
+    /// Dump the pool counters to the log
+    void dump(void);
+
+    std::size_t max_idle = 16;                   ///< Maximum idle connections per domain
+    std::chrono::seconds idle_timeout{30};       ///< Drop idle connections older than this
+    std::chrono::seconds dns_ttl{300};           ///< How long to cache DNS results
+
+  private:
+    ConnectionPool(void);
+    /// Resolve a domain, using the cache when possible
+    tcp::resolver::results_type resolve(const std::string &domain, int port);
+
+    /// \struct Endpoints
+    /// \brief Cached DNS results for a domain
+    struct Endpoints {
+        tcp::resolver::results_type results;
+        std::chrono::steady_clock::time_point resolved;
+    };
+
+    net::io_context ioc;
+    ssl::context ctx{ssl::context::sslv23_client};
+    std::mutex pool_mutex;
+    std::map<std::string, std::list<std::shared_ptr<Connection>>> idle;
+    std::map<std::string, Endpoints> dns;
+    std::atomic<long> hits{0};
+    std::atomic<long> misses{0};
+    std::atomic<long> reconnects{0};
+    std::atomic<long> dns_hits{0};
+    std::atomic<long> dns_misses{0};
+};
+
+} // namespace replication
+
+#endif // EOF __CONNECTIONPOOL_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
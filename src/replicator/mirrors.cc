@@ -0,0 +1,306 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <algorithm>
+#include <condition_variable>
+#include <string>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+#include <boost/format.hpp>
+
+#include "replicator/mirrors.hh"
+
+#include "utils/log.hh"
+using namespace logger;
+
+namespace replication {
+
+/// \struct Race
+/// \brief The requests to the mirrors for one file
+struct Race {
+    std::mutex mutex;
+    std::condition_variable cv;
+    int running = 0;        ///< Requests that haven't finished
+    bool done = false;      ///< Whether a mirror returned the file
+    RequestedFile file;     ///< The file, or the most useful failure
+    std::string domain;     ///< The mirror that returned the file
+};
+
+Mirrors::Mirrors(const std::vector<std::string> &servers, std::size_t threads)
+{
+    for (auto it = std::begin(servers); it != std::end(servers); ++it) {
+        if (std::find(domains.begin(), domains.end(), *it) == domains.end()) {
+            domains.push_back(*it);
+            find(*it);
+        }
+    }
+    // The downloads go through the shared connection pool, so a single
+    // planet that isn't connected is enough
+    planet = std::make_shared<Planet>();
+    workers = std::make_unique<boost::asio::thread_pool>(std::max<std::size_t>(threads, 1));
+}
+
+Mirrors::~Mirrors(void)
+{
+    // The requests use the planet and the counters, so they have to
+    // finish first
+    workers->join();
+}
+
+Mirrors::Mirror &
+Mirrors::find(const std::string &domain)
+{
+    auto &mirror = mirrors[domain];
+    if (mirror.stats.domain.empty()) {
+        mirror.stats.domain = domain;
+    }
+    return mirror;
+}
+
+RequestedFile
+Mirrors::download(const RemoteURL &remote)
+{
+    auto order = rank();
+    if (order.empty()) {
+        return planet->downloadFile(remote);
+    }
+
+    auto race = std::make_shared<Race>();
+    std::size_t next = 0;
+    // Start a request to the next mirror. The race must be locked.
+    auto launch = [&](bool hedge) {
+        const std::string domain = order[next++];
+        RemoteURL url(remote);
+        url.updateDomain(domain);
+        count(domain, hedge, false);
+        race->running++;
+        boost::asio::post(*workers, [this, race, url, domain]() {
+            {
+                // Another mirror won while this was waiting for a thread
+                const std::lock_guard<std::mutex> lock(race->mutex);
+                if (race->done) {
+                    race->running--;
+                    return;
+                }
+            }
+            auto start = std::chrono::steady_clock::now();
+            auto file = planet->downloadFile(url);
+            std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+            record(domain, seconds.count(), file.data ? file.data->size() : 0, file.status, url.frequency);
+
+            const std::lock_guard<std::mutex> lock(race->mutex);
+            race->running--;
+            if (!race->done) {
+                if (file.status == reqfile_t::success) {
+                    race->done = true;
+                    race->file = file;
+                    race->domain = domain;
+                } else if (race->file.status != reqfile_t::remoteNotFound) {
+                    // A missing file tells the caller more than an error
+                    race->file = file;
+                }
+            }
+            race->cv.notify_all();
+        });
+        return deadline(domain, remote.frequency);
+    };
+
+    std::unique_lock<std::mutex> lock(race->mutex);
+    auto wait = launch(false);
+    auto hedge_at = std::chrono::steady_clock::now() + wait;
+    while (!race->done) {
+        bool more = next < order.size();
+        if (race->running == 0) {
+            // Everything asked so far failed, so ask another mirror. A
+            // mirror may be behind the others, so a missing file is
+            // asked for too.
+            if (more) {
+                wait = launch(true);
+                hedge_at = std::chrono::steady_clock::now() + wait;
+                continue;
+            }
+            break;
+        }
+        if (!more || wait.count() == 0) {
+            race->cv.wait(lock);
+        } else if (race->cv.wait_until(lock, hedge_at) == std::cv_status::timeout &&
+                   !race->done && race->running > 0) {
+            log_debug("Hedging %1% after %2%ms", remote.filespec, wait.count());
+            wait = launch(true);
+            hedge_at = std::chrono::steady_clock::now() + wait;
+        }
+    }
+    if (race->done) {
+        count(race->domain, false, true);
+    }
+    return race->file;
+}
+
+StateFile
+Mirrors::getState(const RemoteURL &remote, long sequence)
+{
+    std::string path = "state.txt";
+    if (sequence >= 0) {
+        path = (boost::format("%03d/%03d/%03d.state.txt") % (sequence / 1000000) %
+                (sequence / 1000 % 1000) % (sequence % 1000)).str();
+    }
+    auto order = rank();
+    for (auto it = std::begin(order); it != std::end(order); ++it) {
+        std::string url = "https://" + *it + "/" + remote.datadir + "/" +
+            StateFile::freq_to_string(remote.frequency) + "/" + path;
+        // The latest state changes all the time, so it's never cached
+        auto file = planet->request(*it, url);
+        if (file.status != reqfile_t::success) {
+            continue;
+        }
+        try {
+            StateFile state(std::string(file.data->begin(), file.data->end()), true);
+            if (state.sequence >= 0 && state.timestamp != not_a_date_time) {
+                return state;
+            }
+        } catch (const std::exception &ex) {
+            log_error("Couldn't parse %1%: %2%", url, ex.what());
+        }
+    }
+    return StateFile();
+}
+
+void
+Mirrors::record(const std::string &domain, double seconds, std::size_t bytes, reqfile_t status,
+                frequency_t frequency)
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+    auto &mirror = find(domain);
+    auto &stats = mirror.stats;
+    bool failed = status != reqfile_t::success;
+    bool first = stats.seconds == 0 && stats.errors == 0 && stats.missing == 0;
+    stats.error_rate = first ? failed : stats.error_rate + decay * (failed - stats.error_rate);
+    if (status == reqfile_t::remoteNotFound) {
+        // A fast answer for a file that isn't there says nothing about
+        // the speed of the downloads
+        stats.missing++;
+        return;
+    } else if (failed) {
+        stats.errors++;
+        return;
+    }
+    stats.bytes += bytes;
+    stats.seconds += seconds;
+    stats.latency = stats.latency == 0 ? seconds : stats.latency + decay * (seconds - stats.latency);
+    auto &recent = mirror.recent[frequency];
+    if (recent.times.size() < samples) {
+        recent.times.push_back(seconds);
+    } else {
+        recent.times[recent.next] = seconds;
+        recent.next = (recent.next + 1) % samples;
+    }
+}
+
+void
+Mirrors::count(const std::string &domain, bool hedge, bool win)
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+    auto &stats = find(domain).stats;
+    if (win) {
+        stats.wins++;
+    } else {
+        stats.requests++;
+        stats.hedges += hedge;
+    }
+}
+
+std::vector<std::string>
+Mirrors::rank(void)
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+    // The mirrors that haven't been measured yet go first, so they get
+    // a chance
+    auto cost = [this](const std::string &domain) {
+        auto &stats = mirrors[domain].stats;
+        if (stats.seconds == 0 && stats.errors == 0 && stats.missing == 0) {
+            return 0.0;
+        }
+        double latency = stats.latency > 0 ? stats.latency : first_deadline[minutely].count() / 1000.0;
+        return latency / std::max(0.05, 1.0 - stats.error_rate);
+    };
+    std::vector<std::string> order = domains;
+    std::stable_sort(order.begin(), order.end(), [&cost](const std::string &a, const std::string &b) {
+        return cost(a) < cost(b);
+    });
+    return order;
+}
+
+std::chrono::milliseconds
+Mirrors::deadline(const std::string &domain, frequency_t frequency)
+{
+    const std::lock_guard<std::mutex> lock(mutex);
+    auto first = first_deadline.find(frequency);
+    if (first == first_deadline.end()) {
+        return std::chrono::milliseconds(0);
+    }
+    auto &recent = find(domain).recent[frequency];
+    if (recent.times.size() < min_samples) {
+        return first->second;
+    }
+    std::vector<double> times = recent.times;
+    auto p95 = times.begin() + (times.size() * 95) / 100;
+    std::nth_element(times.begin(), p95, times.end());
+    std::chrono::milliseconds wait{static_cast<long>(*p95 * 1000)};
+    return std::max(wait, min_deadline);
+}
+
+std::vector<MirrorStats>
+Mirrors::getStats(void)
+{
+    std::vector<MirrorStats> stats;
+    for (auto it = std::begin(domains); it != std::end(domains); ++it) {
+        auto wait = deadline(*it);
+        const std::lock_guard<std::mutex> lock(mutex);
+        stats.push_back(mirrors[*it].stats);
+        stats.back().p95 = wait.count() / 1000.0;
+    }
+    return stats;
+}
+
+void
+Mirrors::dump(void)
+{
+    auto stats = getStats();
+    for (auto it = std::begin(stats); it != std::end(stats); ++it) {
+        double throughput = it->seconds > 0 ? it->bytes / it->seconds / 1024 : 0;
+        log_debug("Mirror %1%: %2% requests, %3% wins, %4% hedges, %5% errors, %6% missing",
+                  it->domain, it->requests, it->wins, it->hedges, it->errors, it->missing);
+        log_debug("Mirror %1%: %2%Kb/s, %3%s per file, %4%s deadline, %5%%% errors",
+                  it->domain, static_cast<long>(throughput), it->latency, it->p95,
+                  static_cast<int>(it->error_rate * 100));
+    }
+}
+
+} // namespace replication
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,159 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __MIRRORS_HH__
+#define __MIRRORS_HH__
+
+/// \file mirrors.hh
+/// \brief Download replication files from the fastest planet mirror
+///
+/// The replication files are on several mirrors, which used to be used
+/// in turn whatever their speed, so one slow mirror held up the whole
+/// batch of files. Instead each mirror is measured, the fastest one is
+/// asked first, and a slow request is hedged by asking another mirror.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/asio/thread_pool.hpp>
+
+#include "replicator/replication.hh"
+
+/// \namespace replication
+namespace replication {
+
+/// \struct MirrorStats
+/// \brief Counters for one planet mirror
+struct MirrorStats {
+    std::string domain;     ///< The domain of the mirror
+    long requests = 0;      ///< Files requested from this mirror
+    long wins = 0;          ///< Files this mirror returned first
+    long hedges = 0;        ///< Requests sent because another mirror was slow or failed
+    long errors = 0;        ///< Requests that failed
+    long missing = 0;       ///< Files that weren't on the mirror
+    std::size_t bytes = 0;  ///< Bytes downloaded
+    double seconds = 0;     ///< Time spent on the downloaded files
+    double latency = 0;     ///< Moving average of the seconds per file
+    double error_rate = 0;  ///< Moving average of the failed or missing requests
+    double p95 = 0;         ///< The wait before hedging a minutely file, from the recent seconds per file
+};
+
+/// \class Mirrors
+/// \brief Latency aware downloads from a list of planet mirrors
+///
+/// Each file is requested from the mirror with the lowest expected time,
+/// which is it's average time per file made worse by it's error rate.
+/// If it hasn't answered by the 95th percentile of it's recent times for
+/// files of the same frequency, the next best mirror is asked too, and
+/// whichever returns the file first wins. A daily file takes long enough
+/// that asking for it twice only slows both down, so it isn't hedged.
+/// The slower request is left to finish in the background, and still
+/// counts in the statistics. When a mirror fails or doesn't have the
+/// file, the next one is asked straight away, since a mirror may be
+/// behind the others. The file is only missing when none of them have
+/// it.
+///
+/// The requests run on a fixed number of threads, so when the mirrors
+/// are slow the requests wait for a thread instead of starting more.
+/// A request that is still waiting when another mirror has returned
+/// the file is dropped.
+class Mirrors {
+  public:
+    /// The mirrors in the order to try them before they're measured,
+    /// with up to \a threads requests at a time
+    Mirrors(const std::vector<std::string> &domains, std::size_t threads = 8);
+    /// Wait for the requests that are still running
+    ~Mirrors(void);
+
+    /// Download a file, the domain of \a remote is replaced by the
+    /// domain of the mirror
+    RequestedFile download(const RemoteURL &remote);
+    /// Get the latest state.txt for the frequency of \a remote from the
+    /// best mirror, or the one of the file \a sequence. It's invalid if
+    /// none of them answered.
+    StateFile getState(const RemoteURL &remote, long sequence = -1);
+
+    /// Count a finished request to a mirror for a file of \a frequency
+    void record(const std::string &domain, double seconds, std::size_t bytes, reqfile_t status,
+                frequency_t frequency = minutely);
+    /// The mirrors, best first
+    std::vector<std::string> rank(void);
+    /// How long to wait for a mirror before asking another one for a
+    /// file of \a frequency, zero if it's never hedged
+    std::chrono::milliseconds deadline(const std::string &domain, frequency_t frequency = minutely);
+
+    /// Get a snapshot of the counters for each mirror
+    std::vector<MirrorStats> getStats(void);
+    /// Dump the counters for each mirror to the log
+    void dump(void);
+
+    std::size_t samples = 100;                      ///< Recent times kept for the 95th percentile
+    std::size_t min_samples = 20;                   ///< Times needed before using the 95th percentile
+    std::chrono::milliseconds min_deadline{500};    ///< The shortest wait before hedging
+    /// The wait before there are enough times, for each frequency that
+    /// is hedged
+    std::map<frequency_t, std::chrono::milliseconds> first_deadline = {
+        {minutely, std::chrono::milliseconds(5000)},
+        {hourly, std::chrono::milliseconds(60000)},
+        {changeset, std::chrono::milliseconds(5000)}};
+    double decay = 0.2;                             ///< The weight of a new request in the averages
+
+  private:
+    /// \struct Recent
+    /// \brief The recent times for the files of one frequency, which
+    /// have very different sizes
+    struct Recent {
+        std::vector<double> times;
+        std::size_t next = 0;
+    };
+    /// \struct Mirror
+    /// \brief The counters and recent times for a mirror
+    struct Mirror {
+        MirrorStats stats;
+        std::map<frequency_t, Recent> recent;
+    };
+    /// Find a mirror, adding it if it's new. The lock must be held.
+    Mirror &find(const std::string &domain);
+    /// Count a hedged request, or the mirror that won
+    void count(const std::string &domain, bool hedge, bool win);
+
+    std::mutex mutex;
+    std::vector<std::string> domains;
+    std::map<std::string, Mirror> mirrors;
+    std::shared_ptr<Planet> planet;
+    std::unique_ptr<boost::asio::thread_pool> workers; ///< Runs the requests
+};
+
+} // namespace replication
+
+#endif // EOF __MIRRORS_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
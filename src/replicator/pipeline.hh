@@ -0,0 +1,230 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __PIPELINE_HH__
+#define __PIPELINE_HH__
+
+/// \file pipeline.hh
+/// \brief Bounded queues used to connect the stages of the replicator
+///
+/// Processing a replication file is split into stages, download,
+/// parse, build geometries, generate SQL, and commit. Each stage has
+/// it's own worker threads, and the stages are connected by bounded
+/// queues so a slow stage pushes back on the ones before it instead
+/// of using up all the memory.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// \namespace pipeline
+namespace pipeline {
+
+/// \class BoundedQueue
+/// \brief A blocking queue with a maximum size
+///
+/// Producers block when the queue is full, consumers block when it is
+/// empty. Once closed, producers are rejected and consumers get the
+/// remaining items before being told the queue is done.
+template <typename T>
+class BoundedQueue {
+  public:
+    BoundedQueue(const std::string &qname, std::size_t cap)
+        : name(qname), capacity(cap > 0 ? cap : 1) {};
+
+    /// Add an item, waiting for room. Returns false if the queue was closed.
+    bool push(T item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this] { return closed || items.size() < capacity; });
+        if (closed) {
+            return false;
+        }
+        items.push_back(std::move(item));
+        if (items.size() > max_depth) {
+            max_depth = items.size();
+        }
+        not_empty.notify_one();
+        return true;
+    };
+
+    /// Remove an item, waiting for one. Returns false once the queue
+    /// is closed and empty.
+    bool pop(T &item)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_empty.wait(lock, [this] { return closed || !items.empty(); });
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    };
+
+    /// Remove an item if there is one, without waiting
+    bool tryPop(T &item)
+    {
+        std::scoped_lock lock{mutex};
+        if (items.empty()) {
+            return false;
+        }
+        item = std::move(items.front());
+        items.pop_front();
+        not_full.notify_one();
+        return true;
+    };
+
+    /// No more items will be added
+    void close(void)
+    {
+        std::scoped_lock lock{mutex};
+        closed = true;
+        not_empty.notify_all();
+        not_full.notify_all();
+    };
+
+    /// The number of items waiting in the queue
+    std::size_t depth(void)
+    {
+        std::scoped_lock lock{mutex};
+        return items.size();
+    };
+    /// The most items that have been waiting in the queue
+    std::size_t maxDepth(void)
+    {
+        std::scoped_lock lock{mutex};
+        return max_depth;
+    };
+    const std::string &getName(void) const { return name; };
+    std::size_t getCapacity(void) const { return capacity; };
+
+  private:
+    std::string name;         ///< The name of the queue, used for logging
+    std::size_t capacity;     ///< The maximum number of items
+    std::size_t max_depth = 0; ///< The high water mark
+    bool closed = false;      ///< Set when there are no more producers
+    std::deque<T> items;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+};
+
+/// \class Window
+/// \brief Limits the number of items between the producer and the commit
+///
+/// The items are committed in the order they were issued, so the commit
+/// has to wait for the oldest one. Without a limit, the producer would
+/// get further and further ahead of a slow item.
+class Window {
+  public:
+    /// Wait until fewer than \a size items are issued and not
+    /// committed. The size is checked again whenever the window
+    /// changes. Returns the sequence of the new item, or -1 once the
+    /// window is closed.
+    long issue(const std::function<long()> &size)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        changed.wait(lock, [&] { return closed || issued - committed < size(); });
+        if (closed) {
+            return -1;
+        }
+        return issued++;
+    };
+
+    /// The items before \a next have been committed
+    void commit(long next)
+    {
+        {
+            std::scoped_lock lock{mutex};
+            committed = next;
+        }
+        changed.notify_all();
+    };
+
+    /// Stop issuing items
+    void close(void)
+    {
+        {
+            std::scoped_lock lock{mutex};
+            closed = true;
+        }
+        changed.notify_all();
+    };
+
+    /// The number of items issued and not committed
+    long inflight(void)
+    {
+        std::scoped_lock lock{mutex};
+        return issued - committed;
+    };
+
+  private:
+    long issued = 0;          ///< The sequence of the next item
+    long committed = 0;       ///< The sequence of the next item to commit
+    bool closed = false;      ///< Set when the producer should stop
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+/// Start a stage of the pipeline. Each worker pops an item from the input
+/// queue, processes it, and pushes it to the output queue. When the input
+/// queue is done, the last worker to finish closes the output queue so
+/// the next stage can drain and exit.
+template <typename T>
+void
+startStage(std::vector<std::thread> &threads, int workers,
+           BoundedQueue<T> &input, BoundedQueue<T> &output,
+           std::function<void(T &)> process)
+{
+    auto remaining = std::make_shared<std::atomic<int>>(workers);
+    for (int i = 0; i < workers; i++) {
+        threads.emplace_back([&input, &output, process, remaining] {
+            T item;
+            while (input.pop(item)) {
+                process(item);
+                output.push(std::move(item));
+            }
+            if (--(*remaining) == 0) {
+                output.close();
+            }
+        });
+    }
+}
+
+} // namespace pipeline
+
+#endif // EOF __PIPELINE_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
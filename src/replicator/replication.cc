@@ -69,6 +69,7 @@ using namespace boost::gregorian;
 #include <boost/iostreams/filter/gzip.hpp>
 #include <boost/iostreams/filtering_stream.hpp>
 #include <boost/iostreams/filtering_streambuf.hpp>
+#include <boost/optional.hpp>
 
 namespace beast = boost::beast;   // from <boost/beast.hpp>
 namespace net = boost::asio;      // from <boost/asio.hpp>
@@ -78,6 +79,7 @@ using tcp = net::ip::tcp;         // from <boost/asio/ip/tcp.hpp>
 
 #include "osm/changeset.hh"
 #include "replicator/replication.hh"
+#include "replicator/connectionpool.hh"
 
 /// Control access to the database connection
 std::mutex db_mutex;
@@ -301,104 +303,101 @@ Planet::downloadFile(const std::string &url, const std::string &destdir_base)
         return file;
     }
 
-    file.data = std::make_shared<std::vector<unsigned char>>();
-
-    // The io_context is required for all I/O
-    boost::asio::io_context ioc;
-
-    // The SSL context is required, and holds certificates
-    ssl::context ctx{ssl::context::sslv23_client};
-
-    // Verify the remote server's certificate
-    ctx.set_verify_mode(ssl::verify_none);
-
-    // These objects perform our I/O
-    tcp::resolver resolver{ioc};
-    ssl::stream<tcp::socket> stream{ioc, ctx};
-
-    // Look up the domain name
-    auto const results = resolver.resolve(remote.domain, std::to_string(port));
-    try {
-        // Make the connection on the IP address we get from a lookup
-        boost::asio::connect(stream.next_layer(), results.begin(), results.end());
-        // Perform the SSL handshake
-        stream.handshake(ssl::stream_base::client);
-    } catch (boost::system::system_error ex) {
-        log_error("stream write failed: %1%", ex.what());
-        file.status = reqfile_t::systemError;
+    file = request(remote.domain, url);
+    if (file.status != reqfile_t::success) {
         return file;
     }
 
+#ifdef USE_CACHE
+    if (file.data->size() > 0) {
+        writeFile(remote, file.data);
+    } else {
+        log_error("%1% does not exist!", remote.filespec);
+    }
+#endif
+    return file;
+}
+
+// Request a file from a server, without using the disk cache
+RequestedFile
+Planet::request(const std::string &domain, const std::string &url)
+{
+    RequestedFile file;
+    file.data = std::make_shared<std::vector<unsigned char>>();
+
     // Set up an HTTP GET request message
     http::request<http::string_body> req{http::verb::get, url, version};
 
-    req.keep_alive();
+    req.keep_alive(true);
 
     // We want the host only: strip the rest
     static const std::regex re(R"raw(^(?:https?://)?([^/]+).*)raw");
-    std::string host{remote.domain};
+    std::string host{domain};
     host = std::regex_replace(host, re, "$1");
 
     req.set(http::field::host, host);
     req.set(http::field::user_agent, BOOST_BEAST_VERSION_STRING);
-    // Send the HTTP request to the remote host
-    try {
-        http::write(stream, req);
-        // log_debug("Downloading %1% ... ", url);
-    } catch (boost::system::system_error ex) {
-        log_error("stream write failed: %1%", ex.what());
-        file.status = reqfile_t::systemError;
-        return file;
-    }
-
-    // This buffer is used for reading and must be persistant
-    boost::beast::flat_buffer buffer;
-
-    // Receive the HTTP response
-    http::response_parser<http::string_body> parser;
 
-    try {
-        read(stream, buffer, parser);
-
-        if (parser.get().result() == boost::beast::http::status::not_found ||
-            parser.get().result() == boost::beast::http::status::gateway_timeout) {
-            log_error("Remote file not found: %1%", url);
-            file.status = reqfile_t::remoteNotFound;
+    // Connections are shared between threads and kept alive, so the
+    // server may have closed the one we get between requests. If a
+    // reused connection fails, retry once on a fresh one.
+    auto &pool = ConnectionPool::instance();
+    boost::optional<http::response_parser<http::string_body>> parser;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        std::shared_ptr<Connection> conn;
+        try {
+            conn = pool.acquire(domain, port);
+        } catch (boost::system::system_error &ex) {
+            log_error("stream connect failed: %1%", ex.what());
+            file.status = reqfile_t::systemError;
             return file;
-        } else {
-            // Check the magic number of the file
-            const auto is_gzipped{parser.get().body()[0] == 0x1f};
-            std::shared_ptr<std::vector<unsigned char>> data;
-            for (auto body = std::begin(parser.get().body()); body != std::end(parser.get().body()); ++body) {
-                file.data->push_back(static_cast<unsigned char>(*body));
-            }
+        }
 
-            // Add the last newline back if not gzipped (or we'll get decompression error: unexpected end of file)
-            if (!is_gzipped) {
-                file.data->push_back('\n');
+        bool reused = conn->reused;
+        try {
+            // Send the HTTP request to the remote host
+            http::write(conn->stream, req);
+            // This buffer is used for reading and must be persistant
+            boost::beast::flat_buffer buffer;
+            // Receive the HTTP response
+            parser.emplace();
+            parser->body_limit(boost::none);
+            http::read(conn->stream, buffer, *parser);
+        } catch (boost::system::system_error &ex) {
+            pool.release(conn, false);
+            auto code = ex.code();
+            bool closed = (code == net::error::eof || code == http::error::end_of_stream ||
+                           code == net::error::connection_reset ||
+                           code == net::error::broken_pipe ||
+                           code == ssl::error::stream_truncated);
+            if (reused && closed && attempt == 0) {
+                pool.reconnected();
+                continue;
             }
+            log_error("stream read failed: %1%", ex.what());
+            file.status = reqfile_t::systemError;
+            return file;
         }
-
-    } catch (boost::system::system_error ex) {
-        log_error("stream read failed: %1%", ex.what());
-    }
-
-    // Gracefully close the stream
-    beast::error_code ec;
-    stream.shutdown(ec);
-    if (ec == net::error::eof) {
-        // Rationale:
-        // http://stackoverflow.com/questions/25587403/boost-asio-ssl-async-shutdown-always-finishes-with-an-error
-        ec = {};
+        pool.release(conn, parser->get().keep_alive());
+        break;
     }
 
-#ifdef USE_CACHE
-    if (file.data->size() > 0) {
-        writeFile(remote, file.data);
-    } else {
-        log_error("%1% does not exist!", remote.filespec);
+    if (parser->get().result() == boost::beast::http::status::not_found ||
+        parser->get().result() == boost::beast::http::status::gateway_timeout) {
+        log_error("Remote file not found: %1%", url);
+        file.status = reqfile_t::remoteNotFound;
+        return file;
+    } else if (!parser->get().body().empty()) {
+        auto &body = parser->get().body();
+        // Check the magic number of the file
+        const auto is_gzipped{body[0] == 0x1f};
+        file.data->assign(std::begin(body), std::end(body));
+
+        // Add the last newline back if not gzipped (or we'll get decompression error: unexpected end of file)
+        if (!is_gzipped) {
+            file.data->push_back('\n');
+        }
     }
-#endif
     file.status = reqfile_t::success;
     return file;
 }
@@ -289,6 +289,12 @@ class Planet {
         std::string str = "https://" + remote.domain + "/" + remote.filespec;
         return downloadFile(str, remote.destdir_base);
     };
+    /// \brief request downloads a file from a server, without the disk cache.
+    /// This is for files that change, like the latest state.txt.
+    /// \param domain the server
+    /// \param url the full URL
+    /// \return RequestedFile object, which includes data and status
+    RequestedFile request(const std::string &domain, const std::string &url);
 
     /// \brief readFile read a file from disk cache
     /// \param filespec the full path (such as: "/replication/changesets/000/001/633.osm.gz")
@@ -0,0 +1,103 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <algorithm>
+
+#include "replicator/schedule.hh"
+
+#include "utils/log.hh"
+using namespace logger;
+
+namespace replication {
+
+Schedule::Schedule(frequency_t frequency)
+{
+    switch (frequency) {
+        case frequency_t::daily:
+            interval = 86400;
+            break;
+        case frequency_t::hourly:
+            interval = 3600;
+            break;
+        default:
+            interval = 60;
+            break;
+    }
+}
+
+void
+Schedule::update(const StateFile &state, ptime now)
+{
+    if (state.timestamp == not_a_date_time || state.sequence <= latest.sequence) {
+        return;
+    }
+    // Only the file after the one seen before tells us how long it took
+    // to be published, a newer one may have been there for a while
+    if (latest.sequence >= 0 && state.sequence == latest.sequence + 1) {
+        double seconds = (state.timestamp - latest.timestamp).total_milliseconds() / 1000.0;
+        if (seconds > 0) {
+            interval += decay * (seconds - interval);
+        }
+        double published = (now - state.timestamp).total_milliseconds() / 1000.0;
+        published = std::min(std::max(published, 0.0), interval);
+        delay = delay == 0 ? published : delay + decay * (published - delay);
+        log_debug("Sequence %1% seen %2%s after it's timestamp", state.sequence, published);
+    }
+    latest = state;
+}
+
+ptime
+Schedule::predict(void) const
+{
+    if (latest.timestamp == not_a_date_time) {
+        return not_a_date_time;
+    }
+    return latest.timestamp + milliseconds(static_cast<long>((interval + delay) * 1000));
+}
+
+std::chrono::milliseconds
+Schedule::wait(ptime now) const
+{
+    ptime next = predict();
+    if (next == not_a_date_time) {
+        return poll;
+    }
+    ptime start = next - milliseconds(early.count());
+    if (now < start) {
+        return std::chrono::milliseconds((start - now).total_milliseconds());
+    }
+    // Poll often around the predicted time, then back off when a file
+    // is very late, like when the server is down
+    if (now < next + milliseconds(static_cast<long>(interval * 1000))) {
+        return poll;
+    }
+    return late;
+}
+
+} // namespace replication
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,97 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __SCHEDULE_HH__
+#define __SCHEDULE_HH__
+
+/// \file schedule.hh
+/// \brief Predict when the next replication file is published
+///
+/// Once caught up, the next file used to be requested every 45 seconds
+/// until it was there, which added up to 45 seconds of lag and lots of
+/// requests for files that didn't exist yet. The replication files are
+/// published at a regular interval, so the time of the next one can be
+/// predicted from the latest state.txt, and only checked for around
+/// then.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <chrono>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+using namespace boost::posix_time;
+
+#include "replicator/replication.hh"
+
+/// \namespace replication
+namespace replication {
+
+/// \class Schedule
+/// \brief When to check for the next replication file
+///
+/// This learns the interval between the files from the timestamps in the
+/// state.txt files, and the delay between that timestamp and when the
+/// file can be downloaded. Polling starts a little before the predicted
+/// time, and is done often until the file is there. If it's late, the
+/// polling slows down.
+class Schedule {
+  public:
+    /// A schedule for the files of a frequency
+    Schedule(frequency_t frequency);
+
+    /// Add the latest state.txt, read at \a now
+    void update(const StateFile &state, ptime now);
+    /// When the file after the latest one should be published
+    ptime predict(void) const;
+    /// How long to wait at \a now before checking for the next file
+    std::chrono::milliseconds wait(ptime now) const;
+    /// How many files the server has after \a sequence
+    long behind(long sequence) const { return latest.sequence - sequence; };
+    /// Whether the latest state.txt says the server has the file \a sequence
+    bool published(long sequence) const { return latest.sequence >= 0 && sequence <= latest.sequence; };
+
+    /// The latest state.txt
+    const StateFile &getLatest(void) const { return latest; };
+    /// The interval between the files, in seconds
+    double getInterval(void) const { return interval; };
+    /// The delay between the timestamp of a file and when it's published, in seconds
+    double getDelay(void) const { return delay; };
+
+    std::chrono::milliseconds poll{2000};   ///< Between checks around the predicted time
+    std::chrono::milliseconds early{5000};  ///< How long before the predicted time to start
+    std::chrono::milliseconds late{15000};  ///< Between checks once a file is very late
+    double decay = 0.2;                     ///< The weight of a new file in the averages
+
+  private:
+    StateFile latest;      ///< The latest state.txt
+    double interval;       ///< Moving average of the seconds between files
+    double delay = 0;      ///< Moving average of the seconds before a file is published
+};
+
+} // namespace replication
+
+#endif // EOF __SCHEDULE_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
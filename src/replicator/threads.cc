@@ -23,14 +23,18 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <iterator>
+#include <map>
 #include <mutex>
 #include <range/v3/all.hpp>
 #include <string>
 #include <thread>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <vector>
 #include <sstream>
 #include <chrono>
@@ -73,6 +77,7 @@ using tcp = net::ip::tcp;         // from <boost/asio/ip/tcp.hpp>
 
 #include "osm/osmobjects.hh"
 #include "replicator/threads.hh"
+#include "replicator/checkpoint.hh"
 #include "utils/log.hh"
 #include "osm/changeset.hh"
 #include "osm/osmchange.hh"
@@ -80,9 +85,15 @@ using tcp = net::ip::tcp;         // from <boost/asio/ip/tcp.hpp>
 #include "validate/queryvalidate.hh"
 #include "validate/validate.hh"
 #include "replicator/replication.hh"
+#include "replicator/connectionpool.hh"
+#include "replicator/catchup.hh"
+#include "replicator/mirrors.hh"
+#include "replicator/schedule.hh"
+#include "replicator/pipeline.hh"
 #include "raw/queryraw.hh"
 #include <jemalloc/jemalloc.h>
 #include "data/pq.hh"
+#include "data/pqpool.hh"
 #include "underpassconfig.hh"
 
 
@@ -140,10 +151,85 @@ getClosest(std::shared_ptr<std::vector<ReplicationTask>> tasks, ptime now) {
     return std::make_shared<ReplicationTask>(closest);
 }
 
+// Get the planet mirrors that have the same files as this URL
+std::shared_ptr<replication::Mirrors>
+getMirrors(const replication::RemoteURL &remote, const UnderpassConfig &config)
+{
+    std::vector<std::string> domains = {remote.domain};
+    auto servers = config.getPlanetServers(remote.frequency);
+    for (auto it = std::begin(servers); it != std::end(servers); ++it) {
+        if (it->datadir == remote.datadir) {
+            domains.push_back(it->domain);
+        }
+    }
+    // Each of the download workers may have a request and a hedge
+    // running at the same time
+    std::size_t threads = std::max(config.concurrency, 1u) * 4;
+    return std::make_shared<replication::Mirrors>(domains, threads);
+}
+
+// Plan the daily and hourly files to catch up with, and move the URL
+// to the last minutely file they cover
+bool
+planCatchUp(replication::RemoteURL &remote, replication::Mirrors &mirrors, replication::CatchUp &catchup)
+{
+    auto start = mirrors.getState(remote, remote.sequence());
+    replication::RemoteURL dayurl(remote);
+    dayurl.frequency = replication::daily;
+    replication::RemoteURL hoururl(remote);
+    hoururl.frequency = replication::hourly;
+    catchup.plan(start.timestamp, mirrors.getState(dayurl), mirrors.getState(hoururl));
+    if (catchup.done()) {
+        return false;
+    }
+
+    // The sequences are worked out from the latest files, so check them
+    // in case a file is missing on the server
+    for (auto it = std::begin(catchup.legs); it != std::end(catchup.legs); ++it) {
+        replication::RemoteURL url(remote);
+        url.frequency = it->frequency;
+        auto state = mirrors.getState(url, it->last);
+        if (state.timestamp != it->end) {
+            log_error("The %1% file %2% isn't at %3%, catching up with minutely files",
+                      StateFile::freq_to_string(it->frequency), it->last, it->end);
+            catchup.legs.clear();
+            return false;
+        }
+    }
+
+    // Find the last minutely file that's covered. The minutely files
+    // aren't always regular, so start from a guess and go back.
+    auto latest = mirrors.getState(remote);
+    long handover = -1;
+    if (latest.timestamp != not_a_date_time) {
+        long guess = latest.sequence - (latest.timestamp - catchup.end).total_seconds() / 60;
+        for (int i = 0; i < 5 && guess > remote.sequence(); i++) {
+            auto state = mirrors.getState(remote, guess);
+            if (state.timestamp == not_a_date_time) {
+                break;
+            } else if (state.timestamp <= catchup.end) {
+                handover = guess;
+                break;
+            }
+            guess -= std::max(1L, static_cast<long>((state.timestamp - catchup.end).total_seconds() / 60));
+        }
+    }
+    if (handover < 0) {
+        log_error("No minutely file before %1%, catching up with minutely files", catchup.end);
+        catchup.legs.clear();
+        return false;
+    }
+    catchup.handover = handover;
+    remote.updatePath(handover / 1000000, handover / 1000 % 1000, handover % 1000);
+    log_debug("Catching up with %1% files instead of %2% minutely files, carrying on from %3%",
+              catchup.size(), handover - start.sequence, remote.subpath);
+    return true;
+}
+
 // Starting with this URL, download the file, incrementing
 void
 startMonitorChangesets(std::shared_ptr<replication::RemoteURL> &remote,
-               const multipolygon_t &poly,
+               const geoutil::BoundaryIndex &boundary,
                const UnderpassConfig config)
 {
 #ifdef TIMING_DEBUG
@@ -160,6 +246,9 @@ startMonitorChangesets(std::shared_ptr<replication::RemoteURL> &remote,
         log_debug("Connected to database: %1%", config.underpass_osm_db_url);
     }
     auto querystats = std::make_shared<QueryStats>(db);
+    // The URL is the first file to download
+    replication::Checkpoint checkpoint(db, "changeset", remote->frequency);
+    checkpoint.start(remote->sequence() - 1);
 
     auto osmdb = std::make_shared<Pq>();
     if (!osmdb->connect(config.underpass_osm_db_url)) {
@@ -171,21 +260,9 @@ startMonitorChangesets(std::shared_ptr<replication::RemoteURL> &remote,
 
     int cores = config.concurrency;
 
-    // Support multiple OSM planet servers
-    std::vector<std::shared_ptr<replication::Planet>> planets;
-    std::vector<std::string> servers;
-    for (auto it = std::begin(config.planet_servers); it != std::end(config.planet_servers); ++it) {
-        servers.push_back(it->domain);
-    }
-
-    // Rotate OSM Planet servers
+    // Download from the fastest of the OSM planet servers
+    auto mirrors = getMirrors(*remote, config);
     int i = 0;
-    while (i <= cores/4) {
-        std::rotate(servers.begin(), servers.begin()+1, servers.end());
-        auto replicationPlanet = std::make_shared<replication::Planet>(*remote);
-        planets.push_back(replicationPlanet);
-        i++;
-    }
 
     // Process Changesets replication files
     ReplicationTask closest;
@@ -211,24 +288,35 @@ startMonitorChangesets(std::shared_ptr<replication::RemoteURL> &remote,
             new_remote->destdir_base = remote->destdir_base;
             auto task = boost::bind(threadChangeSet,
                 new_remote,
-                std::ref(planets.front()),
-                std::ref(poly),
+                std::ref(mirrors),
+                std::cref(boundary),
                 std::ref(tasks),
                 std::ref(querystats)
             );
 
             boost::asio::post(pool, task);
-            std::rotate(planets.begin(), planets.begin()+1, planets.end());
-            remote->updateDomain(planets.front()->domain);
         }
         pool.join();
         auto result = allTasksQueries(tasks);
-        if (result->at(0).size() > 0) {
-            db->query(result->at(0));
+        // Move the checkpoint over the files that were done, up to the
+        // first one that failed. The files after the newest one aren't
+        // published yet, so they don't block it.
+        std::vector<pq::Statement> calls;
+        std::sort(tasks->begin(), tasks->end(), [](const ReplicationTask &a, const ReplicationTask &b) {
+            return a.url < b.url;
+        });
+        for (auto it = std::begin(*tasks); it != std::end(*tasks); ++it) {
+            if (it->status != reqfile_t::success) {
+                break;
+            }
+            checkpoint.advance(it->url, it->timestamp, true, calls);
         }
+        db->execute(result->at(0), calls);
         if (result->at(1).size() > 0) {
             osmdb->query(result->at(1));
         }
+        replication::ConnectionPool::instance().dump();
+        mirrors->dump();
 
         ptime now  = boost::posix_time::second_clock::universal_time();
         last_task = getClosest(tasks, now);
@@ -257,13 +345,22 @@ startMonitorChangesets(std::shared_ptr<replication::RemoteURL> &remote,
                 delay = std::chrono::seconds{45};
             }
         }
+        // A file that failed is downloaded again in the next round, and
+        // the files after it are applied again
+        bool failed = std::any_of(std::begin(*tasks), std::end(*tasks), [](const ReplicationTask &task) {
+            return task.status != reqfile_t::success;
+        });
+        if (failed && checkpoint.sequence >= 0 && checkpoint.sequence < remote->sequence()) {
+            long sequence = checkpoint.sequence;
+            remote->updatePath(sequence / 1000000, sequence / 1000 % 1000, sequence % 1000);
+        }
     }
 }
 
 // Starting with this URL, download the file, incrementing
 void
 startMonitorChanges(std::shared_ptr<replication::RemoteURL> &remote,
-            const multipolygon_t &poly,
+            const geoutil::BoundaryIndex &boundary,
             const UnderpassConfig &config)
 {
 #ifdef TIMING_DEBUG
@@ -290,6 +387,13 @@ startMonitorChanges(std::shared_ptr<replication::RemoteURL> &remote,
         exit(0);
     }
     auto validator = creator();
+    if (config.validation_cache_budget > 0) {
+        validator->cache = std::make_shared<ValidationCache>(
+            static_cast<std::size_t>(config.validation_cache_budget) * 1024 * 1024);
+        if (!config.validation_cache_file.empty()) {
+            validator->cache->open(config.validation_cache_file);
+        }
+    }
 
 #ifdef MEMORY_DEBUG
     size_t sz, active1, active2;
@@ -303,6 +407,10 @@ startMonitorChanges(std::shared_ptr<replication::RemoteURL> &remote,
     }
     auto querystats = std::make_shared<QueryStats>(db);
     auto queryvalidate = std::make_shared<QueryValidate>(db);
+    // The producer increments the URL before downloading, so the
+    // starting URL is the last file that was done
+    replication::Checkpoint checkpoint(db, "osmchange", remote->frequency);
+    checkpoint.start(remote->sequence());
 
     // Connect to the raw OSM database, which is separate
     auto osmdb = std::make_shared<Pq>();
@@ -313,112 +421,450 @@ startMonitorChanges(std::shared_ptr<replication::RemoteURL> &remote,
         log_debug("Connected to database: %1%", config.underpass_osm_db_url);
     }
     auto queryraw = std::make_shared<QueryRaw>(osmdb);
+    // Building the geometries reads from the raw OSM database, so each
+    // worker gets it's own connection. The commit writes the raw data
+    // on them too.
+    auto osmpool = std::make_shared<PqPool>();
+    if (!osmpool->connect(config.underpass_osm_db_url, config.getDbConnections())) {
+        log_error("Could not connect to raw OSM DB, aborting monitoring thread!");
+        return;
+    }
+    auto rawstatements = QueryRaw::getStatements();
+    for (auto it = std::begin(rawstatements); it != std::end(rawstatements); ++it) {
+        osmpool->prepare(it->first, it->second);
+    }
+    std::shared_ptr<RawCopy> rawcopy;
+    if (config.raw_copy) {
+        rawcopy = std::make_shared<RawCopy>(osmdb);
+    }
+    if (!config.node_locations.empty()) {
+        auto locations = std::make_shared<NodeLocations>();
+        if (locations->open(config.node_locations)) {
+            queryraw->locations = locations;
+        }
+    }
+    if (config.cache_budget > 0) {
+        queryraw->cache = std::make_shared<ObjectCache>(static_cast<std::size_t>(config.cache_budget) * 1024 * 1024);
+    }
 
     int cores = config.concurrency;
 
-    // Support multiple OSM planet servers
-    std::vector<std::shared_ptr<replication::Planet>> planets;
-    std::vector<std::string> servers;
-    for (auto it = std::begin(config.planet_servers); it != std::end(config.planet_servers); ++it) {
-        servers.push_back(it->domain);
-    }
+    // Downloads go through the shared connection pool, so all the
+    // download workers can use the same mirrors.
+    auto mirrors = getMirrors(*remote, config);
 
-    // Rotate OSM Planet servers
-    int i = 0;
-    while (i <= cores/4) {
-        std::rotate(servers.begin(), servers.begin()+1, servers.end());
-        auto replicationPlanet = std::make_shared<replication::Planet>(*remote);
-        planets.push_back(replicationPlanet);
-        i++;
+    // When far behind, catch up with daily and hourly files first
+    replication::CatchUp catchup;
+    if (config.coarse_catchup && remote->frequency == replication::minutely &&
+        config.end_time == not_a_date_time) {
+        planCatchUp(*remote, *mirrors, catchup);
     }
 
-    // Process OSM changes
-    auto delay = std::chrono::seconds{0};
-    ReplicationTask closest;
-    auto last_task = std::make_shared<ReplicationTask>();
-    last_task->status = reqfile_t::success;
-    bool caughtUpWithNow = false;
-    bool monitoring = true;
-    auto underpassConfig = std::make_shared<UnderpassConfig>(config);
-    int concurrentTasks = cores*2;
+    // Process OSM changes as a pipeline. Each stage has it's own workers,
+    // so a slow download doesn't stall the parsing or SQL generation
+    // of the files that have already arrived.
+    std::size_t capacity = cores * 2;
+    pipeline::BoundedQueue<std::shared_ptr<OsmChangeJob>> downloadq("download", capacity);
+    pipeline::BoundedQueue<std::shared_ptr<OsmChangeJob>> parseq("parse", capacity);
+    pipeline::BoundedQueue<std::shared_ptr<OsmChangeJob>> buildq("build", capacity);
+    pipeline::BoundedQueue<std::shared_ptr<OsmChangeJob>> sqlq("sql", capacity);
+    pipeline::BoundedQueue<std::shared_ptr<OsmChangeJob>> commitq("commit", capacity);
+
+    std::atomic<bool> caughtUpWithNow{false};
+    std::atomic<bool> monitoring{true};
+    // Once caught up, the latest state.txt says when to expect the next
+    // file, so it's only checked for around then
+    replication::Schedule schedule(remote->frequency);
+    auto delay = schedule.late;
+
+    // Limit the number of files between the producer and the commit,
+    // since the commit has to wait for the oldest one.
+    pipeline::Window window;
+    // The latest minutely file on the server, from the last state.txt
+    // the producer read
+    std::atomic<long> head{-1};
+
+    // The objects in a file are validated in batches on these, so one
+    // big file doesn't keep a single SQL worker busy for long
+    boost::asio::thread_pool validation(cores);
+
+    // The work each stage does on a file. A file that failed is done
+    // again by the commit, so it uses them too.
+    auto download = [&](std::shared_ptr<OsmChangeJob> &job) {
+        int attempts = 0;
+        while (true) {
+            downloadOsmChange(*job, mirrors);
+            if (job->file.status == reqfile_t::success || !monitoring) {
+                break;
+            }
+            // A file past the latest one isn't published yet, so wait
+            // for it. The producer waits for the state.txt to have it,
+            // so this is only when that can't be read. A file the
+            // server should have is left for the commit to try again.
+            if (job->file.status == reqfile_t::remoteNotFound) {
+                bool published = job->remote->frequency != remote->frequency || head < 0 ||
+                                 job->remote->sequence() <= head;
+                if (!caughtUpWithNow && published && ++attempts > 3) {
+                    break;
+                }
+                std::this_thread::sleep_for(delay);
+            } else {
+                if (++attempts > 3) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::seconds{5});
+            }
+        }
+    };
+    auto parse = [&](std::shared_ptr<OsmChangeJob> &job) {
+        parseOsmChange(*job);
+    };
+    auto build = [&](std::shared_ptr<OsmChangeJob> &job) {
+        try {
+            auto reader = std::make_shared<QueryRaw>(osmpool->acquire());
+            reader->locations = queryraw->locations;
+            reader->cache = queryraw->cache;
+            buildOsmChange(*job, boundary, reader, config);
+        } catch (std::exception &e) {
+            log_error("Couldn't build geometries for %1%: %2%", job->remote->filespec, e.what());
+            job->task.status = replication::systemError;
+        }
+    };
+    auto queries = [&](std::shared_ptr<OsmChangeJob> &job) {
+        try {
+            queriesOsmChange(*job, boundary.getBoundary(), validator, querystats, queryvalidate, queryraw, config,
+                             &validation);
+        } catch (std::exception &e) {
+            log_error("Couldn't generate queries for %1%: %2%", job->remote->filespec, e.what());
+            job->task.status = replication::systemError;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    pipeline::startStage<std::shared_ptr<OsmChangeJob>>(threads, cores * 2, downloadq, parseq, download);
+    pipeline::startStage<std::shared_ptr<OsmChangeJob>>(threads, cores, parseq, buildq, parse);
+    pipeline::startStage<std::shared_ptr<OsmChangeJob>>(threads, cores, buildq, sqlq, build);
+    pipeline::startStage<std::shared_ptr<OsmChangeJob>>(threads, cores, sqlq, commitq, queries);
+
+    // A file that failed is done again before any file after it is
+    // committed, so the checkpoint never has a gap. The files after it
+    // wait, and the window stops the producer. Returns false if the
+    // replicator is stopping.
+    auto redo = [&](std::shared_ptr<OsmChangeJob> &job) {
+        auto wait = std::chrono::seconds{5};
+        while (job->task.status != replication::success) {
+            if (!monitoring) {
+                return false;
+            }
+            log_error("Processing %1% failed, trying again in %2%s", job->remote->filespec, wait.count());
+            std::this_thread::sleep_for(wait);
+            wait = std::min(wait * 2, std::chrono::seconds{60});
+            auto again = std::make_shared<OsmChangeJob>();
+            again->sequence = job->sequence;
+            again->remote = job->remote;
+            again->handover = job->handover;
+            job = again;
+            download(job);
+            parse(job);
+            if (job->task.status == replication::success) {
+                build(job);
+            }
+            if (job->task.status == replication::success) {
+                queries(job);
+            }
+        }
+        return true;
+    };
+    // A write that failed, like when the database is restarted, is
+    // tried again, since the files after it can't be committed without
+    // it. Returns false if the replicator is stopping.
+    auto persist = [&](const std::string &what, const std::function<bool()> &write) {
+        auto wait = std::chrono::seconds{5};
+        while (!write()) {
+            if (!monitoring) {
+                return false;
+            }
+            log_error("Writing %1% failed, trying again in %2%s", what, wait.count());
+            std::this_thread::sleep_for(wait);
+            wait = std::min(wait * 2, std::chrono::seconds{60});
+        }
+        return true;
+    };
+
+    // Commit the files in sequence order, as soon as the next one is ready.
+    // All the files that are ready are committed together, and only the
+    // last change of each object in them is written.
+    std::thread commitThread([&] {
+        std::map<long, std::shared_ptr<OsmChangeJob>> pending;
+        long next = 0;
+        long logged = 0;
+        // Once a write failed while stopping, nothing after it is
+        // committed, but the queue is still drained
+        bool stopped = false;
+        // Set when a daily or hourly file wasn't committed, since the
+        // minutely files can't carry on after the catch up then
+        bool hole = false;
+        std::shared_ptr<OsmChangeJob> job;
+        while (commitq.pop(job)) {
+            pending[job->sequence] = job;
+            while (commitq.tryPop(job)) {
+                pending[job->sequence] = job;
+            }
+            std::vector<std::shared_ptr<OsmChangeJob>> batch;
+            while (!stopped && !pending.empty() && pending.begin()->first == next) {
+                auto ready = pending.begin()->second;
+                if (!redo(ready)) {
+                    break;
+                }
+                batch.push_back(ready);
+                pending.erase(pending.begin());
+                next++;
+            }
+            if (batch.empty()) {
+                continue;
+            }
 
-    while (monitoring) {
-        auto tasks = std::make_shared<std::vector<ReplicationTask>>(concurrentTasks);
-        boost::asio::thread_pool pool(concurrentTasks);
-        i = concurrentTasks;
-        do {
-            std::this_thread::sleep_for(delay);
-            if (last_task->status == reqfile_t::success ||
-                (last_task->status == reqfile_t::remoteNotFound && !caughtUpWithNow)) {
-                remote->increment();
-                if (!config.silent) {
-                    remote->dump();
+            pq::Coalescer raw;
+            pq::Coalescer validation;
+            std::map<long, std::string> stats;
+            std::shared_ptr<RawBatch> rawbatch;
+            std::size_t before = 0;
+            for (auto it = std::begin(batch); it != std::end(batch); ++it) {
+                auto &ready = *it;
+                raw.add(std::move(ready->raw));
+                validation.add(std::move(ready->validation));
+                // The stats of a changeset are replaced by the ones in a
+                // later file
+                before += ready->stats.size();
+                for (auto sit = std::begin(ready->stats); sit != std::end(ready->stats); ++sit) {
+                    stats[sit->first] = std::move(sit->second);
+                }
+                ready->stats.clear();
+                if (ready->rawbatch) {
+                    before += ready->rawbatch->size();
+                    if (!rawbatch) {
+                        rawbatch = ready->rawbatch;
+                    } else {
+                        rawbatch->add(std::move(*ready->rawbatch));
+                    }
+                    ready->rawbatch.reset();
                 }
             }
-            auto new_remote = std::make_shared<replication::RemoteURL>(remote->getURL());
-            new_remote->destdir_base = remote->destdir_base;
-            OsmChangeTask osmChangeTask {
-                new_remote,
-                std::ref(planets.front()),
-                std::ref(poly),
-                std::ref(validator),
-                std::ref(tasks),
-                std::ref(querystats),
-                std::ref(queryvalidate),
-                std::ref(queryraw),
-                underpassConfig,
-                concurrentTasks - i
-            };
+            std::string statsql;
+            for (auto it = std::begin(stats); it != std::end(stats); ++it) {
+                statsql += it->second;
+            }
+            before += raw.added + validation.added;
+            std::size_t after = raw.size() + validation.size() + stats.size() + (rawbatch ? rawbatch->size() : 0);
+            if (before > 0) {
+                log_debug("Coalesced %1% files: %2% writes instead of %3%, %4%%% fewer",
+                          batch.size(), after, before, 100 * (before - after) / before);
+            }
 
-            auto task = boost::bind(threadOsmChange, osmChangeTask);
-            std::rotate(planets.begin(), planets.begin()+1, planets.end());
+            // The raw data is in another database, so it's written
+            // first. If the replicator stops before the checkpoint is
+            // written, the files are applied again, which the version
+            // checks make harmless. The writes of an object don't depend
+            // on the other objects, so they're split by object between
+            // the pooled connections and written at the same time.
+            auto parts = raw.statements(osmpool->size());
+            bool complete = persist("the raw data", [&] {
+                std::vector<std::future<bool>> results;
+                for (auto it = std::begin(parts); it != std::end(parts); ++it) {
+                    if (!it->empty()) {
+                        results.push_back(osmpool->submit(*it));
+                    }
+                }
+                bool done = true;
+                for (auto it = std::begin(results); it != std::end(results); ++it) {
+                    done &= it->get();
+                }
+                return done;
+            });
+            if (complete && rawcopy && rawbatch) {
+                complete = persist("the raw data", [&] { return rawcopy->write(*rawbatch); });
+            }
+            // The stats, the validation and the checkpoint of the files
+            // are committed together
+            std::vector<pq::Statement> calls = validation.statements();
+            for (auto it = std::begin(batch); it != std::end(batch); ++it) {
+                bool done = complete && (*it)->task.status == replication::success;
+                if ((*it)->remote->frequency == checkpoint.frequency) {
+                    checkpoint.advance((*it)->task.url, (*it)->task.timestamp, done, calls);
+                } else if (!done) {
+                    // A file that failed was done again before it got
+                    // here, so this is only when stopping
+                    hole = true;
+                    log_error("Catching up with %1% failed, the checkpoint stays at %2%",
+                              (*it)->remote->filespec, checkpoint.path);
+                } else if ((*it)->handover >= 0 && !hole) {
+                    checkpoint.start((*it)->handover);
+                }
+            }
+            bool written = complete && persist("the statistics and validation", [&] {
+                return db->execute(statsql, calls);
+            });
+            if (!written || hole) {
+                stopped = true;
+            }
 
-            boost::asio::post(pool, task);
-        } while (--i);
-        pool.join();
-        auto result = allTasksQueries(tasks);
-        if (result->at(0).size() > 0) {
-            db->query(result->at(0));
-        }
-        if (result->at(1).size() > 0) {
-            osmdb->query(result->at(1));
+            for (auto it = std::begin(batch); it != std::end(batch); ++it) {
+                auto &ready = *it;
+                // Files are committed in order, so the node locations
+                // and the cache are always updated with the latest version
+                if (queryraw->locations && ready->osmchanges) {
+                    queryraw->locations->update(*ready->osmchanges);
+                }
+                if (queryraw->cache && ready->osmchanges) {
+                    queryraw->cache->update(*ready->osmchanges);
+                }
+                // Nothing should hold on to the objects of a committed
+                // file, so this frees the whole arena
+                if (ready->osmchanges) {
+#ifdef MEMORY_DEBUG
+                    std::weak_ptr<osmobjects::ObjectArena> arena = ready->osmchanges->arena;
+                    ready->osmchanges.reset();
+                    if (!arena.expired()) {
+                        log_error("Objects from %1% outlived it, so it's arena wasn't freed",
+                                  ready->remote->filespec);
+                    }
+#else
+                    ready->osmchanges.reset();
+#endif
+                }
+                if (validator->cache) {
+                    validator->cache->commit(ready->validated, written && ready->task.status == replication::success);
+                    ready->validated.clear();
+                }
+
+                ptime now = boost::posix_time::second_clock::universal_time();
+                if (ready->task.timestamp != not_a_date_time) {
+                    if (ready->task.timestamp >= config.end_time) {
+                        monitoring = false;
+                    }
+                    // Check if caught up with now
+                    boost::posix_time::time_duration delta = now - ready->task.timestamp;
+                    if (!caughtUpWithNow && delta.hours() * 60 + delta.minutes() <= 2) {
+                        caughtUpWithNow = true;
+                        log_debug("Caught up with: %1%", ready->task.url);
+                    }
+                }
+            }
+            if (next - logged >= 10 || caughtUpWithNow) {
+                logged = next;
+                log_debug("Pipeline queues: download %1%, parse %2%, build %3%, sql %4%, commit %5%, waiting %6%",
+                          downloadq.depth(), parseq.depth(), buildq.depth(),
+                          sqlq.depth(), commitq.depth(), pending.size());
+                replication::ConnectionPool::instance().dump();
+                mirrors->dump();
+                osmpool->dump();
+                if (rawcopy) {
+                    rawcopy->dump();
+                }
+                if (queryraw->locations) {
+                    queryraw->locations->dump();
+                    queryraw->locations->sync();
+                }
+                if (queryraw->cache) {
+                    queryraw->cache->dump();
+                }
+                if (validator->cache) {
+                    validator->cache->dump();
+                    validator->cache->sync();
+                }
+            }
+            window.commit(next);
+            if (!monitoring) {
+                window.close();
+            }
         }
+    });
 
-        ptime now  = boost::posix_time::second_clock::universal_time();
-        last_task = getClosest(tasks, now);
-        if (last_task->timestamp != not_a_date_time) {
-            closest.url = std::string(last_task->url);
-            closest.timestamp = ptime(last_task->timestamp);
-            if (last_task->timestamp >= config.end_time) {
-                monitoring = false;
+    // Produce the files to download, in sequence order
+    while (monitoring) {
+        // A daily file is big, so only a couple are in memory
+        long issued = window.issue([&] {
+            if (caughtUpWithNow) {
+                return 1L;
             }
+            return catchup.current() == replication::daily ? 2L : static_cast<long>(capacity * 2);
+        });
+        if (issued < 0 || !monitoring) {
+            break;
         }
-        // Check if caught up with now
-        if (!caughtUpWithNow) {
-            boost::posix_time::time_duration delta_closest = now - closest.timestamp;
-            if (delta_closest.hours() * 60 + delta_closest.minutes() <= 2) {
-                caughtUpWithNow = true;
-                log_debug("Caught up with: %1%", closest.url);
-                remote->updatePath(
-                    std::stoi(closest.url.substr(0, 3)),
-                    std::stoi(closest.url.substr(4, 3)),
-                    std::stoi(closest.url.substr(8, 3))
-                );
-                if (!config.silent) {
-                    remote->dump();
-                }
-                concurrentTasks = 1;
-                delay = std::chrono::seconds{45};
+        // Don't issue a file the server doesn't have yet, since it would
+        // only fail. Once the producer gets to the latest file, wait for
+        // the next one to be published. When caught up, if the server is
+        // more than a couple of files ahead, go back to catching up in
+        // parallel. Without a state.txt, the download waits for the file.
+        while (catchup.done() && monitoring) {
+            if (!caughtUpWithNow && schedule.published(remote->sequence() + 1)) {
+                break;
+            }
+            auto state = mirrors->getState(*remote);
+            if (state.sequence < 0) {
+                break;
             }
+            schedule.update(state, boost::posix_time::microsec_clock::universal_time());
+            head = schedule.getLatest().sequence;
+            long ahead = schedule.behind(remote->sequence());
+            if (caughtUpWithNow && ahead > 2) {
+                log_debug("Fell behind by %1% files, catching up", ahead);
+                caughtUpWithNow = false;
+            } else if (ahead <= 0) {
+                auto wait = schedule.wait(boost::posix_time::microsec_clock::universal_time());
+                log_debug("Next file expected at %1%, checking in %2%ms", schedule.predict(), wait.count());
+                std::this_thread::sleep_for(wait);
+                continue;
+            }
+            break;
+        }
+        if (!monitoring) {
+            break;
         }
+        auto job = std::make_shared<OsmChangeJob>();
+        job->sequence = issued;
+        frequency_t frequency;
+        long sequence;
+        if (catchup.next(frequency, sequence)) {
+            job->remote = std::make_shared<replication::RemoteURL>(
+                replication::CatchUp::getURL(*remote, frequency, sequence));
+            // The minutely files carry on after the last one
+            if (catchup.done()) {
+                job->handover = catchup.handover;
+            }
+        } else {
+            remote->increment();
+            job->remote = std::make_shared<replication::RemoteURL>(remote->getURL());
+        }
+        job->remote->destdir_base = remote->destdir_base;
+        if (!config.silent) {
+            job->remote->dump();
+        }
+        if (!downloadq.push(job)) {
+            break;
+        }
+    }
+    window.close();
+    downloadq.close();
+    for (auto it = std::begin(threads); it != std::end(threads); ++it) {
+        it->join();
+    }
+    commitThread.join();
+    if (validator->cache) {
+        validator->cache->dump();
+        validator->cache->save();
     }
+    log_debug("Pipeline queue high water marks: download %1%, parse %2%, build %3%, sql %4%, commit %5%",
+              downloadq.maxDepth(), parseq.maxDepth(), buildq.maxDepth(),
+              sqlq.maxDepth(), commitq.maxDepth());
 }
 
 // This parses the changeset file into changesets
 void
 threadChangeSet(std::shared_ptr<replication::RemoteURL> &remote,
-        std::shared_ptr<replication::Planet> &planet,
-        const multipolygon_t &poly,
+        std::shared_ptr<replication::Mirrors> &mirrors,
+        const geoutil::BoundaryIndex &boundary,
         std::shared_ptr<std::vector<ReplicationTask>> tasks,
         std::shared_ptr<QueryStats> &querystats)
 {
@@ -427,22 +873,26 @@ threadChangeSet(std::shared_ptr<replication::RemoteURL> &remote,
 #endif
     ReplicationTask task;
     task.url = remote->subpath;
-    auto file = planet->downloadFile(*remote.get());
+    auto file = mirrors->download(*remote.get());
     task.status = file.status;
 
     if (file.status == reqfile_t::success) {
         auto changeset = std::make_unique<changesets::ChangeSetFile>();
         log_debug("Processing ChangeSet: %1%", remote->filespec);
-        auto xml = planet->processData(remote->filespec, *file.data);
-        std::istream& input(xml);
-        changeset->readXML(input);
+        try {
+            changeset->readChanges(*file.data);
+        } catch (std::exception &e) {
+            log_error("%1% is corrupted!", remote->filespec);
+            task.status = reqfile_t::corrupted;
+            std::cerr << e.what() << std::endl;
+        }
         if (changeset->last_closed_at != not_a_date_time) {
             task.timestamp = changeset->last_closed_at;
         } else if (changeset->changes.size() && changeset->changes.back()->created_at != not_a_date_time) {
             task.timestamp = changeset->changes.back()->created_at;
         }
         log_debug("ChangeSet last_closed_at: %1%", task.timestamp);
-        changeset->areaFilter(poly);
+        changeset->areaFilter(boundary);
         for (auto cit = std::begin(changeset->changes); cit != std::end(changeset->changes); ++cit) {
             task.query.push_back(querystats->applyChange(*cit->get()));
         }
@@ -451,96 +901,116 @@ threadChangeSet(std::shared_ptr<replication::RemoteURL> &remote,
     tasks->push_back(task);
 }
 
-// This thread get started for every osmChange file
+// Download the osmChange file for a job
 void
-threadOsmChange(OsmChangeTask osmChangeTask)
+downloadOsmChange(OsmChangeJob &job, std::shared_ptr<replication::Mirrors> mirrors)
 {
-#ifdef TIMING_DEBUG
-    boost::timer::auto_cpu_timer timer("threadOsmChange: took %w seconds\n");
+#ifdef TIMING_DEBUG_X
+    boost::timer::auto_cpu_timer timer("downloadOsmChange: took %w seconds\n");
 #endif
-    auto remote = osmChangeTask.remote;
-    auto planet = osmChangeTask.planet;
-    auto poly = osmChangeTask.poly;
-    auto plugin = osmChangeTask.plugin;
-    auto tasks = osmChangeTask.tasks;
-    auto querystats = osmChangeTask.querystats;
-    auto queryvalidate = osmChangeTask.queryvalidate;
-    auto queryraw = osmChangeTask.queryraw;
-    auto config = osmChangeTask.config;
-    auto taskIndex = osmChangeTask.taskIndex;
-
-    auto osmchanges = std::make_shared<osmchange::OsmChangeFile>();
-    log_debug("Processing OsmChange: %1%", remote->filespec);
-    ReplicationTask task;
-    task.url = remote->subpath;
-    auto file = planet->downloadFile(*remote.get());
-    task.status = file.status;
-
-    // Read OsmChange
-    if (file.status == replication::success) {
-        try {
-            std::istringstream changes_xml;
-            // Scope to deallocate buffers
-            {
-                boost::iostreams::filtering_streambuf<boost::iostreams::input> inbuf;
-                inbuf.push(boost::iostreams::gzip_decompressor());
-                boost::iostreams::array_source arrs{reinterpret_cast<char const *>(file.data->data()), file.data->size()};
-                inbuf.push(arrs);
-                std::istream instream(&inbuf);
-                changes_xml.str(std::string{std::istreambuf_iterator<char>(instream), {}});
-            }
-
-            try {
-                osmchanges->nodecache.clear();
-                osmchanges->waycache.clear();
-                osmchanges->readXML(changes_xml);
-                if (osmchanges->changes.size() > 0) {
-                    task.timestamp = osmchanges->changes.back()->final_entry;
-                    // log_debug("OsmChange final_entry: %1%", task.timestamp);
-                }
-            } catch (std::exception &e) {
-                log_error("Couldn't parse: %1%", remote->filespec);
-                boost::filesystem::remove(remote->filespec);
-                std::cerr << e.what() << std::endl;
-            }
+    job.task.url = job.remote->subpath;
+    job.file = mirrors->download(*job.remote.get());
+    job.task.status = job.file.status;
+}
 
-        } catch (std::exception &e) {
-            log_error("%1% is corrupted!", remote->filespec);
-            boost::filesystem::remove(remote->filespec);
-            std::cerr << e.what() << std::endl;
+// Decompress and parse the osmChange file for a job
+void
+parseOsmChange(OsmChangeJob &job)
+{
+#ifdef TIMING_DEBUG_X
+    boost::timer::auto_cpu_timer timer("parseOsmChange: took %w seconds\n");
+#endif
+    job.osmchanges = std::make_shared<osmchange::OsmChangeFile>();
+    if (job.file.status != replication::success) {
+        return;
+    }
+    log_debug("Processing OsmChange: %1%", job.remote->filespec);
+    // The file is decompressed as it's parsed, so the uncompressed
+    // XML is never in memory all at once.
+    try {
+        job.osmchanges->nodecache.clear();
+        job.osmchanges->waycache.clear();
+        job.osmchanges->readChanges(*job.file.data);
+        if (job.osmchanges->changes.size() > 0) {
+            job.task.timestamp = job.osmchanges->changes.back()->final_entry;
+            // log_debug("OsmChange final_entry: %1%", job.task.timestamp);
         }
+    } catch (std::exception &e) {
+        log_error("%1% is corrupted!", job.remote->filespec);
+        job.task.status = replication::corrupted;
+        boost::filesystem::remove(job.remote->filespec);
+        std::cerr << e.what() << std::endl;
     }
+#ifdef MEMORY_DEBUG
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    log_debug("Peak RSS after parsing %1%: %2%Kb", job.remote->filespec, usage.ru_maxrss);
+    log_debug("Arena for %1%: %2% objects in %3% bytes", job.remote->filespec,
+              job.osmchanges->arena->getObjects(), job.osmchanges->arena->getBytes());
+#endif
+    // The compressed data isn't needed anymore
+    job.file.data.reset();
+}
 
+// Build the geometries and filter by the priority area
+void
+buildOsmChange(OsmChangeJob &job, const geoutil::BoundaryIndex &boundary,
+               std::shared_ptr<QueryRaw> queryraw,
+               const UnderpassConfig &config)
+{
+#ifdef TIMING_DEBUG_X
+    boost::timer::auto_cpu_timer timer("buildOsmChange: took %w seconds\n");
+#endif
     // - Fill node cache with nodes referenced in modified
     //   or created ways and also ways indirectly modified by modified nodes
     // - Add indirectly modified ways to osmchanges
     // - Build ways polygon/linestring geometries using nodecache
     // - Build relation multipolyon/multilinestring geometries using waycache
-    if (!config->disable_raw) {
-        queryraw->buildGeometries(osmchanges, poly);
+    if (!config.disable_raw) {
+        queryraw->buildGeometries(job.osmchanges, boundary);
     }
 
     // Filter data by priority polygon
-    osmchanges->areaFilter(poly);
+    job.osmchanges->areaFilter(boundary);
+}
+
+// Generate the SQL queries for stats, raw data and validation
+void
+queriesOsmChange(OsmChangeJob &job, const multipolygon_t &poly,
+                 std::shared_ptr<Validate> plugin,
+                 std::shared_ptr<QueryStats> querystats,
+                 std::shared_ptr<QueryValidate> queryvalidate,
+                 std::shared_ptr<QueryRaw> queryraw,
+                 const UnderpassConfig &config,
+                 boost::asio::thread_pool *pool)
+{
+#ifdef TIMING_DEBUG_X
+    boost::timer::auto_cpu_timer timer("queriesOsmChange: took %w seconds\n");
+#endif
+    auto osmchanges = job.osmchanges;
 
     // Collect stats
-    if (!config->disable_stats) {
+    if (!config.disable_stats) {
         auto stats = osmchanges->collectStats(poly);
         for (auto it = std::begin(*stats); it != std::end(*stats); ++it) {
             if (it->second->added.size() == 0 && it->second->modified.size() == 0) {
                 continue;
             }
-            task.query.push_back(querystats->applyChange(*it->second));
+            auto query = querystats->applyChange(*it->second);
+            if (!query.empty()) {
+                job.stats[it->first] = query;
+            }
         }
     }
 
-    auto removed_nodes = std::make_shared<std::vector<long>>();
-    auto removed_ways = std::make_shared<std::vector<long>>();
-    auto removed_relations = std::make_shared<std::vector<long>>();
-    auto validation_removals = std::make_shared<std::vector<long>>();
+    // The raw data is either written by the commit with COPY, or
+    // as SQL queries like the rest
+    if (!config.disable_raw && config.raw_copy) {
+        job.rawbatch = std::make_shared<queryraw::RawBatch>();
+    }
 
     // Raw data and validation
-    if (!config->disable_validation || !config->disable_raw) {
+    if (!config.disable_validation || !config.disable_raw) {
         for (auto it = std::begin(osmchanges->changes); it != std::end(osmchanges->changes); ++it) {
             osmchange::OsmChange *change = it->get();
 
@@ -553,16 +1023,15 @@ threadOsmChange(OsmChangeTask osmChangeTask)
                 }
 
                 // Remove deleted nodes from validation table
-                if (!config->disable_validation && node->action == osmobjects::remove) {
-                    removed_nodes->push_back(node->id);
+                if (!config.disable_validation && node->action == osmobjects::remove) {
+                    queryvalidate->updateValidation(osmobjects::node, node->id, node->version, job.validation);
                 }
 
                 //  Update nodes, ignore new ones outside priority area
-                if (!config->disable_raw) {
-                    auto changes = queryraw->applyChange(*node);
-                    for (auto it = changes->begin(); it != changes->end(); ++it) {
-                         task.query.push_back(*it);
-                    }
+                if (job.rawbatch) {
+                    job.rawbatch->add(*node);
+                } else if (!config.disable_raw) {
+                    queryraw->applyChange(*node, job.raw);
                 }
             }
 
@@ -575,16 +1044,15 @@ threadOsmChange(OsmChangeTask osmChangeTask)
                 }
 
                 // Remove deleted ways from validation table
-                if (!config->disable_validation && way->action == osmobjects::remove) {
-                    removed_ways->push_back(way->id);
+                if (!config.disable_validation && way->action == osmobjects::remove) {
+                    queryvalidate->updateValidation(osmobjects::way, way->id, way->version, job.validation);
                 }
 
                 //  Update ways, ignore new ones outside priority area
-                if (!config->disable_raw) {
-                    auto changes = queryraw->applyChange(*way);
-                    for (auto it = changes->begin(); it != changes->end(); ++it) {
-                        task.query.push_back(*it);
-                    }
+                if (job.rawbatch) {
+                    job.rawbatch->add(*way);
+                } else if (!config.disable_raw) {
+                    queryraw->applyChange(*way, job.raw);
                 }
             }
 
@@ -599,56 +1067,78 @@ threadOsmChange(OsmChangeTask osmChangeTask)
                     continue;
                 }
                 // Remove deleted relations from validation table
-                // if (!config->disable_validation && relation->action == osmobjects::remove) {
-                //     removed_relations->push_back(relation->id);
+                // if (!config.disable_validation && relation->action == osmobjects::remove) {
+                //     queryvalidate->updateValidation(osmobjects::relation, relation->id, relation->version, job.validation);
                 // }
 
                 //  Update relations, ignore new ones outside priority area
-                if (!config->disable_raw) {
-                    auto changes = queryraw->applyChange(*relation);
-                    for (auto it = changes->begin(); it != changes->end(); ++it) {
-                        task.query.push_back(*it);
-                    }
+                if (job.rawbatch) {
+                    job.rawbatch->add(*relation);
+                } else if (!config.disable_raw) {
+                    queryraw->applyChange(*relation, job.raw);
                 }
             }
         }
     }
 
     // // Update validation table
-    if (!config->disable_validation) {
+    if (!config.disable_validation) {
 
         // Validate ways
-        auto wayval = osmchanges->validateWays(poly, plugin);
-        for (auto it = task.query.begin(); it != task.query.end(); ++it) {
-            auto result = queryvalidate->ways(wayval, validation_removals);
-            for (auto itt = result->begin(); itt != result->end(); ++itt) {
-                task.query.push_back(*itt);
-            }
-        }
+        auto wayval = osmchanges->validateWays(poly, plugin, pool);
+        queryvalidate->ways(wayval, job.validation);
 
         // Validate nodes
-        auto nodeval = osmchanges->validateNodes(poly, plugin);
-        for (auto it = task.query.begin(); it != task.query.end(); ++it) {
-            auto result = queryvalidate->nodes(nodeval, validation_removals);
-            for (auto itt = result->begin(); itt != result->end(); ++itt) {
-                task.query.push_back(*itt);
-            }
+        auto nodeval = osmchanges->validateNodes(poly, plugin, pool);
+        queryvalidate->nodes(nodeval, job.validation);
+
+        // The results go in the cache once the file is committed
+        if (plugin->cache) {
+            job.validated.insert(job.validated.end(), wayval->begin(), wayval->end());
+            job.validated.insert(job.validated.end(), nodeval->begin(), nodeval->end());
         }
 
         // Validate relations
         // relval = osmchanges->validateRelations(poly, plugin);
-        // queryvalidate->relations(relval, task.query, validation_removals);
-
-        // Remove validation entries for removed objects
-        task.query.push_back(*queryvalidate->updateValidation(validation_removals));
-        task.query.push_back(*queryvalidate->updateValidation(removed_nodes));
-        task.query.push_back(*queryvalidate->updateValidation(removed_ways));
-        // task.query += queryvalidate->updateValidation(removed_relations);
+        // queryvalidate->relations(relval, job.validation);
+    }
+    // The parsed data isn't needed once the queries exist, unless the
+    // commit has to store the node locations or cache the objects from it
+    if (!queryraw->locations && !queryraw->cache) {
+        job.osmchanges.reset();
+    }
+}
 
+// This thread get started for every osmChange file
+void
+threadOsmChange(OsmChangeTask osmChangeTask)
+{
+#ifdef TIMING_DEBUG
+    boost::timer::auto_cpu_timer timer("threadOsmChange: took %w seconds\n");
+#endif
+    OsmChangeJob job;
+    job.remote = osmChangeTask.remote;
+    downloadOsmChange(job, osmChangeTask.mirrors);
+    parseOsmChange(job);
+    geoutil::BoundaryIndex boundary(osmChangeTask.poly);
+    buildOsmChange(job, boundary, osmChangeTask.queryraw, *osmChangeTask.config);
+    queriesOsmChange(job, osmChangeTask.poly, osmChangeTask.plugin,
+                     osmChangeTask.querystats, osmChangeTask.queryvalidate,
+                     osmChangeTask.queryraw, *osmChangeTask.config);
+    if (job.rawbatch) {
+        RawCopy(osmChangeTask.queryraw->dbconn).write(*job.rawbatch);
+    }
+    osmChangeTask.queryraw->dbconn->execute(job.raw.statements());
+    bool written = osmChangeTask.queryvalidate->dbconn->execute(job.validation.statements());
+    if (osmChangeTask.plugin->cache) {
+        osmChangeTask.plugin->cache->commit(job.validated, written);
+    }
+    for (auto it = std::begin(job.stats); it != std::end(job.stats); ++it) {
+        job.task.query.push_back(it->second);
     }
-    const std::lock_guard<std::mutex> lock(tasks_change_mutex);
-    (*tasks)[taskIndex] = task;
 
+    const std::lock_guard<std::mutex> lock(tasks_change_mutex);
+    (*osmChangeTask.tasks)[osmChangeTask.taskIndex] = job.task;
 }
 
 } // namespace replicatorthreads
@@ -72,7 +72,9 @@ using tcp = net::ip::tcp;
 #include "stats/querystats.hh"
 #include "validate/queryvalidate.hh"
 #include "raw/queryraw.hh"
+#include "raw/rawcopy.hh"
 #include "validate/validate.hh"
+#include "utils/boundaryindex.hh"
 #include <ogr_geometry.h>
 
 using namespace queryvalidate;
@@ -83,6 +85,8 @@ using namespace underpassconfig;
 namespace replication {
 class StateFile;
 class RemoteURL;
+class Mirrors;
+class CatchUp;
 }; // namespace replication
 
 typedef std::shared_ptr<Validate>(plugin_t)();
@@ -104,32 +108,45 @@ struct ReplicationTask {
 /// minutely change files and processes them.
 extern void
 startMonitorChangesets(std::shared_ptr<replication::RemoteURL> &remote,
-    const multipolygon_t &poly,
+    const geoutil::BoundaryIndex &boundary,
     const underpassconfig::UnderpassConfig config
 );
 
+/// Get the planet servers that have the same files as \a remote, starting
+/// with it's own server
+std::shared_ptr<replication::Mirrors>
+getMirrors(const replication::RemoteURL &remote, const underpassconfig::UnderpassConfig &config);
+
+/// Plan the daily and hourly files to catch up from \a remote, and move
+/// it to the minutely file to carry on from. Returns false if there's
+/// nothing to plan, or the files couldn't be found.
+bool
+planCatchUp(replication::RemoteURL &remote, replication::Mirrors &mirrors, replication::CatchUp &catchup);
+
 /// This updates several fields in the changesets table, which are part of
 /// the changeset file, and don't need to be calculated.
 void
 threadChangeSet(std::shared_ptr<replication::RemoteURL> &remote,
-    std::shared_ptr<replication::Planet> &planet,
-    const multipolygon_t &poly,
+    std::shared_ptr<replication::Mirrors> &mirrors,
+    const geoutil::BoundaryIndex &boundary,
     std::shared_ptr<std::vector<ReplicationTask>> tasks,
     std::shared_ptr<QueryStats> &querystats
 );
 
 /// This monitors the planet server for new OSM changes files.
 /// It does a bulk download to catch up the database, then checks for the
-/// minutely change files and processes them.
+/// minutely change files and processes them. The files go through a
+/// pipeline of download, parse, geometry, and SQL stages connected by
+/// bounded queues, and are committed in sequence order.
 extern void
 startMonitorChanges(std::shared_ptr<replication::RemoteURL> &remote,
-    const multipolygon_t &poly,
+    const geoutil::BoundaryIndex &boundary,
     const underpassconfig::UnderpassConfig &config
 );
 
 struct OsmChangeTask {
         std::shared_ptr<replication::RemoteURL> remote;
-        std::shared_ptr<replication::Planet> planet;
+        std::shared_ptr<replication::Mirrors> mirrors;
         const multipolygon_t poly;
         std::shared_ptr<Validate> plugin;
         std::shared_ptr<std::vector<ReplicationTask>> tasks;
@@ -143,6 +160,40 @@ struct OsmChangeTask {
 /// Updates the tables from a changeset file
 void threadOsmChange(OsmChangeTask osmChangeTask);
 
+/// \struct OsmChangeJob
+/// \brief An osmChange file moving through the stages of the pipeline
+struct OsmChangeJob {
+    long sequence = 0;      ///< The order the file was issued in, used to commit in order
+    std::shared_ptr<replication::RemoteURL> remote; ///< The file to download
+    replication::RequestedFile file; ///< The downloaded data
+    std::shared_ptr<osmchange::OsmChangeFile> osmchanges; ///< The parsed data
+    std::shared_ptr<queryraw::RawBatch> rawbatch; ///< The raw data rows, when using COPY
+    pq::Coalescer raw;      ///< The prepared statement calls for the raw data
+    pq::Coalescer validation; ///< The prepared statement calls for the validation
+    std::vector<std::shared_ptr<ValidateStatus>> validated; ///< The validation results, for the cache
+    std::map<long, std::string> stats; ///< The statistics queries, by changeset
+    ReplicationTask task;   ///< The status, timestamp and queries for the file
+    long handover = -1;     ///< The minutely file that carries on after this catch up file
+};
+
+/// Download the osmChange file for a job
+void downloadOsmChange(OsmChangeJob &job, std::shared_ptr<replication::Mirrors> mirrors);
+/// Decompress and parse the downloaded osmChange file
+void parseOsmChange(OsmChangeJob &job);
+/// Build the way and relation geometries, and filter by the priority area
+void buildOsmChange(OsmChangeJob &job, const geoutil::BoundaryIndex &boundary,
+                    std::shared_ptr<QueryRaw> queryraw,
+                    const UnderpassConfig &config);
+/// Generate the queries for the stats, raw data, and validation. The
+/// validation is done on the \a pool if there is one.
+void queriesOsmChange(OsmChangeJob &job, const multipolygon_t &poly,
+                      std::shared_ptr<Validate> plugin,
+                      std::shared_ptr<QueryStats> querystats,
+                      std::shared_ptr<QueryValidate> queryvalidate,
+                      std::shared_ptr<QueryRaw> queryraw,
+                      const UnderpassConfig &config,
+                      boost::asio::thread_pool *pool = nullptr);
+
 static std::mutex tasks_change_mutex;
 static std::mutex tasks_changeset_mutex;
 
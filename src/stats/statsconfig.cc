@@ -25,12 +25,18 @@
 #include "utils/yaml.hh"
 #include "statsconfig.hh"
 #include "osm/osmchange.hh"
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <memory>
 
 /// \namespace statsconfig
 namespace statsconfig {
 
     std::map<std::string, std::shared_ptr<std::vector<StatsConfigCategory>>> StatsConfig::cache;
+    std::map<std::string, std::shared_ptr<const StatsClassifier>> StatsConfig::classifiers;
+    std::mutex StatsConfig::cache_mutex;
+    std::mutex StatsConfig::classifiers_mutex;
     std::string StatsConfig::path;
 
     StatsConfigCategory::StatsConfigCategory(std::string name) {
@@ -50,24 +56,45 @@ namespace statsconfig {
 
 
     StatsConfig::StatsConfig() {
+        read_yaml(getPath());
+    }
+
+    std::string StatsConfig::getPath(void) {
+        std::scoped_lock lock{cache_mutex};
         if (path.empty()) {
             path = ETCDIR;
             path += "/stats/statistics.yaml";
             if (!boost::filesystem::exists(path)) {
-                throw std::runtime_error("Statistics file not found: " + path);
+                std::string missing = path;
+                path.clear();
+                throw std::runtime_error("Statistics file not found: " + missing);
             }
         }
-        read_yaml(path);
+        return path;
+    }
+
+    std::shared_ptr<const StatsClassifier> StatsConfig::getClassifier(void) {
+        std::string filename = getPath();
+        std::scoped_lock lock{classifiers_mutex};
+        auto found = classifiers.find(filename);
+        if (found != classifiers.end()) {
+            return found->second;
+        }
+        auto classifier = std::make_shared<const StatsClassifier>(*read_yaml(filename));
+        classifiers[filename] = classifier;
+        return classifier;
     }
 
     void StatsConfig::setConfigurationFile(std::string statsConfigFilename) {
         if (!boost::filesystem::exists(statsConfigFilename)) {
             throw std::runtime_error("Statistics configuration file not found: " + statsConfigFilename);
         }
+        std::scoped_lock lock{cache_mutex};
         path = statsConfigFilename;
     }
 
     std::shared_ptr<std::vector<StatsConfigCategory>> StatsConfig::read_yaml(std::string filename) {
+        std::scoped_lock lock{cache_mutex};
         if (!cache.count(filename)) {
             yaml::Yaml yaml;
             yaml.read(filename);
@@ -151,6 +178,140 @@ namespace statsconfig {
         return "";
     }
 
+    StatsClassifier::StatsClassifier(const std::vector<StatsConfigCategory> &config) {
+        for (auto it = std::begin(config); it != std::end(config); ++it) {
+            int category = categories.size();
+            if (it->name == "\"[key]\"") {
+                categories.push_back({it->name, key});
+            } else if (it->name == "\"[key:value]\"") {
+                categories.push_back({it->name, keyvalue});
+            } else {
+                categories.push_back({it->name, named});
+            }
+            const std::map<std::string, std::set<std::string>> *types[] = {&it->node, &it->way, &it->relation};
+            const osmchange::osmtype_t osmtypes[] = {osmchange::node, osmchange::way, osmchange::relation};
+            for (int i = 0; i < 3; i++) {
+                for (auto tag_it = std::begin(*types[i]); tag_it != std::end(*types[i]); ++tag_it) {
+                    if (tag_it->first == "*") {
+                        if (any[osmtypes[i]] < 0) {
+                            any[osmtypes[i]] = category;
+                        }
+                        continue;
+                    }
+                    if (tag_it->second.count("*")) {
+                        add(osmtypes[i], tag_it->first, "*", category);
+                        continue;
+                    }
+                    for (auto value_it = std::begin(tag_it->second); value_it != std::end(tag_it->second); ++value_it) {
+                        add(osmtypes[i], tag_it->first, *value_it, category);
+                    }
+                }
+            }
+        }
+
+        std::sort(keys.begin(), keys.end(), std::less<const std::string *>());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+
+        // Keep the table at most half full, so the probes are short
+        std::size_t size = 16;
+        while (size < entries.size() * 2) {
+            size *= 2;
+        }
+        slots.assign(size, -1);
+        for (std::size_t i = 0; i < entries.size(); i++) {
+            std::size_t slot = entries[i].hash & (size - 1);
+            while (slots[slot] >= 0) {
+                slot = (slot + 1) & (size - 1);
+            }
+            slots[slot] = i;
+        }
+    }
+
+    void StatsClassifier::add(osmchange::osmtype_t type, const std::string &tag, const std::string &value, int category) {
+        // An earlier category has the same tag, so it always wins
+        for (auto it = std::begin(entries); it != std::end(entries); ++it) {
+            if (it->type == type && it->tag == tag && it->value == value) {
+                return;
+            }
+        }
+        entries.push_back({hash(type, tag, value), type, tag, value, category});
+        const std::string *key = osmobjects::StringTable::instance().intern(tag);
+        if (key == nullptr) {
+            interned = false;
+        } else {
+            keys.push_back(key);
+        }
+    }
+
+    std::size_t StatsClassifier::hash(osmchange::osmtype_t type, std::string_view tag, std::string_view value) {
+        // FNV-1a, with a separator so "ab"="c" isn't "a"="bc"
+        std::uint64_t hash = 14695981039346656037ULL ^ type;
+        for (auto it = std::begin(tag); it != std::end(tag); ++it) {
+            hash = (hash ^ static_cast<unsigned char>(*it)) * 1099511628211ULL;
+        }
+        hash = (hash ^ 0xff) * 1099511628211ULL;
+        for (auto it = std::begin(value); it != std::end(value); ++it) {
+            hash = (hash ^ static_cast<unsigned char>(*it)) * 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    int StatsClassifier::lookup(osmchange::osmtype_t type, std::string_view tag, std::string_view value) const {
+        std::size_t want = hash(type, tag, value);
+        std::size_t mask = slots.size() - 1;
+        for (std::size_t slot = want & mask; slots[slot] >= 0; slot = (slot + 1) & mask) {
+            const Entry &entry = entries[slots[slot]];
+            if (entry.hash == want && entry.type == type && entry.tag == tag && entry.value == value) {
+                return entry.category;
+            }
+        }
+        return -1;
+    }
+
+    int StatsClassifier::classify(osmchange::osmtype_t type, std::string_view tag, std::string_view value) const {
+        int category = any[type];
+        int found = lookup(type, tag, value);
+        if (found >= 0 && (category < 0 || found < category)) {
+            category = found;
+        }
+        found = lookup(type, tag, "*");
+        if (found >= 0 && (category < 0 || found < category)) {
+            category = found;
+        }
+        return category;
+    }
+
+    std::string StatsClassifier::name(int category, const std::string &tag, const std::string &value) const {
+        if (category < 0) {
+            return "";
+        }
+        if (categories[category].naming == key) {
+            return tag;
+        } else if (categories[category].naming == keyvalue) {
+            return tag + ":" + value;
+        }
+        return categories[category].name;
+    }
+
+    void StatsClassifier::scan(const osmobjects::TagList &tags, osmchange::osmtype_t type, std::vector<std::string> &hits) const {
+        // The keys of a TagList are interned too, so a key that isn't
+        // in any category is skipped without hashing it
+        bool filter = interned && any[type] < 0;
+        for (auto it = std::begin(tags); it != std::end(tags); ++it) {
+            if (it->second.empty()) {
+                continue;
+            }
+            if (filter && !std::binary_search(keys.begin(), keys.end(), &it->first,
+                                              std::less<const std::string *>())) {
+                continue;
+            }
+            int category = classify(type, it->first, it->second);
+            if (category >= 0) {
+                hits.push_back(name(category, it->first, it->second));
+            }
+        }
+    }
+
 
 
 } // EOF statsconfig namespace
@@ -32,8 +32,10 @@
 
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include "osm/osmchange.hh"
 
 /// \namespace statsconfig
@@ -57,6 +59,59 @@ namespace statsconfig {
             );
     };
 
+    /// \class StatsClassifier
+    /// \brief The stats categories compiled into a hash table
+    ///
+    /// Every tag of every priority object is looked up, so the categories
+    /// are compiled once into a flat table of (type, key, value) entries,
+    /// where the value may be "*" for any value. A lookup hashes the tag
+    /// in place, so it doesn't allocate. The first category in the
+    /// configuration file that matches wins, like StatsConfig::search().
+    /// The keys are interned, so the tags with other keys, which are
+    /// most of them, are skipped by comparing pointers.
+    class StatsClassifier {
+        public:
+            StatsClassifier(const std::vector<StatsConfigCategory> &categories);
+
+            /// The index of the category of a tag, -1 if it has none
+            int classify(osmchange::osmtype_t type, std::string_view tag, std::string_view value) const;
+            /// The name of a category for a tag, which may be the tag
+            /// itself for the "[key]" and "[key:value]" categories
+            std::string name(int category, const std::string &tag, const std::string &value) const;
+            /// Add the names of the categories of the \a tags to \a hits
+            void scan(const osmobjects::TagList &tags, osmchange::osmtype_t type, std::vector<std::string> &hits) const;
+
+            /// The number of (type, key, value) entries
+            std::size_t size(void) const { return entries.size(); };
+
+        private:
+            /// How a category is named in the stats
+            typedef enum { named, key, keyvalue } naming_t;
+            struct Category {
+                std::string name;
+                naming_t naming;
+            };
+            struct Entry {
+                std::size_t hash;
+                osmchange::osmtype_t type;
+                std::string tag;
+                std::string value;
+                int category;
+            };
+            static std::size_t hash(osmchange::osmtype_t type, std::string_view tag, std::string_view value);
+            int lookup(osmchange::osmtype_t type, std::string_view tag, std::string_view value) const;
+            void add(osmchange::osmtype_t type, const std::string &tag, const std::string &value, int category);
+            /// The category that matches any tag of a type, by osmtype_t
+            int any[osmchange::member + 1] = {-1, -1, -1, -1, -1};
+            /// The interned keys of the entries, sorted by address
+            std::vector<const std::string *> keys;
+            bool interned = true;    ///< False if a key couldn't be interned
+
+            std::vector<Category> categories;
+            std::vector<Entry> entries;
+            std::vector<int> slots;  ///< Indexes into entries, -1 when empty
+    };
+
    /// \class StatsConfig
    /// \brief Stats configuration manager
    class StatsConfig {
@@ -64,11 +119,18 @@ namespace statsconfig {
             StatsConfig();
             std::string search(std::string tag, std::string value, osmchange::osmtype_t type);
             static void setConfigurationFile(std::string statsConfigFilename);
+            /// The classifier for the configuration file, which is only
+            /// compiled the first time and then shared by all the threads
+            static std::shared_ptr<const StatsClassifier> getClassifier(void);
         private:
             static std::map<std::string, std::shared_ptr<std::vector<StatsConfigCategory>>> cache;
+            static std::map<std::string, std::shared_ptr<const StatsClassifier>> classifiers;
+            static std::mutex cache_mutex;
+            static std::mutex classifiers_mutex;
             static std::string path;
+            static std::string getPath(void);
             bool searchCategory(std::string tag, std::string value, std::map<std::string, std::set<std::string>> tags);
-            std::shared_ptr<std::vector<statsconfig::StatsConfigCategory>> read_yaml(std::string filename);
+            static std::shared_ptr<std::vector<statsconfig::StatsConfigCategory>> read_yaml(std::string filename);
 
     };
 
@@ -0,0 +1,190 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "utils/boundaryindex.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace geoutil;
+
+namespace bg = boost::geometry;
+
+TestState runtest;
+
+/// A ragged circle with lots of points, like the outline of a country
+polygon_t
+country(double x, double y, double radius, int points, std::mt19937 &random)
+{
+    std::uniform_real_distribution<double> jitter(0.8, 1.0);
+    polygon_t poly;
+    for (int i = 0; i < points; i++) {
+        double angle = -2 * M_PI * i / points;
+        double r = radius * jitter(random);
+        bg::append(poly.outer(), point_t(x + r * std::cos(angle), y + r * std::sin(angle)));
+    }
+    bg::append(poly.outer(), poly.outer().front());
+    bg::correct(poly);
+    return poly;
+}
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("boundary-test.log");
+    dbglogfile.setVerbosity(3);
+
+    std::mt19937 random(1);
+    multipolygon_t poly;
+    poly.push_back(country(10, 10, 8, 4000, random));
+    poly.push_back(country(30, 5, 6, 3000, random));
+    poly.push_back(country(-20, 20, 10, 5000, random));
+    // A lake in the last one
+    polygon_t lake = country(-20, 20, 3, 500, random);
+    poly.back().inners().push_back(lake.outer());
+    std::reverse(poly.back().inners().back().begin(), poly.back().inners().back().end());
+    bg::correct(poly);
+
+    BoundaryIndex empty;
+    if (empty.empty() && !empty.within(point_t(10, 10))) {
+        runtest.pass("BoundaryIndex::empty()");
+    } else {
+        runtest.fail("BoundaryIndex::empty()");
+    }
+
+    BoundaryIndex boundary(poly);
+    boundary.dump();
+    if (boundary.within(point_t(10, 10)) && boundary.within(point_t(30, 5)) &&
+        !boundary.within(point_t(-20, 20)) && !boundary.within(point_t(100, 0))) {
+        runtest.pass("BoundaryIndex::within(point)");
+    } else {
+        runtest.fail("BoundaryIndex::within(point)");
+    }
+
+    // Random points over the whole envelope, so many are near an edge
+    std::uniform_real_distribution<double> xs(-32, 38);
+    std::uniform_real_distribution<double> ys(-3, 32);
+    std::vector<point_t> points;
+    for (int i = 0; i < 20000; i++) {
+        points.push_back(point_t(xs(random), ys(random)));
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<bool> expected;
+    for (auto it = std::begin(points); it != std::end(points); ++it) {
+        expected.push_back(bg::within(*it, poly));
+    }
+    double plain = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    std::vector<bool> result;
+    for (auto it = std::begin(points); it != std::end(points); ++it) {
+        result.push_back(boundary.within(*it));
+    }
+    double prepared = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "bg::within(): " << plain / points.size() * 1e9 << "ns per point" << std::endl;
+    std::cout << "BoundaryIndex::within(): " << prepared / points.size() * 1e9 << "ns per point" << std::endl;
+    if (result == expected) {
+        runtest.pass("BoundaryIndex::within(point) matches bg::within()");
+    } else {
+        runtest.fail("BoundaryIndex::within(point) matches bg::within()");
+    }
+
+    // Short lines, like the ways in a change file
+    std::normal_distribution<double> step(0, 0.05);
+    std::vector<linestring_t> lines;
+    for (int i = 0; i < 2000; i++) {
+        linestring_t line;
+        point_t pt = points[i];
+        for (int j = 0; j < 5; j++) {
+            bg::append(line, pt);
+            pt = point_t(pt.x() + step(random), pt.y() + step(random));
+        }
+        lines.push_back(line);
+    }
+    start = std::chrono::steady_clock::now();
+    expected.clear();
+    for (auto it = std::begin(lines); it != std::end(lines); ++it) {
+        expected.push_back(bg::within(*it, poly));
+    }
+    plain = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    result.clear();
+    for (auto it = std::begin(lines); it != std::end(lines); ++it) {
+        result.push_back(boundary.within(*it));
+    }
+    prepared = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "bg::within(line): " << plain / lines.size() * 1e9 << "ns per line" << std::endl;
+    std::cout << "BoundaryIndex::within(line): " << prepared / lines.size() * 1e9 << "ns per line" << std::endl;
+    if (result == expected) {
+        runtest.pass("BoundaryIndex::within(line) matches bg::within()");
+    } else {
+        runtest.fail("BoundaryIndex::within(line) matches bg::within()");
+    }
+
+    // Changeset bounding boxes
+    std::uniform_real_distribution<double> sizes(0.001, 2);
+    std::vector<polygon_t> boxes;
+    for (int i = 0; i < 2000; i++) {
+        const point_t &pt = points[i];
+        double size = sizes(random);
+        polygon_t bbox;
+        bg::append(bbox, point_t(pt.x() + size, pt.y() + size));
+        bg::append(bbox, point_t(pt.x() + size, pt.y()));
+        bg::append(bbox, point_t(pt.x(), pt.y()));
+        bg::append(bbox, point_t(pt.x(), pt.y() + size));
+        bg::append(bbox, point_t(pt.x() + size, pt.y() + size));
+        boxes.push_back(bbox);
+    }
+    start = std::chrono::steady_clock::now();
+    expected.clear();
+    for (auto it = std::begin(boxes); it != std::end(boxes); ++it) {
+        expected.push_back(bg::intersects(*it, poly));
+    }
+    plain = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    start = std::chrono::steady_clock::now();
+    result.clear();
+    for (auto it = std::begin(boxes); it != std::end(boxes); ++it) {
+        result.push_back(boundary.intersects(*it));
+    }
+    prepared = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "bg::intersects(): " << plain / boxes.size() * 1e9 << "ns per box" << std::endl;
+    std::cout << "BoundaryIndex::intersects(): " << prepared / boxes.size() * 1e9 << "ns per box" << std::endl;
+    if (result == expected) {
+        runtest.pass("BoundaryIndex::intersects() matches bg::intersects()");
+    } else {
+        runtest.fail("BoundaryIndex::intersects() matches bg::intersects()");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
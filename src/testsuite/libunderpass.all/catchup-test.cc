@@ -0,0 +1,108 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <iostream>
+#include <string>
+
+#include "replicator/catchup.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace replication;
+
+TestState runtest;
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("catchup-test.log");
+    dbglogfile.setVerbosity(3);
+
+    StateFile day("", 4000, time_from_string("2024-01-05 00:00:00"), daily);
+    StateFile hour("", 90007, time_from_string("2024-01-05 07:00:00"), hourly);
+
+    // Late in the day, hourly files go to the end of it, then the daily
+    // files, then the hourly files after the last daily one
+    CatchUp late;
+    late.plan(time_from_string("2024-01-01 15:30:00"), day, hour);
+    if (late.legs.size() == 3 && late.size() == 19 &&
+        late.legs[0].frequency == hourly && late.legs[0].first == 89920 && late.legs[0].last == 89928 &&
+        late.legs[1].frequency == daily && late.legs[1].first == 3998 && late.legs[1].last == 4000 &&
+        late.legs[2].frequency == hourly && late.legs[2].first == 90001 && late.legs[2].last == 90007 &&
+        late.end == hour.timestamp) {
+        runtest.pass("CatchUp::plan(late in the day)");
+    } else {
+        runtest.fail("CatchUp::plan(late in the day)");
+    }
+
+    // Early in the day, the daily file with the start is used
+    CatchUp early;
+    early.plan(time_from_string("2024-01-02 02:00:00"), day, hour);
+    if (early.legs.size() == 2 && early.legs[0].frequency == daily &&
+        early.legs[0].first == 3998 && early.legs[0].last == 4000) {
+        runtest.pass("CatchUp::plan(early in the day)");
+    } else {
+        runtest.fail("CatchUp::plan(early in the day)");
+    }
+
+    // Less than a day behind is only hourly files, and a little behind is
+    // left to the minutely files
+    CatchUp hours;
+    hours.plan(time_from_string("2024-01-04 23:59:00"), day, hour);
+    CatchUp none;
+    none.plan(time_from_string("2024-01-05 06:00:00"), day, hour);
+    if (hours.legs.size() == 1 && hours.legs[0].first == 90000 && hours.legs[0].last == 90007 &&
+        none.done() && none.end == time_from_string("2024-01-05 06:00:00")) {
+        runtest.pass("CatchUp::plan(hourly)");
+    } else {
+        runtest.fail("CatchUp::plan(hourly)");
+    }
+
+    // The files come out in order, then the plan is done
+    frequency_t frequency;
+    long sequence;
+    long files = 0;
+    bool ordered = true;
+    while (early.next(frequency, sequence)) {
+        ordered &= (files < 3 && frequency == daily && sequence == 3998 + files) ||
+                   (files >= 3 && frequency == hourly && sequence == 89998 + files);
+        files++;
+    }
+    if (ordered && files == early.size() && early.done() && early.current() == minutely) {
+        runtest.pass("CatchUp::next()");
+    } else {
+        runtest.fail("CatchUp::next()");
+    }
+
+    RemoteURL remote("https://planet.maps.mail.ru/replication/minute/005/912/046.osc.gz");
+    if (CatchUp::getURL(remote, daily, 4000) ==
+        "https://planet.maps.mail.ru/replication/day/000/004/000.osc.gz") {
+        runtest.pass("CatchUp::getURL()");
+    } else {
+        runtest.fail("CatchUp::getURL()");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
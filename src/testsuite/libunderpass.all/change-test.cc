@@ -19,6 +19,7 @@
 
 #include <cmath>
 #include <dejagnu.h>
+#include <fstream>
 #include <iostream>
 #include <pqxx/pqxx>
 #include <string>
@@ -35,6 +36,9 @@
 #include <boost/date_time.hpp>
 #include <boost/geometry.hpp>
 #include <boost/program_options.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_stream.hpp>
 
 namespace opts = boost::program_options;
 
@@ -235,6 +239,53 @@ main(int argc, char *argv[])
         runtest.fail("ChangeSetFile::readChanges(last change)");
     }
 
+    // The objects are stored in the file's arena, and stay valid after
+    // the file is gone
+    {
+        std::shared_ptr<osmobjects::OsmNode> kept;
+        std::weak_ptr<osmobjects::ObjectArena> arena;
+        {
+            TestCO arenaco;
+            arenaco.readChanges(test_data_dir + "/123.osc");
+            arena = arenaco.arena;
+            kept = arenaco.changes.front()->nodes.front();
+        }
+        if (kept->id == tnf->id && !arena.expired() && arena.lock()->getObjects() > 0) {
+            runtest.pass("OsmChangeFile::arena(object outlives file)");
+        } else {
+            runtest.fail("OsmChangeFile::arena(object outlives file)");
+        }
+        kept.reset();
+        if (arena.expired()) {
+            runtest.pass("OsmChangeFile::arena(released with last object)");
+        } else {
+            runtest.fail("OsmChangeFile::arena(released with last object)");
+        }
+    }
+
+    // Read the same file compressed in memory, which is decompressed
+    // while it's parsed
+    {
+        std::ifstream osc(test_data_dir + "/123.osc", std::ios_base::in | std::ios_base::binary);
+        std::string compressed;
+        {
+            boost::iostreams::filtering_ostream out;
+            out.push(boost::iostreams::gzip_compressor());
+            out.push(boost::iostreams::back_inserter(compressed));
+            out << osc.rdbuf();
+        }
+        std::vector<unsigned char> gzdata(compressed.begin(), compressed.end());
+
+        TestCO memco;
+        memco.readChanges(gzdata);
+        if (memco.changes.size() == testco.changes.size() &&
+            memco.changes.front()->nodes.front()->id == tnf->id) {
+            runtest.pass("OsmChangeFile::readChanges(compressed buffer)");
+        } else {
+            runtest.fail("OsmChangeFile::readChanges(compressed buffer)");
+        }
+    }
+
     testco.readChanges(test_data_dir + "/changeset-data.osm");
 
     if (testco.changes.size() == 3 && testco.changes.back()->obj->id > 0) {
@@ -0,0 +1,111 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "replicator/checkpoint.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace replication;
+
+TestState runtest;
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("checkpoint-test.log");
+    dbglogfile.setVerbosity(3);
+
+    if (Checkpoint::toSequence("005/912/046") == 5912046 && Checkpoint::toSequence("000/000/000") == 0 &&
+        Checkpoint::toSequence("005/912") == -1 && Checkpoint::toSequence("005/abc/046") == -1) {
+        runtest.pass("Checkpoint::toSequence()");
+    } else {
+        runtest.fail("Checkpoint::toSequence()");
+    }
+
+    // Adding files doesn't use the database, only the statements do
+    auto db = std::make_shared<pq::Pq>();
+    Checkpoint checkpoint(db, "osmchange", minutely);
+    std::vector<pq::Statement> statements;
+    ptime timestamp = time_from_string("2024-01-02 03:04:05");
+    checkpoint.start(Checkpoint::toSequence("005/912/999"));
+    if (checkpoint.path == "005/912/999" &&
+        checkpoint.advance("005/913/000", timestamp, true, statements) &&
+        checkpoint.advance("005/913/001", timestamp, true, statements) &&
+        statements.size() == 2 && statements.back().name == "checkpoint_update" &&
+        statements.back().params[3].value_or("") == "005/913/001" &&
+        statements.back().params[4].value_or("") == "2024-01-02T03:04:05Z") {
+        runtest.pass("Checkpoint::advance()");
+    } else {
+        runtest.fail("Checkpoint::advance()");
+    }
+
+    // A file that was done before doesn't move it back
+    if (!checkpoint.advance("005/913/000", timestamp, true, statements) && statements.size() == 2 &&
+        checkpoint.path == "005/913/001") {
+        runtest.pass("Checkpoint::advance(done before)");
+    } else {
+        runtest.fail("Checkpoint::advance(done before)");
+    }
+
+    // A failed file stops it, and so does a gap
+    if (!checkpoint.advance("005/913/002", timestamp, false, statements) &&
+        !checkpoint.advance("005/913/003", timestamp, true, statements) &&
+        statements.size() == 2 && checkpoint.path == "005/913/001" && checkpoint.blocked) {
+        runtest.pass("Checkpoint::advance(failed)");
+    } else {
+        runtest.fail("Checkpoint::advance(failed)");
+    }
+
+    // Once the failed file is done again, it carries on
+    if (checkpoint.advance("005/913/002", timestamp, true, statements) && !checkpoint.blocked &&
+        checkpoint.advance("005/913/003", timestamp, true, statements) &&
+        statements.size() == 4 && checkpoint.path == "005/913/003") {
+        runtest.pass("Checkpoint::advance(gap filled)");
+    } else {
+        runtest.fail("Checkpoint::advance(gap filled)");
+    }
+    checkpoint.start(Checkpoint::toSequence("005/913/001"));
+    if (!checkpoint.advance("005/913/003", timestamp, true, statements) && checkpoint.blocked) {
+        runtest.pass("Checkpoint::advance(gap)");
+    } else {
+        runtest.fail("Checkpoint::advance(gap)");
+    }
+
+    if (checkpoint.getURL("planet.maps.mail.ru") ==
+            "https://planet.maps.mail.ru/replication/minute/005/913/001.osc.gz" &&
+        Checkpoint(db, "changeset", changeset).getURL("planet.maps.mail.ru").find("/replication/changesets/") !=
+            std::string::npos) {
+        runtest.pass("Checkpoint::getURL()");
+    } else {
+        runtest.fail("Checkpoint::getURL()");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,147 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "data/coalescer.hh"
+#include "validate/queryvalidate.hh"
+#include "validate/validate.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace pq;
+
+TestState runtest;
+
+/// A write of one version of an object
+std::vector<Statement>
+upsert(long id, long version)
+{
+    return {Statement("upsert").bind(id).bind(version)};
+}
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("coalescer-test.log");
+    dbglogfile.setVerbosity(3);
+
+    // The latest version wins, whatever order they're added in
+    Coalescer first;
+    first.add(osmobjects::node, 1, 2, upsert(1, 2));
+    first.add(osmobjects::node, 1, 1, upsert(1, 1));
+    first.add(osmobjects::way, 1, 1, upsert(1, 1));
+    auto calls = first.statements();
+    if (first.added == 3 && first.size() == 2 && calls.size() == 2 &&
+        calls[0].params[1].value_or("") == "2" && calls[1].params[1].value_or("") == "1") {
+        runtest.pass("Coalescer::add()");
+    } else {
+        runtest.fail("Coalescer::add()");
+    }
+
+    // A geometry update of the same version is kept after the full write
+    first.update(osmobjects::way, 1, 1, {Statement("geometry").bind(1)});
+    first.update(osmobjects::way, 1, 1, {Statement("geometry").bind(2)});
+    calls = first.statements();
+    if (calls.size() == 3 && calls[1].name == "upsert" && calls[2].name == "geometry" &&
+        calls[2].params[0].value_or("") == "2") {
+        runtest.pass("Coalescer::update()");
+    } else {
+        runtest.fail("Coalescer::update()");
+    }
+
+    // A later file replaces the writes, and the removals are done at once
+    Coalescer second;
+    second.add(osmobjects::node, 1, 3, upsert(1, 3));
+    second.remove(osmobjects::way, 1, 2, "delete");
+    second.remove(osmobjects::way, 1, 2, "delete_other");
+    second.remove(osmobjects::node, 2, 1, "delete");
+    first.add(std::move(second));
+    calls = first.statements();
+    if (first.added == 9 && first.size() == 4 && calls.size() == 3 &&
+        calls[0].params[1].value_or("") == "3" &&
+        calls[1].name == "delete" && calls[1].params[0].value_or("") == "{1,2}" &&
+        calls[2].name == "delete_other" && calls[2].params[0].value_or("") == "{1}") {
+        runtest.pass("Coalescer::add(later)");
+    } else {
+        runtest.fail("Coalescer::add(later)");
+    }
+
+    // An older write after a removal is ignored
+    first.add(osmobjects::way, 1, 1, upsert(1, 1));
+    if (first.statements().size() == 3) {
+        runtest.pass("Coalescer::remove()");
+    } else {
+        runtest.fail("Coalescer::remove()");
+    }
+
+    // Split between connections, the writes of an object stay together
+    auto parts = first.statements(2);
+    if (parts.size() == 2 && parts[0].size() == 1 && parts[1].size() == 3 &&
+        parts[0][0].name == "delete" && parts[0][0].params[0].value_or("") == "{2}" &&
+        parts[1][0].name == "upsert" && parts[1][1].name == "delete" &&
+        parts[1][1].params[0].value_or("") == "{1}" && parts[1][2].name == "delete_other") {
+        runtest.pass("Coalescer::statements(parts)");
+    } else {
+        runtest.fail("Coalescer::statements(parts)");
+    }
+
+    // A node is validated for each of it's keys, all with the same
+    // version, so a clean result for the last key mustn't replace or
+    // remove what was found for the others
+    osmobjects::OsmNode node;
+    node.id = 5;
+    node.version = 2;
+    auto building = std::make_shared<ValidateStatus>(node);
+    building->status.insert(badvalue);
+    building->values.insert("building=sponge");
+    auto natural = std::make_shared<ValidateStatus>(node);
+    auto nodeval = std::make_shared<std::vector<std::shared_ptr<ValidateStatus>>>();
+    nodeval->push_back(building);
+    nodeval->push_back(natural);
+    Coalescer validation;
+    queryvalidate::QueryValidate().nodes(nodeval, validation);
+    calls = validation.statements();
+    if (calls.size() == 1 && calls[0].name == "validation_upsert" && calls[0].params[4].value_or("") == "badvalue") {
+        runtest.pass("QueryValidate::nodes(same version)");
+    } else {
+        runtest.fail("QueryValidate::nodes(same version)");
+    }
+
+    // The node is only removed from the table when all of them are clean
+    building->status.clear();
+    Coalescer clean;
+    queryvalidate::QueryValidate().nodes(nodeval, clean);
+    calls = clean.statements();
+    if (calls.size() == 1 && calls[0].name == "validation_delete" && calls[0].params[0].value_or("") == "{5}") {
+        runtest.pass("QueryValidate::nodes(clean)");
+    } else {
+        runtest.fail("QueryValidate::nodes(clean)");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
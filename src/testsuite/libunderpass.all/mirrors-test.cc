@@ -0,0 +1,114 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "replicator/mirrors.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace replication;
+
+TestState runtest;
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("mirrors-test.log");
+    dbglogfile.setVerbosity(3);
+
+    auto mirrors = std::make_shared<Mirrors>(std::vector<std::string>{"a.example", "b.example", "a.example"});
+    auto order = mirrors->rank();
+    if (order.size() == 2 && order[0] == "a.example" && order[1] == "b.example") {
+        runtest.pass("Mirrors::rank(not measured)");
+    } else {
+        runtest.fail("Mirrors::rank(not measured)");
+    }
+
+    // The faster mirror goes first, until it starts failing
+    for (int i = 0; i < 30; i++) {
+        mirrors->record("a.example", 2.0, 1000, reqfile_t::success);
+        mirrors->record("b.example", 0.5 + (i % 10) * 0.1, 1000, reqfile_t::success);
+    }
+    if (mirrors->rank().front() == "b.example") {
+        runtest.pass("Mirrors::rank(latency)");
+    } else {
+        runtest.fail("Mirrors::rank(latency)");
+    }
+    for (int i = 0; i < 10; i++) {
+        mirrors->record("b.example", 0, 0, reqfile_t::systemError);
+    }
+    if (mirrors->rank().front() == "a.example") {
+        runtest.pass("Mirrors::rank(errors)");
+    } else {
+        runtest.fail("Mirrors::rank(errors)");
+    }
+
+    // The deadline is the 95th percentile of the recent times
+    auto fresh = std::make_shared<Mirrors>(std::vector<std::string>{"c.example"});
+    if (mirrors->deadline("b.example").count() == 1400 &&
+        fresh->deadline("c.example") == fresh->first_deadline[minutely]) {
+        runtest.pass("Mirrors::deadline()");
+    } else {
+        runtest.fail("Mirrors::deadline()");
+    }
+
+    // The hourly files are bigger, so their times don't change the
+    // deadline of the minutely ones, and the daily files aren't hedged
+    for (int i = 0; i < 30; i++) {
+        fresh->record("c.example", 0.2, 1000, reqfile_t::success);
+        fresh->record("c.example", 20.0, 100000, reqfile_t::success, hourly);
+    }
+    if (fresh->deadline("c.example").count() == 500 && fresh->deadline("c.example", hourly).count() == 20000 &&
+        fresh->deadline("c.example", daily).count() == 0) {
+        runtest.pass("Mirrors::deadline(frequency)");
+    } else {
+        runtest.fail("Mirrors::deadline(frequency)");
+    }
+
+    // A file in the local cache doesn't need the network
+    std::string destdir = std::filesystem::temp_directory_path().string() + "/mirrors-test/";
+    std::filesystem::create_directories(destdir + "replication/minute/000/000");
+    std::ofstream(destdir + "replication/minute/000/000/001.osc.gz") << "cached";
+    RemoteURL remote("https://a.example/replication/minute/000/000/001.osc.gz");
+    remote.destdir_base = destdir;
+    auto file = mirrors->download(remote);
+    auto stats = mirrors->getStats();
+    if (file.status == reqfile_t::success && file.data->size() == 6 &&
+        stats.size() == 2 && stats[0].wins == 1 && stats[0].requests == 1) {
+        runtest.pass("Mirrors::download()");
+    } else {
+        runtest.fail("Mirrors::download()");
+    }
+    mirrors->dump();
+    std::filesystem::remove_all(destdir);
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
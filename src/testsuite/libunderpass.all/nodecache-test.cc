@@ -0,0 +1,123 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+#include "osm/nodecache.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace osmchange;
+
+TestState runtest;
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("nodecache-test.log");
+    dbglogfile.setVerbosity(3);
+
+    NodeCache nodecache;
+    point_t point;
+    nodecache.insert(42, point_t(-105.1234567, 40.7654321));
+    nodecache.insert(-1, point_t(1, 2));
+    if (nodecache.find(42, point) && point.get<0>() == -105.1234567 && point.get<1>() == 40.7654321 &&
+        nodecache.contains(-1) && !nodecache.contains(43) && nodecache.size() == 2) {
+        runtest.pass("NodeCache::find()");
+    } else {
+        runtest.fail("NodeCache::find()");
+    }
+
+    nodecache.insert(42, point_t(1, 1));
+    nodecache.find(42, point);
+    if (nodecache.size() == 2 && point.get<0>() == 1) {
+        runtest.pass("NodeCache::insert(replace)");
+    } else {
+        runtest.fail("NodeCache::insert(replace)");
+    }
+
+    nodecache.clear();
+    if (nodecache.empty() && !nodecache.contains(42)) {
+        runtest.pass("NodeCache::clear()");
+    } else {
+        runtest.fail("NodeCache::clear()");
+    }
+
+    // The nodes of a large change file, which are mostly new IDs close
+    // together, and the refs of it's ways looking them up
+    std::mt19937 random(1);
+    std::uniform_int_distribution<long> ids(11000000000L, 11000400000L);
+    std::uniform_real_distribution<double> coords(-90, 90);
+    std::vector<std::pair<long, point_t>> nodes;
+    for (int i = 0; i < 100000; i++) {
+        nodes.push_back(std::make_pair(ids(random), point_t(coords(random), coords(random))));
+    }
+    std::vector<long> refs;
+    for (int i = 0; i < 1000000; i++) {
+        refs.push_back(nodes[random() % nodes.size()].first);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::map<double, point_t> tree;
+    for (auto it = std::begin(nodes); it != std::end(nodes); ++it) {
+        tree[it->first] = it->second;
+    }
+    double found = 0;
+    for (auto it = std::begin(refs); it != std::end(refs); ++it) {
+        if (tree.count(*it)) {
+            found += tree.at(*it).get<0>();
+        }
+    }
+    double maptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    NodeCache table;
+    table.reserve(nodes.size());
+    for (auto it = std::begin(nodes); it != std::end(nodes); ++it) {
+        table.insert(it->first, it->second);
+    }
+    double total = 0;
+    for (auto it = std::begin(refs); it != std::end(refs); ++it) {
+        if (table.find(*it, point)) {
+            total += point.get<0>();
+        }
+    }
+    double tabletime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "std::map<double, point_t>: " << maptime * 1000 << "ms" << std::endl;
+    std::cout << "NodeCache: " << tabletime * 1000 << "ms" << std::endl;
+    if (table.size() == tree.size() && std::abs(total - found) < 1) {
+        runtest.pass("NodeCache matches std::map");
+    } else {
+        runtest.fail("NodeCache matches std::map");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
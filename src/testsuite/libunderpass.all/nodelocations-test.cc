@@ -0,0 +1,147 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+
+#include "raw/nodelocations.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace queryraw;
+
+TestState runtest;
+
+bool
+near(const point_t &a, const point_t &b)
+{
+    return std::abs(a.get<0>() - b.get<0>()) < 1e-7 && std::abs(a.get<1>() - b.get<1>()) < 1e-7;
+}
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("nodelocations-test.log");
+    dbglogfile.setVerbosity(3);
+
+    std::string filespec = boost::filesystem::temp_directory_path().string() + "/nodelocations-test.bin";
+    boost::filesystem::remove(filespec);
+
+    {
+        NodeLocations locations;
+        if (locations.open(filespec)) {
+            runtest.pass("NodeLocations::open()");
+        } else {
+            runtest.fail("NodeLocations::open()");
+            return 1;
+        }
+
+        point_t point;
+        locations.set(42, point_t(-105.123456, 40.654321));
+        locations.set(43, point_t(0.0, 0.0));
+        if (locations.get(42, point) && near(point, point_t(-105.123456, 40.654321)) &&
+            locations.get(43, point) && near(point, point_t(0.0, 0.0)) &&
+            !locations.get(44, point)) {
+            runtest.pass("NodeLocations::get()");
+        } else {
+            runtest.fail("NodeLocations::get()");
+        }
+
+        // A node ID past the end of the file makes it grow
+        locations.set(12000000000L, point_t(179.9999999, -89.9999999));
+        if (locations.get(12000000000L, point) && near(point, point_t(179.9999999, -89.9999999)) &&
+            locations.get(42, point)) {
+            runtest.pass("NodeLocations::set(grow)");
+        } else {
+            runtest.fail("NodeLocations::set(grow)");
+        }
+
+        locations.remove(43);
+        if (!locations.get(43, point)) {
+            runtest.pass("NodeLocations::remove()");
+        } else {
+            runtest.fail("NodeLocations::remove()");
+        }
+
+        // A location read from the database before a file was committed
+        // doesn't replace the committed one, or bring back a deleted node
+        locations.set(42, point_t(1.5, 2.5), true);
+        locations.set(42, point_t(-105.123456, 40.654321));
+        locations.set(43, point_t(3.0, 4.0));
+        if (locations.get(42, point) && near(point, point_t(1.5, 2.5)) && !locations.get(43, point)) {
+            runtest.pass("NodeLocations::set(stale)");
+        } else {
+            runtest.fail("NodeLocations::set(stale)");
+        }
+        locations.set(42, point_t(-105.123456, 40.654321), true);
+    }
+
+    // The locations are still there after reopening the file
+    NodeLocations locations;
+    locations.open(filespec);
+    point_t point;
+    if (locations.get(42, point) && near(point, point_t(-105.123456, 40.654321)) &&
+        locations.get(12000000000L, point)) {
+        runtest.pass("NodeLocations::open(existing)");
+    } else {
+        runtest.fail("NodeLocations::open(existing)");
+    }
+
+    // Lookups of random node IDs, like the refs of the ways in a change file
+    std::mt19937 random(1);
+    std::uniform_int_distribution<long> ids(1, 10000000);
+    for (int i = 0; i < 1000000; i++) {
+        locations.set(ids(random), point_t(1.0, 1.0));
+    }
+    std::vector<long> refs;
+    for (int i = 0; i < 1000000; i++) {
+        refs.push_back(ids(random));
+    }
+    osmchange::NodeCache nodecache;
+    std::vector<long> missing;
+    auto start = std::chrono::steady_clock::now();
+    locations.resolve(refs, nodecache, missing);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "NodeLocations: " << elapsed / refs.size() * 1e9 << "ns per lookup, "
+              << (refs.size() - missing.size()) * 100.0 / refs.size() << "% found" << std::endl;
+    locations.dump();
+    if (nodecache.size() > 0 && missing.size() > 0 &&
+        locations.getHits() + locations.getMisses() > refs.size()) {
+        runtest.pass("NodeLocations::resolve()");
+    } else {
+        runtest.fail("NodeLocations::resolve()");
+    }
+
+    locations.close();
+    boost::filesystem::remove(filespec);
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
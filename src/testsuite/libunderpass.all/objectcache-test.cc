@@ -0,0 +1,159 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "raw/objectcache.hh"
+#include "osm/osmchange.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace queryraw;
+
+TestState runtest;
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("objectcache-test.log");
+    dbglogfile.setVerbosity(3);
+
+    ObjectCache cache(1024 * 1024, 4);
+    point_t point;
+    cache.set(1, point_t(1.5, 2.5), 1);
+    if (cache.get(1, point) && point.get<0>() == 1.5 && point.get<1>() == 2.5 &&
+        !cache.get(2, point) && cache.getHits() == 1 && cache.getMisses() == 1) {
+        runtest.pass("ObjectCache::get()");
+    } else {
+        runtest.fail("ObjectCache::get()");
+    }
+
+    // A database read doesn't replace a committed object of the same
+    // version, but a committed one does
+    cache.set(1, point_t(3, 4), 1);
+    cache.get(1, point);
+    bool read = point.get<0>() == 1.5;
+    cache.set(1, point_t(3, 4), 1, true);
+    cache.get(1, point);
+    bool committed = point.get<0>() == 3;
+    cache.set(1, point_t(5, 6), 0, true);
+    cache.get(1, point);
+    if (read && committed && point.get<0>() == 3) {
+        runtest.pass("ObjectCache::set(version)");
+    } else {
+        runtest.fail("ObjectCache::set(version)");
+    }
+
+    // Nodes and ways with the same ID are different objects
+    osmobjects::OsmWay way;
+    way.id = 1;
+    way.version = 2;
+    way.refs = {1, 2};
+    boost::geometry::append(way.linestring, point_t(1, 1));
+    boost::geometry::append(way.linestring, point_t(2, 2));
+    way.addTag("highway", "primary");
+    cache.set(way);
+    auto cached = cache.getWay(1);
+    if (cached && cached->version == 2 && boost::geometry::num_points(cached->linestring) == 2 &&
+        cached->tags.empty() && cache.get(1, point) && !cache.getWay(2)) {
+        runtest.pass("ObjectCache::getWay()");
+    } else {
+        runtest.fail("ObjectCache::getWay()");
+    }
+
+    // A deleted object stays deleted until there's a newer version
+    cache.remove(osmobjects::way, 1, 3);
+    cache.set(way);
+    if (!cache.getWay(1)) {
+        runtest.pass("ObjectCache::remove()");
+    } else {
+        runtest.fail("ObjectCache::remove()");
+    }
+
+    // Committed files update the cache
+    osmchange::OsmChangeFile osmchanges;
+    auto change = std::make_shared<osmchange::OsmChange>(osmobjects::modify);
+    auto node = std::make_shared<osmobjects::OsmNode>(7.0, 8.0);
+    node->id = 2;
+    node->version = 1;
+    node->action = osmobjects::modify;
+    node->priority = true;
+    change->nodes.push_back(node);
+    auto moved = std::make_shared<osmobjects::OsmNode>(0.0, 0.0);
+    moved->id = 1;
+    moved->version = 2;
+    moved->action = osmobjects::remove;
+    moved->priority = true;
+    change->nodes.push_back(moved);
+    osmchanges.changes.push_back(change);
+    cache.update(osmchanges);
+    osmchange::NodeCache nodecache;
+    std::vector<long> missing;
+    cache.resolve({1, 2, 3}, nodecache, missing);
+    if (nodecache.size() == 1 && nodecache.contains(2) && missing == std::vector<long>{1, 3}) {
+        runtest.pass("ObjectCache::update()");
+    } else {
+        runtest.fail("ObjectCache::update()");
+    }
+
+    // Objects outside the priority area aren't in the database, so a
+    // cached version of them is dropped
+    cache.set(4, point_t(1, 1), 1);
+    auto outside = std::make_shared<osmobjects::OsmNode>(9.0, 9.0);
+    outside->id = 4;
+    outside->version = 2;
+    outside->action = osmobjects::modify;
+    auto elsewhere = std::make_shared<osmobjects::OsmNode>(9.0, 9.0);
+    elsewhere->id = 5;
+    elsewhere->version = 1;
+    elsewhere->action = osmobjects::create;
+    osmchange::OsmChangeFile filtered;
+    auto other = std::make_shared<osmchange::OsmChange>(osmobjects::modify);
+    other->nodes.push_back(outside);
+    other->nodes.push_back(elsewhere);
+    filtered.changes.push_back(other);
+    cache.update(filtered);
+    if (!cache.get(4, point) && !cache.get(5, point)) {
+        runtest.pass("ObjectCache::update(priority)");
+    } else {
+        runtest.fail("ObjectCache::update(priority)");
+    }
+
+    // The least recently used objects are dropped to stay in the budget
+    ObjectCache small(4096, 1);
+    for (long id = 1; id <= 1000; id++) {
+        small.set(id, point_t(id, id), 1);
+    }
+    if (small.getEvictions() > 0 && small.getBytes() <= 4096 &&
+        small.get(1000, point) && !small.get(1, point)) {
+        runtest.pass("ObjectCache eviction");
+    } else {
+        runtest.fail("ObjectCache eviction");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,305 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/program_options.hpp>
+
+#include "osm/osmchange.hh"
+#include "osm/osmchangereader.hh"
+#include "utils/log.hh"
+
+namespace opts = boost::program_options;
+
+using namespace logger;
+using namespace osmchange;
+
+TestState runtest;
+
+class TestCO : public osmchange::OsmChangeFile {
+  public:
+#ifdef LIBXML
+    /// Parse with libxml++, even when the pull parser is the default
+    bool readSax(std::istream &xml)
+    {
+        setlocale(LC_NUMERIC, "C");
+        try {
+            set_substitute_entities(true);
+            parse_stream(xml);
+        } catch (const xmlpp::exception &ex) {
+        }
+        return true;
+    };
+#endif
+};
+
+// Count the objects and tags, so the two parsers can be compared
+std::string
+summary(TestCO &co)
+{
+    long nodes = 0, ways = 0, relations = 0, tags = 0, refs = 0, members = 0;
+    for (auto it = std::begin(co.changes); it != std::end(co.changes); ++it) {
+        for (auto nit = std::begin((*it)->nodes); nit != std::end((*it)->nodes); ++nit) {
+            nodes++;
+            tags += (*nit)->tags.size();
+        }
+        for (auto wit = std::begin((*it)->ways); wit != std::end((*it)->ways); ++wit) {
+            ways++;
+            tags += (*wit)->tags.size();
+            refs += (*wit)->refs.size();
+        }
+        for (auto rit = std::begin((*it)->relations); rit != std::end((*it)->relations); ++rit) {
+            relations++;
+            tags += (*rit)->tags.size();
+            members += (*rit)->members.size();
+        }
+    }
+    std::stringstream out;
+    out << co.changes.size() << " changes, " << nodes << " nodes, " << ways
+        << " ways, " << relations << " relations, " << tags << " tags, "
+        << refs << " refs, " << members << " members, " << co.nodecache.size()
+        << " cached";
+    return out.str();
+}
+
+// Write out everything that was parsed, so the two parsers can be
+// compared object by object
+void
+common(std::ostream &out, const osmobjects::OsmObject &obj)
+{
+    out << obj.action << " " << obj.id << " v" << obj.version << " c" << obj.changeset
+        << " " << obj.uid << " " << obj.user << " " << to_iso_extended_string(obj.timestamp);
+    std::vector<std::pair<std::string, std::string>> tags;
+    for (auto it = std::begin(obj.tags); it != std::end(obj.tags); ++it) {
+        tags.emplace_back(it->first, it->second);
+    }
+    std::sort(tags.begin(), tags.end());
+    for (auto it = std::begin(tags); it != std::end(tags); ++it) {
+        out << " " << it->first << "=" << it->second;
+    }
+}
+
+std::string
+contents(TestCO &co)
+{
+    std::stringstream out;
+    out << std::setprecision(12);
+    for (auto it = std::begin(co.changes); it != std::end(co.changes); ++it) {
+        for (auto nit = std::begin((*it)->nodes); nit != std::end((*it)->nodes); ++nit) {
+            out << "node ";
+            common(out, **nit);
+            // A deleted node may not have a location
+            if ((*nit)->action != osmobjects::remove) {
+                out << " " << (*nit)->point.x() << "," << (*nit)->point.y();
+            }
+            point_t cached;
+            if (co.nodecache.find((*nit)->id, cached)) {
+                out << " cached " << cached.x() << "," << cached.y();
+            }
+            out << std::endl;
+        }
+        for (auto wit = std::begin((*it)->ways); wit != std::end((*it)->ways); ++wit) {
+            out << "way ";
+            common(out, **wit);
+            for (auto rit = std::begin((*wit)->refs); rit != std::end((*wit)->refs); ++rit) {
+                out << " " << *rit;
+            }
+            out << std::endl;
+        }
+        for (auto rit = std::begin((*it)->relations); rit != std::end((*it)->relations); ++rit) {
+            out << "relation ";
+            common(out, **rit);
+            for (auto mit = std::begin((*rit)->members); mit != std::end((*rit)->members); ++mit) {
+                out << " " << mit->type << ":" << mit->ref << ":" << mit->role;
+            }
+            out << std::endl;
+        }
+    }
+    return out.str();
+}
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("parser-test.log");
+    dbglogfile.setVerbosity(3);
+
+    std::string test_data_dir(DATADIR);
+    test_data_dir += "/testsuite/testdata/";
+
+    opts::variables_map vm;
+    try {
+        opts::options_description desc("Allowed options");
+        // clang-format off
+        desc.add_options()
+            ("help,h", "display help")
+            ("file,f", opts::value<std::string>(), "OsmChange file to parse")
+            ("iterations,i", opts::value<int>(), "Number of times to parse the file");
+        // clang-format on
+        opts::store(opts::command_line_parser(argc, argv).options(desc).run(), vm);
+        opts::notify(vm);
+        if (vm.count("help")) {
+            std::cout << desc << std::endl;
+            exit(0);
+        }
+    } catch (std::exception &e) {
+        std::cout << e.what() << std::endl;
+        return 1;
+    }
+    std::string file = test_data_dir + "123.osc";
+    if (vm.count("file")) {
+        file = vm["file"].as<std::string>();
+    }
+    int iterations = 1;
+    if (vm.count("iterations")) {
+        iterations = vm["iterations"].as<int>();
+    }
+
+    std::ifstream in(file);
+    std::stringstream buf;
+    buf << in.rdbuf();
+    const std::string data = buf.str();
+
+    // Test the reader on its own
+    {
+        std::istringstream xml("<?xml version=\"1.0\"?><!-- a > comment -->"
+                               "<osmChange><create><tag k=\"name\" v=\"A &amp; B &#x263A;\"/>"
+                               "</create></osmChange>");
+        OsmChangeReader reader(xml, 8);
+        Element element;
+        int count = 0;
+        std::string value;
+        std::string tmp;
+        while (reader.next(element)) {
+            count++;
+            if (element.type == element_t::tag) {
+                value = OsmChangeReader::unescape(element.attributes[1], tmp);
+            }
+        }
+        if (count == 3 && value == "A & B \xE2\x98\xBA") {
+            runtest.pass("OsmChangeReader::next(small buffer)");
+        } else {
+            runtest.fail("OsmChangeReader::next(small buffer)");
+        }
+    }
+    if (OsmChangeReader::toTimestamp("2020-10-30T20:15:24Z") == time_from_string("2020-10-30 20:15:24")) {
+        runtest.pass("OsmChangeReader::toTimestamp()");
+    } else {
+        runtest.fail("OsmChangeReader::toTimestamp()");
+    }
+
+    // A line break in a value is a space, unless it's a character reference
+    {
+        Attribute attr;
+        attr.value = "27 F\r\nebruary\t2020&#10;";
+        attr.escaped = true;
+        std::string tmp;
+        if (OsmChangeReader::unescape(attr, tmp) == "27 F ebruary 2020\n") {
+            runtest.pass("OsmChangeReader::unescape(whitespace)");
+        } else {
+            runtest.fail("OsmChangeReader::unescape(whitespace)");
+        }
+    }
+
+    // A deleted node may not have a location, so it isn't cached
+    {
+        std::istringstream xml("<osmChange><delete><node id=\"7\" version=\"2\" visible=\"false\"/></delete>"
+                               "<modify><node id=\"8\" version=\"3\" lat=\"21.7\" lon=\"4.6\"/></modify></osmChange>");
+        TestCO co;
+        co.readPull(xml);
+        point_t point;
+        if (co.nodecache.size() == 1 && !co.nodecache.contains(7) && co.nodecache.find(8, point) &&
+            std::abs(point.x() - 4.6) < 1e-7 && std::abs(point.y() - 21.7) < 1e-7) {
+            runtest.pass("OsmChangeFile::readPull(deleted node)");
+        } else {
+            runtest.fail("OsmChangeFile::readPull(deleted node)");
+        }
+    }
+
+    // Parse with the pull parser
+    double pulltime = 0;
+    std::string pullsummary;
+    std::string pullcontents;
+    for (int i = 0; i < iterations; i++) {
+        TestCO co;
+        std::istringstream xml(data);
+        auto start = std::chrono::steady_clock::now();
+        co.readPull(xml);
+        pulltime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        pullsummary = summary(co);
+        pullcontents = contents(co);
+    }
+    std::cout << "Pull parser: " << pullsummary << std::endl;
+    std::cout << "Pull parser: " << pulltime / iterations * 1000 << "ms per file" << std::endl;
+
+#ifdef LIBXML
+    // Parse with libxml++, to compare the results and the speed
+    double saxtime = 0;
+    std::string saxsummary;
+    std::string saxcontents;
+    for (int i = 0; i < iterations; i++) {
+        TestCO co;
+        std::istringstream xml(data);
+        auto start = std::chrono::steady_clock::now();
+        co.readSax(xml);
+        saxtime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        saxsummary = summary(co);
+        saxcontents = contents(co);
+    }
+    std::cout << "libxml++: " << saxsummary << std::endl;
+    std::cout << "libxml++: " << saxtime / iterations * 1000 << "ms per file" << std::endl;
+    if (pulltime > 0) {
+        std::cout << "Speedup: " << saxtime / pulltime << "x" << std::endl;
+    }
+
+    if (pullsummary == saxsummary && pullcontents == saxcontents) {
+        runtest.pass("OsmChangeFile::readPull(same as libxml++)");
+    } else {
+        runtest.fail("OsmChangeFile::readPull(same as libxml++)");
+        // Show the first object that differs
+        std::istringstream pull(pullcontents);
+        std::istringstream sax(saxcontents);
+        std::string pullline;
+        std::string saxline;
+        while (std::getline(pull, pullline) && std::getline(sax, saxline)) {
+            if (pullline != saxline) {
+                std::cout << "Pull parser: " << pullline << std::endl;
+                std::cout << "libxml++: " << saxline << std::endl;
+                break;
+            }
+        }
+    }
+#endif
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,142 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "replicator/pipeline.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace pipeline;
+
+TestState runtest;
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("pipeline-test.log");
+    dbglogfile.setVerbosity(3);
+
+    // Once closed, the items left are still popped
+    BoundedQueue<int> queue("test", 2);
+    int item = 0;
+    if (queue.push(1) && queue.push(2) && queue.depth() == 2 && queue.maxDepth() == 2 &&
+        queue.tryPop(item) && item == 1) {
+        queue.close();
+        if (!queue.push(3) && queue.pop(item) && item == 2 && !queue.pop(item) && !queue.tryPop(item)) {
+            runtest.pass("BoundedQueue::close()");
+        } else {
+            runtest.fail("BoundedQueue::close()");
+        }
+    } else {
+        runtest.fail("BoundedQueue::push()");
+    }
+
+    // A full queue holds up the producer until there is room
+    BoundedQueue<int> full("full", 1);
+    full.push(1);
+    std::atomic<bool> pushed{false};
+    std::thread producer([&] {
+        full.push(2);
+        pushed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bool waited = !pushed;
+    full.pop(item);
+    producer.join();
+    if (waited && pushed && full.depth() == 1 && full.maxDepth() == 1) {
+        runtest.pass("BoundedQueue::push(full)");
+    } else {
+        runtest.fail("BoundedQueue::push(full)");
+    }
+
+    // Every item goes through the stage, and the output is closed once
+    // all the workers are done
+    BoundedQueue<int> input("input", 4);
+    BoundedQueue<int> output("output", 4);
+    std::vector<std::thread> threads;
+    startStage<int>(threads, 3, input, output, [](int &value) { value *= 2; });
+    std::thread feed([&] {
+        for (int i = 1; i <= 100; i++) {
+            input.push(i);
+        }
+        input.close();
+    });
+    long sum = 0;
+    int count = 0;
+    while (output.pop(item)) {
+        sum += item;
+        count++;
+    }
+    feed.join();
+    for (auto it = std::begin(threads); it != std::end(threads); ++it) {
+        it->join();
+    }
+    if (count == 100 && sum == 10100) {
+        runtest.pass("startStage()");
+    } else {
+        runtest.fail("startStage()");
+    }
+
+    // The producer can't get more than the window ahead of the commit
+    Window window;
+    long size = 2;
+    auto limit = [&] { return size; };
+    if (window.issue(limit) == 0 && window.issue(limit) == 1 && window.inflight() == 2) {
+        runtest.pass("Window::issue()");
+    } else {
+        runtest.fail("Window::issue()");
+    }
+    std::atomic<long> issued{-2};
+    std::thread ahead([&] { issued = window.issue(limit); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    waited = issued == -2;
+    window.commit(1);
+    ahead.join();
+    if (waited && issued == 2 && window.inflight() == 2) {
+        runtest.pass("Window::issue(full)");
+    } else {
+        runtest.fail("Window::issue(full)");
+    }
+
+    // Closing it stops a producer that is waiting
+    size = 1;
+    std::thread stopped([&] { issued = window.issue(limit); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    window.close();
+    stopped.join();
+    if (issued == -1 && window.issue(limit) == -1) {
+        runtest.pass("Window::close()");
+    } else {
+        runtest.fail("Window::close()");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
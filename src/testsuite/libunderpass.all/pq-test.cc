@@ -18,10 +18,13 @@
 //
 
 #include "data/pq.hh"
+#include "data/pqpool.hh"
 #include "utils/log.hh"
 #include <dejagnu.h>
+#include <future>
 #include <iostream>
 #include <string>
+#include <vector>
 
 TestState runtest;
 
@@ -102,6 +105,57 @@ main(int argc, char *argv[])
         runtest.fail("PQ::parseURL(user:pass@remote)");
         return 1;
     }
+
+    // Parameters are bound as text, and an empty value is a NULL
+    pq::Statement statement("test");
+    statement.bind(42L).bind("O'Mapper").bind(std::optional<std::string>());
+    statement.bind(std::vector<long>{1, 2, 3}).bind(std::vector<std::string>{"a \"b\"", "c\\d"});
+    if (statement.params.size() == 5 && statement.params[0] == "42" && statement.params[1] == "O'Mapper" &&
+        !statement.params[2] && statement.params[3] == "{1,2,3}" &&
+        statement.params[4] == "{\"a \\\"b\\\"\",\"c\\\\d\"}") {
+        runtest.pass("Statement::bind()");
+    } else {
+        runtest.fail("Statement::bind()");
+        return 1;
+    }
+    if (pq::Statement("empty").bind(std::vector<long>()).params[0] == "{}") {
+        runtest.pass("Statement::bind(empty array)");
+    } else {
+        runtest.fail("Statement::bind(empty array)");
+        return 1;
+    }
+
+    // A pool of connections, when there is a test database
+    const std::string dbconn{getenv("UNDERPASS_TEST_DB_CONN")
+                                 ? getenv("UNDERPASS_TEST_DB_CONN")
+                                 : "user=underpass_test host=localhost password=underpass_test"};
+    pq::PqPool pool;
+    if (!pool.connect(dbconn + " dbname=template1", 4)) {
+        return 0;
+    }
+    {
+        auto first = pool.acquire();
+        auto second = pool.acquire();
+        if (first && second && first.get() != second.get()) {
+            runtest.pass("PqPool::acquire()");
+        } else {
+            runtest.fail("PqPool::acquire()");
+        }
+    }
+    std::vector<std::future<bool>> results;
+    for (int i = 0; i < 16; i++) {
+        results.push_back(pool.submit(std::vector<std::string>{"SELECT 1", "SELECT " + std::to_string(i)}));
+    }
+    bool ok = true;
+    for (auto it = std::begin(results); it != std::end(results); ++it) {
+        ok = it->get() && ok;
+    }
+    if (ok && !pool.submit(std::vector<std::string>{"SELECT 1", "SELECT FROM nowhere"}).get()) {
+        runtest.pass("PqPool::submit()");
+    } else {
+        runtest.fail("PqPool::submit()");
+    }
+    pool.dump();
 }
 
 // local Variables:
@@ -0,0 +1,327 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <cassert>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "raw/queryraw.hh"
+#include "raw/rawcopy.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace queryraw;
+
+TestState runtest;
+
+/// Clear the test DB and create the schema
+bool
+init_test_case(const std::string &dbconn)
+{
+    std::string source_tree_root = getenv("UNDERPASS_SOURCE_TREE_ROOT")
+                                       ? getenv("UNDERPASS_SOURCE_TREE_ROOT")
+                                       : "../";
+    const std::string test_db_name{"underpass_test"};
+    try {
+        {
+            pqxx::connection conn{dbconn + " dbname=template1"};
+            pqxx::nontransaction worker{conn};
+            worker.exec0("DROP DATABASE IF EXISTS " + test_db_name);
+            worker.exec0("CREATE DATABASE " + test_db_name);
+            worker.commit();
+        }
+        pqxx::connection conn{dbconn + " dbname=" + test_db_name};
+        pqxx::nontransaction worker{conn};
+        worker.exec0("CREATE EXTENSION postgis");
+        worker.exec0("CREATE EXTENSION hstore");
+        std::ifstream schema_definition(source_tree_root + "setup/db/underpass.sql");
+        std::string sql((std::istreambuf_iterator<char>(schema_definition)),
+                        std::istreambuf_iterator<char>());
+        assert(!sql.empty());
+        worker.exec0(sql);
+    } catch (std::exception &e) {
+        std::cout << "ERROR: can't create the test DB: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/// A change file worth of nodes, and closed ways made from them
+void
+makeObjects(std::vector<osmobjects::OsmNode> &nodes, std::vector<osmobjects::OsmWay> &ways, int count, int version)
+{
+    nodes.clear();
+    ways.clear();
+    for (int i = 1; i <= count; i++) {
+        osmobjects::OsmNode node;
+        node.id = i;
+        node.version = version;
+        node.changeset = 1000 + version;
+        node.uid = 1;
+        node.user = "O'Mapper";
+        node.action = osmobjects::modify;
+        node.setPoint(4.6 + i * 1e-5, 21.7 + i * 1e-5);
+        node.addTag("name", "Node " + std::to_string(i));
+        nodes.push_back(node);
+    }
+    for (int i = 1; i + 3 <= count; i += 4) {
+        osmobjects::OsmWay way;
+        way.id = i;
+        way.version = version;
+        way.changeset = 1000 + version;
+        way.uid = 1;
+        way.user = "O'Mapper";
+        way.action = osmobjects::modify;
+        way.addTag("building", "yes");
+        for (int j = 0; j < 4; j++) {
+            way.addRef(i + j);
+            boost::geometry::append(way.polygon, nodes[i + j - 1].point);
+        }
+        way.addRef(i);
+        boost::geometry::append(way.polygon, nodes[i - 1].point);
+        ways.push_back(way);
+    }
+}
+
+long
+count(std::shared_ptr<Pq> &db, const std::string &sql)
+{
+    auto result = db->query(sql);
+    if (result.size() == 0) {
+        return -1;
+    }
+    return result[0][0].as<long>();
+}
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("rawcopy-test.log");
+    dbglogfile.setVerbosity(3);
+
+    if (RawCopy::ewkb(point_t(1, 2)) == "0101000020E6100000000000000000F03F0000000000000040") {
+        runtest.pass("RawCopy::ewkb(point)");
+    } else {
+        runtest.fail("RawCopy::ewkb(point)");
+    }
+    linestring_t line;
+    boost::geometry::read_wkt("LINESTRING(0 0,1 1)", line);
+    if (RawCopy::ewkb(line) == "0102000020E61000000200000000000000000000000000000000000000000000000000F03F000000000000F03F") {
+        runtest.pass("RawCopy::ewkb(linestring)");
+    } else {
+        runtest.fail("RawCopy::ewkb(linestring)");
+    }
+
+    osmobjects::TagList tags;
+    tags.set("name", "\"Quoted\"\n");
+    tags.set("building", "yes");
+    if (RawCopy::json(tags).value_or("") == "{\"building\":\"yes\",\"name\":\"\\\"Quoted\\\"\\n\"}" &&
+        !RawCopy::json(osmobjects::TagList())) {
+        runtest.pass("RawCopy::json(tags)");
+    } else {
+        runtest.fail("RawCopy::json(tags)");
+    }
+
+    // Only the latest version of an object is kept in a batch
+    RawBatch batch;
+    osmobjects::OsmNode node;
+    node.id = 1;
+    node.version = 2;
+    node.action = osmobjects::modify;
+    batch.add(node);
+    node.version = 1;
+    batch.add(node);
+    node.version = 3;
+    node.action = osmobjects::remove;
+    batch.add(node);
+    if (batch.size() == 1 && batch.nodes.size() == 2 &&
+        batch.nodes[0].op == RawRow::skip && batch.nodes[1].op == RawRow::remove) {
+        runtest.pass("RawBatch::add() keeps the latest version");
+    } else {
+        runtest.fail("RawBatch::add() keeps the latest version");
+    }
+
+    // The rows of a later file replace the ones for the same objects
+    RawBatch later;
+    node.id = 2;
+    node.version = 1;
+    node.action = osmobjects::create;
+    later.add(node);
+    node.id = 1;
+    node.version = 4;
+    node.action = osmobjects::modify;
+    later.add(node);
+    batch.add(std::move(later));
+    if (batch.size() == 2 && later.empty() && batch.nodes.back().osm_id == 1 && batch.nodes.back().version == 4) {
+        runtest.pass("RawBatch::add(later)");
+    } else {
+        runtest.fail("RawBatch::add(later)");
+    }
+
+    const std::string dbconn{getenv("UNDERPASS_TEST_DB_CONN")
+                                 ? getenv("UNDERPASS_TEST_DB_CONN")
+                                 : "user=underpass_test host=localhost password=underpass_test"};
+    if (!init_test_case(dbconn)) {
+        return 0;
+    }
+    auto db = std::make_shared<Pq>();
+    if (!db->connect(dbconn + " dbname=underpass_test")) {
+        std::cout << "ERROR: can't connect to the test DB (" << dbconn << " dbname=underpass_test" << ")" << std::endl;
+        return 0;
+    }
+
+    const int objects = 20000;
+    std::vector<osmobjects::OsmNode> nodes;
+    std::vector<osmobjects::OsmWay> ways;
+
+    // The SQL queries, joined like allTasksQueries() does
+    makeObjects(nodes, ways, objects, 1);
+    auto queryraw = std::make_shared<QueryRaw>(db);
+    auto start = std::chrono::steady_clock::now();
+    std::string sql;
+    for (auto it = std::begin(nodes); it != std::end(nodes); ++it) {
+        auto queries = queryraw->applyChange(*it);
+        for (auto qit = std::begin(*queries); qit != std::end(*queries); ++qit) {
+            sql += *qit;
+        }
+    }
+    for (auto it = std::begin(ways); it != std::end(ways); ++it) {
+        auto queries = queryraw->applyChange(*it);
+        for (auto qit = std::begin(*queries); qit != std::end(*queries); ++qit) {
+            sql += *qit;
+        }
+    }
+    db->query(sql);
+    double insert = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long rows = nodes.size() + ways.size();
+    std::cout << "INSERT: " << rows / insert << " rows/s" << std::endl;
+
+    // The same objects, one version later, with COPY
+    makeObjects(nodes, ways, objects, 2);
+    RawCopy rawcopy(db);
+    start = std::chrono::steady_clock::now();
+    RawBatch copybatch;
+    for (auto it = std::begin(nodes); it != std::end(nodes); ++it) {
+        copybatch.add(*it);
+    }
+    for (auto it = std::begin(ways); it != std::end(ways); ++it) {
+        copybatch.add(*it);
+    }
+    bool written = rawcopy.write(copybatch);
+    double copy = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "COPY: " << rows / copy << " rows/s" << std::endl;
+    rawcopy.dump();
+
+    if (written && count(db, "SELECT count(*) FROM nodes WHERE version = 2") == static_cast<long>(nodes.size()) &&
+        count(db, "SELECT count(*) FROM ways_poly WHERE version = 2") == static_cast<long>(ways.size())) {
+        runtest.pass("RawCopy::write() updates the objects");
+    } else {
+        runtest.fail("RawCopy::write() updates the objects");
+    }
+    // Each way uses 4 nodes, and is in the reverse index once
+    auto used = queryraw->getWaysByNodesRefs({1, 6});
+    if (count(db, "SELECT count(*) FROM way_refs") == static_cast<long>(ways.size() * 4) &&
+        used.size() == 2 && used.front()->id + used.back()->id == 6) {
+        runtest.pass("RawCopy::write() way_refs");
+    } else {
+        runtest.fail("RawCopy::write() way_refs");
+    }
+    std::stringstream wkt;
+    wkt << std::setprecision(12) << boost::geometry::wkt(nodes[0].point);
+    if (count(db, "SELECT count(*) FROM nodes WHERE ST_Equals(geom, ST_GeomFromText('" +
+                  wkt.str() + "', 4326)) AND tags->>'name' = 'Node 1'") == 1) {
+        runtest.pass("RawCopy::write() geometry and tags");
+    } else {
+        runtest.fail("RawCopy::write() geometry and tags");
+    }
+
+    // An older version doesn't replace a newer one, and a delete removes it
+    RawBatch older;
+    makeObjects(nodes, ways, 8, 1);
+    older.add(nodes[0]);
+    nodes[1].version = 3;
+    nodes[1].action = osmobjects::remove;
+    older.add(nodes[1]);
+    // Nor do it's refs
+    ways[0].refs[3] = 8;
+    older.add(ways[0]);
+    rawcopy.write(older);
+    if (count(db, "SELECT version FROM nodes WHERE osm_id = 1") == 2 &&
+        count(db, "SELECT count(*) FROM nodes WHERE osm_id = 2") == 0) {
+        runtest.pass("RawCopy::write() version check and delete");
+    } else {
+        runtest.fail("RawCopy::write() version check and delete");
+    }
+    if (count(db, "SELECT count(*) FROM way_refs WHERE way_id = 1 AND node_id = 4") == 1 &&
+        count(db, "SELECT count(*) FROM way_refs WHERE way_id = 1 AND node_id = 8") == 0) {
+        runtest.pass("RawCopy::write() way_refs version check");
+    } else {
+        runtest.fail("RawCopy::write() way_refs version check");
+    }
+
+    // The way members of relations, like bootstrap writes them
+    rawcopy.write(std::vector<std::pair<long, long>>{{10, 1}, {10, 5}, {11, 5}});
+    bool copied = count(db, "SELECT count(*) FROM rel_refs") == 3;
+    rawcopy.write(std::vector<std::pair<long, long>>{{10, 1}});
+    if (copied && count(db, "SELECT count(*) FROM rel_refs WHERE rel_id = 10") == 1 &&
+        count(db, "SELECT count(*) FROM rel_refs WHERE way_id = 5") == 1) {
+        runtest.pass("RawCopy::write(rel_refs)");
+    } else {
+        runtest.fail("RawCopy::write(rel_refs)");
+    }
+
+    // An older version of a relation doesn't replace the members of a
+    // newer one
+    osmobjects::OsmRelation relation;
+    relation.id = 20;
+    relation.version = 2;
+    relation.action = osmobjects::modify;
+    relation.addTag("type", "route");
+    relation.addMember(1, osmobjects::way, "");
+    relation.multilinestring.resize(1);
+    boost::geometry::append(relation.multilinestring[0], nodes[0].point);
+    boost::geometry::append(relation.multilinestring[0], nodes[1].point);
+    RawBatch newer;
+    newer.add(relation);
+    rawcopy.write(newer);
+    relation.version = 1;
+    relation.members.front().ref = 5;
+    RawBatch stale;
+    stale.add(relation);
+    rawcopy.write(stale);
+    if (count(db, "SELECT count(*) FROM rel_refs WHERE rel_id = 20 AND way_id = 1") == 1 &&
+        count(db, "SELECT count(*) FROM rel_refs WHERE rel_id = 20 AND way_id = 5") == 0) {
+        runtest.pass("RawCopy::write() rel_refs version check");
+    } else {
+        runtest.fail("RawCopy::write() rel_refs version check");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,100 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <iostream>
+#include <string>
+
+#include "replicator/schedule.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace replication;
+
+TestState runtest;
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("schedule-test.log");
+    dbglogfile.setVerbosity(3);
+
+    Schedule schedule(minutely);
+    ptime start = time_from_string("2024-01-02 03:04:00");
+    if (schedule.predict() == not_a_date_time && schedule.wait(start) == schedule.poll) {
+        runtest.pass("Schedule::wait(no state)");
+    } else {
+        runtest.fail("Schedule::wait(no state)");
+    }
+
+    // The first state was published a while ago, so it doesn't tell the delay
+    schedule.update(StateFile("", 5912000, start, minutely), start + seconds(40));
+    if (schedule.getDelay() == 0 && schedule.predict() == start + seconds(60) &&
+        schedule.wait(start + seconds(40)).count() == 15000 && schedule.behind(5912000) == 0) {
+        runtest.pass("Schedule::update(first)");
+    } else {
+        runtest.fail("Schedule::update(first)");
+    }
+
+    // Each file is seen 8 seconds after it's timestamp
+    for (int i = 1; i <= 5; i++) {
+        schedule.update(StateFile("", 5912000 + i, start + minutes(i), minutely), start + minutes(i) + seconds(8));
+    }
+    ptime last = start + minutes(5);
+    if (schedule.getDelay() == 8 && schedule.getInterval() == 60 &&
+        schedule.predict() == last + seconds(68) && schedule.behind(5912003) == 2) {
+        runtest.pass("Schedule::update(next)");
+    } else {
+        runtest.fail("Schedule::update(next)");
+    }
+
+    // An older state doesn't change it
+    schedule.update(StateFile("", 5912001, start + minutes(1), minutely), last);
+    if (schedule.getLatest().sequence == 5912005) {
+        runtest.pass("Schedule::update(older)");
+    } else {
+        runtest.fail("Schedule::update(older)");
+    }
+
+    // Wait until just before the next file, poll often, then back off
+    if (schedule.wait(last + seconds(8)).count() == 55000 &&
+        schedule.wait(last + seconds(64)) == schedule.poll &&
+        schedule.wait(last + seconds(130)) == schedule.late) {
+        runtest.pass("Schedule::wait()");
+    } else {
+        runtest.fail("Schedule::wait()");
+    }
+
+    // Only the files up to the latest state.txt are issued, the ones
+    // after it would be missing
+    Schedule empty(minutely);
+    if (schedule.published(5912000) && schedule.published(5912005) && !schedule.published(5912006) &&
+        !empty.published(0)) {
+        runtest.pass("Schedule::published()");
+    } else {
+        runtest.fail("Schedule::published()");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -18,6 +18,9 @@
 //
 
 #include <dejagnu.h>
+#include <chrono>
+#include <iostream>
+#include <random>
 #include "utils/log.hh"
 
 #include "stats/statsconfig.hh"
@@ -83,6 +86,87 @@ main(int argc, char *argv[])
         return 1;
     }
 
+    // The compiled classifier finds the same categories as search()
+    auto classifier = statsconfig::StatsConfig::getClassifier();
+    if (classifier == statsconfig::StatsConfig::getClassifier()) {
+        runtest.pass("StatsConfig::getClassifier() - compiled once");
+    } else {
+        runtest.fail("StatsConfig::getClassifier() - compiled once");
+    }
+    std::vector<std::string> keys = {"building", "amenity", "highway", "underpass_tag", "underpass_tag2", "name", "source"};
+    std::vector<std::string> values = {"yes", "school", "hospital", "emergency", "underpass_test", "residential", "Main St"};
+    osmchange::osmtype_t types[] = {osmchange::node, osmchange::way, osmchange::relation};
+    bool same = true;
+    for (auto kit = std::begin(keys); kit != std::end(keys); ++kit) {
+        for (auto vit = std::begin(values); vit != std::end(values); ++vit) {
+            for (int i = 0; i < 3; i++) {
+                int category = classifier->classify(types[i], *kit, *vit);
+                if (classifier->name(category, *kit, *vit) != statsconfig.search(*kit, *vit, types[i])) {
+                    std::cout << "Different: " << *kit << "=" << *vit << std::endl;
+                    same = false;
+                }
+            }
+        }
+    }
+    if (same) {
+        runtest.pass("StatsClassifier::classify() - same as search()");
+    } else {
+        runtest.fail("StatsClassifier::classify() - same as search()");
+    }
+
+    // The first category wins, and the names can come from the tag
+    std::vector<statsconfig::StatsConfigCategory> categories;
+    categories.push_back(statsconfig::StatsConfigCategory("roads", {{"highway", {"primary"}}}, {}, {}));
+    categories.push_back(statsconfig::StatsConfigCategory("\"[key:value]\"", {{"highway", {"*"}}}, {}, {}));
+    categories.push_back(statsconfig::StatsConfigCategory("\"[key]\"", {{"*", {"*"}}}, {}, {}));
+    statsconfig::StatsClassifier dynamic(categories);
+    if (dynamic.name(dynamic.classify(osmchange::way, "highway", "primary"), "highway", "primary") == "roads" &&
+        dynamic.name(dynamic.classify(osmchange::way, "highway", "track"), "highway", "track") == "highway:track" &&
+        dynamic.name(dynamic.classify(osmchange::way, "building", "yes"), "building", "yes") == "building" &&
+        dynamic.classify(osmchange::node, "highway", "primary") < 0) {
+        runtest.pass("StatsClassifier::classify() - order and names");
+    } else {
+        runtest.fail("StatsClassifier::classify() - order and names");
+    }
+
+    // The tags of a large change file, scanned the old way with a
+    // StatsConfig for each object, and with the classifier
+    std::mt19937 random(1);
+    std::vector<osmobjects::TagList> objects(100000);
+    for (auto it = std::begin(objects); it != std::end(objects); ++it) {
+        for (int i = random() % 5; i >= 0; i--) {
+            it->set(keys[random() % keys.size()], values[random() % values.size()]);
+        }
+    }
+    auto start = std::chrono::steady_clock::now();
+    long found = 0;
+    for (auto it = std::begin(objects); it != std::end(objects); ++it) {
+        auto config = statsconfig::StatsConfig();
+        for (auto tit = std::begin(*it); tit != std::end(*it); ++tit) {
+            if (!config.search(tit->first, tit->second, osmchange::way).empty()) {
+                found++;
+            }
+        }
+    }
+    double searchtime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    long scanned = 0;
+    std::vector<std::string> hits;
+    for (auto it = std::begin(objects); it != std::end(objects); ++it) {
+        hits.clear();
+        classifier->scan(*it, osmchange::way, hits);
+        scanned += hits.size();
+    }
+    double scantime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "StatsConfig::search(): " << objects.size() / searchtime << " objects/s" << std::endl;
+    std::cout << "StatsClassifier::scan(): " << objects.size() / scantime << " objects/s" << std::endl;
+    if (found == scanned) {
+        runtest.pass("StatsClassifier::scan() matches StatsConfig::search()");
+    } else {
+        runtest.fail("StatsClassifier::scan() matches StatsConfig::search()");
+    }
 }
 
 // local Variables:
@@ -0,0 +1,213 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "osm/osmobjects.hh"
+#include "osm/osmtags.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+using namespace osmobjects;
+
+TestState runtest;
+
+// The memory used by a std::map of tags, which is a node for each tag,
+// plus the heap for strings too long for the small string buffer.
+std::size_t
+mapBytes(const std::map<std::string, std::string> &tags)
+{
+    std::size_t total = sizeof(tags);
+    for (auto it = std::begin(tags); it != std::end(tags); ++it) {
+        total += 32 + sizeof(std::string) * 2;
+        if (it->first.capacity() > 15) {
+            total += it->first.capacity() + 1;
+        }
+        if (it->second.capacity() > 15) {
+            total += it->second.capacity() + 1;
+        }
+    }
+    return total;
+}
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("tags-test.log");
+    dbglogfile.setVerbosity(3);
+
+    // The API used on OsmObject
+    OsmWay way;
+    way.addTag("highway", "residential");
+    way.addTag("building", "yes");
+    way.addTag("name", "A street with a name too long to be interned by the table");
+    way.addTag("building", "house");
+    if (way.tags.size() == 3 && way.getTagValue("building") == "house" &&
+        way.containsKey("highway") && !way.containsKey("amenity")) {
+        runtest.pass("TagList::set()");
+    } else {
+        runtest.fail("TagList::set()");
+    }
+    if (way.getTagValue("amenity").empty() && way.tags.size() == 3) {
+        runtest.pass("TagList::get(missing key isn't added)");
+    } else {
+        runtest.fail("TagList::get(missing key isn't added)");
+    }
+    std::string order;
+    for (auto const &[key, val] : way.tags) {
+        order += key + "=" + val + ";";
+    }
+    if (order == "building=house;highway=residential;name=A street with a name too long to be interned by the table;") {
+        runtest.pass("TagList::begin(sorted by key)");
+    } else {
+        runtest.fail("TagList::begin(sorted by key)");
+    }
+
+    // Interned strings are shared, so the pointers can be compared
+    auto &table = StringTable::instance();
+    const std::string *highway = table.intern("highway");
+    OsmNode node;
+    node.addTag("highway", "residential");
+    if (node.tags.count(highway) && way.tags.find(highway)->second == "residential" &&
+        &node.tags.find(highway)->second == &way.tags.find(highway)->second) {
+        runtest.pass("StringTable::intern()");
+    } else {
+        runtest.fail("StringTable::intern()");
+    }
+
+    // Copies don't share the strings owned by the list
+    OsmWay copy = way;
+    way.tags.clear();
+    if (copy.tags.size() == 3 && copy.getTagValue("name").size() > TagList::max_value) {
+        runtest.pass("TagList::TagList(copy)");
+    } else {
+        runtest.fail("TagList::TagList(copy)");
+    }
+
+    // Replacing or erasing a long value frees it, so the list doesn't
+    // grow when a tag is set over and over
+    std::string note(100, 'x');
+    OsmNode edited;
+    edited.addTag("note", note);
+    std::size_t bytes = edited.tags.getBytes();
+    for (int i = 0; i < 10; i++) {
+        edited.addTag("note", note + std::to_string(i));
+    }
+    if (edited.tags.getBytes() <= bytes + 1 && edited.getTagValue("note") == note + "9") {
+        runtest.pass("TagList::set(old value freed)");
+    } else {
+        runtest.fail("TagList::set(old value freed)");
+    }
+    edited.addTag("building", "yes");
+    std::size_t kept = edited.tags.getBytes();
+    edited.tags.erase("note");
+    if (edited.tags.getBytes() < kept && edited.tags.size() == 1) {
+        runtest.pass("TagList::erase(old value freed)");
+    } else {
+        runtest.fail("TagList::erase(old value freed)");
+    }
+
+    // The hot keys are interned once and looked up by pointer
+    if (edited.containsKey(keys::building) && edited.getTagValue(keys::building) == "yes" &&
+        !edited.containsKey(keys::highway) && edited.getTagValue(keys::highway).empty() &&
+        keys::building.interned == table.intern("building")) {
+        runtest.pass("TagList::find(TagKey)");
+    } else {
+        runtest.fail("TagList::find(TagKey)");
+    }
+
+    // Compare with the std::map that used to be used, with a typical
+    // mix of tags on a building and a road.
+    std::vector<std::vector<std::pair<std::string, std::string>>> samples = {
+        {{"building", "yes"}, {"source", "Bing"}},
+        {{"building", "house"}, {"addr:street", "Main Street"}, {"addr:housenumber", "12"}},
+        {{"highway", "residential"}, {"name", "Rue de la Republique"}, {"surface", "asphalt"}, {"oneway", "yes"}},
+        {{"natural", "water"}, {"water", "pond"}, {"source", "survey"}, {"note", "Traced from the imagery with the outline checked on the ground last summer"}},
+    };
+    const int objects = 100000;
+    std::vector<std::map<std::string, std::string>> maps(objects);
+    std::vector<TagList> lists(objects);
+    std::size_t mapbytes = 0;
+    std::size_t listbytes = 0;
+    for (int i = 0; i < objects; i++) {
+        auto &sample = samples[i % samples.size()];
+        for (auto it = std::begin(sample); it != std::end(sample); ++it) {
+            maps[i][it->first] = it->second;
+            lists[i].set(it->first, it->second);
+        }
+        mapbytes += mapBytes(maps[i]);
+        listbytes += lists[i].getBytes();
+    }
+    std::cout << "std::map: " << mapbytes / objects << " bytes per object" << std::endl;
+    std::cout << "TagList: " << listbytes / objects << " bytes per object, plus "
+              << table.getBytes() << " bytes for " << table.size()
+              << " interned strings" << std::endl;
+
+    const std::vector<std::string> keys = {"building", "highway", "amenity", "source"};
+    long found = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < objects; i++) {
+        for (auto it = std::begin(keys); it != std::end(keys); ++it) {
+            found += maps[i].count(*it);
+        }
+    }
+    double maptime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    long listfound = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < objects; i++) {
+        for (auto it = std::begin(keys); it != std::end(keys); ++it) {
+            listfound += lists[i].count(*it);
+        }
+    }
+    double listtime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::vector<const std::string *> interned;
+    for (auto it = std::begin(keys); it != std::end(keys); ++it) {
+        interned.push_back(table.intern(*it));
+    }
+    long internfound = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < objects; i++) {
+        for (auto it = std::begin(interned); it != std::end(interned); ++it) {
+            internfound += lists[i].count(*it);
+        }
+    }
+    double interntime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    const double lookups = objects * keys.size();
+    std::cout << "std::map: " << maptime / lookups * 1e9 << "ns per lookup" << std::endl;
+    std::cout << "TagList: " << listtime / lookups * 1e9 << "ns per lookup by string" << std::endl;
+    std::cout << "TagList: " << interntime / lookups * 1e9 << "ns per lookup by interned key" << std::endl;
+
+    if (found == listfound && found == internfound) {
+        runtest.pass("TagList::count(same as std::map)");
+    } else {
+        runtest.fail("TagList::count(same as std::map)");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -50,6 +50,7 @@ typedef std::shared_ptr<Validate>(plugin_t)();
 
 int test_semantic(std::shared_ptr<Validate> &plugin);
 int test_geospatial(std::shared_ptr<Validate> &plugin);
+int test_cache(std::shared_ptr<Validate> &plugin);
 
 int
 main(int argc, char *argv[])
@@ -77,8 +78,47 @@ main(int argc, char *argv[])
     auto plugin = creator();
     plugin->loadConfig(testValidationConfig);
 
+    // The configuration files are compiled when they are loaded
+    const ValidationRules &building = plugin->getRules("building");
+    const ValidationRules &place = plugin->getRules("place");
+    if (building.badgeom && building.badvalue && !building.incomplete && building.badgeom_maxangle == 91 &&
+        building.isValidTag("building", "house") && building.isValidTag("height", "12") &&
+        !building.isValidTag("building", "sponge") && place.isRequiredTag("name") && place.getRequiredCount() == 1 &&
+        !plugin->getRules("nothing").badvalue) {
+        runtest.pass("Validate::getRules()");
+    } else {
+        runtest.fail("Validate::getRules()");
+    }
+
+    // The batches on a thread pool have the same results as checking
+    // each node, in the same order
+    std::vector<osmobjects::OsmNode> places(500);
+    std::vector<const osmobjects::OsmNode *> batch;
+    for (std::size_t i = 0; i < places.size(); i++) {
+        places[i].id = i;
+        places[i].addTag("place", i % 3 ? "city" : "nowhere");
+        if (i % 2) {
+            places[i].addTag("name", "Electric City");
+        }
+        batch.push_back(&places[i]);
+    }
+    boost::asio::thread_pool pool(4);
+    std::vector<std::shared_ptr<ValidateStatus>> results;
+    plugin->checkNodes(batch, "place", results, &pool);
+    bool same = results.size() == places.size();
+    for (std::size_t i = 0; same && i < places.size(); i++) {
+        auto status = plugin->checkNode(places[i], "place");
+        same = results[i]->osm_id == places[i].id && results[i]->status == status->status;
+    }
+    if (same) {
+        runtest.pass("Validate::checkNodes(thread pool)");
+    } else {
+        runtest.fail("Validate::checkNodes(thread pool)");
+    }
+
     test_semantic(plugin);
     test_geospatial(plugin);
+    test_cache(plugin);
 }
 
 osmobjects::OsmWay readOsmWayFromFile(std::string filename) {
@@ -505,6 +545,97 @@ test_geospatial(std::shared_ptr<Validate> &plugin)
     }
 }
 
+int
+test_cache(std::shared_ptr<Validate> &plugin)
+{
+    // A building with a bad value that isn't square
+    osmobjects::OsmWay way;
+    way.id = 42;
+    way.version = 3;
+    way.addTag("building", "sponge");
+    for (auto point : {point_t(0, 0), point_t(0, 1), point_t(2, 1.5), point_t(1, 0), point_t(0, 0)}) {
+        way.linestring.push_back(point);
+    }
+    auto plain = plugin->checkWay(way, "building");
+
+    plugin->cache = std::make_shared<ValidationCache>(1024 * 1024);
+    auto cache = plugin->cache;
+    auto first = plugin->checkWay(way, "building");
+    auto again = plugin->checkWay(way, "building");
+    if (!first->unchanged && !again->unchanged && first->status == plain->status &&
+        first->hasStatus(badvalue) && first->hasStatus(badgeom) && cache->getSemanticSkipped() == 0) {
+        runtest.pass("ValidationCache::find(not committed)");
+    } else {
+        runtest.fail("ValidationCache::find(not committed)");
+    }
+
+    // Once committed, the same way has the same results without the
+    // checks, and isn't written again
+    cache->commit({first, again}, true);
+    auto third = plugin->checkWay(way, "building");
+    if (third->unchanged && third->status == plain->status && third->values.size() == 1 &&
+        third->values[0] == "building=sponge" && cache->getSemanticSkipped() == 1 &&
+        cache->getGeometrySkipped() == 1 && cache->getWritesSkipped() == 1) {
+        runtest.pass("ValidationCache::commit(unchanged way)");
+    } else {
+        runtest.fail("ValidationCache::commit(unchanged way)");
+    }
+
+    // A node of the way moved, so the tags aren't checked again but the
+    // geometry is, and it's written
+    osmobjects::OsmWay moved = way;
+    moved.linestring[2] = point_t(1, 1);
+    auto square = plugin->checkWay(moved, "building");
+    if (!square->unchanged && square->hasStatus(badvalue) && !square->hasStatus(badgeom) &&
+        cache->getSemanticSkipped() == 2 && cache->getGeometrySkipped() == 1) {
+        runtest.pass("ValidationCache::find(moved way)");
+    } else {
+        runtest.fail("ValidationCache::find(moved way)");
+    }
+
+    // A result that wasn't written isn't stored, and isn't pending
+    cache->commit({square}, false);
+    if (plugin->checkWay(way, "building")->unchanged && !plugin->checkWay(moved, "building")->unchanged) {
+        runtest.pass("ValidationCache::commit(not written)");
+    } else {
+        runtest.fail("ValidationCache::commit(not written)");
+    }
+
+    // A node with the same version that moved has the same results, but
+    // a new location to write
+    osmobjects::OsmNode node;
+    node.id = 7;
+    node.version = 2;
+    node.point = point_t(1, 2);
+    node.addTag("place", "city");
+    cache->commit({plugin->checkNode(node, "place")}, true);
+    node.point = point_t(1, 3);
+    auto city = plugin->checkNode(node, "place");
+    if (!city->unchanged && city->center.y() == 3 && cache->getSemanticSkipped() == 5) {
+        runtest.pass("ValidationCache::find(moved node)");
+    } else {
+        runtest.fail("ValidationCache::find(moved node)");
+    }
+
+    // The results saved to a file are used by the next run
+    std::string file = "validationcache.bin";
+    std::remove(file.c_str());
+    cache->open(file);
+    cache->save();
+    plugin->cache = std::make_shared<ValidationCache>(1024 * 1024);
+    plugin->cache->open(file);
+    auto loaded = plugin->checkWay(way, "building");
+    if (plugin->cache->size() == 2 && loaded->unchanged && loaded->status == plain->status &&
+        loaded->values.size() == 1) {
+        runtest.pass("ValidationCache::open()");
+    } else {
+        runtest.fail("ValidationCache::open()");
+    }
+    std::remove(file.c_str());
+    plugin->cache.reset();
+    return 0;
+}
+
 // local Variables:
 // mode: C++
 // indent-tabs-mode: nil
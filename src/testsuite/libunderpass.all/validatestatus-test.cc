@@ -0,0 +1,156 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#include <dejagnu.h>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "validate/validate.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+
+TestState runtest;
+
+/// Count the allocations, to check the pool doesn't make any
+static std::atomic<long> allocations{0};
+
+void *
+operator new(std::size_t size)
+{
+    allocations++;
+    if (void *block = std::malloc(size ? size : 1)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void
+operator delete(void *block) noexcept
+{
+    std::free(block);
+}
+
+void
+operator delete(void *block, std::size_t) noexcept
+{
+    std::free(block);
+}
+
+int
+main(int argc, char *argv[])
+{
+    logger::LogFile &dbglogfile = logger::LogFile::getDefaultInstance();
+    dbglogfile.setWriteDisk(true);
+    dbglogfile.setLogFilename("validatestatus-test.log");
+    dbglogfile.setVerbosity(3);
+
+    ValidateStatus status;
+    status.status.insert(badvalue);
+    status.status.insert(notags);
+    status.status.insert(badvalue);
+    std::vector<valerror_t> found(status.status.begin(), status.status.end());
+    if (status.hasStatus(badvalue) && status.hasStatus(notags) && !status.hasStatus(badgeom) &&
+        status.status.size() == 2 && found.size() == 2 && found[0] == notags && found[1] == badvalue &&
+        status.status.getBits() == ((1u << notags) | (1u << badvalue))) {
+        runtest.pass("StatusSet::insert()");
+    } else {
+        runtest.fail("StatusSet::insert()");
+    }
+    status.status.erase(notags);
+    if (status.status.size() == 1 && !status.hasStatus(notags)) {
+        runtest.pass("StatusSet::erase()");
+    } else {
+        runtest.fail("StatusSet::erase()");
+    }
+
+    status.values.insert("building=sponge");
+    status.values.insert("building=sponge");
+    status.values.insert("roof:material=jelly");
+    status.values.insert("_building=yes");
+    std::vector<std::string> values(status.values.begin(), status.values.end());
+    if (status.values.size() == 3 && values.size() == 3 && values[0] == "building=sponge" &&
+        values[2] == "_building=yes") {
+        runtest.pass("ValueList::insert()");
+    } else {
+        runtest.fail("ValueList::insert()");
+    }
+    status.values.clear();
+    if (status.values.empty() && status.values.begin() == status.values.end()) {
+        runtest.pass("ValueList::clear()");
+    } else {
+        runtest.fail("ValueList::clear()");
+    }
+
+    // Once some results were released, a result without any findings
+    // doesn't allocate
+    ValidateStatusPool pool;
+    osmobjects::OsmWay way;
+    way.id = 42;
+    std::vector<std::shared_ptr<ValidateStatus>> results;
+    results.reserve(100);
+    for (int i = 0; i < 100; i++) {
+        results.push_back(pool.make(way));
+    }
+    results.clear();
+    long before = allocations;
+    for (int round = 0; round < 10; round++) {
+        for (int i = 0; i < 100; i++) {
+            results.push_back(pool.make(way));
+            results.back()->source = "building";
+        }
+        results.clear();
+    }
+    long made = allocations - before;
+    if (made == 0 && pool.getFree() == 100) {
+        runtest.pass("ValidateStatusPool::make()");
+    } else {
+        runtest.fail("ValidateStatusPool::make()");
+        std::cout << made << " allocations" << std::endl;
+    }
+    auto again = pool.make(way);
+    if (again->osm_id == 42 && again->status.empty() && again->values.empty() && pool.getFree() == 99) {
+        runtest.pass("ValidateStatusPool::make(reused)");
+    } else {
+        runtest.fail("ValidateStatusPool::make(reused)");
+    }
+
+    // A result can outlive the pool
+    std::shared_ptr<ValidateStatus> kept;
+    {
+        ValidateStatusPool other;
+        kept = other.make(way);
+    }
+    kept->status.insert(badgeom);
+    if (kept->hasStatus(badgeom)) {
+        runtest.pass("ValidateStatusPool::make(outlives pool)");
+    } else {
+        runtest.fail("ValidateStatusPool::make(outlives pool)");
+    }
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -62,6 +62,7 @@ namespace opts = boost::program_options;
 #include "osm/changeset.hh"
 #include "osm/osmchange.hh"
 #include "replicator/threads.hh"
+#include "replicator/checkpoint.hh"
 #include "bootstrap/bootstrap.hh"
 #include "underpassconfig.hh"
 
@@ -105,16 +106,24 @@ main(int argc, char *argv[])
             ("changeseturl", opts::value<std::string>(), "Starting URL path for ChangeSet (ex. 000/075/000), takes precedence over 'timestamp' option")
             ("frequency,f", opts::value<std::string>(), "Update frequency (hourly, daily), default minutely)")
             ("timestamp,t", opts::value<std::vector<std::string>>(), "Starting timestamp (can be used 2 times to set a range)")
+            ("resume", "Resume from the checkpoints in the database")
             // ("import,i", opts::value<std::string>(), "Initialize OSM database with datafile")
             ("boundary,b", opts::value<std::string>(), "Boundary polygon file name")
             ("osmnoboundary", "Disable boundary polygon for OsmChanges")
             ("oscnoboundary", "Disable boundary polygon for Changesets")
             ("datadir", opts::value<std::string>(), "Directory for remote and local cached files (with ending slash)")
             ("destdir_base", opts::value<std::string>(), "Base directory for local cached files (with ending slash)")
+            ("node-locations", opts::value<std::string>(), "File for storing node locations, instead of querying them from the database")
+            ("raw-copy", "Write raw OSM data with COPY instead of INSERT")
+            ("cache-budget", opts::value<unsigned int>(), "Mb for caching recent nodes and ways across files, default 256, 0 disables it")
+            ("validation-cache-budget", opts::value<unsigned int>(), "Mb for the last validation result of each object, default 64, 0 disables it")
+            ("validation-cache-file", opts::value<std::string>(), "File for saving the validation results, so the next run can skip the unchanged objects")
+            ("minutely-catchup", "Catch up with minutely files only, instead of daily and hourly ones")
             ("verbose,v", "Enable verbosity")
             ("logstdout,l", "Enable logging to stdout, default is log to underpass.log")
             ("changefile", opts::value<std::string>(), "Import change file")
             ("concurrency,c", opts::value<std::string>(), "Concurrency")
+            ("db-connections", opts::value<unsigned int>(), "Database connections for the workers, default is the concurrency")
             ("changesets", "Changesets only")
             ("osmchanges", "OsmChanges only")
             ("debug,d", "Enable debug messages for developers")
@@ -169,6 +178,24 @@ main(int argc, char *argv[])
     if (vm.count("destdir_base")) {
         config.destdir_base = vm["destdir_base"].as<std::string>();
     }
+    if (vm.count("node-locations")) {
+        config.node_locations = vm["node-locations"].as<std::string>();
+    }
+    if (vm.count("raw-copy")) {
+        config.raw_copy = true;
+    }
+    if (vm.count("cache-budget")) {
+        config.cache_budget = vm["cache-budget"].as<unsigned int>();
+    }
+    if (vm.count("validation-cache-budget")) {
+        config.validation_cache_budget = vm["validation-cache-budget"].as<unsigned int>();
+    }
+    if (vm.count("validation-cache-file")) {
+        config.validation_cache_file = vm["validation-cache-file"].as<std::string>();
+    }
+    if (vm.count("minutely-catchup")) {
+        config.coarse_catchup = false;
+    }
 
     // Concurrency
     if (vm.count("concurrency")) {
@@ -186,8 +213,11 @@ main(int argc, char *argv[])
     } else {
         config.concurrency = std::thread::hardware_concurrency();
     }
+    if (vm.count("db-connections")) {
+        config.db_connections = vm["db-connections"].as<unsigned int>();
+    }
 
-    if (vm.count("timestamp") || vm.count("url") ||  vm.count("changeseturl")) {
+    if (vm.count("timestamp") || vm.count("url") ||  vm.count("changeseturl") || vm.count("resume")) {
 
         // Planet server
         if (vm.count("planet")) {
@@ -230,7 +260,6 @@ main(int argc, char *argv[])
         }
         
         // Priority boundary
-        multipolygon_t poly;
         if (vm.count("boundary")) {
             boundary = vm["boundary"].as<std::string>();
         }
@@ -238,9 +267,11 @@ main(int argc, char *argv[])
         if (!geou.readFile(boundary)) {
             log_debug("Could not find '%1%' area file!", boundary);
         }
-        multipolygon_t * oscboundary = &poly;
+        // An empty index doesn't filter anything
+        geoutil::BoundaryIndex noboundary;
+        const geoutil::BoundaryIndex *oscboundary = &noboundary;
         if (!vm.count("oscnoboundary")) {
-            oscboundary = &geou.boundary;
+            oscboundary = &geou.index;
         }
 
         // Features
@@ -293,14 +324,29 @@ main(int argc, char *argv[])
             config.start_time = start.timestamp;
             boost::algorithm::replace_all(osmchange->filespec, ".state.txt", ".osc.gz");
         }
+        // Carry on after the last file committed, unless a starting
+        // point was given
+        bool resumed = false;
+        if (vm.count("resume") && !vm.count("timestamp") && !vm.count("url")) {
+            auto db = std::make_shared<pq::Pq>();
+            replication::Checkpoint checkpoint(db, "osmchange", config.frequency);
+            if (db->connect(config.underpass_db_url) && checkpoint.load()) {
+                osmchange->parse(checkpoint.getURL(config.planet_server));
+                config.start_time = checkpoint.timestamp;
+                resumed = true;
+            } else if (!vm.count("changesets")) {
+                log_error("No checkpoint for the %1% OsmChanges, use 'url' or 'timestamp'",
+                          StateFile::freq_to_string(config.frequency));
+            }
+        }
 
         // OsmChanges
         std::thread osmChangeThread;
-        if ((!vm.count("changesets") && !vm.count("changeseturl")) ||
-            (vm.count("changeseturl") && (vm.count("timestamp") || vm.count("url")))) {
-            multipolygon_t * osmboundary = &poly;
+        if ((vm.count("timestamp") || vm.count("url") || resumed) &&
+            (!vm.count("changesets") || vm.count("changeseturl"))) {
+            const geoutil::BoundaryIndex *osmboundary = &noboundary;
             if (!vm.count("osmnoboundary")) {
-                osmboundary = &geou.boundary;
+                osmboundary = &geou.index;
             }
             osmchange->destdir_base = config.destdir_base;
             if (!config.silent) {
@@ -308,18 +354,29 @@ main(int argc, char *argv[])
             }
 #ifdef SINGLE_THREAD            // debugging hack
             replicatorthreads::startMonitorChanges(std::ref(osmchange),
-                            std::ref(*osmboundary), config);
+                            std::cref(*osmboundary), config);
 #else
             osmChangeThread = std::thread(replicatorthreads::startMonitorChanges, std::ref(osmchange),
-                            std::ref(*osmboundary), config);
+                            std::cref(*osmboundary), config);
 #endif
         }
 
         // Changesets
         std::thread changesetThread;
         auto changeset = std::make_shared<RemoteURL>();
-        if (vm.count("changeseturl") && !vm.count("osmchanges")) {
-            auto changeseturl = vm["changeseturl"].as<std::string>();
+        std::string changeseturl;
+        bool changesetresumed = false;
+        if (vm.count("changeseturl")) {
+            changeseturl = vm["changeseturl"].as<std::string>();
+        } else if (vm.count("resume") && !vm.count("osmchanges")) {
+            auto db = std::make_shared<pq::Pq>();
+            replication::Checkpoint checkpoint(db, "changeset", replication::changeset);
+            if (db->connect(config.underpass_osm_db_url) && checkpoint.load()) {
+                changeseturl = checkpoint.path;
+                changesetresumed = true;
+            }
+        }
+        if (!changeseturl.empty() && !vm.count("osmchanges")) {
             config.frequency = replication::changeset;
             std::string fullurl = "https://" + config.planet_server + 
                 "/replication/changesets/" + changeseturl + ".osm.gz";
@@ -328,14 +385,18 @@ main(int argc, char *argv[])
             std::vector<std::string> parts;
             boost::split(parts, changeseturl, boost::is_any_of("/"));
             changeset->updatePath(stoi(parts[0]),stoi(parts[1]),stoi(parts[2]));
+            // The checkpoint is the last file done
+            if (changesetresumed) {
+                changeset->increment();
+            }
             if (!config.silent) {
                 changeset->dump();
             }
 #ifdef SINGLE_THREAD            // debugging hack
-            replicatorthreads::startMonitorChangesets(std::ref(changeset), std::ref(*oscboundary), config);
+            replicatorthreads::startMonitorChangesets(std::ref(changeset), std::cref(*oscboundary), config);
 #else
             changesetThread = std::thread(replicatorthreads::startMonitorChangesets, 
-                std::ref(changeset), std::ref(*oscboundary), config);
+                std::ref(changeset), std::cref(*oscboundary), config);
 #endif
         }
 
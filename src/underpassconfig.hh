@@ -29,6 +29,7 @@
 #endif
 
 #include "replicator/replication.hh"
+#include <algorithm>
 #include <boost/format.hpp>
 #include "utils/yaml.hh"
 #include <string>
@@ -128,6 +129,27 @@ struct UnderpassConfig {
             if (yaml.contains_key("destdir_base")) {
                 destdir_base = yamlConfig.get_value("destdir_base");
             }
+            if (yaml.contains_key("node_locations")) {
+                node_locations = yamlConfig.get_value("node_locations");
+            }
+            if (yaml.contains_key("raw_copy")) {
+                raw_copy = yamlConfig.get_value("raw_copy") == "true";
+            }
+            if (yaml.contains_key("db_connections")) {
+                db_connections = std::stoul(yamlConfig.get_value("db_connections"));
+            }
+            if (yaml.contains_key("cache_budget")) {
+                cache_budget = std::stoul(yamlConfig.get_value("cache_budget"));
+            }
+            if (yaml.contains_key("validation_cache_budget")) {
+                validation_cache_budget = std::stoul(yamlConfig.get_value("validation_cache_budget"));
+            }
+            if (yaml.contains_key("validation_cache_file")) {
+                validation_cache_file = yamlConfig.get_value("validation_cache_file");
+            }
+            if (yaml.contains_key("coarse_catchup")) {
+                coarse_catchup = yamlConfig.get_value("coarse_catchup") == "true";
+            }
         }
 
         if (getenv("REPLICATOR_OSM_DB_URL")) {
@@ -139,6 +161,27 @@ struct UnderpassConfig {
         if (getenv("REPLICATOR_DESTDIR_BASE")) {
             destdir_base = getenv("REPLICATOR_DESTDIR_BASE");
         }
+        if (getenv("REPLICATOR_NODE_LOCATIONS")) {
+            node_locations = getenv("REPLICATOR_NODE_LOCATIONS");
+        }
+        if (getenv("REPLICATOR_RAW_COPY")) {
+            raw_copy = std::string(getenv("REPLICATOR_RAW_COPY")) == "true";
+        }
+        if (getenv("REPLICATOR_DB_CONNECTIONS")) {
+            db_connections = std::stoul(getenv("REPLICATOR_DB_CONNECTIONS"));
+        }
+        if (getenv("REPLICATOR_CACHE_BUDGET")) {
+            cache_budget = std::stoul(getenv("REPLICATOR_CACHE_BUDGET"));
+        }
+        if (getenv("REPLICATOR_VALIDATION_CACHE_BUDGET")) {
+            validation_cache_budget = std::stoul(getenv("REPLICATOR_VALIDATION_CACHE_BUDGET"));
+        }
+        if (getenv("REPLICATOR_VALIDATION_CACHE_FILE")) {
+            validation_cache_file = getenv("REPLICATOR_VALIDATION_CACHE_FILE");
+        }
+        if (getenv("REPLICATOR_COARSE_CATCHUP")) {
+            coarse_catchup = std::string(getenv("REPLICATOR_COARSE_CATCHUP")) == "true";
+        }
         if (getenv("REPLICATOR_PLANET_SERVER")) {
             planet_server = getenv("REPLICATOR_PLANET_SERVER");
         }
@@ -162,10 +205,15 @@ struct UnderpassConfig {
     std::string underpass_osm_db_url = "localhost/underpass";
     std::string underpass_db_url = "localhost/underpass";
     std::string destdir_base;
+    std::string node_locations;                      ///< File of node locations, disabled if empty
+    std::string validation_cache_file;               ///< File the validation cache is saved to, if any
     std::string planet_server;
     std::string datadir;
     std::vector<PlanetServer> planet_servers;
     unsigned int concurrency = 1;
+    unsigned int db_connections = 0;                 ///< Database connections for the workers, 0 uses the concurrency
+    unsigned int cache_budget = 256;                 ///< Mb for the cache of recent nodes and ways, 0 disables it
+    unsigned int validation_cache_budget = 64;       ///< Mb for the last validation results, 0 disables them
     unsigned int bootstrap_page_size = 100;
 
     frequency_t frequency = frequency_t::minutely;
@@ -175,9 +223,20 @@ struct UnderpassConfig {
     bool disable_validation = false;
     bool disable_stats = false;
     bool disable_raw = false;
+    bool raw_copy = false;                           ///< Write the raw tables with COPY instead of INSERT
+    bool coarse_catchup = true;                      ///< Catch up with daily and hourly files when far behind
     bool norefs = false;
     bool silent = false;
 
+    ///
+    /// \brief getDbConnections returns the size of the database
+    ///        connection pools, which is the concurrency unless it's set.
+    ///
+    unsigned int getDbConnections() const
+    {
+        return db_connections > 0 ? db_connections : std::max(concurrency, 1u);
+    }
+
     ///
     /// \brief getPlanetServer returns either the command line supplied planet server
     ///        replication URL or the first planet server replication URL from the hardcoded
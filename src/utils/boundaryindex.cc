@@ -0,0 +1,315 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file boundaryindex.cc
+/// \brief A prepared priority boundary for fast point in polygon tests
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <vector>
+
+#include "utils/boundaryindex.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+
+namespace bg = boost::geometry;
+namespace bgi = boost::geometry::index;
+
+namespace geoutil {
+
+/// A cell that hasn't been classified yet
+static const std::uint8_t unknown = 0xff;
+
+BoundaryIndex::BoundaryIndex(const multipolygon_t &poly, int resolution)
+{
+    build(poly, resolution);
+}
+
+void
+BoundaryIndex::build(const multipolygon_t &poly, int resolution)
+{
+    boundary = poly;
+    parts.clear();
+    cells.clear();
+    cols = rows = 0;
+    if (boundary.empty()) {
+        return;
+    }
+
+    for (std::size_t i = 0; i < boundary.size(); i++) {
+        parts.insert(std::make_pair(bg::return_envelope<box_t>(boundary[i]), i));
+    }
+
+    // Size the cells so they are close to square
+    bounds = bg::return_envelope<box_t>(boundary);
+    double xspan = std::max(bounds.max_corner().x() - bounds.min_corner().x(), 1e-9);
+    double yspan = std::max(bounds.max_corner().y() - bounds.min_corner().y(), 1e-9);
+    resolution = std::max(resolution, 1);
+    if (xspan >= yspan) {
+        cols = resolution;
+        rows = std::max(1, static_cast<int>(std::ceil(resolution * yspan / xspan)));
+    } else {
+        rows = resolution;
+        cols = std::max(1, static_cast<int>(std::ceil(resolution * xspan / yspan)));
+    }
+    width = xspan / cols;
+    height = yspan / rows;
+    cells.assign(static_cast<std::size_t>(cols) * rows, unknown);
+
+    for (auto it = std::begin(boundary); it != std::end(boundary); ++it) {
+        markEdges(it->outer());
+        for (auto rit = std::begin(it->inners()); rit != std::end(it->inners()); ++rit) {
+            markEdges(*rit);
+        }
+    }
+    fillCells();
+}
+
+int
+BoundaryIndex::column(double x) const
+{
+    int col = static_cast<int>(std::floor((x - bounds.min_corner().x()) / width));
+    return std::clamp(col, 0, cols - 1);
+}
+
+int
+BoundaryIndex::row(double y) const
+{
+    int row = static_cast<int>(std::floor((y - bounds.min_corner().y()) / height));
+    return std::clamp(row, 0, rows - 1);
+}
+
+BoundaryIndex::box_t
+BoundaryIndex::cellBox(int col, int row) const
+{
+    double x = bounds.min_corner().x() + col * width;
+    double y = bounds.min_corner().y() + row * height;
+    return box_t(point_t(x, y), point_t(x + width, y + height));
+}
+
+void
+BoundaryIndex::markEdges(const polygon_t::ring_type &ring)
+{
+    // The cells are grown a little when testing, so rounding when a
+    // point is mapped to a cell can never put it in the wrong one.
+    double xpad = width * 1e-6;
+    double ypad = height * 1e-6;
+    for (std::size_t i = 1; i < ring.size(); i++) {
+        segment_t segment(ring[i - 1], ring[i]);
+        int col0 = std::max(column(std::min(ring[i - 1].x(), ring[i].x())) - 1, 0);
+        int col1 = std::min(column(std::max(ring[i - 1].x(), ring[i].x())) + 1, cols - 1);
+        int row0 = std::max(row(std::min(ring[i - 1].y(), ring[i].y())) - 1, 0);
+        int row1 = std::min(row(std::max(ring[i - 1].y(), ring[i].y())) + 1, rows - 1);
+        for (int r = row0; r <= row1; r++) {
+            for (int c = col0; c <= col1; c++) {
+                std::uint8_t &state = cells[r * cols + c];
+                if (state == edge) {
+                    continue;
+                }
+                box_t box = cellBox(c, r);
+                box.min_corner().x(box.min_corner().x() - xpad);
+                box.min_corner().y(box.min_corner().y() - ypad);
+                box.max_corner().x(box.max_corner().x() + xpad);
+                box.max_corner().y(box.max_corner().y() + ypad);
+                if (bg::intersects(segment, box)) {
+                    state = edge;
+                }
+            }
+        }
+    }
+}
+
+void
+BoundaryIndex::fillCells(void)
+{
+    // No edge passes through a region of connected cells that aren't
+    // edge cells, so testing one point classifies the whole region.
+    std::vector<int> stack;
+    for (int start = 0; start < cols * rows; start++) {
+        if (cells[start] != unknown) {
+            continue;
+        }
+        int c = start % cols;
+        int r = start / cols;
+        point_t center(bounds.min_corner().x() + (c + 0.5) * width,
+                       bounds.min_corner().y() + (r + 0.5) * height);
+        std::uint8_t state = bg::within(center, boundary) ? inside : outside;
+        cells[start] = state;
+        stack.push_back(start);
+        while (!stack.empty()) {
+            int pos = stack.back();
+            stack.pop_back();
+            int pc = pos % cols;
+            int pr = pos / cols;
+            int next[4] = {pc > 0 ? pos - 1 : -1, pc < cols - 1 ? pos + 1 : -1,
+                           pr > 0 ? pos - cols : -1, pr < rows - 1 ? pos + cols : -1};
+            for (int i = 0; i < 4; i++) {
+                if (next[i] >= 0 && cells[next[i]] == unknown) {
+                    cells[next[i]] = state;
+                    stack.push_back(next[i]);
+                }
+            }
+        }
+    }
+}
+
+BoundaryIndex::cell_t
+BoundaryIndex::classify(const point_t &point) const
+{
+    if (cells.empty() || !bg::covered_by(point, bounds)) {
+        return outside;
+    }
+    return cell(column(point.x()), row(point.y()));
+}
+
+bool
+BoundaryIndex::within(const point_t &point) const
+{
+    cell_t state = classify(point);
+    if (state != edge) {
+        return state == inside;
+    }
+    std::vector<entry_t> candidates;
+    parts.query(bgi::intersects(point), std::back_inserter(candidates));
+    bool touches = false;
+    for (auto it = std::begin(candidates); it != std::end(candidates); ++it) {
+        const polygon_t &part = boundary[it->second];
+        if (bg::within(point, part)) {
+            return true;
+        }
+        touches = touches || bg::covered_by(point, part);
+    }
+    // A point on an edge shared by two parts is inside the union,
+    // but not inside either of them.
+    if (touches && candidates.size() > 1) {
+        return bg::within(point, boundary);
+    }
+    return false;
+}
+
+bool
+BoundaryIndex::within(const linestring_t &line) const
+{
+    if (cells.empty()) {
+        return false;
+    }
+    if (line.empty()) {
+        return bg::within(line, boundary);
+    }
+    // Any point outside means the line isn't inside
+    for (auto it = std::begin(line); it != std::end(line); ++it) {
+        if (classify(*it) == outside) {
+            return false;
+        }
+    }
+    // If every cell the line could cross is inside, so is the line
+    box_t envelope = bg::return_envelope<box_t>(line);
+    bool decided = true;
+    int col0 = column(envelope.min_corner().x());
+    int col1 = column(envelope.max_corner().x());
+    int row0 = row(envelope.min_corner().y());
+    int row1 = row(envelope.max_corner().y());
+    for (int r = row0; r <= row1 && decided; r++) {
+        for (int c = col0; c <= col1; c++) {
+            if (cell(c, r) != inside) {
+                decided = false;
+                break;
+            }
+        }
+    }
+    if (decided) {
+        return true;
+    }
+    std::vector<entry_t> candidates;
+    parts.query(bgi::intersects(envelope), std::back_inserter(candidates));
+    if (candidates.empty()) {
+        return false;
+    }
+    if (candidates.size() == 1) {
+        return bg::within(line, boundary[candidates.front().second]);
+    }
+    return bg::within(line, boundary);
+}
+
+bool
+BoundaryIndex::intersects(const polygon_t &poly) const
+{
+    if (cells.empty()) {
+        return false;
+    }
+    box_t envelope = bg::return_envelope<box_t>(poly);
+    if (!bg::intersects(envelope, bounds)) {
+        return false;
+    }
+    bool exact = false;
+    int col0 = column(envelope.min_corner().x());
+    int col1 = column(envelope.max_corner().x());
+    int row0 = row(envelope.min_corner().y());
+    int row1 = row(envelope.max_corner().y());
+    for (int r = row0; r <= row1; r++) {
+        for (int c = col0; c <= col1; c++) {
+            cell_t state = cell(c, r);
+            if (state == inside) {
+                // The polygon is usually a box, so it covers the cell
+                if (bg::intersects(cellBox(c, r), poly)) {
+                    return true;
+                }
+                exact = true;
+            } else if (state == edge) {
+                exact = true;
+            }
+        }
+    }
+    if (!exact) {
+        return false;
+    }
+    std::vector<entry_t> candidates;
+    parts.query(bgi::intersects(envelope), std::back_inserter(candidates));
+    for (auto it = std::begin(candidates); it != std::end(candidates); ++it) {
+        if (bg::intersects(poly, boundary[it->second])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void
+BoundaryIndex::dump(void) const
+{
+    std::size_t counts[3] = {0, 0, 0};
+    for (auto it = std::begin(cells); it != std::end(cells); ++it) {
+        counts[*it]++;
+    }
+    log_debug("Boundary index: %1% polygons, %2%x%3% cells, %4% inside, %5% outside, %6% edge",
+              boundary.size(), cols, rows, counts[inside], counts[outside], counts[edge]);
+}
+
+} // namespace geoutil
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
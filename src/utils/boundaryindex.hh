@@ -0,0 +1,127 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __BOUNDARYINDEX_HH__
+#define __BOUNDARYINDEX_HH__
+
+/// \file boundaryindex.hh
+/// \brief A prepared priority boundary for fast point in polygon tests
+///
+/// Every node in a change file, and every point of every way, gets
+/// checked against the priority boundary. Doing that with
+/// boost::geometry::within() on the whole multipolygon looks at every
+/// edge of every polygon each time, so the boundary is prepared once
+/// instead, and most points are answered by a single array lookup.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <boost/geometry.hpp>
+#include <boost/geometry/index/rtree.hpp>
+
+#include "osm/osmobjects.hh"
+
+/// \namespace geoutil
+namespace geoutil {
+
+/// \class BoundaryIndex
+/// \brief A multipolygon with an R-tree of it's parts, and a grid of cells
+///
+/// The envelope of the boundary is divided into a uniform grid, and each
+/// cell is classified once as inside, outside, or on the edge of the
+/// boundary. A point in an inside or outside cell is answered from the
+/// grid, only points in edge cells need an exact test, and that is only
+/// done against the polygons whose envelopes contain the point, which
+/// are found with the R-tree.
+///
+/// An empty index has no boundary, and callers treat that as the whole
+/// planet, like they do with an empty multipolygon.
+class BoundaryIndex {
+  public:
+    typedef boost::geometry::model::box<point_t> box_t;
+
+    /// The classification of a cell in the grid
+    typedef enum { outside, inside, edge } cell_t;
+
+    BoundaryIndex(void) {};
+    /// Prepare an index for a boundary
+    BoundaryIndex(const multipolygon_t &poly, int resolution = default_resolution);
+
+    /// Prepare the index, replacing any previous boundary. The grid has
+    /// \a resolution cells along the longer side of the envelope.
+    void build(const multipolygon_t &poly, int resolution = default_resolution);
+
+    /// Is there a boundary to filter by
+    bool empty(void) const { return boundary.empty(); };
+    /// The boundary this index was built from
+    const multipolygon_t &getBoundary(void) const { return boundary; };
+
+    /// Is this point inside the boundary
+    bool within(const point_t &point) const;
+    /// Is this line entirely inside the boundary
+    bool within(const linestring_t &line) const;
+    /// Does this polygon, usually a changeset bounding box, touch the boundary
+    bool intersects(const polygon_t &poly) const;
+
+    /// Classify a point from the grid only, without an exact test
+    cell_t classify(const point_t &point) const;
+
+    /// Log the size of the grid, and how many cells need an exact test
+    void dump(void) const;
+
+    static const int default_resolution = 512; ///< Cells on the longer side
+
+  private:
+    /// The cell column or row for a coordinate, clamped to the grid
+    int column(double x) const;
+    int row(double y) const;
+    cell_t cell(int col, int row) const { return static_cast<cell_t>(cells[row * cols + col]); };
+    box_t cellBox(int col, int row) const;
+    /// Mark the cells a ring passes through as edge cells
+    void markEdges(const polygon_t::ring_type &ring);
+    /// Classify the cells that aren't edge cells by flood filling
+    void fillCells(void);
+
+    typedef std::pair<box_t, std::size_t> entry_t;
+    typedef boost::geometry::index::rtree<entry_t, boost::geometry::index::quadratic<16>> rtree_t;
+
+    multipolygon_t boundary;
+    rtree_t parts;             ///< The envelope of each polygon, and it's index
+    box_t bounds;              ///< The envelope of the whole boundary
+    int cols = 0;
+    int rows = 0;
+    double width = 0;          ///< The width of a cell in degrees
+    double height = 0;         ///< The height of a cell in degrees
+    std::vector<std::uint8_t> cells;
+};
+
+} // namespace geoutil
+
+#endif // EOF __BOUNDARYINDEX_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -79,6 +79,8 @@ GeoUtil::readFile(const std::string &filespec)
             CPLFree(wkt);
         }
     }
+    index.build(boundary);
+    index.dump();
 
     return true;
 }
@@ -88,6 +90,8 @@ bool
 GeoUtil::readPoly(const std::string &wkt)
 {
     boost::geometry::read_wkt(wkt, boundary);
+    index.build(boundary);
+    return true;
 }
 
 } // namespace geoutil
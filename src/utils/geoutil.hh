@@ -48,6 +48,7 @@
 
 #include "stats/querystats.hh"
 #include "osm/osmobjects.hh"
+#include "utils/boundaryindex.hh"
 
 /// \namespace geoutil
 namespace geoutil {
@@ -91,7 +92,7 @@ public:
     };
     /// Is this node in the priority area
     bool inPriorityArea(point_t pt) {
-        return boost::geometry::within(pt, boundary);
+        return index.within(pt);
     };
 
     /// DUmp internal data for debugging purposes.
@@ -102,6 +103,7 @@ public:
     };
     // private:
     multipolygon_t boundary; ///< The boundary multipolygon
+    BoundaryIndex index;     ///< The boundary prepared for fast lookups
 };
     
 }       // EOF geoutil
@@ -42,15 +42,32 @@ DefaultValidation::DefaultValidation(void) {}
 std::shared_ptr<ValidateStatus>
 DefaultValidation::checkNode(const osmobjects::OsmNode &node, const std::string &type)
 {
-    auto status = std::make_shared<ValidateStatus>(node);
+    auto status = pool.make(node);
     status->timestamp = boost::posix_time::microsec_clock::universal_time();
     status->uid = node.uid;
-    if (yamls.size() == 0) {
+    if (rules.empty()) {
         log_error("No config files!");
         return status;
     }
-    yaml::Yaml tests = yamls[type];
-    semantic::Semantic::checkNode(node, type, tests, status);
+    const ValidationRules &tests = getRules(type);
+    if (!cache || node.action == osmobjects::remove) {
+        semantic::Semantic::checkNode(node, type, tests, status);
+        return status;
+    }
+
+    // The same version has the same tags, so the last result is still
+    // right, but it's only the same row if the node didn't move
+    ValidationCache::Result last;
+    status->ruleset = ValidationCache::ruleset(type, tests.fingerprint);
+    status->geometry = ValidationCache::geometry(node.point);
+    bool sametags = cache->find(osmobjects::node, node.id, status->ruleset, last) && last.version == node.version;
+    if (sametags) {
+        reuseTags(last, status);
+        status->center = node.point;
+    } else {
+        semantic::Semantic::checkNode(node, type, tests, status);
+    }
+    finish(last, sametags, false, status);
 
     return status;
 }
@@ -60,16 +77,38 @@ DefaultValidation::checkNode(const osmobjects::OsmNode &node, const std::string
 std::shared_ptr<ValidateStatus>
 DefaultValidation::checkWay(const osmobjects::OsmWay &way, const std::string &type)
 {
-    auto status = std::make_shared<ValidateStatus>(way);
+    auto status = pool.make(way);
     status->timestamp = boost::posix_time::microsec_clock::universal_time();
     status->uid = way.uid;
-    if (yamls.size() == 0) {
+    if (rules.empty()) {
         log_error("No config files!");
         return status;
     }
-    yaml::Yaml tests = yamls[type];
-    semantic::Semantic::checkWay(way, type, tests, status);
-    geospatial::Geospatial::checkWay(way, type, tests, status);
+    const ValidationRules &tests = getRules(type);
+    if (!cache || way.action == osmobjects::remove) {
+        semantic::Semantic::checkWay(way, type, tests, status);
+        geospatial::Geospatial::checkWay(way, type, tests, status);
+    } else {
+        // A way changed by moving one of it's nodes keeps it's version
+        // and tags, and a way with new tags may not have moved
+        ValidationCache::Result last;
+        status->ruleset = ValidationCache::ruleset(type, tests.fingerprint);
+        status->geometry = ValidationCache::geometry(way.linestring, tests.hasType(way.tags, type));
+        bool found = cache->find(osmobjects::way, way.id, status->ruleset, last);
+        bool sametags = found && last.version == way.version;
+        bool samegeom = found && last.geometry == status->geometry;
+        if (sametags) {
+            reuseTags(last, status);
+        } else {
+            semantic::Semantic::checkWay(way, type, tests, status);
+        }
+        if (samegeom) {
+            status->status.addBits(last.geospatial);
+        } else {
+            geospatial::Geospatial::checkWay(way, type, tests, status);
+        }
+        finish(last, sametags, samegeom, status);
+    }
     if (way.linestring.size() > 2) {
         boost::geometry::centroid(way.linestring, status->center);
     }
@@ -77,18 +116,44 @@ DefaultValidation::checkWay(const osmobjects::OsmWay &way, const std::string &ty
     return status;
 }
 
+// Use the results of the last check of the tags
+void
+DefaultValidation::reuseTags(const ValidationCache::Result &last, std::shared_ptr<ValidateStatus> &status)
+{
+    status->status.addBits(last.semantic);
+    for (auto it = std::begin(last.values); it != std::end(last.values); ++it) {
+        status->values.insert(*it);
+    }
+}
+
+// Count what was skipped, and decide whether the result has to be
+// written. A node only has the checks on it's tags, so the location is
+// in the geometry hash.
+void
+DefaultValidation::finish(const ValidationCache::Result &last, bool sametags, bool samegeom,
+                          std::shared_ptr<ValidateStatus> &status)
+{
+    bool unchanged = sametags && last.geometry == status->geometry && !last.pending;
+    if (unchanged) {
+        status->unchanged = true;
+    } else {
+        cache->begin(status->objtype, status->osm_id);
+    }
+    cache->skipped(sametags, samegeom, unchanged);
+}
+
 // This checks a relation. A relation should always have some tags.
 std::shared_ptr<ValidateStatus>
 DefaultValidation::checkRelation(const osmobjects::OsmRelation &relation, const std::string &type)
 {
-    auto status = std::make_shared<ValidateStatus>(relation);
+    auto status = pool.make(relation);
     status->timestamp = boost::posix_time::microsec_clock::universal_time();
     status->uid = relation.uid;
-    if (yamls.size() == 0) {
+    if (rules.empty()) {
         log_error("No config files!");
         return status;
     }
-    yaml::Yaml tests = yamls[type];
+    const ValidationRules &tests = getRules(type);
     semantic::Semantic::checkRelation(relation, type, tests, status);
     // geospatial::Geospatial::checkRelation(relation, type, tests, status);
     // if (relation.linestring.size() > 2) {
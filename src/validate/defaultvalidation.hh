@@ -64,6 +64,13 @@ public:
         return std::make_shared<DefaultValidation>();
     };
 private:
+    /// Add the results of the last check of the tags
+    void reuseTags(const ValidationCache::Result &last, std::shared_ptr<ValidateStatus> &status);
+    /// Count the checks that were skipped, and mark the result as
+    /// unchanged if it's the same as the last one, or pending if not
+    void finish(const ValidationCache::Result &last, bool sametags, bool samegeom,
+                std::shared_ptr<ValidateStatus> &status);
+
     std::map<std::string, std::vector<std::string>> tests;
 };
 
@@ -32,6 +32,7 @@
 #include <array>
 #include <assert.h>
 #include <iostream>
+#include <map>
 #include <memory>
 #include <string>
 #include <vector>
@@ -83,8 +84,26 @@ std::map<osmobjects::osmtype_t, std::string> objtypes = {
 
 QueryValidate::QueryValidate(void) {}
 
+/// The prepared statements for the validation table. The version check
+/// is the same as the one in the SQL built by applyChange().
+static const std::map<std::string, std::string> validationStatements = {
+    {"validation_upsert", "INSERT INTO validation AS v (osm_id, changeset, uid, type, status, values, timestamp, \
+location, source, version) VALUES ($1, $2, $3, $4, $5, $6::text[], $7, ST_GeomFromText($8, 4326), $9, $10) \
+ON CONFLICT (osm_id, status, source) DO UPDATE SET version = EXCLUDED.version, timestamp = EXCLUDED.timestamp \
+WHERE v.version < EXCLUDED.version"},
+    {"validation_delete", "DELETE FROM validation WHERE osm_id = ANY($1::bigint[])"},
+    {"validation_delete_status", "DELETE FROM validation WHERE osm_id = $1 AND status = $2"},
+    {"validation_delete_status_source", "DELETE FROM validation WHERE osm_id = $1 AND source = $2 AND status = $3"}
+};
+
 QueryValidate::QueryValidate(std::shared_ptr<Pq> db) {
     dbconn = db;
+    if (!dbconn) {
+        return;
+    }
+    for (auto it = std::begin(validationStatements); it != std::end(validationStatements); ++it) {
+        dbconn->prepare(it->first, it->second);
+    }
 }
 
 std::shared_ptr<std::string>
@@ -143,7 +162,7 @@ QueryValidate::applyChange(const ValidateStatus &validation, const valerror_t &s
     std::string format;
     auto query = std::make_shared<std::string>();
 
-    if (validation.values.size() > 0) {
+    if (!validation.values.empty()) {
         *query = "INSERT INTO validation as v (osm_id, changeset, uid, type, status, values, timestamp, location, source, version) VALUES(";
         format = "%d, %d, %g, \'%s\', \'%s\', ARRAY[%s], \'%s\', ST_GeomFromText(\'%s\', 4326), \'%s\', %s) ";
     } else {
@@ -158,7 +177,7 @@ QueryValidate::applyChange(const ValidateStatus &validation, const valerror_t &s
     fmt % objtypes[validation.objtype];
     std::string valtmp;
     fmt % status_list[status];
-    if (validation.values.size() > 0) {
+    if (!validation.values.empty()) {
         for (const auto &tag: std::as_const(validation.values)) {
             valtmp += + "'" + dbconn->escapedString(tag) + "',";
         }
@@ -186,11 +205,39 @@ QueryValidate::applyChange(const ValidateStatus &validation, const valerror_t &s
     return query;
 }
 
+void
+QueryValidate::applyChange(const ValidateStatus &validation, const valerror_t &status,
+                           std::vector<Statement> &statements) const
+{
+    Statement upsert("validation_upsert");
+    upsert.bind(validation.osm_id).bind(validation.changeset).bind(validation.uid);
+    upsert.bind(objtypes[validation.objtype]).bind(status_list[status]);
+    if (!validation.values.empty()) {
+        upsert.bind(std::vector<std::string>(std::begin(validation.values), std::end(validation.values)));
+    } else {
+        upsert.bind(std::optional<std::string>());
+    }
+    upsert.bind(to_simple_string(validation.timestamp));
+    std::stringstream ss;
+    ss << std::setprecision(12) << boost::geometry::wkt(validation.center);
+    upsert.bind(ss.str()).bind(validation.source).bind(validation.version);
+    statements.push_back(upsert);
+}
+
+void
+QueryValidate::updateValidation(osmobjects::osmtype_t type, long osm_id, long version, Coalescer &writes) const
+{
+    writes.remove(type, osm_id, version, "validation_delete");
+}
+
 std::shared_ptr<std::vector<std::string>>
 QueryValidate::ways(std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>> wayval) {
     auto query = std::make_shared<std::vector<std::string>>();
     for (auto it = wayval->begin(); it != wayval->end(); ++it) {
-        if (it->get()->status.size() > 0) {
+        if (it->get()->unchanged) {
+            continue;
+        }
+        if (!it->get()->status.empty()) {
             for (auto status_it = it->get()->status.begin(); status_it != it->get()->status.end(); ++status_it) {
                 query->push_back(*applyChange(*it->get(), *status_it));
             }
@@ -206,7 +253,10 @@ QueryValidate::ways(
 ) {
     auto query = std::make_shared<std::vector<std::string>>();
     for (auto it = wayval->begin(); it != wayval->end(); ++it) {
-        if (it->get()->status.size() > 0) {
+        if (it->get()->unchanged) {
+            continue;
+        }
+        if (!it->get()->status.empty()) {
             for (auto status_it = it->get()->status.begin(); status_it != it->get()->status.end(); ++status_it) {
                 query->push_back(*applyChange(*it->get(), *status_it));
             }
@@ -233,7 +283,10 @@ std::shared_ptr<std::vector<std::string>>
 QueryValidate::nodes(std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>> nodeval) {
     auto query = std::make_shared<std::vector<std::string>>();
     for (auto it = nodeval->begin(); it != nodeval->end(); ++it) {
-        if (it->get()->status.size() > 0) {
+        if (it->get()->unchanged) {
+            continue;
+        }
+        if (!it->get()->status.empty()) {
             for (auto status_it = it->get()->status.begin(); status_it != it->get()->status.end(); ++status_it) {
                 query->push_back(*applyChange(*it->get(), *status_it));
             }
@@ -249,7 +302,10 @@ QueryValidate::nodes(
 ) {
     auto query = std::make_shared<std::vector<std::string>>();
     for (auto it = nodeval->begin(); it != nodeval->end(); ++it) {
-        if (it->get()->status.size() > 0) {
+        if (it->get()->unchanged) {
+            continue;
+        }
+        if (!it->get()->status.empty()) {
             for (auto status_it = it->get()->status.begin(); status_it != it->get()->status.end(); ++status_it) {
                 query->push_back(*applyChange(*it->get(), *status_it));
             }
@@ -263,6 +319,92 @@ QueryValidate::nodes(
     return query;
 }
 
+void
+QueryValidate::ways(
+    std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>> wayval,
+    Coalescer &writes
+) {
+    for (auto it = wayval->begin(); it != wayval->end(); ++it) {
+        const ValidateStatus &validation = *it->get();
+        // The same rows are in the table already
+        if (validation.unchanged) {
+            continue;
+        }
+        if (!validation.status.empty()) {
+            std::vector<Statement> statements;
+            for (auto status_it = validation.status.begin(); status_it != validation.status.end(); ++status_it) {
+                applyChange(validation, *status_it, statements);
+            }
+            for (const valerror_t status : {overlapping, duplicate, badgeom}) {
+                if (!validation.hasStatus(status)) {
+                    statements.push_back(Statement("validation_delete_status_source")
+                                             .bind(validation.osm_id).bind("building").bind(status_list[status]));
+                }
+            }
+            if (!validation.hasStatus(badvalue)) {
+                statements.push_back(Statement("validation_delete_status")
+                                         .bind(validation.osm_id).bind(status_list[badvalue]));
+            }
+            writes.add(validation.objtype, validation.osm_id, validation.version, std::move(statements));
+        } else {
+            updateValidation(validation.objtype, validation.osm_id, validation.version, writes);
+        }
+    }
+}
+
+void
+QueryValidate::nodes(
+    std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>> nodeval,
+    Coalescer &writes
+) {
+    // A node is validated for each key it has, and the coalescer only
+    // keeps the last writes for a version of an object, so the results
+    // for the same node are written together
+    std::vector<std::vector<const ValidateStatus *>> nodes;
+    std::map<std::pair<long, long>, std::size_t> index;
+    for (auto it = nodeval->begin(); it != nodeval->end(); ++it) {
+        const ValidateStatus *validation = it->get();
+        auto found = index.emplace(std::make_pair(validation->osm_id, validation->version), nodes.size());
+        if (found.second) {
+            nodes.emplace_back();
+        }
+        nodes[found.first->second].push_back(validation);
+    }
+    for (auto it = std::begin(nodes); it != std::end(nodes); ++it) {
+        const ValidateStatus &node = *it->front();
+        bool unchanged = true;
+        bool clean = true;
+        bool bad = false;
+        std::vector<Statement> statements;
+        for (auto vit = std::begin(*it); vit != std::end(*it); ++vit) {
+            const ValidateStatus &validation = **vit;
+            unchanged &= validation.unchanged;
+            clean &= validation.status.empty();
+            bad |= validation.hasStatus(badvalue) != 0;
+            // The same rows are in the table already
+            if (validation.unchanged) {
+                continue;
+            }
+            for (auto status_it = validation.status.begin(); status_it != validation.status.end(); ++status_it) {
+                applyChange(validation, *status_it, statements);
+            }
+        }
+        if (unchanged) {
+            continue;
+        }
+        if (clean) {
+            updateValidation(node.objtype, node.osm_id, node.version, writes);
+            continue;
+        }
+        // A bad value found for any of the keys is kept
+        if (!bad) {
+            statements.push_back(Statement("validation_delete_status")
+                                     .bind(node.osm_id).bind(status_list[badvalue]));
+        }
+        writes.add(node.objtype, node.osm_id, node.version, std::move(statements));
+    }
+}
+
 } // namespace queryvalidate
 
 // local Variables:
@@ -49,6 +49,7 @@ using namespace boost::gregorian;
 #include "osm/osmchange.hh"
 
 #include "data/pq.hh"
+#include "data/coalescer.hh"
 
 using namespace pq;
 
@@ -76,6 +77,11 @@ class QueryValidate  {
     /// Apply data validation to the database
     std::shared_ptr<std::string> applyChange(const ValidateStatus &validation,
                                              const valerror_t &status) const;
+    /// Add the prepared statement call to apply data validation
+    void applyChange(const ValidateStatus &validation, const valerror_t &status,
+                     std::vector<Statement> &statements) const;
+    /// Add the removal of the validation of a feature
+    void updateValidation(osmobjects::osmtype_t type, long osm_id, long version, Coalescer &writes) const;
     /// Update the validation table, delete any feature that has been fixed.
     std::shared_ptr<std::string> updateValidation(
         std::shared_ptr<std::vector<long>> removals);
@@ -93,6 +99,17 @@ class QueryValidate  {
     std::shared_ptr<std::vector<std::string>> nodes(
         std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>> nodeval,
         std::shared_ptr<std::vector<long>> validation_removals);
+    /// Add the prepared statement calls for validated ways, except the
+    /// unchanged ones
+    void ways(
+        std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>> wayval,
+        Coalescer &writes);
+    /// Add the prepared statement calls for validated nodes, except the
+    /// unchanged ones. The results for each key of a node are written
+    /// together.
+    void nodes(
+        std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>> nodeval,
+        Coalescer &writes);
     std::shared_ptr<std::vector<std::string>> rels(
         std::shared_ptr<std::vector<std::shared_ptr<ValidateStatus>>> relval);
     std::shared_ptr<std::vector<std::string>> rels(
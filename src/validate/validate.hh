@@ -37,6 +37,13 @@
 #include <iostream>
 #include <filesystem>
 #include <unordered_set>
+#include <array>
+#include <bitset>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
 
 #include <boost/config.hpp>
 #include <boost/geometry.hpp>
@@ -45,6 +52,8 @@
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/dll/runtime_symbol_info.hpp>
 #include <boost/timer/timer.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
 using namespace boost::posix_time;
 using namespace boost::gregorian;
 
@@ -52,6 +61,8 @@ using namespace boost::gregorian;
 #include "utils/yaml.hh"
 #include "utils/log.hh"
 #include "utils/geo.hh"
+#include "validate/validationrules.hh"
+#include "validate/validationcache.hh"
 
 using namespace logger;
 
@@ -97,6 +108,130 @@ namespace bg = boost::geometry;
 namespace bgm = bg::model;
 typedef bgm::polygon<bgm::d2::point_xy<double> > polygon;
 
+/// \class StatusSet
+/// \brief The valerror_t values found for an object, as a bitmask
+///
+/// This has the parts of the std::unordered_set API that were used on
+/// the results, and iterates in the order of valerror_t.
+class StatusSet {
+  public:
+    class const_iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = valerror_t;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const valerror_t *;
+        using reference = valerror_t;
+
+        const_iterator(std::uint32_t rest) : bits(rest) {};
+        reference operator*() const { return static_cast<valerror_t>(lowest(bits)); };
+        const_iterator &operator++() { bits &= bits - 1; return *this; };
+        const_iterator operator++(int) { auto tmp = *this; ++*this; return tmp; };
+        bool operator==(const const_iterator &other) const { return bits == other.bits; };
+        bool operator!=(const const_iterator &other) const { return bits != other.bits; };
+
+      private:
+        std::uint32_t bits;  ///< The values not iterated over yet
+    };
+
+    void insert(valerror_t value) { bits |= 1u << value; };
+    std::size_t erase(valerror_t value) {
+        std::size_t found = count(value);
+        bits &= ~(1u << value);
+        return found;
+    };
+    std::size_t count(valerror_t value) const { return (bits >> value) & 1; };
+    std::size_t size(void) const { return std::bitset<32>(bits).count(); };
+    bool empty(void) const { return bits == 0; };
+    void clear(void) { bits = 0; };
+    const_iterator begin(void) const { return const_iterator(bits); };
+    const_iterator end(void) const { return const_iterator(0); };
+    bool operator==(const StatusSet &other) const { return bits == other.bits; };
+    bool operator!=(const StatusSet &other) const { return bits != other.bits; };
+
+    /// The bitmask, with bit N set for the valerror_t N
+    std::uint32_t getBits(void) const { return bits; };
+    /// Add the values in a bitmask from getBits()
+    void addBits(std::uint32_t more) { bits |= more; };
+
+  private:
+    /// The index of the lowest bit that is set
+    static int lowest(std::uint32_t bits) {
+        int index = 0;
+        while (!(bits & 1)) {
+            bits >>= 1;
+            index++;
+        }
+        return index;
+    };
+    std::uint32_t bits = 0;
+};
+
+/// \class ValueList
+/// \brief The bad tag values found for an object
+///
+/// Most objects have no bad values, and the ones that do only have a
+/// few, so the first ones are kept inline instead of in a hash set.
+/// Adding a value that is already there does nothing, like a set.
+class ValueList {
+  public:
+    class const_iterator {
+      public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::string;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const std::string *;
+        using reference = const std::string &;
+
+        const_iterator(const ValueList *list, std::size_t index) : list(list), index(index) {};
+        reference operator*() const { return (*list)[index]; };
+        pointer operator->() const { return &(*list)[index]; };
+        const_iterator &operator++() { ++index; return *this; };
+        const_iterator operator++(int) { auto tmp = *this; ++index; return tmp; };
+        bool operator==(const const_iterator &other) const { return index == other.index; };
+        bool operator!=(const const_iterator &other) const { return index != other.index; };
+
+      private:
+        const ValueList *list;
+        std::size_t index;
+    };
+
+    void insert(std::string value) {
+        for (std::size_t i = 0; i < count; i++) {
+            if ((*this)[i] == value) {
+                return;
+            }
+        }
+        if (count < inline_values) {
+            local[count] = std::move(value);
+        } else {
+            more.push_back(std::move(value));
+        }
+        count++;
+    };
+    const std::string &operator[](std::size_t index) const {
+        return index < inline_values ? local[index] : more[index - inline_values];
+    };
+    std::size_t size(void) const { return count; };
+    bool empty(void) const { return count == 0; };
+    void clear(void) {
+        for (std::size_t i = 0; i < count && i < inline_values; i++) {
+            local[i].clear();
+        }
+        more.clear();
+        count = 0;
+    };
+    const_iterator begin(void) const { return const_iterator(this, 0); };
+    const_iterator end(void) const { return const_iterator(this, count); };
+
+    static const std::size_t inline_values = 2;  ///< The values kept inline
+
+  private:
+    std::array<std::string, inline_values> local;
+    std::vector<std::string> more;  ///< Only used with more than inline_values
+    std::size_t count = 0;
+};
+
 /// \class ValidateStatus
 /// \brief This class stores data from the validation process
 class ValidateStatus {
@@ -128,11 +263,7 @@ class ValidateStatus {
     }
     /// Does this change have a particular status value
     bool hasStatus(const valerror_t &val) const {
-        auto match = std::find(status.begin(), status.end(), val);
-        if (match != status.end()) {
-            return true;
-        }
-        return false;
+        return status.count(val);
     }
     /// Dump internal data for debugging
     void dump(void) const {
@@ -154,14 +285,14 @@ class ValidateStatus {
         for (const auto &stat: std::as_const(status)) {
             std::cerr << "\tResult: " << results[stat] << std::endl;
         }
-        if (values.size() > 0) {
+        if (!values.empty()) {
             std::cerr << "\tValues: ";
             for (auto it = std::begin(values); it != std::end(values); ++it ) {
                 std::cerr << *it << ", " << std::endl;
             }
         }
     }
-    std::unordered_set<valerror_t> status;
+    StatusSet status;       ///< The problems that were found
     osmobjects::osmtype_t objtype;
     long osm_id = 0;        ///< The OSM ID of the feature
     long uid = 0;        ///< The user ID of the mapper creating/modifying this feature
@@ -169,8 +300,93 @@ class ValidateStatus {
     long version = 0;        ///< The object version
     ptime timestamp;        ///< The timestamp when this validation was performed
     point_t center;        ///< The centroid of the building polygon
-    std::unordered_set<std::string> values; ///< The found bad tag values
+    ValueList values;       ///< The found bad tag values
     std::string source; //< The source of the validation status
+    std::uint64_t ruleset = 0;  ///< The rules it was checked with, 0 if it isn't cached
+    std::uint64_t geometry = 0; ///< The hash of the geometry it was checked with
+    bool unchanged = false;     ///< The same as the committed result, so it isn't written
+};
+
+/// \class ValidateStatusPool
+/// \brief Hands out validation results, reusing the memory of old ones
+///
+/// Every validated object gets a result, even though most of them are
+/// fine, and the results are released in batches once their queries
+/// are made. The result and it's shared_ptr count are allocated in one
+/// block, which goes back to the pool when the last shared_ptr goes
+/// away, so after the first few files a result doesn't allocate. The
+/// pool can be used from several threads, and the results can be
+/// released on any thread, even after the pool is gone.
+class ValidateStatusPool {
+  public:
+    ValidateStatusPool(void) : blocks(std::make_shared<FreeList>()) {};
+
+    /// Get a result, with the same arguments as the ValidateStatus constructors
+    template <typename... Args>
+    std::shared_ptr<ValidateStatus> make(Args &&...args) {
+        return std::allocate_shared<ValidateStatus>(Allocator<ValidateStatus>(blocks), std::forward<Args>(args)...);
+    };
+    /// The number of blocks that are ready to be reused
+    std::size_t getFree(void) const {
+        std::scoped_lock lock{blocks->mutex};
+        return blocks->free.size();
+    };
+
+  private:
+    /// The released blocks, which are all the same size
+    struct FreeList {
+        std::mutex mutex;
+        std::vector<void *> free;
+        std::size_t size = 0;                       ///< The size of the blocks
+        static const std::size_t limit = 65536;     ///< The most blocks kept for reuse
+        ~FreeList(void) {
+            for (auto it = std::begin(free); it != std::end(free); ++it) {
+                ::operator delete(*it);
+            }
+        };
+    };
+
+    /// Allocates from the free list, the allocator of each result keeps
+    /// the list around until the result is released
+    template <typename T>
+    struct Allocator {
+        using value_type = T;
+        Allocator(std::shared_ptr<FreeList> list) : list(std::move(list)) {};
+        template <typename U>
+        Allocator(const Allocator<U> &other) : list(other.list) {};
+        T *allocate(std::size_t n) {
+            if (n == 1) {
+                std::scoped_lock lock{list->mutex};
+                if (list->size == 0) {
+                    list->size = sizeof(T);
+                }
+                if (list->size == sizeof(T) && !list->free.empty()) {
+                    void *block = list->free.back();
+                    list->free.pop_back();
+                    return static_cast<T *>(block);
+                }
+            }
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        };
+        void deallocate(T *block, std::size_t n) {
+            if (n == 1) {
+                std::scoped_lock lock{list->mutex};
+                if (list->size == sizeof(T) && list->free.size() < list->limit) {
+                    list->free.push_back(block);
+                    return;
+                }
+            }
+            ::operator delete(block);
+        };
+        template <typename U>
+        bool operator==(const Allocator<U> &other) const { return list == other.list; };
+        template <typename U>
+        bool operator!=(const Allocator<U> &other) const { return list != other.list; };
+
+        std::shared_ptr<FreeList> list;
+    };
+
+    std::shared_ptr<FreeList> blocks;
 };
 
 
@@ -195,6 +411,7 @@ class BOOST_SYMBOL_VISIBLE Validate {
                 yaml.read(config.string());
                 if (!config.stem().empty()) {
                     yamls[config.stem()] = yaml;
+                    rules[config.stem()] = ValidationRules(yaml, config.stem().string());
                 }
             }
         }
@@ -205,7 +422,59 @@ class BOOST_SYMBOL_VISIBLE Validate {
     virtual std::shared_ptr<ValidateStatus> checkNode(const osmobjects::OsmNode &node, const std::string &type) = 0;
     virtual std::shared_ptr<ValidateStatus> checkWay(const osmobjects::OsmWay &way, const std::string &type) = 0;
 
+    /// Validate \a count nodes into \a results, which has room for all
+    /// of them. This checks them one at a time, a plugin only has to
+    /// override it if it can do better with a batch.
+    virtual void checkNodes(const osmobjects::OsmNode *const *nodes, std::size_t count, const std::string &type,
+                            std::shared_ptr<ValidateStatus> *results) {
+        for (std::size_t i = 0; i < count; i++) {
+            results[i] = checkNode(*nodes[i], type);
+        }
+    };
+    /// Validate \a count ways into \a results, which has room for all
+    /// of them. This checks them one at a time, a plugin only has to
+    /// override it if it can do better with a batch.
+    virtual void checkWays(const osmobjects::OsmWay *const *ways, std::size_t count, const std::string &type,
+                           std::shared_ptr<ValidateStatus> *results) {
+        for (std::size_t i = 0; i < count; i++) {
+            results[i] = checkWay(*ways[i], type);
+        }
+    };
+
+    /// Validate the \a nodes in batches on the \a pool, or in this thread
+    /// if there isn't one. This returns when all of them are done.
+    void checkNodes(const std::vector<const osmobjects::OsmNode *> &nodes, const std::string &type,
+                    std::vector<std::shared_ptr<ValidateStatus>> &results, boost::asio::thread_pool *pool = nullptr) {
+        results.resize(nodes.size());
+        fanOut(nodes.size(), pool, [&](std::size_t first, std::size_t count) {
+            checkNodes(nodes.data() + first, count, type, results.data() + first);
+        });
+    };
+    /// Validate the \a ways in batches on the \a pool, or in this thread
+    /// if there isn't one. This returns when all of them are done.
+    void checkWays(const std::vector<const osmobjects::OsmWay *> &ways, const std::string &type,
+                   std::vector<std::shared_ptr<ValidateStatus>> &results, boost::asio::thread_pool *pool = nullptr) {
+        results.resize(ways.size());
+        fanOut(ways.size(), pool, [&](std::size_t first, std::size_t count) {
+            checkWays(ways.data() + first, count, type, results.data() + first);
+        });
+    };
+
+    std::size_t batch_size = 64;    ///< The objects validated by each task on a pool
+    std::shared_ptr<ValidationCache> cache; ///< The last results of each object, if they are kept
+
     yaml::Yaml &operator[](const std::string &key) { return yamls[key]; };
+
+    /// The compiled configuration file for a type of object, or one
+    /// with no checks when there isn't a file for it
+    const ValidationRules &getRules(const std::string &type) const {
+        static const ValidationRules none;
+        auto found = rules.find(type);
+        if (found == rules.end()) {
+            return none;
+        }
+        return found->second;
+    };
     
     void dump(void) {
         for (auto it = std::begin(yamls); it != std::end(yamls); ++it) {
@@ -214,7 +483,50 @@ class BOOST_SYMBOL_VISIBLE Validate {
     }
 
   protected:
+    /// Split \a count objects into batches, and wait for \a check to
+    /// do all of them. An exception in a batch is thrown again here.
+    template <typename Check>
+    void fanOut(std::size_t count, boost::asio::thread_pool *pool, Check check) {
+        if (pool == nullptr || count <= batch_size) {
+            check(0, count);
+            return;
+        }
+        std::mutex mutex;
+        std::condition_variable done;
+        std::size_t pending = 0;
+        std::exception_ptr error;
+        for (std::size_t first = 0; first < count; first += batch_size) {
+            std::size_t size = std::min(batch_size, count - first);
+            {
+                std::scoped_lock lock{mutex};
+                pending++;
+            }
+            boost::asio::post(*pool, [&, first, size] {
+                std::exception_ptr failed;
+                try {
+                    check(first, size);
+                } catch (...) {
+                    failed = std::current_exception();
+                }
+                std::scoped_lock lock{mutex};
+                if (failed && !error) {
+                    error = failed;
+                }
+                if (--pending == 0) {
+                    done.notify_all();
+                }
+            });
+        }
+        std::unique_lock lock{mutex};
+        done.wait(lock, [&] { return pending == 0; });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    };
+
     std::map<std::string, yaml::Yaml> yamls;
+    std::map<std::string, ValidationRules> rules;  ///< The yamls, compiled when loaded
+    ValidateStatusPool pool;                       ///< Where the results come from
 };
 
 #endif // EOF __VALIDATE_HH__
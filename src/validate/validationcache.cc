@@ -0,0 +1,367 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file validationcache.cc
+/// \brief The last committed validation result of each object
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "validate/validationcache.hh"
+#include "validate/validate.hh"
+#include "utils/log.hh"
+
+using namespace logger;
+
+/// The memory used by the list and index for each object, on top of
+/// the entry itself
+static const std::size_t overhead = 64;
+
+/// The results that come from the geometry checks, the others come
+/// from the tags
+static const std::uint32_t geospatial_bits = (1u << badgeom) | (1u << overlapping) | (1u << duplicate);
+
+/// The start of a saved file, and the version of the format
+static const char magic[4] = {'U', 'P', 'V', 'C'};
+static const std::uint32_t format = 1;
+
+/// FNV-1a, so the hashes in a saved file are the same in the next run
+static std::uint64_t
+fnv(const void *data, std::size_t size, std::uint64_t hash = 14695981039346656037ULL)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+ValidationCache::ValidationCache(std::size_t bytes, std::size_t count)
+{
+    if (count == 0) {
+        count = 1;
+    }
+    for (std::size_t i = 0; i < count; i++) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    budget = bytes / count;
+}
+
+std::size_t
+ValidationCache::bytes(const Entry &entry)
+{
+    std::size_t bytes = sizeof(Entry) + overhead;
+    for (auto it = std::begin(entry.results); it != std::end(entry.results); ++it) {
+        bytes += sizeof(*it);
+        for (auto vit = std::begin(it->second.values); vit != std::end(it->second.values); ++vit) {
+            bytes += sizeof(std::string) + vit->capacity();
+        }
+    }
+    return bytes;
+}
+
+bool
+ValidationCache::find(osmobjects::osmtype_t type, long id, std::uint64_t ruleset, Result &result)
+{
+    long object = key(type, id);
+    Shard &shard = this->shard(object);
+    std::scoped_lock lock{shard.mutex};
+    auto it = shard.index.find(object);
+    if (it != shard.index.end()) {
+        auto &results = it->second->results;
+        for (auto rit = std::begin(results); rit != std::end(results); ++rit) {
+            if (rit->first == ruleset) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                result = rit->second;
+                result.pending = shard.pending.count(object);
+                hits++;
+                return true;
+            }
+        }
+    }
+    misses++;
+    return false;
+}
+
+void
+ValidationCache::begin(osmobjects::osmtype_t type, long id)
+{
+    long object = key(type, id);
+    Shard &shard = this->shard(object);
+    std::scoped_lock lock{shard.mutex};
+    shard.pending[object]++;
+}
+
+void
+ValidationCache::put(Shard &shard, long key, std::uint64_t ruleset, Result &&result)
+{
+    result.pending = false;
+    auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        shard.lru.push_front({key, {}, 0});
+        it = shard.index.emplace(key, shard.lru.begin()).first;
+    } else {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    }
+    Entry &entry = *it->second;
+    shard.bytes -= entry.bytes;
+    auto rit = std::begin(entry.results);
+    while (rit != std::end(entry.results) && rit->first != ruleset) {
+        ++rit;
+    }
+    if (rit == std::end(entry.results)) {
+        entry.results.emplace_back(ruleset, std::move(result));
+    } else {
+        rit->second = std::move(result);
+    }
+    entry.bytes = bytes(entry);
+    shard.bytes += entry.bytes;
+    while (shard.bytes > budget && shard.lru.size() > 1) {
+        shard.bytes -= shard.lru.back().bytes;
+        shard.index.erase(shard.lru.back().key);
+        shard.lru.pop_back();
+        evictions++;
+    }
+}
+
+void
+ValidationCache::commit(const std::vector<std::shared_ptr<ValidateStatus>> &results, bool written)
+{
+    for (auto it = std::begin(results); it != std::end(results); ++it) {
+        const ValidateStatus *status = it->get();
+        // Results that weren't checked with the cache aren't stored, and
+        // unchanged ones are already there
+        if (status == nullptr || status->ruleset == 0 || status->unchanged) {
+            continue;
+        }
+        long object = key(status->objtype, status->osm_id);
+        Shard &shard = this->shard(object);
+        std::scoped_lock lock{shard.mutex};
+        auto pit = shard.pending.find(object);
+        if (pit != shard.pending.end() && --pit->second <= 0) {
+            shard.pending.erase(pit);
+        }
+        if (!written) {
+            continue;
+        }
+        Result result;
+        result.version = status->version;
+        result.geometry = status->geometry;
+        result.semantic = status->status.getBits() & ~geospatial_bits;
+        result.geospatial = status->status.getBits() & geospatial_bits;
+        result.values.assign(std::begin(status->values), std::end(status->values));
+        put(shard, object, status->ruleset, std::move(result));
+    }
+}
+
+void
+ValidationCache::skipped(bool semantic, bool geometry, bool write)
+{
+    if (semantic) {
+        semantic_skipped++;
+    }
+    if (geometry) {
+        geometry_skipped++;
+    }
+    if (write) {
+        writes_skipped++;
+    }
+}
+
+std::uint64_t
+ValidationCache::ruleset(const std::string &type, std::uint64_t fingerprint)
+{
+    std::uint64_t hash = fnv(type.data(), type.size());
+    hash = fnv(&fingerprint, sizeof(fingerprint), hash);
+    // Zero is for the results that aren't cached
+    return hash == 0 ? 1 : hash;
+}
+
+std::uint64_t
+ValidationCache::geometry(const linestring_t &linestring, bool tagged)
+{
+    std::uint64_t hash = fnv(&tagged, sizeof(tagged));
+    for (auto it = std::begin(linestring); it != std::end(linestring); ++it) {
+        double xy[2] = {it->x(), it->y()};
+        hash = fnv(xy, sizeof(xy), hash);
+    }
+    return hash;
+}
+
+std::uint64_t
+ValidationCache::geometry(const point_t &point)
+{
+    double xy[2] = {point.x(), point.y()};
+    return fnv(xy, sizeof(xy));
+}
+
+bool
+ValidationCache::open(const std::string &path)
+{
+    std::scoped_lock file_lock{file_mutex};
+    file = path;
+    saved = std::chrono::steady_clock::now();
+    if (!std::filesystem::exists(path)) {
+        return true;
+    }
+    std::ifstream in(path, std::ios::binary);
+    char header[sizeof(magic)];
+    std::uint32_t version = 0;
+    in.read(header, sizeof(header));
+    in.read(reinterpret_cast<char *>(&version), sizeof(version));
+    if (!in || std::memcmp(header, magic, sizeof(magic)) != 0 || version != format) {
+        log_error("Couldn't read the validation cache %1%, starting without it", path);
+        return false;
+    }
+    std::size_t loaded = 0;
+    while (in.peek() != std::ifstream::traits_type::eof()) {
+        long object;
+        std::uint64_t ruleset;
+        std::uint32_t count;
+        Result result;
+        in.read(reinterpret_cast<char *>(&object), sizeof(object));
+        in.read(reinterpret_cast<char *>(&ruleset), sizeof(ruleset));
+        in.read(reinterpret_cast<char *>(&result.version), sizeof(result.version));
+        in.read(reinterpret_cast<char *>(&result.geometry), sizeof(result.geometry));
+        in.read(reinterpret_cast<char *>(&result.semantic), sizeof(result.semantic));
+        in.read(reinterpret_cast<char *>(&result.geospatial), sizeof(result.geospatial));
+        in.read(reinterpret_cast<char *>(&count), sizeof(count));
+        for (std::uint32_t i = 0; in && i < count; i++) {
+            std::uint32_t length;
+            in.read(reinterpret_cast<char *>(&length), sizeof(length));
+            std::string value(length, '\0');
+            in.read(value.data(), length);
+            result.values.push_back(std::move(value));
+        }
+        if (!in) {
+            log_error("The validation cache %1% is truncated, %2% results were read", path, loaded);
+            break;
+        }
+        Shard &shard = this->shard(object);
+        std::scoped_lock lock{shard.mutex};
+        put(shard, object, ruleset, std::move(result));
+        loaded++;
+    }
+    log_debug("Loaded %1% validation results from %2%", loaded, path);
+    return true;
+}
+
+bool
+ValidationCache::save(void)
+{
+    std::scoped_lock file_lock{file_mutex};
+    if (file.empty()) {
+        return false;
+    }
+    saved = std::chrono::steady_clock::now();
+    // The results are written to another file first, so stopping while
+    // saving doesn't lose the last ones
+    std::string temp = file + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out.write(magic, sizeof(magic));
+    out.write(reinterpret_cast<const char *>(&format), sizeof(format));
+    std::size_t written = 0;
+    for (auto sit = std::begin(shards); sit != std::end(shards); ++sit) {
+        Shard &shard = **sit;
+        std::scoped_lock lock{shard.mutex};
+        // The least recently used first, so they are the first to go
+        // when the file is loaded again
+        for (auto it = shard.lru.rbegin(); it != shard.lru.rend(); ++it) {
+            for (auto rit = std::begin(it->results); rit != std::end(it->results); ++rit) {
+                const Result &result = rit->second;
+                std::uint32_t count = result.values.size();
+                out.write(reinterpret_cast<const char *>(&it->key), sizeof(it->key));
+                out.write(reinterpret_cast<const char *>(&rit->first), sizeof(rit->first));
+                out.write(reinterpret_cast<const char *>(&result.version), sizeof(result.version));
+                out.write(reinterpret_cast<const char *>(&result.geometry), sizeof(result.geometry));
+                out.write(reinterpret_cast<const char *>(&result.semantic), sizeof(result.semantic));
+                out.write(reinterpret_cast<const char *>(&result.geospatial), sizeof(result.geospatial));
+                out.write(reinterpret_cast<const char *>(&count), sizeof(count));
+                for (auto vit = std::begin(result.values); vit != std::end(result.values); ++vit) {
+                    std::uint32_t length = vit->size();
+                    out.write(reinterpret_cast<const char *>(&length), sizeof(length));
+                    out.write(vit->data(), length);
+                }
+                written++;
+            }
+        }
+    }
+    out.close();
+    if (!out) {
+        log_error("Couldn't save the validation cache to %1%", temp);
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(temp, file, error);
+    if (error) {
+        log_error("Couldn't save the validation cache to %1%: %2%", file, error.message());
+        return false;
+    }
+    log_debug("Saved %1% validation results to %2%", written, file);
+    return true;
+}
+
+void
+ValidationCache::sync(void)
+{
+    {
+        std::scoped_lock file_lock{file_mutex};
+        if (file.empty() || std::chrono::steady_clock::now() - saved < interval) {
+            return;
+        }
+    }
+    save();
+}
+
+std::size_t
+ValidationCache::size(void)
+{
+    std::size_t objects = 0;
+    for (auto it = std::begin(shards); it != std::end(shards); ++it) {
+        std::scoped_lock lock{(*it)->mutex};
+        objects += (*it)->index.size();
+    }
+    return objects;
+}
+
+void
+ValidationCache::dump(void)
+{
+    std::uint64_t lookups = hits + misses;
+    double rate = 0;
+    if (lookups > 0) {
+        rate = hits * 100.0 / lookups;
+    }
+    log_debug("Validation cache: %1% objects, %2% lookups, %3%%% hit rate, %4% evictions",
+              size(), lookups, rate, evictions.load());
+    log_debug("Validation cache: skipped %1% tag checks, %2% geometry checks, and %3% writes",
+              semantic_skipped.load(), geometry_skipped.load(), writes_skipped.load());
+}
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
@@ -0,0 +1,178 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+#ifndef __VALIDATIONCACHE_HH__
+#define __VALIDATIONCACHE_HH__
+
+/// \file validationcache.hh
+/// \brief The last committed validation result of each object
+///
+/// A way that is only in a change file because one of it's nodes moved
+/// has the same tags, and often the same geometry, as the last time it
+/// was validated, and a bootstrap validates everything again. Both used
+/// to run all the checks and write the same rows again. This keeps the
+/// last result of each object, so the checks on what didn't change can
+/// be skipped, and so can the writes when nothing changed.
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "osm/osmobjects.hh"
+
+class ValidateStatus;
+
+/// \class ValidationCache
+/// \brief A sharded LRU cache of validation results, by object
+///
+/// The results are stored by the rules they were checked with, which is
+/// a hash of the type of check and of the configuration file, so a node
+/// checked for several keys has a result for each, and a result from
+/// an older configuration is never used.
+///
+/// The change files are validated in parallel, but committed in order,
+/// so a result is only stored once it's file is committed. Until then
+/// the object is pending, and it's results are written even if they are
+/// the same as the stored ones, since the database may be about to
+/// change. The checks can still be skipped, since they only depend on
+/// what was checked.
+///
+/// The cache is in memory, and can be saved to a file so the next run
+/// starts with it. The file has to be removed when the validation table
+/// is emptied.
+class ValidationCache {
+  public:
+    /// A cache using up to \a budget bytes
+    ValidationCache(std::size_t budget, std::size_t shards = 16);
+
+    /// The result of an object, for one set of rules
+    struct Result {
+        long version = 0;                 ///< The version that was checked
+        std::uint64_t geometry = 0;       ///< The hash of the geometry that was checked
+        std::uint32_t semantic = 0;       ///< The StatusSet bits from the tags
+        std::uint32_t geospatial = 0;     ///< The StatusSet bits from the geometry
+        std::vector<std::string> values;  ///< The bad tag values
+        bool pending = false;             ///< A newer result isn't committed yet
+    };
+
+    /// Find the last committed result of an object for a \a ruleset,
+    /// returns false if there isn't one
+    bool find(osmobjects::osmtype_t type, long id, std::uint64_t ruleset, Result &result);
+    /// Note that an object has a result to write, which stays pending
+    /// until it's committed
+    void begin(osmobjects::osmtype_t type, long id);
+    /// Store the \a results of a file once it's committed. If it wasn't
+    /// \a written, they are only not pending anymore.
+    void commit(const std::vector<std::shared_ptr<ValidateStatus>> &results, bool written);
+    /// Count the checks and the writes skipped for an object
+    void skipped(bool semantic, bool geometry, bool write);
+
+    /// The rules a \a type of object is checked with, from the
+    /// \a fingerprint of it's configuration file
+    static std::uint64_t ruleset(const std::string &type, std::uint64_t fingerprint);
+    /// The hash of the geometry of a way, and whether it has the key
+    /// of the rules, since the geometry is only checked when it does
+    static std::uint64_t geometry(const linestring_t &linestring, bool tagged);
+    /// The hash of the location of a node
+    static std::uint64_t geometry(const point_t &point);
+
+    /// Load the results saved in a \a file, which is also where they
+    /// are saved to. A missing file is an empty cache.
+    bool open(const std::string &file);
+    /// Save the results to the file, if there is one
+    bool save(void);
+    /// Save the results if it's been \a interval since they were saved
+    void sync(void);
+
+    /// The number of lookups that found a result
+    std::uint64_t getHits(void) const { return hits; };
+    /// The number of lookups that didn't
+    std::uint64_t getMisses(void) const { return misses; };
+    /// The number of objects dropped to stay in the budget
+    std::uint64_t getEvictions(void) const { return evictions; };
+    /// The number of tag checks that used the stored result
+    std::uint64_t getSemanticSkipped(void) const { return semantic_skipped; };
+    /// The number of geometry checks that used the stored result
+    std::uint64_t getGeometrySkipped(void) const { return geometry_skipped; };
+    /// The number of results that weren't written again
+    std::uint64_t getWritesSkipped(void) const { return writes_skipped; };
+    /// The number of objects with a result
+    std::size_t size(void);
+    /// Log the hit rate and what was skipped
+    void dump(void);
+
+    std::chrono::minutes interval{10};  ///< How often sync() saves the results
+
+  private:
+    /// The results of an object, most are only checked with one ruleset
+    struct Entry {
+        long key;
+        std::vector<std::pair<std::uint64_t, Result>> results;
+        std::size_t bytes;
+    };
+    /// The objects for part of the IDs, most recently used first
+    struct Shard {
+        std::mutex mutex;
+        std::list<Entry> lru;
+        std::unordered_map<long, std::list<Entry>::iterator> index;
+        std::unordered_map<long, int> pending;  ///< The results not committed yet
+        std::size_t bytes = 0;
+    };
+    /// All the types are stored together, so the type is in the key
+    static long key(osmobjects::osmtype_t type, long id) { return id * 4 + static_cast<long>(type); };
+    Shard &shard(long key) { return *shards[static_cast<std::uint64_t>(key) % shards.size()]; };
+    /// Add or replace the result of an object for a \a ruleset, then
+    /// drop the oldest objects if the shard is over budget. The shard
+    /// must be locked.
+    void put(Shard &shard, long key, std::uint64_t ruleset, Result &&result);
+    /// The memory used by an entry
+    static std::size_t bytes(const Entry &entry);
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::size_t budget;  ///< The bytes for each shard
+
+    std::mutex file_mutex;
+    std::string file;    ///< Where the results are saved, if anywhere
+    std::chrono::steady_clock::time_point saved = std::chrono::steady_clock::now();
+
+    std::atomic<std::uint64_t> hits = 0;
+    std::atomic<std::uint64_t> misses = 0;
+    std::atomic<std::uint64_t> evictions = 0;
+    std::atomic<std::uint64_t> semantic_skipped = 0;
+    std::atomic<std::uint64_t> geometry_skipped = 0;
+    std::atomic<std::uint64_t> writes_skipped = 0;
+};
+
+#endif // EOF __VALIDATIONCACHE_HH__
+
+// local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
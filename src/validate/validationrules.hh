@@ -0,0 +1,208 @@
+//
+// Copyright (c) 2024 Humanitarian OpenStreetMap Team
+//
+// This file is part of Underpass.
+//
+//     Underpass is free software: you can redistribute it and/or modify
+//     it under the terms of the GNU General Public License as published by
+//     the Free Software Foundation, either version 3 of the License, or
+//     (at your option) any later version.
+//
+//     Underpass is distributed in the hope that it will be useful,
+//     but WITHOUT ANY WARRANTY; without even the implied warranty of
+//     MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//     GNU General Public License for more details.
+//
+//     You should have received a copy of the GNU General Public License
+//     along with Underpass.  If not, see <https://www.gnu.org/licenses/>.
+//
+
+/// \file validationrules.hh
+/// \brief The validation configuration files, compiled when loaded
+///
+/// Every object that is validated used to look up the same settings in
+/// the YAML tree of the configuration file, which walks the whole tree
+/// and copies the nodes it finds. This is shared by the plugin and the
+/// library, like validate.hh, so it's all in the header.
+
+#ifndef __VALIDATIONRULES_HH__
+#define __VALIDATIONRULES_HH__
+
+// This is generated by autoconf
+#ifdef HAVE_CONFIG_H
+#include "unconfig.h"
+#endif
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "osm/osmtags.hh"
+#include "utils/yaml.hh"
+
+/// \class ValidationRules
+/// \brief The settings and tags of one validation configuration file
+///
+/// A configuration file has a config section with the checks to do,
+/// a tags section with the keys that are allowed and their values, and
+/// a required_tags section. A key without values can have any value.
+/// When a key is listed more than once, the first one is used. The
+/// keys are interned, so checking the tags of an object only compares
+/// pointers.
+class ValidationRules {
+  public:
+    ValidationRules(void){};
+    /// Compile the configuration file for the objects with the key \a name
+    ValidationRules(const yaml::Yaml &yaml, const std::string &name = "") : type(name) {
+        fingerprint = hash(yaml.root, fingerprint);
+        for (auto it = std::begin(yaml.root.children); it != std::end(yaml.root.children); ++it) {
+            if (it->value == "config") {
+                readConfig(*it);
+            } else if (it->value == "tags") {
+                for (auto tit = std::begin(it->children); tit != std::end(it->children); ++tit) {
+                    if (tags.count(tit->value)) {
+                        continue;
+                    }
+                    auto &values = tags[tit->value];
+                    for (auto vit = std::begin(tit->children); vit != std::end(tit->children); ++vit) {
+                        values.insert(vit->value);
+                    }
+                }
+            } else if (it->value == "required_tags") {
+                for (auto rit = std::begin(it->children); rit != std::end(it->children); ++rit) {
+                    required.insert(rit->value);
+                }
+            }
+        }
+        auto &table = osmobjects::StringTable::instance();
+        for (auto it = std::begin(tags); it != std::end(tags); ++it) {
+            const std::string *key = table.intern(it->first);
+            if (key == nullptr) {
+                interned = false;
+            } else {
+                tagkeys[key] = it->second;
+            }
+        }
+        for (auto it = std::begin(required); it != std::end(required); ++it) {
+            const std::string *key = table.intern(*it);
+            if (key == nullptr) {
+                interned = false;
+            } else {
+                requiredkeys.insert(key);
+            }
+        }
+    };
+
+    /// Is the value of a tag one of the allowed ones
+    bool isValidTag(const std::string &key, const std::string &value) const {
+        auto found = tags.find(key);
+        if (found == tags.end()) {
+            return false;
+        }
+        return found->second.empty() || found->second.count(value);
+    };
+    /// Is a key one of the required ones
+    bool isRequiredTag(const std::string &key) const { return required.count(key); };
+    /// The same for a tag of an object, which only hashes the pointer to
+    /// the interned key
+    bool isValidTag(const osmobjects::TagList::const_iterator &tag) const {
+        if (!interned) {
+            return isValidTag(tag->first, tag->second);
+        }
+        auto found = tagkeys.find(&tag->first);
+        if (found == tagkeys.end()) {
+            return false;
+        }
+        return found->second.empty() || found->second.count(tag->second);
+    };
+    bool isRequiredTag(const osmobjects::TagList::const_iterator &tag) const {
+        if (!interned) {
+            return isRequiredTag(tag->first);
+        }
+        return requiredkeys.count(&tag->first);
+    };
+    /// Does an object have the key \a name, which is looked up by pointer
+    /// when it's the key these rules are for
+    bool hasType(const osmobjects::TagList &objtags, const std::string &name) const {
+        return name == type.name ? objtags.count(type) : objtags.count(name);
+    };
+    /// How many keys are required
+    std::size_t getRequiredCount(void) const { return required.size(); };
+    /// Are there any allowed tags, without them all the values are bad
+    bool hasTags(void) const { return !tags.empty(); };
+
+    bool badvalue = false;          ///< Check for values that aren't allowed
+    bool incomplete = false;        ///< Check for missing required tags
+    bool badgeom = false;           ///< Check for buildings that aren't square
+    double badgeom_minangle = 89;   ///< The smallest angle of a square corner
+    double badgeom_maxangle = 91;   ///< The largest angle of a square corner
+    /// A hash of the whole file, which changes when anything in it does
+    std::uint64_t fingerprint = 14695981039346656037ULL;
+
+  private:
+    /// Add a node and it's children to a FNV-1a \a hash. The number of
+    /// children is added too, so the nesting is part of the hash.
+    static std::uint64_t hash(const yaml::Node &node, std::uint64_t hash) {
+        auto add = [&hash](const void *data, std::size_t size) {
+            const unsigned char *bytes = static_cast<const unsigned char *>(data);
+            for (std::size_t i = 0; i < size; i++) {
+                hash ^= bytes[i];
+                hash *= 1099511628211ULL;
+            }
+        };
+        std::size_t children = node.children.size();
+        add(node.value.data(), node.value.size());
+        add(&children, sizeof(children));
+        for (auto it = std::begin(node.children); it != std::end(node.children); ++it) {
+            hash = ValidationRules::hash(*it, hash);
+        }
+        return hash;
+    };
+
+    /// The settings are a key with one value each
+    void readConfig(const yaml::Node &config) {
+        std::string minangle;
+        std::string maxangle;
+        for (auto it = std::begin(config.children); it != std::end(config.children); ++it) {
+            if (it->children.empty()) {
+                continue;
+            }
+            const std::string &value = it->children.front().value;
+            if (it->value == "badvalue") {
+                badvalue = value == "yes";
+            } else if (it->value == "incomplete") {
+                incomplete = value == "yes";
+            } else if (it->value == "badgeom") {
+                badgeom = value == "yes";
+            } else if (it->value == "badgeom_minangle") {
+                minangle = value;
+            } else if (it->value == "badgeom_maxangle") {
+                maxangle = value;
+            }
+        }
+        // The default angles are only replaced when both are set
+        if (!minangle.empty() && !maxangle.empty()) {
+            badgeom_minangle = std::stod(minangle);
+            badgeom_maxangle = std::stod(maxangle);
+        }
+    };
+
+    /// The key of the objects these rules are for, empty if there are
+    /// no rules
+    osmobjects::TagKey type{""};
+    /// The allowed values of each key, which are empty for any value
+    std::unordered_map<std::string, std::unordered_set<std::string>> tags;
+    std::unordered_set<std::string> required;  ///< The required keys
+    /// The same as tags and required, by interned key
+    std::unordered_map<const std::string *, std::unordered_set<std::string>> tagkeys;
+    std::unordered_set<const std::string *> requiredkeys;
+    bool interned = true;   ///< False if a key couldn't be interned
+};
+
+#endif // EOF __VALIDATIONRULES_HH__
+
+// Local Variables:
+// mode: C++
+// indent-tabs-mode: nil
+// End:
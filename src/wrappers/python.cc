@@ -72,7 +72,7 @@ std::string dumpJSON(ValidateStatus& self) {
     output += "\t\"uid\":" + std::to_string(self.uid) + ",\n";
     output += "\t\"changeset\":" + std::to_string(self.changeset) + ",\n";
 
-    if (self.status.size() > 0) {
+    if (!self.status.empty()) {
         output += "\t\"results\": [";
         for (const auto &stat: std::as_const(self.status)) {
             output += "\"" + results[stat] + "\",";
@@ -81,7 +81,7 @@ std::string dumpJSON(ValidateStatus& self) {
         output += "]";
     }
 
-    if (self.values.size() > 0) {
+    if (!self.values.empty()) {
         output += ",\n\t\"values\": [";
         for (auto it = std::begin(self.values); it != std::end(self.values); ++it ) {
             output += "\"" + *it + "\",";
@@ -123,7 +123,7 @@ BOOST_PYTHON_MODULE(underpass)
 
     using namespace osmchange;
     class_<OsmChangeFile, boost::noncopyable>("OsmChangeFile")
-        .def("readChanges", &OsmChangeFile::readChanges)
+        .def("readChanges", static_cast<bool (OsmChangeFile::*)(const std::string &)>(&OsmChangeFile::readChanges))
         .def("dump", &OsmChangeFile::dump);
 }
 #endif